@@ -23,12 +23,13 @@
 #include <QSqlError>
 #include <QSettings>
 #include <QDateTime>
+#include <vector>
 
 #define PAM_ACCT_EXPIRED 1
 #define PAM_NEW_AUTHTOK_REQD 2
 
-AccountStatusUpdater::AccountStatusUpdater(const QString &confFile, bool quiet) :
-    ConfigFile(confFile, false, false, quiet)
+AccountStatusUpdater::AccountStatusUpdater(const QString &confFile, bool quiet, bool verbose) :
+    ConfigFile(confFile, false, false, quiet), m_verbose(verbose && !quiet)
 {
 
 }
@@ -63,59 +64,110 @@ int AccountStatusUpdater::exec() const
     }
 
 
-    printStatus(tr("Fetching accounts"));
-    QSqlQuery q(db.getDb());
-    if (!q.exec(QStringLiteral("SELECT id, valid_until, pwd_expire, status FROM accountuser WHERE domain_id > 0"))) {
-        printFailed();
-        return dbError(q.lastError());
-    } else {
-        //: %1 will be the number of found accounts
-        printDone(tr("Found %1").arg(q.size()));
-    }
-
-    while (q.next()) {
-        const quint32 id = q.value(0).value<quint32>();
-        printStatus(tr("Checking account ID %1").arg(id));
-        const QDateTime now = QDateTime::currentDateTimeUtc();
-        int newStatus = 0;
-        QDateTime validUntil = q.value(1).toDateTime();
-        validUntil.setTimeSpec(Qt::UTC);
-        QDateTime pwdExpire = q.value(2).toDateTime();
-        pwdExpire.setTimeSpec(Qt::UTC);
-        const int oldStatus = q.value(3).toInt();
-
-        if (validUntil < now) {
-            newStatus |= PAM_ACCT_EXPIRED;
+    // every status bit is changed by two statements, one that sets it and one that clears it,
+    // so only the accounts whose status changes are touched and the expiry indexes can be used
+    struct Transition {
+        QString condition;
+        QString change;
+        QString status;
+        QString message;
+        QString dateColumn;
+    };
+
+    const std::vector<Transition> transitions({
+        {
+            QStringLiteral("valid_until < :now AND status IN (0, 2)"),
+            QStringLiteral("status = status + %1").arg(PAM_ACCT_EXPIRED),
+            tr("Marking expired accounts"),
+            tr("Account ID %1 has been expired at %2."),
+            QStringLiteral("valid_until")
+        },
+        {
+            QStringLiteral("valid_until >= :now AND status IN (1, 3)"),
+            QStringLiteral("status = status - %1").arg(PAM_ACCT_EXPIRED),
+            tr("Marking accounts that are valid again"),
+            tr("Account ID %1 is valid again until %2."),
+            QStringLiteral("valid_until")
+        },
+        {
+            QStringLiteral("pwd_expire < :now AND status IN (0, 1)"),
+            QStringLiteral("status = status + %1").arg(PAM_NEW_AUTHTOK_REQD),
+            tr("Marking expired passwords"),
+            tr("Password for account ID %1 has been expired at %2."),
+            QStringLiteral("pwd_expire")
+        },
+        {
+            QStringLiteral("pwd_expire >= :now AND status IN (2, 3)"),
+            QStringLiteral("status = status - %1").arg(PAM_NEW_AUTHTOK_REQD),
+            tr("Marking passwords that are valid again"),
+            tr("Password for account ID %1 is valid again until %2."),
+            QStringLiteral("pwd_expire")
         }
+    });
 
-        if (pwdExpire < now) {
-            newStatus |= PAM_NEW_AUTHTOK_REQD;
-        }
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QSqlDatabase sdb = db.getDb();
+    int changed = 0;
+
+    if (!sdb.transaction()) {
+        return dbError(sdb.lastError());
+    }
 
-        if (oldStatus != newStatus) {
-            QSqlQuery updateQuery(db.getDb());
-            updateQuery.prepare(QStringLiteral("UPDATE accountuser SET status = :status WHERE id = :id"));
-            updateQuery.bindValue(QStringLiteral(":status"), newStatus);
-            updateQuery.bindValue(QStringLiteral(":id"), id);
+    for (const Transition &t : transitions) {
 
-            if (!updateQuery.exec()) {
-                printFailed();
-                return dbError(updateQuery.lastError());
+        if (m_verbose) {
+            // only list the accounts if requested, this needs an additional query
+            QSqlQuery sq(sdb);
+            sq.setForwardOnly(true);
+            if (!sq.prepare(QStringLiteral("SELECT id, %1 FROM accountuser WHERE domain_id > 0 AND %2").arg(t.dateColumn, t.condition))) {
+                sdb.rollback();
+                return dbError(sq.lastError());
+            }
+            sq.bindValue(QStringLiteral(":now"), now);
+            if (!sq.exec()) {
+                sdb.rollback();
+                return dbError(sq.lastError());
+            }
+            while (sq.next()) {
+                QDateTime dt = sq.value(1).toDateTime();
+                dt.setTimeSpec(Qt::UTC);
+                printMessage(t.message.arg(QString::number(sq.value(0).value<quint32>()), dt.toLocalTime().toString()));
             }
         }
 
-        printDone();
-
-        if ((newStatus & PAM_ACCT_EXPIRED) == PAM_ACCT_EXPIRED) {
-            printMessage(tr("Account ID %1 has been expired at %2.").arg(QString::number(id), validUntil.toLocalTime().toString()));
+        printStatus(t.status);
+        QSqlQuery q(sdb);
+        if (!q.prepare(QStringLiteral("UPDATE accountuser SET %1 WHERE domain_id > 0 AND %2").arg(t.change, t.condition))) {
+            printFailed();
+            sdb.rollback();
+            return dbError(q.lastError());
+        }
+        q.bindValue(QStringLiteral(":now"), now);
+        if (!q.exec()) {
+            printFailed();
+            sdb.rollback();
+            return dbError(q.lastError());
         }
+        const int affected = q.numRowsAffected();
+        changed += affected;
+        printDone(tr("%n account(s)", "", affected));
+    }
+
+    if (!sdb.commit()) {
+        return dbError(sdb.lastError());
+    }
 
-        if ((newStatus & PAM_NEW_AUTHTOK_REQD) == PAM_NEW_AUTHTOK_REQD) {
-            printMessage(tr("Password for account ID %1 has been expired at %2.").arg(QString::number(id), pwdExpire.toLocalTime().toString()));
+    // the status of all accounts is up to date now, changes should have been processed by a
+    // running expiry scheduler long before
+    QSqlQuery cq(sdb);
+    if (cq.prepare(QStringLiteral("DELETE FROM account_expiry_change WHERE created_at < :limit"))) {
+        cq.bindValue(QStringLiteral(":limit"), now.addDays(-1));
+        if (!cq.exec()) {
+            printError(cq.lastError().text());
         }
     }
 
-    printSuccess(tr("Finished updating status for %n account(s).", "", q.size()));
+    printSuccess(tr("Finished updating status, changed the status of %n account(s).", "", changed));
 
     return 0;
 }
@@ -31,6 +31,10 @@
  * (pwd_expire). It updates the status column accordingly. The status column contains a integer value
  * that is used for storing different flags. Bit 0 will be flagged if the account has expired, bit 1
  * will be flagged if the password has been expired.
+ *
+ * The status is changed by a few set-based UPDATE statements that only touch the accounts whose status
+ * has to change. By default only the number of changed accounts is printed, in verbose mode every changed
+ * account will be listed.
  */
 class AccountStatusUpdater : public ConfigFile
 {
@@ -40,14 +44,18 @@ public:
      * \brief Constructs a new AccountStatusUpdater object.
      * \param confFile  Absolute path to the configuration file that contains database access data.
      * \param quiet     If \c true, no output will be print to stdout.
+     * \param verbose   If \c true, every account whose status changes will be printed.
      */
-    explicit AccountStatusUpdater(const QString &confFile, bool quiet = false);
+    explicit AccountStatusUpdater(const QString &confFile, bool quiet = false, bool verbose = false);
 
     /*!
      * \brief Starts the execution of the status checks.
      * \return Returns \c 0 on success.
      */
     int exec() const;
+
+private:
+    bool m_verbose = false;
 };
 
 #endif // ACCOUNTSTATUSUPDATER_H
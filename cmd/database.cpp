@@ -22,6 +22,7 @@
 #include <QFile>
 #include <QTextStream>
 #include <QDateTime>
+#include <algorithm>
 
 #include "../common/config.h"
 
@@ -124,11 +125,9 @@ QVersionNumber Database::sqlFilesVersion() const
 {
     QVersionNumber version;
 
-    QFileInfoList fil = getSqlFiles();
+    const QFileInfoList fil = getSqlFiles();
     if (Q_LIKELY(!fil.empty())) {
-        QString fn = fil.last().fileName();
-        fn.chop(4);
-        version = QVersionNumber::fromString(fn);
+        version = fileVersion(fil.last());
     }
 
     return version;
@@ -136,40 +135,113 @@ QVersionNumber Database::sqlFilesVersion() const
 
 bool Database::installDatabase()
 {
-    bool success = false;
-
     const QFileInfoList fil = getSqlFiles();
     if (Q_UNLIKELY(fil.empty())) {
         m_lastError = QSqlError(tr("Empty SQL file list. Aborting."), QString(), QSqlError::UnknownError);
-        return success;
+        return false;
     }
 
     for (const QFileInfo &fi : fil) {
-        QFile f(fi.absoluteFilePath());
-        if (Q_UNLIKELY(!f.open(QFile::ReadOnly|QFile::Text))) {
-            m_lastError = QSqlError(tr("Failed to open file %1 for reading. Aborting.").arg(fi.absoluteFilePath()), QString(), QSqlError::UnknownError);
-            return success;
+        if (!applySqlFile(fi)) {
+            return false;
         }
-        f.close();
     }
 
-    QSqlQuery q(m_db);
+    return true;
+}
 
+QList<QVersionNumber> Database::pendingMigrations(const QVersionNumber &installedVersion) const
+{
+    QList<QVersionNumber> versions;
+
+    const QFileInfoList fil = getSqlFiles();
     for (const QFileInfo &fi : fil) {
-        QFile f(fi.absoluteFilePath());
-        f.open(QFile::ReadOnly|QFile::Text);
-        QTextStream in(&f);
-        const QString sql = in.readAll();
-        if (Q_UNLIKELY(!q.exec(sql))) {
-            m_lastError = q.lastError();
-            m_lastError = QSqlError(tr("Failed to apply SQL statements from %1. Aborting.").arg(fi.absoluteFilePath()), q.lastError().databaseText(), q.lastError().type());
-            return success;
+        const QVersionNumber version = fileVersion(fi);
+        if (version > installedVersion) {
+            versions << version;
+        }
+    }
+
+    return versions;
+}
+
+bool Database::applyMigration(const QVersionNumber &version)
+{
+    const QFileInfoList fil = getSqlFiles();
+    for (const QFileInfo &fi : fil) {
+        if (fileVersion(fi) == version) {
+            if (!applySqlFile(fi)) {
+                return false;
+            }
+            // the search index added by 0.0.4 has to cover existing accounts
+            if (version == QVersionNumber(0, 0, 4)) {
+                return rebuildSearchIndex();
+            }
+            return true;
+        }
+    }
+
+    m_lastError = QSqlError(tr("Can not find SQL file for database layout version %1. Aborting.").arg(version.toString()), QString(), QSqlError::UnknownError);
+    return false;
+}
+
+bool Database::upgradeDatabase(const QVersionNumber &installedVersion)
+{
+    const QList<QVersionNumber> versions = pendingMigrations(installedVersion);
+    for (const QVersionNumber &version : versions) {
+        if (!applyMigration(version)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Database::applySqlFile(const QFileInfo &fi)
+{
+    QFile f(fi.absoluteFilePath());
+    if (Q_UNLIKELY(!f.open(QFile::ReadOnly|QFile::Text))) {
+        m_lastError = QSqlError(tr("Failed to open file %1 for reading. Aborting.").arg(fi.absoluteFilePath()), QString(), QSqlError::UnknownError);
+        return false;
+    }
+    QTextStream in(&f);
+
+    // statements are executed one by one to report the failing one and to not
+    // depend on multi statement support of the driver
+    QStringList statements;
+    QString statement;
+    while (!in.atEnd()) {
+        const QString line = in.readLine();
+        const QString trimmed = line.trimmed();
+        if (trimmed.isEmpty() || trimmed.startsWith(QLatin1String("--"))) {
+            continue;
+        }
+        statement += line + QLatin1Char('\n');
+        if (trimmed.endsWith(QLatin1Char(';'))) {
+            statements << statement.trimmed();
+            statement.clear();
+        }
+    }
+    if (!statement.trimmed().isEmpty()) {
+        statements << statement.trimmed();
+    }
+
+    QSqlQuery q(m_db);
+    const int count = statements.size();
+    for (int i = 0; i < count; ++i) {
+        if (Q_UNLIKELY(!q.exec(statements.at(i)))) {
+            //: %1 will be the number of the failed statement, %2 the number of statements, %3 the file path
+            m_lastError = QSqlError(tr("Failed to apply SQL statement %1 of %2 from %3. Aborting.").arg(QString::number(i + 1), QString::number(count), fi.absoluteFilePath()), q.lastError().databaseText(), q.lastError().type());
+            return false;
         }
     }
 
-    success = true;
+    return true;
+}
 
-    return success;
+QVersionNumber Database::fileVersion(const QFileInfo &fi)
+{
+    return QVersionNumber::fromString(fi.completeBaseName());
 }
 
 bool Database::setAdmin(const QString &adminUser, const QByteArray &adminPassword)
@@ -193,7 +265,7 @@ bool Database::setAdmin(const QString &adminUser, const QByteArray &adminPasswor
                 if (id > 0) {
                     q.prepare(QStringLiteral("INSERT INTO settings (admin_id) VALUES (?)"));
                     q.addBindValue(id);
-                    if (Q_LIKELY(q.exec())) {
+                    if (Q_LIKELY(q.exec() && q.exec(QStringLiteral("UPDATE statistics SET admins = admins + 1 WHERE domain_id = 0")))) {
                         if (Q_LIKELY(m_db.commit())) {
                             ret = true;
                         } else {
@@ -225,6 +297,114 @@ bool Database::setAdmin(const QString &adminUser, const QByteArray &adminPasswor
     return ret;
 }
 
+bool Database::updateStatistics()
+{
+    // the number of addresses of every account is needed for the domain statistics
+    const QStringList statements({
+                                     QStringLiteral("UPDATE accountuser a "
+                                                    "LEFT JOIN (SELECT username, COUNT(*) AS cnt FROM virtual WHERE alias LIKE '%@%' AND idn_id = 0 AND username <> '' GROUP BY username) v ON v.username = a.username "
+                                                    "SET a.addresscount = COALESCE(v.cnt, 0)"),
+                                     QStringLiteral("DELETE FROM statistics"),
+                                     QStringLiteral("INSERT INTO statistics (domain_id, domains, accounts, addresses, admins, accountquota, domainquota, updated_at) "
+                                                    "SELECT d.id, 1, COUNT(a.id), COALESCE(SUM(a.addresscount), 0), 0, COALESCE(SUM(a.quota), 0), d.domainquota, UTC_TIMESTAMP() "
+                                                    "FROM domain d LEFT JOIN accountuser a ON a.domain_id = d.id "
+                                                    "WHERE d.idn_id = 0 GROUP BY d.id, d.domainquota"),
+                                     QStringLiteral("INSERT INTO statistics (domain_id, domains, accounts, addresses, admins, accountquota, domainquota, updated_at) "
+                                                    "SELECT 0, COUNT(*), COALESCE(SUM(accounts), 0), COALESCE(SUM(addresses), 0), (SELECT COUNT(*) FROM adminuser), COALESCE(SUM(accountquota), 0), COALESCE(SUM(domainquota), 0), UTC_TIMESTAMP() "
+                                                    "FROM statistics WHERE domain_id > 0")
+                                 });
+
+    if (Q_UNLIKELY(!m_db.transaction())) {
+        m_lastError = m_db.lastError();
+        return false;
+    }
+
+    QSqlQuery q(m_db);
+    for (const QString &statement : statements) {
+        if (Q_UNLIKELY(!q.exec(statement))) {
+            m_lastError = q.lastError();
+            m_db.rollback();
+            return false;
+        }
+    }
+
+    if (Q_UNLIKELY(!m_db.commit())) {
+        m_lastError = m_db.lastError();
+        m_db.rollback();
+        return false;
+    }
+
+    return true;
+}
+
+bool Database::rebuildSearchIndex()
+{
+    QSqlQuery q(m_db);
+
+    // the sequence of trigram start positions has to cover the longest indexed value
+    if (Q_UNLIKELY(!q.exec(QStringLiteral("SELECT GREATEST("
+                                          "(SELECT COALESCE(MAX(CHAR_LENGTH(username)), 0) FROM accountuser), "
+                                          "(SELECT COALESCE(MAX(CHAR_LENGTH(alias)), 0) FROM virtual), "
+                                          "(SELECT COALESCE(MAX(CHAR_LENGTH(dest)), 0) FROM virtual))")))) {
+        m_lastError = q.lastError();
+        return false;
+    }
+    const quint64 maxLength = q.next() ? q.value(0).toULongLong() : 0;
+
+    const QString digits = QStringLiteral("(SELECT 0 AS d UNION ALL SELECT 1 UNION ALL SELECT 2 UNION ALL SELECT 3 UNION ALL SELECT 4 UNION ALL SELECT 5 UNION ALL SELECT 6 UNION ALL SELECT 7 UNION ALL SELECT 8 UNION ALL SELECT 9)");
+
+    // one cross joined digit table per decimal place of the maximum length
+    QString seqValue = QStringLiteral("d0.d");
+    QString seqTables = digits + QLatin1String(" d0");
+    quint64 factor = 10;
+    for (int place = 1; factor < maxLength; ++place, factor *= 10) {
+        const QString table = QLatin1Char('d') + QString::number(place);
+        seqValue += QLatin1String(" + ") + table + QLatin1String(".d * ") + QString::number(factor);
+        seqTables += QLatin1String(", ") + digits + QLatin1Char(' ') + table;
+    }
+
+    const QStringList statements({
+                                     QStringLiteral("DROP TEMPORARY TABLE IF EXISTS account_search_seq"),
+                                     QStringLiteral("CREATE TEMPORARY TABLE account_search_seq (n int unsigned NOT NULL PRIMARY KEY)"),
+                                     QString(QLatin1String("INSERT INTO account_search_seq (n) SELECT s.n FROM (SELECT ") + seqValue + QLatin1String(" + 1 AS n FROM ") + seqTables + QLatin1String(") s WHERE s.n <= ") + QString::number(maxLength)),
+                                     QStringLiteral("DELETE FROM account_search"),
+                                     QStringLiteral("INSERT IGNORE INTO account_search (account_id, domain_id, role, trigram) "
+                                                    "SELECT au.id, au.domain_id, 0, LOWER(SUBSTRING(au.username, s.n, 3)) "
+                                                    "FROM accountuser au JOIN account_search_seq s ON s.n <= CHAR_LENGTH(au.username) - 2"),
+                                     QStringLiteral("INSERT IGNORE INTO account_search (account_id, domain_id, role, trigram) "
+                                                    "SELECT au.id, au.domain_id, 1, LOWER(SUBSTRING(vi.alias, s.n, 3)) "
+                                                    "FROM accountuser au JOIN virtual vi ON vi.dest = au.username AND vi.username = au.username "
+                                                    "JOIN account_search_seq s ON s.n <= CHAR_LENGTH(vi.alias) - 2"),
+                                     QStringLiteral("INSERT IGNORE INTO account_search (account_id, domain_id, role, trigram) "
+                                                    "SELECT au.id, au.domain_id, 2, LOWER(SUBSTRING(vi.dest, s.n, 3)) "
+                                                    "FROM accountuser au JOIN virtual vi ON vi.alias = au.username AND vi.username = '' "
+                                                    "JOIN account_search_seq s ON s.n <= CHAR_LENGTH(vi.dest) - 2")
+                                 });
+
+    if (Q_UNLIKELY(!m_db.transaction())) {
+        m_lastError = m_db.lastError();
+        return false;
+    }
+
+    for (const QString &statement : statements) {
+        if (Q_UNLIKELY(!q.exec(statement))) {
+            m_lastError = q.lastError();
+            m_db.rollback();
+            return false;
+        }
+    }
+
+    if (Q_UNLIKELY(!m_db.commit())) {
+        m_lastError = m_db.lastError();
+        m_db.rollback();
+        return false;
+    }
+
+    q.exec(QStringLiteral("DROP TEMPORARY TABLE IF EXISTS account_search_seq"));
+
+    return true;
+}
+
 uint Database::checkAdmin() const
 {
     uint adminCount = 0;
@@ -289,6 +469,11 @@ QFileInfoList Database::getSqlFiles() const
 
     fil = sqlDir.entryInfoList(QStringList(QStringLiteral("*.sql")), QDir::Files, QDir::Name);
 
+    // sorting by name would put 0.0.10 before 0.0.2
+    std::sort(fil.begin(), fil.end(), [](const QFileInfo &a, const QFileInfo &b) {
+        return fileVersion(a) < fileVersion(b);
+    });
+
     return fil;
 }
 
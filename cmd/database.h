@@ -26,6 +26,7 @@
 #include <QFileInfoList>
 #include <QVersionNumber>
 #include <QVariantHash>
+#include <QList>
 
 /*!
  * \ingroup skaffaricmd
@@ -89,12 +90,42 @@ public:
      * This will use the SQL schema files for installation.
      */
     bool installDatabase();
+    /*!
+     * \brief Applies all SQL schema files newer than the \a installedVersion and returns \c true on success.
+     */
+    bool upgradeDatabase(const QVersionNumber &installedVersion);
+    /*!
+     * \brief Returns the versions of all SQL schema files newer than the \a installedVersion in ascending order.
+     */
+    QList<QVersionNumber> pendingMigrations(const QVersionNumber &installedVersion) const;
+    /*!
+     * \brief Applies the SQL schema file for \a version and returns \c true on success.
+     *
+     * Every schema file updates the database layout version stored in the systeminfo table.
+     * After applying version 0.0.4 the account search index will be filled by rebuildSearchIndex().
+     */
+    bool applyMigration(const QVersionNumber &version);
     /*!
      * \brief Creates \a adminUser with the \a adminPassword in the database and returns \c true on success.
      *
      * This is the super user administrator for the web access.
      */
     bool setAdmin(const QString &adminUser, const QByteArray &adminPassword);
+    /*!
+     * \brief Recounts the dashboard statistics and the number of email addresses of every account.
+     *
+     * The web interface changes the statistics incrementally. Recounting corrects drift caused by
+     * failed operations or by changes made directly in the database.
+     */
+    bool updateStatistics();
+    /*!
+     * \brief Rebuilds the trigram search index of all accounts from the accountuser and virtual tables.
+     *
+     * The web interface maintains the index for single accounts. Rebuilding is needed after
+     * importing data from another system or after changes made directly in the database.
+     * Trigrams are created over the full length of every user name, email address and forward list.
+     */
+    bool rebuildSearchIndex();
     /*!
      * \brief Returns the number of admin accounts in the database.
      */
@@ -145,6 +176,8 @@ private:
     QString m_conName;
 
     QFileInfoList getSqlFiles() const;
+    bool applySqlFile(const QFileInfo &fi);
+    static QVersionNumber fileVersion(const QFileInfo &fi);
 
     QSqlError m_lastError;
 };
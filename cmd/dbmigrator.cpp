@@ -0,0 +1,108 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dbmigrator.h"
+#include "database.h"
+#include "queryplanchecker.h"
+#include <QSettings>
+#include <QVersionNumber>
+
+DbMigrator::DbMigrator(const QString &confFile, bool quiet) :
+    ConfigFile(confFile, false, false, quiet)
+{
+
+}
+
+
+int DbMigrator::exec()
+{
+    int retVal = checkConfigFile();
+    if (retVal > 0) {
+        return retVal;
+    }
+
+    QSettings s(configFileName(), QSettings::IniFormat);
+    s.beginGroup(QStringLiteral("Database"));
+    const QString dbhost = s.value(QStringLiteral("host"), QStringLiteral("localhost")).toString();
+    const QString dbname = s.value(QStringLiteral("name")).toString();
+    const QString dbpass = s.value(QStringLiteral("password")).toString();
+    const QString dbtype = s.value(QStringLiteral("type"), QStringLiteral("QMYSQL")).toString();
+    const QString dbuser = s.value(QStringLiteral("user")).toString();
+    const quint16 dbport = s.value(QStringLiteral("port"), 3306).value<quint16>();
+    s.endGroup();
+
+    Database db(dbtype, dbhost, dbport, dbname, dbuser, dbpass);
+    printStatus(tr("Establishing database connection"));
+    if (!db.open()) {
+        printFailed();
+        return dbError(db.lastDbError());
+    } else {
+        printDone();
+    }
+
+    printStatus(tr("Checking database layout"));
+    const QVersionNumber installedVersion = db.installedVersion();
+    if (installedVersion.isNull()) {
+        printFailed();
+        return dbError(tr("Database layout not installed. Please run the setup first."));
+    }
+    printDone(installedVersion.toString());
+
+    const QList<QVersionNumber> migrations = db.pendingMigrations(installedVersion);
+    if (migrations.empty()) {
+        printMessage(tr("No pending database migrations."));
+    }
+
+    for (const QVersionNumber &version : migrations) {
+        //: %1 will be the version of the database layout
+        printStatus(tr("Applying database migration %1").arg(version.toString()));
+        if (!db.applyMigration(version)) {
+            printFailed();
+            return dbError(db.lastDbError());
+        }
+        printDone();
+    }
+
+    printStatus(tr("Checking query plans"));
+    const QueryPlanChecker checker(db.getDb());
+    const std::vector<QueryPlanChecker::Result> results = checker.check();
+    printDone();
+
+    int warnings = 0;
+    for (const QueryPlanChecker::Result &result : results) {
+        if (!result.error.isEmpty()) {
+            ++warnings;
+            //: %1 will be the query description, %2 the database error
+            printError(tr("%1: failed to explain query: %2").arg(result.description, result.error));
+        } else if (!result.fullScans.empty()) {
+            ++warnings;
+            //: %1 will be the query description, %2 a list of table names
+            printError(tr("%1: full table scan without usable index on %2").arg(result.description, result.fullScans.join(QLatin1String(", "))));
+        } else {
+            printDesc(result.description + QLatin1String(": ") + result.keys.join(QLatin1String(", ")));
+        }
+    }
+
+    if (warnings > 0) {
+        printError(tr("%n lookup query/queries can not use an index.", "", warnings));
+    } else {
+        printSuccess(tr("All lookup queries can use an index."));
+    }
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DBMIGRATOR_H
+#define DBMIGRATOR_H
+
+#include <QCoreApplication>
+#include "configfile.h"
+
+/*!
+ * \ingroup skaffaricmd
+ * \brief Applies pending database migrations and checks the query plans afterwards.
+ *
+ * Every SQL schema file newer than the installed database layout version is applied on its own,
+ * so a failing migration leaves the database at the version of the last successful one. After
+ * the migrations the QueryPlanChecker reports lookup queries that can not use an index.
+ */
+class DbMigrator : public ConfigFile
+{
+    Q_DECLARE_TR_FUNCTIONS(DbMigrator)
+public:
+    /*!
+     * \brief Constructs a new DbMigrator object.
+     * \param confFile  Absolute path to the configuration file that contains database access data.
+     * \param quiet     If \c true, no output will be print to stdout.
+     */
+    explicit DbMigrator(const QString &confFile, bool quiet = false);
+
+    /*!
+     * \brief Applies the pending migrations and checks the query plans.
+     * \return Returns \c 0 on success, otherwise an error code.
+     */
+    int exec();
+};
+
+#endif // DBMIGRATOR_H
@@ -0,0 +1,371 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "expiryscheduler.h"
+#include "database.h"
+#include <QSqlQuery>
+#include <QSettings>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+
+#define SK_EXPIRY_WINDOW 3600
+#define SK_EXPIRY_POLL_INTERVAL 5000
+#define SK_EXPIRY_MAX_SLEEP 500
+#define SK_EXPIRY_CHUNK_SIZE 500
+
+namespace {
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int signal)
+{
+    Q_UNUSED(signal);
+    stopRequested = 1;
+}
+
+QString placeholders(std::size_t count)
+{
+    QString ret = QStringLiteral("?");
+    for (std::size_t i = 1; i < count; ++i) {
+        ret += QLatin1String(",?");
+    }
+    return ret;
+}
+
+}
+
+ExpiryScheduler::ExpiryScheduler(const QString &confFile, bool quiet) :
+    ConfigFile(confFile, false, false, quiet)
+{
+
+}
+
+
+int ExpiryScheduler::exec()
+{
+    // the output goes to the journal, so print it line by line
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    printMessage(tr("Start expiry scheduler."));
+
+    int retVal = checkConfigFile();
+    if (retVal > 0) {
+        return retVal;
+    }
+
+    QSettings s(configFileName(), QSettings::IniFormat);
+    s.beginGroup(QStringLiteral("Database"));
+    const QString dbhost = s.value(QStringLiteral("host"), QStringLiteral("localhost")).toString();
+    const QString dbname = s.value(QStringLiteral("name")).toString();
+    const QString dbpass = s.value(QStringLiteral("password")).toString();
+    const QString dbtype = s.value(QStringLiteral("type"), QStringLiteral("QMYSQL")).toString();
+    const QString dbuser = s.value(QStringLiteral("user")).toString();
+    const quint16 dbport = s.value(QStringLiteral("port"), 3306).value<quint16>();
+    s.endGroup();
+
+    Database db(dbtype, dbhost, dbport, dbname, dbuser, dbpass);
+    printStatus(tr("Establishing database connection"));
+    if (!db.open()) {
+        printFailed();
+        return dbError(db.lastDbError());
+    } else {
+        printDone();
+    }
+    m_db = db.getDb();
+
+    std::signal(SIGTERM, requestStop);
+    std::signal(SIGINT, requestStop);
+
+    // changes that are older than the scheduler are covered by the following full update
+    QSqlQuery q(m_db);
+    if (!q.exec(QStringLiteral("SELECT MAX(id) FROM account_expiry_change"))) {
+        return dbError(q.lastError());
+    }
+    if (q.next()) {
+        m_lastChangeId = q.value(0).value<dbid_t>();
+    }
+
+    int changed = 0;
+    printStatus(tr("Updating the status of all accounts"));
+    if (!updateAllStatus(&changed)) {
+        printFailed();
+        return dbError(m_lastError);
+    }
+    printDone(tr("%n account(s)", "", changed));
+
+    const qint64 start = QDateTime::currentMSecsSinceEpoch();
+    printStatus(tr("Loading expiration times of the next hour"));
+    if (!loadWindow(start, start + SK_EXPIRY_WINDOW * 1000)) {
+        printFailed();
+        return dbError(m_lastError);
+    }
+    printDone(tr("%n expiration(s)", "", static_cast<int>(m_heap.size())));
+
+    QElapsedTimer pollTimer;
+    pollTimer.start();
+
+    while (!stopRequested) {
+
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+        std::vector<dbid_t> due;
+        while (!m_heap.empty() && (m_heap.top().first <= now)) {
+            due.push_back(m_heap.top().second);
+            m_heap.pop();
+        }
+
+        if (!due.empty()) {
+            std::sort(due.begin(), due.end());
+            due.erase(std::unique(due.begin(), due.end()), due.end());
+            if (!updateStatus(due, &changed)) {
+                return dbError(m_lastError);
+            }
+            if (changed > 0) {
+                printMessage(tr("Updated the status of %n expired account(s).", "", changed));
+            }
+        }
+
+        if (pollTimer.hasExpired(SK_EXPIRY_POLL_INTERVAL)) {
+            if (!processChanges()) {
+                return dbError(m_lastError);
+            }
+            pollTimer.restart();
+        }
+
+        // load the next expiration times before the end of the window has been reached
+        if ((m_windowEnd - now) < (SK_EXPIRY_WINDOW * 500)) {
+            if (!loadWindow(m_windowEnd, now + SK_EXPIRY_WINDOW * 1000)) {
+                return dbError(m_lastError);
+            }
+        }
+
+        qint64 wait = SK_EXPIRY_POLL_INTERVAL - pollTimer.elapsed();
+        if (!m_heap.empty()) {
+            wait = qMin(wait, m_heap.top().first - QDateTime::currentMSecsSinceEpoch());
+        }
+        // sleep in small steps to react on signals
+        wait = qMin<qint64>(wait, SK_EXPIRY_MAX_SLEEP);
+        if (wait > 0) {
+            QThread::msleep(static_cast<unsigned long>(wait));
+        }
+    }
+
+    printSuccess(tr("Stopped expiry scheduler."));
+
+    return 0;
+}
+
+
+bool ExpiryScheduler::updateAllStatus(int *changed)
+{
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+
+    QSqlQuery q(m_db);
+    if (!q.prepare(QStringLiteral("UPDATE accountuser SET status = (IF(valid_until < ?, 1, 0) | IF(pwd_expire < ?, 2, 0)) "
+                                  "WHERE domain_id > 0 AND status <> (IF(valid_until < ?, 1, 0) | IF(pwd_expire < ?, 2, 0))"))) {
+        m_lastError = q.lastError();
+        return false;
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        q.addBindValue(now);
+    }
+
+    if (!q.exec()) {
+        m_lastError = q.lastError();
+        return false;
+    }
+
+    *changed = q.numRowsAffected();
+
+    return true;
+}
+
+
+bool ExpiryScheduler::updateStatus(const std::vector<dbid_t> &ids, int *changed)
+{
+    *changed = 0;
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+
+    // the status is calculated from the current values, so outdated heap entries do no harm
+    for (std::size_t pos = 0; pos < ids.size(); pos += SK_EXPIRY_CHUNK_SIZE) {
+        const std::size_t count = std::min<std::size_t>(SK_EXPIRY_CHUNK_SIZE, ids.size() - pos);
+
+        QSqlQuery q(m_db);
+        if (!q.prepare(QStringLiteral("UPDATE accountuser SET status = (IF(valid_until < ?, 1, 0) | IF(pwd_expire < ?, 2, 0)) WHERE id IN (%1)").arg(placeholders(count)))) {
+            m_lastError = q.lastError();
+            return false;
+        }
+
+        q.addBindValue(now);
+        q.addBindValue(now);
+        for (std::size_t i = pos; i < (pos + count); ++i) {
+            q.addBindValue(ids.at(i));
+        }
+
+        if (!q.exec()) {
+            m_lastError = q.lastError();
+            return false;
+        }
+
+        *changed += q.numRowsAffected();
+    }
+
+    return true;
+}
+
+
+bool ExpiryScheduler::loadWindow(qint64 from, qint64 to)
+{
+    const QDateTime fromDt = QDateTime::fromMSecsSinceEpoch(from, Qt::UTC);
+    const QDateTime toDt = QDateTime::fromMSecsSinceEpoch(to, Qt::UTC);
+    m_windowEnd = to;
+
+    const QStringList columns({QStringLiteral("valid_until"), QStringLiteral("pwd_expire")});
+    for (const QString &column : columns) {
+        QSqlQuery q(m_db);
+        q.setForwardOnly(true);
+        if (!q.prepare(QStringLiteral("SELECT id, %1 FROM accountuser WHERE domain_id > 0 AND %1 >= ? AND %1 < ?").arg(column))) {
+            m_lastError = q.lastError();
+            return false;
+        }
+        q.addBindValue(fromDt);
+        q.addBindValue(toDt);
+
+        if (!q.exec()) {
+            m_lastError = q.lastError();
+            return false;
+        }
+
+        while (q.next()) {
+            QDateTime expires = q.value(1).toDateTime();
+            expires.setTimeSpec(Qt::UTC);
+            schedule(q.value(0).value<dbid_t>(), expires);
+        }
+    }
+
+    return true;
+}
+
+
+bool ExpiryScheduler::loadAccounts(const std::vector<dbid_t> &ids)
+{
+    for (std::size_t pos = 0; pos < ids.size(); pos += SK_EXPIRY_CHUNK_SIZE) {
+        const std::size_t count = std::min<std::size_t>(SK_EXPIRY_CHUNK_SIZE, ids.size() - pos);
+
+        QSqlQuery q(m_db);
+        q.setForwardOnly(true);
+        if (!q.prepare(QStringLiteral("SELECT id, valid_until, pwd_expire FROM accountuser WHERE id IN (%1)").arg(placeholders(count)))) {
+            m_lastError = q.lastError();
+            return false;
+        }
+
+        for (std::size_t i = pos; i < (pos + count); ++i) {
+            q.addBindValue(ids.at(i));
+        }
+
+        if (!q.exec()) {
+            m_lastError = q.lastError();
+            return false;
+        }
+
+        while (q.next()) {
+            const dbid_t id = q.value(0).value<dbid_t>();
+            QDateTime validUntil = q.value(1).toDateTime();
+            validUntil.setTimeSpec(Qt::UTC);
+            QDateTime pwdExpire = q.value(2).toDateTime();
+            pwdExpire.setTimeSpec(Qt::UTC);
+            schedule(id, validUntil);
+            schedule(id, pwdExpire);
+        }
+    }
+
+    return true;
+}
+
+
+bool ExpiryScheduler::processChanges()
+{
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    if (!q.prepare(QStringLiteral("SELECT id, account_id FROM account_expiry_change WHERE id > ? ORDER BY id ASC"))) {
+        m_lastError = q.lastError();
+        return false;
+    }
+    q.addBindValue(m_lastChangeId);
+
+    if (!q.exec()) {
+        m_lastError = q.lastError();
+        return false;
+    }
+
+    dbid_t lastChangeId = m_lastChangeId;
+    std::vector<dbid_t> ids;
+    while (q.next()) {
+        lastChangeId = q.value(0).value<dbid_t>();
+        ids.push_back(q.value(1).value<dbid_t>());
+    }
+
+    if (ids.empty()) {
+        return true;
+    }
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    // new expiration times might already be in the past
+    int changed = 0;
+    if (!updateStatus(ids, &changed)) {
+        return false;
+    }
+
+    if (!loadAccounts(ids)) {
+        return false;
+    }
+
+    QSqlQuery dq(m_db);
+    if (!dq.prepare(QStringLiteral("DELETE FROM account_expiry_change WHERE id <= ?"))) {
+        m_lastError = dq.lastError();
+        return false;
+    }
+    dq.addBindValue(lastChangeId);
+    if (!dq.exec()) {
+        m_lastError = dq.lastError();
+        return false;
+    }
+
+    m_lastChangeId = lastChangeId;
+
+    printMessage(tr("Rescheduled %n changed account(s), updated the status of %1.", "", static_cast<int>(ids.size())).arg(changed));
+
+    return true;
+}
+
+
+void ExpiryScheduler::schedule(dbid_t id, const QDateTime &expires)
+{
+    // the status checks use "expiration time < now", so wake up a second later
+    const qint64 due = expires.toMSecsSinceEpoch() + 1000;
+    if ((due > QDateTime::currentMSecsSinceEpoch()) && (due <= (m_windowEnd + 1000))) {
+        m_heap.push(std::make_pair(due, id));
+    }
+}
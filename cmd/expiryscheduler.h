@@ -0,0 +1,79 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EXPIRYSCHEDULER_H
+#define EXPIRYSCHEDULER_H
+
+#include <QCoreApplication>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QDateTime>
+#include <vector>
+#include <queue>
+#include <utility>
+#include <functional>
+#include "configfile.h"
+#include "../common/global.h"
+
+/*!
+ * \ingroup skaffaricmd
+ * \brief Updates the status column of the accountuser table at the time accounts or passwords expire.
+ *
+ * Instead of checking all accounts in regular intervals like the AccountStatusUpdater, the scheduler
+ * runs as daemon and loads the expiration times of the next hour into a min-heap. It sleeps until the
+ * earliest of them and then only updates the status of the accounts that are due.
+ *
+ * The web interface writes the IDs of accounts with changed expiration times into the
+ * \c account_expiry_change table. The scheduler polls that table every few seconds, updates the
+ * status of the changed accounts and adds their new expiration times to the heap.
+ */
+class ExpiryScheduler : public ConfigFile
+{
+    Q_DECLARE_TR_FUNCTIONS(ExpiryScheduler)
+public:
+    /*!
+     * \brief Constructs a new ExpiryScheduler object.
+     * \param confFile  Absolute path to the configuration file that contains database access data.
+     * \param quiet     If \c true, no output will be print to stdout.
+     */
+    explicit ExpiryScheduler(const QString &confFile, bool quiet = false);
+
+    /*!
+     * \brief Runs the scheduler until the process receives SIGTERM or SIGINT.
+     * \return Returns \c 0 if the scheduler has been stopped by a signal.
+     */
+    int exec();
+
+private:
+    typedef std::pair<qint64,dbid_t> Entry;
+
+    bool updateAllStatus(int *changed);
+    bool updateStatus(const std::vector<dbid_t> &ids, int *changed);
+    bool loadWindow(qint64 from, qint64 to);
+    bool loadAccounts(const std::vector<dbid_t> &ids);
+    bool processChanges();
+    void schedule(dbid_t id, const QDateTime &expires);
+
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_heap;
+    QSqlDatabase m_db;
+    QSqlError m_lastError;
+    qint64 m_windowEnd = 0;
+    dbid_t m_lastChangeId = 0;
+};
+
+#endif // EXPIRYSCHEDULER_H
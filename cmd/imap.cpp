@@ -17,9 +17,36 @@
  */
 
 #include "imap.h"
+#include "../src/imap/skaffariimapparser.h"
 #include <QSslError>
 #include <QMessageAuthenticationCode>
 
+namespace {
+
+bool parseStorageQuota(const QByteArray &respLine, quota_pair &quota)
+{
+    int startUsage = respLine.indexOf(QByteArrayLiteral("STORAGE"));
+    if (startUsage < 0) {
+        return false;
+    }
+
+    // 8 is the length of "STORAGE" + 1
+    startUsage += 8;
+    int startQuota = respLine.indexOf(' ', startUsage);
+    quota.first = respLine.mid(startUsage, startQuota - (startUsage)).toULongLong();
+    // advancing 1 to be at the start of the quota value
+    startQuota++;
+    int endQuota = respLine.indexOf(' ', startQuota);
+    if (endQuota < 0) {
+        endQuota = respLine.indexOf(')', startQuota);
+    }
+    quota.second = respLine.mid(startQuota, endQuota - startQuota).toULongLong();
+
+    return true;
+}
+
+}
+
 QStringList Imap::m_capabilities = QStringList();
 
 Imap::Imap(QObject *parent) : QSslSocket(parent)
@@ -417,21 +444,7 @@ quota_pair Imap::getQuota(const QString &user)
                 m_lastError = tr("Can not get quota.");
                 return quota;
             }
-            const QByteArray respLine = response.first();
-            int startUsage = respLine.indexOf(QByteArrayLiteral("STORAGE"));
-            if (startUsage > -1) {
-                // 8 is the length of "STORAGE" + 1
-                startUsage += 8;
-                int startQuota = respLine.indexOf(' ', startUsage);
-                quota.first = respLine.mid(startUsage, startQuota - (startUsage)).toULongLong();
-                // advancing 1 to be at the start of the quota value
-                startQuota++;
-                int endQuota = respLine.indexOf(' ', startQuota);
-                if (endQuota < 0) {
-                    endQuota = respLine.indexOf(')', startQuota);
-                }
-                quota.second = respLine.mid(startQuota, endQuota - startQuota).toULongLong();
-            }
+            parseStorageQuota(response.first(), quota);
         }
     }
 
@@ -440,6 +453,96 @@ quota_pair Imap::getQuota(const QString &user)
 
 
 
+bool Imap::requestQuotas(const QStringList &users)
+{
+    m_quotaTags.clear();
+    m_lastQuotaTag.clear();
+    m_lastError.clear();
+
+    if (users.empty()) {
+        return true;
+    }
+
+    m_quotaTags.reserve(users.size());
+
+    QByteArray commands;
+    for (const QString &user : users) {
+        const QByteArray tag = getTag().toLatin1();
+        commands.append(tag);
+        commands.append(QByteArrayLiteral(" GETQUOTA user"));
+        commands.append(QString(m_hierarchysep + user).toLatin1());
+        commands.append(QByteArrayLiteral("\r\n"));
+        m_quotaTags.insert(tag, user);
+        m_lastQuotaTag = tag;
+    }
+
+    if (Q_UNLIKELY(write(commands) != commands.size())) {
+        m_lastError = tr("Failed to send %1 command to the IMAP server: %2").arg(QStringLiteral("GETQUOTA"), errorString());
+        m_quotaTags.clear();
+        m_lastQuotaTag.clear();
+        return false;
+    }
+
+    // hand the commands over to the server, so that it can process them while we are
+    // waiting for the responses of other connections
+    flush();
+
+    return true;
+}
+
+
+
+QHash<QString,quota_pair> Imap::receiveQuotas()
+{
+    QHash<QString,quota_pair> quotas;
+
+    if (m_lastQuotaTag.isEmpty()) {
+        return quotas;
+    }
+
+    SkaffariIMAPParser parser(m_lastQuotaTag);
+    while (parser.state() == SkaffariIMAPParser::Incomplete) {
+        if ((bytesAvailable() <= 0) && Q_UNLIKELY(!waitForReadyRead())) {
+            m_lastError = tr("Connection to the IMAP server timed out.");
+            break;
+        }
+        parser.feed(readAll());
+    }
+
+    quotas.reserve(m_quotaTags.size());
+
+    // untagged QUOTA responses belong to the next tagged status line
+    quota_pair current(0, 0);
+    bool gotQuota = false;
+    const int respCount = parser.count();
+    const bool complete = (parser.state() == SkaffariIMAPParser::Complete);
+    for (int i = 0; i < respCount + (complete ? 1 : 0); ++i) {
+        const QByteArray line = (i < respCount) ? parser.response(i) : parser.statusLine();
+
+        if (line.startsWith('*')) {
+            if (line.startsWith(QByteArrayLiteral("* QUOTA "))) {
+                gotQuota = parseStorageQuota(line, current);
+            }
+            continue;
+        }
+
+        const int spaceIdx = line.indexOf(' ');
+        const QString user = m_quotaTags.value(line.left(spaceIdx));
+        if (!user.isEmpty() && gotQuota && line.mid(spaceIdx + 1).startsWith(QByteArrayLiteral("OK"))) {
+            quotas.insert(user, current);
+        }
+        current = quota_pair(0, 0);
+        gotQuota = false;
+    }
+
+    m_quotaTags.clear();
+    m_lastQuotaTag.clear();
+
+    return quotas;
+}
+
+
+
 bool Imap::checkResponse(const QByteArray &data, const QString &tag, QList<QByteArray> *response)
 {
     bool ret = false;
@@ -21,6 +21,7 @@
 
 #include <QSslSocket>
 #include <QStringList>
+#include <QHash>
 
 #include "../common/global.h"
 
@@ -102,6 +103,22 @@ public:
      */
     quota_pair getQuota(const QString &user);
 
+    /*!
+     * \brief Sends the GETQUOTA commands for all \a users at once without waiting for the responses.
+     *
+     * Use receiveQuotas() to read the responses. This way multiple connections can process
+     * their commands on the server at the same time. Returns \c false if the commands could not be sent.
+     */
+    bool requestQuotas(const QStringList &users);
+
+    /*!
+     * \brief Reads the responses to the commands sent by requestQuotas().
+     *
+     * Returns the user names as keys and quota pairs containing the used storage and the storage
+     * limit in KiB as values. Users the server returned no quota for are not part of the result.
+     */
+    QHash<QString,quota_pair> receiveQuotas();
+
     /*!
      * \brief Sets the \a user that should login to the IMAP server.
      */
@@ -188,6 +205,8 @@ private:
     static QStringList m_capabilities;
     quint32 m_tagSequence = 0;
     AuthMech m_authMech = CLEAR;
+    QHash<QByteArray,QString> m_quotaTags;
+    QByteArray m_lastQuotaTag;
 };
 
 #endif // IMAP_H
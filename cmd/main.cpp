@@ -28,8 +28,12 @@
 #include "../common/config.h"
 #include "setup.h"
 #include "webcyradmimporter.h"
+#include "expiryscheduler.h"
 #include "tester.h"
 #include "accountstatusupdater.h"
+#include "usagesynchronizer.h"
+#include "dbmigrator.h"
+#include "statisticsupdater.h"
 
 /*!
  * \defgroup skaffaricmd CMD
@@ -57,6 +61,12 @@ int main(int argc, char *argv[])
     QCommandLineOption import(QStringLiteral("import-web-cyradm"), QCoreApplication::translate("main", "Import web-cyradm configuration and database."), QCoreApplication::translate("main", "path to web-cyradm config file"));
     parser.addOption(import);
 
+    QCommandLineOption jobs(QStringList({QStringLiteral("jobs"), QStringLiteral("j")}), QCoreApplication::translate("main", "Maximum number of tables to import concurrently when importing web-cyradm data. Default: %1").arg(1), QStringLiteral("number"), QStringLiteral("1"));
+    parser.addOption(jobs);
+
+    QCommandLineOption upgradeDb(QStringLiteral("upgrade-db"), QCoreApplication::translate("main", "Applies pending database migrations and checks the query plans of the lookup queries."));
+    parser.addOption(upgradeDb);
+
     QCommandLineOption test(QStringList({QStringLiteral("test"), QStringLiteral("t")}), QCoreApplication::translate("main", "Test the Skaffari settings."));
     parser.addOption(test);
 
@@ -70,6 +80,21 @@ int main(int argc, char *argv[])
     QCommandLineOption updateAccountStatus(QStringLiteral("update-account-status"), QCoreApplication::translate("main", "Checks and updates the status column of every account."));
     parser.addOption(updateAccountStatus);
 
+    QCommandLineOption verbose(QStringLiteral("verbose"), QCoreApplication::translate("main", "Print every account whose status has been changed by --update-account-status."));
+    parser.addOption(verbose);
+
+    QCommandLineOption expiryDaemon(QStringLiteral("expiry-daemon"), QCoreApplication::translate("main", "Runs as daemon that updates the status of accounts at the time they or their passwords expire."));
+    parser.addOption(expiryDaemon);
+
+    QCommandLineOption syncUsage(QStringLiteral("sync-usage"), QCoreApplication::translate("main", "Synchronizes the mailbox usage of all accounts into the database."));
+    parser.addOption(syncUsage);
+
+    QCommandLineOption updateStatistics(QStringLiteral("update-statistics"), QCoreApplication::translate("main", "Recounts the statistics shown on the dashboard."));
+    parser.addOption(updateStatistics);
+
+    QCommandLineOption rebuildSearchIndex(QStringLiteral("rebuild-search-index"), QCoreApplication::translate("main", "Rebuilds the account search index and recounts the statistics shown on the dashboard."));
+    parser.addOption(rebuildSearchIndex);
+
     parser.process(app);
 
     if (parser.isSet(setup)) {
@@ -83,9 +108,14 @@ int main(int argc, char *argv[])
 
     } else if (parser.isSet(import)) {
 
-        WebCyradmImporter importer(parser.value(import), parser.value(iniPath));
+        WebCyradmImporter importer(parser.value(import), parser.value(iniPath), parser.value(jobs).toInt());
         return importer.exec();
 
+    } else if (parser.isSet(upgradeDb)) {
+
+        DbMigrator migrator(parser.value(iniPath), parser.isSet(quiet));
+        return migrator.exec();
+
     } else if (parser.isSet(test)) {
 
         Tester tester(parser.value(iniPath));
@@ -93,9 +123,24 @@ int main(int argc, char *argv[])
 
     } else if (parser.isSet(updateAccountStatus)) {
 
-        AccountStatusUpdater asu(parser.value(iniPath), parser.isSet(quiet));
+        AccountStatusUpdater asu(parser.value(iniPath), parser.isSet(quiet), parser.isSet(verbose));
         return asu.exec();
 
+    } else if (parser.isSet(expiryDaemon)) {
+
+        ExpiryScheduler es(parser.value(iniPath), parser.isSet(quiet));
+        return es.exec();
+
+    } else if (parser.isSet(syncUsage)) {
+
+        UsageSynchronizer us(parser.value(iniPath), parser.isSet(quiet));
+        return us.exec();
+
+    } else if (parser.isSet(updateStatistics) || parser.isSet(rebuildSearchIndex)) {
+
+        StatisticsUpdater su(parser.value(iniPath), parser.isSet(quiet), parser.isSet(rebuildSearchIndex));
+        return su.exec();
+
     } else {
         parser.showHelp(1);
     }
@@ -0,0 +1,103 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "queryplanchecker.h"
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <utility>
+
+QueryPlanChecker::QueryPlanChecker(const QSqlDatabase &db) :
+    m_db(db)
+{
+
+}
+
+std::vector<QueryPlanChecker::Result> QueryPlanChecker::check() const
+{
+    // lookups of the web interface and skaffaricmd, parameters are replaced by sample values
+    const std::vector<std::pair<QString,QString>> catalogue({
+        {tr("Account by ID"), QStringLiteral("SELECT domain_id, username FROM accountuser WHERE id = 1")},
+        {tr("Account by user name"), QStringLiteral("SELECT quota FROM accountuser WHERE username = 'user'")},
+        {tr("Accounts of a domain"), QStringLiteral("SELECT id, username FROM accountuser WHERE domain_id = 1 ORDER BY username ASC LIMIT 25")},
+        {tr("Accounts of a domain by creation time"), QStringLiteral("SELECT id FROM accountuser WHERE domain_id = 1 ORDER BY created_at DESC LIMIT 25")},
+        {tr("Accounts by creation time"), QStringLiteral("SELECT id FROM accountuser WHERE created_at > '2018-01-01 00:00:00'")},
+        {tr("Expiring accounts"), QStringLiteral("SELECT id FROM accountuser WHERE valid_until >= '2018-01-01 00:00:00' AND valid_until < '2018-01-01 01:00:00'")},
+        {tr("Expiring passwords"), QStringLiteral("SELECT id FROM accountuser WHERE pwd_expire >= '2018-01-01 00:00:00' AND pwd_expire < '2018-01-01 01:00:00'")},
+        {tr("Accounts valid again"), QStringLiteral("SELECT id FROM accountuser WHERE valid_until >= '2018-01-01 00:00:00' AND status IN (1, 3)")},
+        {tr("Account search"), QStringLiteral("SELECT account_id FROM account_search WHERE domain_id = 1 AND role = 0 AND trigram = 'abc'")},
+        {tr("Addresses of an account"), QStringLiteral("SELECT id, ace_id, alias FROM virtual WHERE dest = 'user' AND username = 'user' AND idn_id = 0 ORDER BY alias ASC")},
+        {tr("Addresses of multiple accounts"), QStringLiteral("SELECT username, alias FROM virtual WHERE dest = username AND idn_id = 0 AND username IN ('user1', 'user2') ORDER BY alias ASC")},
+        {tr("Forwards of an account"), QStringLiteral("SELECT dest FROM virtual WHERE alias = 'user' AND username = ''")},
+        {tr("Owner of an address"), QStringLiteral("SELECT username FROM virtual WHERE alias = 'user@example.com'")},
+        {tr("Address by ID"), QStringLiteral("SELECT ace_id, alias FROM virtual WHERE id = 1")},
+        {tr("Addresses pointing to a destination"), QStringLiteral("SELECT alias FROM virtual WHERE dest = 'user@example.com'")},
+        {tr("Domain by ID"), QStringLiteral("SELECT domain_name FROM domain WHERE id = 1")},
+        {tr("Domain by name"), QStringLiteral("SELECT id, autoconfig FROM domain WHERE domain_name = 'example.com'")},
+        {tr("Child domains"), QStringLiteral("SELECT id, domain_name FROM domain WHERE parent_id = 1")},
+        {tr("ACE domain of an IDN domain"), QStringLiteral("SELECT id FROM domain WHERE idn_id = 1")},
+        {tr("Domains of an administrator"), QStringLiteral("SELECT dom.id, dom.domain_name FROM domain dom JOIN domainadmin da ON dom.id = da.domain_id WHERE da.admin_id = 1 ORDER BY dom.domain_name ASC")},
+        {tr("Administrators of a domain"), QStringLiteral("SELECT a.id, a.username FROM domainadmin da JOIN adminuser a ON a.id = da.admin_id WHERE da.domain_id = 1")},
+        {tr("Administrator login"), QStringLiteral("SELECT au.id, se.lang FROM adminuser au JOIN settings se ON au.id = se.admin_id WHERE au.username = 'admin' AND au.type > 0")},
+        {tr("Default folders of a domain"), QStringLiteral("SELECT id, name, special_use FROM folder WHERE domain_id = 1")},
+        {tr("Log entries of a user"), QStringLiteral("SELECT id, msg FROM log WHERE user = 'user'")},
+        {tr("Queued jobs"), QStringLiteral("SELECT id FROM job WHERE status = 0 ORDER BY id ASC LIMIT 1")},
+        {tr("Active job of an object"), QStringLiteral("SELECT id FROM job WHERE type = 1 AND object_id = 1 AND status IN (0, 1)")},
+        {tr("Changed expiration times"), QStringLiteral("SELECT account_id FROM account_expiry_change WHERE id > 1 ORDER BY id ASC")}
+    });
+
+    std::vector<Result> results;
+    results.reserve(catalogue.size());
+
+    QSqlQuery q(m_db);
+
+    for (const std::pair<QString,QString> &entry : catalogue) {
+        Result result;
+        result.description = entry.first;
+
+        if (q.exec(QLatin1String("EXPLAIN ") + entry.second)) {
+            const QSqlRecord rec = q.record();
+            const int tableIdx = rec.indexOf(QStringLiteral("table"));
+            const int typeIdx = rec.indexOf(QStringLiteral("type"));
+            const int possibleKeysIdx = rec.indexOf(QStringLiteral("possible_keys"));
+            const int keyIdx = rec.indexOf(QStringLiteral("key"));
+
+            while (q.next()) {
+                const QString table = q.value(tableIdx).toString();
+                // rows without table are created for optimized away or impossible conditions
+                if (table.isEmpty()) {
+                    continue;
+                }
+                const QString key = q.value(keyIdx).toString();
+                if (!key.isEmpty()) {
+                    result.keys << table + QLatin1Char('.') + key;
+                }
+                // small tables might be scanned even if there is an index, so only report missing indexes
+                if ((q.value(typeIdx).toString() == QLatin1String("ALL")) && q.value(possibleKeysIdx).toString().isEmpty()) {
+                    result.fullScans << table;
+                }
+            }
+        } else {
+            result.error = q.lastError().text();
+        }
+
+        results.push_back(result);
+    }
+
+    return results;
+}
@@ -0,0 +1,67 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUERYPLANCHECKER_H
+#define QUERYPLANCHECKER_H
+
+#include <QCoreApplication>
+#include <QSqlDatabase>
+#include <QStringList>
+#include <vector>
+
+/*!
+ * \ingroup skaffaricmd
+ * \brief Checks the execution plans of the lookup queries used by Skaffari.
+ *
+ * Runs EXPLAIN for every query of an internal catalogue that contains the lookups Skaffari
+ * performs on the database, with sample values for the parameters. A query is reported if
+ * the database has to scan a table because there is no index it could use. Tables that only
+ * contain configuration data are not part of the catalogue.
+ *
+ * The result does not depend on the table sizes, because only the possible keys are evaluated,
+ * not the keys the optimizer selected for the current data.
+ */
+class QueryPlanChecker
+{
+    Q_DECLARE_TR_FUNCTIONS(QueryPlanChecker)
+public:
+    /*!
+     * \brief Result of the check of a single query.
+     */
+    struct Result {
+        QString description;    /**< description of the query */
+        QStringList fullScans;  /**< tables that have to be scanned completely */
+        QStringList keys;       /**< keys used for the tables */
+        QString error;          /**< error message if EXPLAIN failed */
+    };
+
+    /*!
+     * \brief Constructs a new QueryPlanChecker for the database connection \a db.
+     */
+    explicit QueryPlanChecker(const QSqlDatabase &db);
+
+    /*!
+     * \brief Explains all queries of the catalogue and returns the results.
+     */
+    std::vector<Result> check() const;
+
+private:
+    QSqlDatabase m_db;
+};
+
+#endif // QUERYPLANCHECKER_H
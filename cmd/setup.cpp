@@ -117,6 +117,17 @@ int Setup::exec() const
     const QVersionNumber installedVersion = db.installedVersion();
     if (!installedVersion.isNull()) {
         printDone(installedVersion.toString());
+        const QVersionNumber filesVersion = db.sqlFilesVersion();
+        if (installedVersion < filesVersion) {
+            //: %1 will be the new database layout version
+            printStatus(tr("Upgrading database layout to version %1").arg(filesVersion.toString()));
+            if (!db.upgradeDatabase(installedVersion)) {
+                printFailed();
+                return dbError(db.lastDbError());
+            } else {
+                printDone();
+            }
+        }
     } else {
         printFailed();
         printStatus(tr("Performing database installation"));
@@ -0,0 +1,75 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "statisticsupdater.h"
+#include "database.h"
+#include <QSettings>
+
+StatisticsUpdater::StatisticsUpdater(const QString &confFile, bool quiet, bool searchIndex) :
+    ConfigFile(confFile, false, false, quiet), m_searchIndex(searchIndex)
+{
+
+}
+
+
+int StatisticsUpdater::exec() const
+{
+    int retVal = checkConfigFile();
+    if (retVal > 0) {
+        return retVal;
+    }
+
+    QSettings s(configFileName(), QSettings::IniFormat);
+    s.beginGroup(QStringLiteral("Database"));
+    const QString dbhost = s.value(QStringLiteral("host"), QStringLiteral("localhost")).toString();
+    const QString dbname = s.value(QStringLiteral("name")).toString();
+    const QString dbpass = s.value(QStringLiteral("password")).toString();
+    const QString dbtype = s.value(QStringLiteral("type"), QStringLiteral("QMYSQL")).toString();
+    const QString dbuser = s.value(QStringLiteral("user")).toString();
+    const quint16 dbport = s.value(QStringLiteral("port"), 3306).value<quint16>();
+    s.endGroup();
+
+    Database db(dbtype, dbhost, dbport, dbname, dbuser, dbpass);
+    printStatus(tr("Establishing database connection"));
+    if (!db.open()) {
+        printFailed();
+        return dbError(db.lastDbError());
+    } else {
+        printDone();
+    }
+
+    if (m_searchIndex) {
+        printStatus(tr("Rebuilding search index"));
+        if (!db.rebuildSearchIndex()) {
+            printFailed();
+            return dbError(db.lastDbError());
+        } else {
+            printDone();
+        }
+    }
+
+    printStatus(tr("Recounting statistics"));
+    if (!db.updateStatistics()) {
+        printFailed();
+        return dbError(db.lastDbError());
+    } else {
+        printDone();
+    }
+
+    return 0;
+}
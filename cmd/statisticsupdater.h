@@ -0,0 +1,55 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATISTICSUPDATER_H
+#define STATISTICSUPDATER_H
+
+#include <QCoreApplication>
+#include "configfile.h"
+
+/*!
+ * \ingroup skaffaricmd
+ * \brief Recounts the statistics shown on the dashboard.
+ *
+ * The web interface keeps the counters in the statistics table up to date when accounts, addresses,
+ * domains and administrators are changed. Running this regularly corrects deviations caused by
+ * failed operations or by changes made directly in the database.
+ */
+class StatisticsUpdater : public ConfigFile
+{
+    Q_DECLARE_TR_FUNCTIONS(StatisticsUpdater)
+public:
+    /*!
+     * \brief Constructs a new StatisticsUpdater object.
+     * \param confFile  Absolute path to the configuration file that contains database access data.
+     * \param quiet     If \c true, no output will be print to stdout.
+     * \param searchIndex If \c true, the account search index will be rebuilt before recounting.
+     */
+    explicit StatisticsUpdater(const QString &confFile, bool quiet = false, bool searchIndex = false);
+
+    /*!
+     * \brief Starts the recount.
+     * \return Returns \c 0 on success.
+     */
+    int exec() const;
+
+private:
+    bool m_searchIndex = false;
+};
+
+#endif // STATISTICSUPDATER_H
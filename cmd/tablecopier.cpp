@@ -0,0 +1,272 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tablecopier.h"
+#include <QSqlQuery>
+#include <QElapsedTimer>
+
+TableCopier::TableCopier(const QString &description, const QString &sourceTable, const QStringList &sourceColumns, const QString &targetTable, const QStringList &targetColumns, const RowConverter &converter) :
+    m_description(description),
+    m_sourceTable(sourceTable),
+    m_sourceColumns(sourceColumns),
+    m_targetTable(targetTable),
+    m_targetColumns(targetColumns),
+    m_converter(converter)
+{
+
+}
+
+QString TableCopier::description() const
+{
+    return m_description;
+}
+
+void TableCopier::setFilter(const QString &filter)
+{
+    m_filter = filter;
+}
+
+void TableCopier::setKeyColumn(const QString &column, int pageSize)
+{
+    Q_ASSERT_X(m_sourceColumns.value(0) == column, "set key column", "the key column has to be the first source column");
+    m_keyColumn = column;
+    m_pageSize = qMax(pageSize, 1);
+}
+
+int TableCopier::batchSize() const
+{
+    return m_batchSize;
+}
+
+void TableCopier::setBatchSize(int rows)
+{
+    m_batchSize = qMax(rows, 1);
+}
+
+int TableCopier::transactionSize() const
+{
+    return m_transactionSize;
+}
+
+void TableCopier::setTransactionSize(int rows)
+{
+    m_transactionSize = qMax(rows, 1);
+}
+
+void TableCopier::setProgressCallback(const ProgressCallback &callback)
+{
+    m_progressCallback = callback;
+}
+
+bool TableCopier::copy(const QSqlDatabase &source, QSqlDatabase target)
+{
+    m_rows = 0;
+    m_elapsed = 0;
+    m_lastError = QSqlError();
+
+    QElapsedTimer timer;
+    timer.start();
+    QElapsedTimer progressTimer;
+    progressTimer.start();
+    quint64 progressRows = 0;
+
+    const int columnCount = m_targetColumns.size();
+    const bool paged = !m_keyColumn.isEmpty();
+
+    QSqlQuery insert(target);
+    if (!insert.prepare(insertStatement(m_batchSize))) {
+        return fail(insert.lastError(), target);
+    }
+
+    QString select = QLatin1String("SELECT ") % m_sourceColumns.join(QLatin1String(", ")) % QLatin1String(" FROM ") % m_sourceTable;
+    QStringList conditions;
+    if (!m_filter.isEmpty()) {
+        conditions << m_filter;
+    }
+    if (paged) {
+        conditions << QString(m_keyColumn % QLatin1String(" > ?"));
+    }
+    if (!conditions.empty()) {
+        select += QLatin1String(" WHERE ") % conditions.join(QLatin1String(" AND "));
+    }
+    if (paged) {
+        select += QLatin1String(" ORDER BY ") % m_keyColumn % QLatin1String(" ASC LIMIT ") % QString::number(m_pageSize);
+    }
+
+    // do not let the driver cache the complete result
+    QSqlQuery sq(source);
+    sq.setForwardOnly(true);
+    if (!sq.prepare(select)) {
+        return fail(sq.lastError(), target);
+    }
+
+    if (!target.transaction()) {
+        return fail(target.lastError(), target);
+    }
+
+    QVariantList values;
+    values.reserve(columnCount * m_batchSize);
+    QVariantList row;
+    row.reserve(columnCount);
+    int batchRows = 0;
+    int transactionRows = 0;
+    qlonglong lastKey = 0;
+    bool morePages = true;
+
+    while (morePages) {
+
+        if (paged) {
+            sq.bindValue(0, lastKey);
+        }
+
+        if (!sq.exec()) {
+            return fail(sq.lastError(), target);
+        }
+
+        int pageRows = 0;
+        while (sq.next()) {
+            ++pageRows;
+            if (paged) {
+                lastKey = sq.value(0).toLongLong();
+            }
+
+            row.clear();
+            if (m_converter) {
+                if (!m_converter(sq, row)) {
+                    continue;
+                }
+            } else {
+                for (int i = 0; i < columnCount; ++i) {
+                    row.append(sq.value(i));
+                }
+            }
+            values += row;
+            ++batchRows;
+
+            if (batchRows == m_batchSize) {
+                if (!writeBatch(insert, target, values, batchRows)) {
+                    return false;
+                }
+                values.clear();
+                transactionRows += batchRows;
+                batchRows = 0;
+
+                if (transactionRows >= m_transactionSize) {
+                    if (!target.commit() || !target.transaction()) {
+                        return fail(target.lastError(), target);
+                    }
+                    transactionRows = 0;
+                }
+
+                if (m_progressCallback && progressTimer.hasExpired(1000)) {
+                    const double rate = static_cast<double>(m_rows - progressRows) * 1000.0 / static_cast<double>(progressTimer.elapsed());
+                    m_progressCallback(*this, m_rows, rate);
+                    progressRows = m_rows;
+                    progressTimer.restart();
+                }
+            }
+        }
+
+        morePages = paged && (pageRows == m_pageSize);
+    }
+
+    if ((batchRows > 0) && !writeBatch(insert, target, values, batchRows)) {
+        return false;
+    }
+
+    if (!target.commit()) {
+        return fail(target.lastError(), target);
+    }
+
+    m_elapsed = timer.elapsed();
+
+    return true;
+}
+
+quint64 TableCopier::rows() const
+{
+    return m_rows;
+}
+
+qint64 TableCopier::elapsed() const
+{
+    return m_elapsed;
+}
+
+double TableCopier::rowsPerSecond() const
+{
+    if (m_elapsed > 0) {
+        return static_cast<double>(m_rows) * 1000.0 / static_cast<double>(m_elapsed);
+    }
+    return static_cast<double>(m_rows);
+}
+
+QSqlError TableCopier::lastError() const
+{
+    return m_lastError;
+}
+
+bool TableCopier::writeBatch(QSqlQuery &fullBatch, QSqlDatabase &target, const QVariantList &values, int rowCount)
+{
+    QSqlQuery partialBatch(target);
+    QSqlQuery *q = &fullBatch;
+
+    // the last batch is smaller and needs its own statement
+    if (rowCount != m_batchSize) {
+        if (!partialBatch.prepare(insertStatement(rowCount))) {
+            return fail(partialBatch.lastError(), target);
+        }
+        q = &partialBatch;
+    }
+
+    const int valueCount = values.size();
+    for (int i = 0; i < valueCount; ++i) {
+        q->bindValue(i, values.at(i));
+    }
+
+    if (!q->exec()) {
+        return fail(q->lastError(), target);
+    }
+
+    m_rows += static_cast<quint64>(rowCount);
+
+    return true;
+}
+
+bool TableCopier::fail(const QSqlError &error, QSqlDatabase &target)
+{
+    m_lastError = error;
+    target.rollback();
+    return false;
+}
+
+QString TableCopier::insertStatement(int rowCount) const
+{
+    QString placeholders = QStringLiteral("(?");
+    for (int i = 1; i < m_targetColumns.size(); ++i) {
+        placeholders += QLatin1String(",?");
+    }
+    placeholders += QLatin1Char(')');
+
+    QStringList rowsList;
+    rowsList.reserve(rowCount);
+    for (int i = 0; i < rowCount; ++i) {
+        rowsList << placeholders;
+    }
+    return QLatin1String("INSERT INTO ") % m_targetTable % QLatin1String(" (") % m_targetColumns.join(QLatin1String(", ")) % QLatin1String(") VALUES ") % rowsList.join(QLatin1Char(','));
+}
@@ -0,0 +1,164 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TABLECOPIER_H
+#define TABLECOPIER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariantList>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <functional>
+
+class QSqlQuery;
+
+/*!
+ * \ingroup skaffaricmd
+ * \brief Copies the rows of a table from one database into a table of another database.
+ *
+ * The source rows are read with forward-only queries. If a key column has been set with
+ * setKeyColumn(), the source table is read in pages ordered by that column, so that the
+ * client never has to hold more than one page in memory. The rows are written with multi-row
+ * INSERT statements of batchSize() rows inside transactions that are committed every
+ * transactionSize() rows.
+ */
+class TableCopier
+{
+public:
+    /*!
+     * \brief Function that converts the current row of the \a source query into the \a values for the target table.
+     *
+     * Return \c false to skip the row.
+     */
+    typedef std::function<bool(const QSqlQuery &source, QVariantList &values)> RowConverter;
+
+    /*!
+     * \brief Function that is called about once per second while copying.
+     *
+     * \a rows is the number of rows written so far, \a rowsPerSecond the current throughput.
+     */
+    typedef std::function<void(const TableCopier &copier, quint64 rows, double rowsPerSecond)> ProgressCallback;
+
+    /*!
+     * \brief Constructs a new TableCopier object.
+     * \param description   human readable description of the copied data, used for output
+     * \param sourceTable   name of the table to read from
+     * \param sourceColumns columns to read from the source table
+     * \param targetTable   name of the table to write to
+     * \param targetColumns columns to write to, if no converter is set, the source columns will be written in the same order
+     * \param converter     optional function to convert source rows into target rows
+     */
+    TableCopier(const QString &description, const QString &sourceTable, const QStringList &sourceColumns, const QString &targetTable, const QStringList &targetColumns, const RowConverter &converter = nullptr);
+
+    /*!
+     * \brief Returns the description of the copied data.
+     */
+    QString description() const;
+
+    /*!
+     * \brief Sets a \a filter that will be used as WHERE clause when reading the source table.
+     */
+    void setFilter(const QString &filter);
+
+    /*!
+     * \brief Reads the source table in pages of \a pageSize rows ordered by the integer \a column.
+     *
+     * The \a column has to be unique and has to be the first of the source columns.
+     */
+    void setKeyColumn(const QString &column, int pageSize = 50000);
+
+    /*!
+     * \brief Returns the number of rows written by a single INSERT statement.
+     */
+    int batchSize() const;
+
+    /*!
+     * \brief Sets the number of rows written by a single INSERT statement.
+     *
+     * Default: 500
+     */
+    void setBatchSize(int rows);
+
+    /*!
+     * \brief Returns the number of rows after that the transaction will be committed.
+     */
+    int transactionSize() const;
+
+    /*!
+     * \brief Sets the number of rows after that the transaction will be committed.
+     *
+     * Default: 10000
+     */
+    void setTransactionSize(int rows);
+
+    /*!
+     * \brief Sets the function that will be called to report the progress.
+     */
+    void setProgressCallback(const ProgressCallback &callback);
+
+    /*!
+     * \brief Copies the rows from the \a source to the \a target database and returns \c true on success.
+     *
+     * On errors, the current transaction will be rolled back and lastError() will contain the error.
+     */
+    bool copy(const QSqlDatabase &source, QSqlDatabase target);
+
+    /*!
+     * \brief Returns the number of rows that have been written.
+     */
+    quint64 rows() const;
+
+    /*!
+     * \brief Returns the time in milliseconds copy() took.
+     */
+    qint64 elapsed() const;
+
+    /*!
+     * \brief Returns the average number of rows written per second.
+     */
+    double rowsPerSecond() const;
+
+    /*!
+     * \brief Returns the last occurred database error.
+     */
+    QSqlError lastError() const;
+
+private:
+    bool writeBatch(QSqlQuery &fullBatch, QSqlDatabase &target, const QVariantList &values, int rowCount);
+    bool fail(const QSqlError &error, QSqlDatabase &target);
+    QString insertStatement(int rowCount) const;
+
+    QString m_description;
+    QString m_sourceTable;
+    QStringList m_sourceColumns;
+    QString m_targetTable;
+    QStringList m_targetColumns;
+    QString m_filter;
+    QString m_keyColumn;
+    RowConverter m_converter;
+    ProgressCallback m_progressCallback;
+    QSqlError m_lastError;
+    quint64 m_rows = 0;
+    qint64 m_elapsed = 0;
+    int m_pageSize = 50000;
+    int m_batchSize = 500;
+    int m_transactionSize = 10000;
+};
+
+#endif // TABLECOPIER_H
@@ -0,0 +1,216 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "usagesynchronizer.h"
+#include "database.h"
+#include "imap.h"
+#include "../common/config.h"
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QSettings>
+#include <QDateTime>
+#include <QHash>
+#include <memory>
+#include <vector>
+
+#define SK_USAGE_SYNC_CONNECTIONS 3
+#define SK_USAGE_SYNC_BATCH_SIZE 250
+
+UsageSynchronizer::UsageSynchronizer(const QString &confFile, bool quiet) :
+    ConfigFile(confFile, false, false, quiet)
+{
+
+}
+
+
+int UsageSynchronizer::exec() const
+{
+    printMessage(tr("Start synchronizing the mailbox usage of all user accounts."));
+
+    int retVal = checkConfigFile();
+    if (retVal > 0) {
+        return retVal;
+    }
+
+    QSettings s(configFileName(), QSettings::IniFormat);
+    s.beginGroup(QStringLiteral("Database"));
+    const QString dbhost = s.value(QStringLiteral("host"), QStringLiteral("localhost")).toString();
+    const QString dbname = s.value(QStringLiteral("name")).toString();
+    const QString dbpass = s.value(QStringLiteral("password")).toString();
+    const QString dbtype = s.value(QStringLiteral("type"), QStringLiteral("QMYSQL")).toString();
+    const QString dbuser = s.value(QStringLiteral("user")).toString();
+    const quint16 dbport = s.value(QStringLiteral("port"), 3306).value<quint16>();
+    s.endGroup();
+
+    s.beginGroup(QStringLiteral("IMAP"));
+    const QString imapuser = s.value(QStringLiteral("user")).toString();
+    const QString imappass = s.value(QStringLiteral("password")).toString();
+    const QString imaphost = s.value(QStringLiteral("host"), QStringLiteral("localhost")).toString();
+    const quint16 imapport = s.value(QStringLiteral("port"), 143).value<quint16>();
+    const quint8 imapprotocol = s.value(QStringLiteral("protocol"), SK_DEF_IMAP_PROTOCOL).value<quint8>();
+    const quint8 imapencryption = s.value(QStringLiteral("encryption"), SK_DEF_IMAP_ENCRYPTION).value<quint8>();
+    const quint8 imapauthmech = s.value(QStringLiteral("authmech"), SK_DEF_IMAP_AUTHMECH).value<quint8>();
+    const QString imappeername = s.value(QStringLiteral("peername")).toString();
+    const bool unixHierarchySep = s.value(QStringLiteral("unixhierarchysep"), SK_DEF_IMAP_UNIXHIERARCHYSEP).toBool();
+    s.endGroup();
+
+    Database db(dbtype, dbhost, dbport, dbname, dbuser, dbpass);
+    printStatus(tr("Establishing database connection"));
+    if (!db.open()) {
+        printFailed();
+        return dbError(db.lastDbError());
+    } else {
+        printDone();
+    }
+
+    printStatus(tr("Fetching accounts"));
+    QSqlQuery q(db.getDb());
+    if (!q.exec(QStringLiteral("SELECT id, username FROM accountuser WHERE domain_id > 0 ORDER BY id"))) {
+        printFailed();
+        return dbError(q.lastError());
+    } else {
+        //: %1 will be the number of found accounts
+        printDone(tr("Found %1").arg(q.size()));
+    }
+
+    QStringList usernames;
+    QHash<QString,quint32> ids;
+    if (q.size() > 0) {
+        usernames.reserve(q.size());
+        ids.reserve(q.size());
+    }
+    while (q.next()) {
+        const QString username = q.value(1).toString();
+        usernames.push_back(username);
+        ids.insert(username, q.value(0).value<quint32>());
+    }
+
+    if (usernames.empty()) {
+        printSuccess(tr("Finished synchronizing mailbox usage for %n account(s).", "", 0));
+        return 0;
+    }
+
+    const int connectionCount = qMin(SK_USAGE_SYNC_CONNECTIONS, (usernames.size() + SK_USAGE_SYNC_BATCH_SIZE - 1) / SK_USAGE_SYNC_BATCH_SIZE);
+
+    printStatus(tr("Establishing %n connection(s) to the IMAP server", "", connectionCount));
+    std::vector<std::unique_ptr<Imap>> connections;
+    connections.reserve(connectionCount);
+    for (int i = 0; i < connectionCount; ++i) {
+        std::unique_ptr<Imap> imap(new Imap(imapuser,
+                                            imappass,
+                                            static_cast<Imap::AuthMech>(imapauthmech),
+                                            imaphost,
+                                            imapport,
+                                            static_cast<QAbstractSocket::NetworkLayerProtocol>(imapprotocol),
+                                            static_cast<Imap::EncryptionType>(imapencryption),
+                                            unixHierarchySep ? QLatin1Char('/') : QLatin1Char('.'),
+                                            imappeername));
+        if (!imap->login()) {
+            printFailed();
+            return imapError(imap->lastError());
+        }
+        connections.push_back(std::move(imap));
+    }
+    printDone();
+
+    QSqlQuery updateQuery(db.getDb());
+    if (!updateQuery.prepare(QStringLiteral("UPDATE accountuser SET quota_usage = ?, quota_limit = ?, usage_updated_at = ? WHERE id = ?"))) {
+        return dbError(updateQuery.lastError());
+    }
+
+    int synced = 0;
+    int missing = 0;
+    int pos = 0;
+    const int total = usernames.size();
+
+    while (pos < total) {
+        const int roundStart = pos;
+        printStatus(tr("Synchronizing accounts %1 to %2").arg(QString::number(roundStart + 1), QString::number(qMin(total, roundStart + connectionCount * SK_USAGE_SYNC_BATCH_SIZE))));
+
+        // send all commands first, so that the server can work on all connections at the same time
+        int sent = 0;
+        for (const std::unique_ptr<Imap> &imap : connections) {
+            const QStringList batch = usernames.mid(pos, SK_USAGE_SYNC_BATCH_SIZE);
+            if (batch.empty()) {
+                break;
+            }
+            if (!imap->requestQuotas(batch)) {
+                printFailed();
+                return imapError(imap->lastError());
+            }
+            pos += batch.size();
+            ++sent;
+        }
+
+        QHash<QString,quota_pair> quotas;
+        for (int i = 0; i < sent; ++i) {
+            const QHash<QString,quota_pair> received = connections[i]->receiveQuotas();
+            if (received.empty() && !connections[i]->lastError().isEmpty()) {
+                printFailed();
+                return imapError(connections[i]->lastError());
+            }
+            quotas.unite(received);
+        }
+
+        const QDateTime now = QDateTime::currentDateTimeUtc();
+
+        if (!db.getDb().transaction()) {
+            printFailed();
+            return dbError(db.getDb());
+        }
+
+        for (int i = roundStart; i < pos; ++i) {
+            const QString &username = usernames.at(i);
+            const auto it = quotas.constFind(username);
+            if (it == quotas.constEnd()) {
+                ++missing;
+                continue;
+            }
+            updateQuery.addBindValue(it.value().first);
+            updateQuery.addBindValue(it.value().second);
+            updateQuery.addBindValue(now);
+            updateQuery.addBindValue(ids.value(username));
+            if (!updateQuery.exec()) {
+                printFailed();
+                db.getDb().rollback();
+                return dbError(updateQuery.lastError());
+            }
+            ++synced;
+        }
+
+        if (!db.getDb().commit()) {
+            printFailed();
+            return dbError(db.getDb());
+        }
+
+        printDone();
+    }
+
+    for (const std::unique_ptr<Imap> &imap : connections) {
+        imap->logout();
+    }
+
+    if (missing > 0) {
+        printMessage(tr("The IMAP server returned no quota for %n account(s).", "", missing));
+    }
+
+    printSuccess(tr("Finished synchronizing mailbox usage for %n account(s).", "", synced));
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef USAGESYNCHRONIZER_H
+#define USAGESYNCHRONIZER_H
+
+#include <QCoreApplication>
+#include "configfile.h"
+
+/*!
+ * \ingroup skaffaricmd
+ * \brief Synchronizes the mailbox usage of all accounts into the accountuser table.
+ *
+ * Requests the storage quota of all accounts from the IMAP server and writes the used storage,
+ * the storage limit and the time of the synchronization into the quota_usage, quota_limit and
+ * usage_updated_at columns of the accountuser table. The web interface reads the usage from these
+ * columns instead of asking the IMAP server for every listed account.
+ *
+ * The accounts are processed in batches. Every batch is split onto a few IMAP connections that
+ * get all their GETQUOTA commands at once, so the server can work on them in parallel while the
+ * responses are read.
+ */
+class UsageSynchronizer : public ConfigFile
+{
+    Q_DECLARE_TR_FUNCTIONS(UsageSynchronizer)
+public:
+    /*!
+     * \brief Constructs a new UsageSynchronizer object.
+     * \param confFile  Absolute path to the configuration file that contains database and IMAP access data.
+     * \param quiet     If \c true, no output will be print to stdout.
+     */
+    explicit UsageSynchronizer(const QString &confFile, bool quiet = false);
+
+    /*!
+     * \brief Starts the synchronization.
+     * \return Returns \c 0 on success.
+     */
+    int exec() const;
+};
+
+#endif // USAGESYNCHRONIZER_H
@@ -31,17 +31,98 @@
 #include <QSqlQuery>
 #include <Cutelyst/Plugins/Authentication/credentialpassword.h>
 #include <QTimeZone>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
 
 #include "database.h"
 #include "imap.h"
+#include "tablecopier.h"
 #include "../common/password.h"
 #include "../common/config.h"
 #include "../common/global.h"
 
 #include <QDebug>
 
-WebCyradmImporter::WebCyradmImporter(const QString &confFileName, const QString &iniFileName) :
-    m_webCyradmConfFile(confFileName), m_iniFile(iniFileName)
+namespace {
+
+QMutex outputMutex;
+
+/*!
+ * \internal
+ * \brief Thread that takes TableCopier objects from a shared queue and executes them.
+ *
+ * Every thread uses its own connections to both databases.
+ */
+class CopyThread : public QThread
+{
+public:
+    CopyThread(std::vector<TableCopier*> *queue, QMutex *queueMutex, const QSqlDatabase &source, const QSqlDatabase &target, int number) :
+        QThread(),
+        m_queue(queue),
+        m_queueMutex(queueMutex),
+        m_source(source),
+        m_target(target),
+        m_number(number)
+    {
+
+    }
+
+    QSqlError error() const { return m_error; }
+
+protected:
+    void run() override
+    {
+        const QString sourceConName = QStringLiteral("webcyradmdb_job%1").arg(m_number);
+        const QString targetConName = QStringLiteral("skaffaridb_job%1").arg(m_number);
+
+        {
+            QSqlDatabase source = QSqlDatabase::cloneDatabase(m_source, sourceConName);
+            QSqlDatabase target = QSqlDatabase::cloneDatabase(m_target, targetConName);
+
+            if (!source.open()) {
+                m_error = source.lastError();
+            } else if (!target.open()) {
+                m_error = target.lastError();
+            } else {
+                for (;;) {
+                    TableCopier *copier = nullptr;
+                    {
+                        QMutexLocker locker(m_queueMutex);
+                        if (m_queue->empty()) {
+                            break;
+                        }
+                        copier = m_queue->front();
+                        m_queue->erase(m_queue->begin());
+                    }
+                    if (!copier->copy(source, target)) {
+                        m_error = copier->lastError();
+                        break;
+                    }
+                }
+            }
+
+            source.close();
+            target.close();
+        }
+
+        QSqlDatabase::removeDatabase(sourceConName);
+        QSqlDatabase::removeDatabase(targetConName);
+    }
+
+private:
+    std::vector<TableCopier*> *m_queue = nullptr;
+    QMutex *m_queueMutex = nullptr;
+    QSqlDatabase m_source;
+    QSqlDatabase m_target;
+    QSqlError m_error;
+    int m_number = 0;
+};
+
+}
+
+WebCyradmImporter::WebCyradmImporter(const QString &confFileName, const QString &iniFileName, int jobs) :
+    m_webCyradmConfFile(confFileName), m_iniFile(iniFileName), m_jobs(qMax(jobs, 1))
 {
 
 }
@@ -447,345 +528,249 @@ int WebCyradmImporter::exec() const
         printDone();
     }
 
-    QSqlQuery wq(wdb.getDb()); // web-cyradm query
     QSqlQuery sq(sdb.getDb()); // Skaffari query
-    QDateTime currentTime = QDateTime::currentDateTimeUtc();
+    const QDateTime currentTime = QDateTime::currentDateTimeUtc();
+
+    // domains are inserted in batches, so the IDs are read back afterwards by name
+    QHash<QString,QStringList> domainNameFolders;
+    TableCopier domains(tr("domains"),
+                        QStringLiteral("domain"),
+                        QStringList({QStringLiteral("domain_name"), QStringLiteral("prefix"), QStringLiteral("maxaccounts"), QStringLiteral("quota"), QStringLiteral("domainquota"), QStringLiteral("transport"), QStringLiteral("freenames"), QStringLiteral("freeaddress"), QStringLiteral("folders")}),
+                        QStringLiteral("domain"),
+                        QStringList({QStringLiteral("domain_name"), QStringLiteral("prefix"), QStringLiteral("maxaccounts"), QStringLiteral("quota"), QStringLiteral("domainquota"), QStringLiteral("transport"), QStringLiteral("freenames"), QStringLiteral("freeaddress"), QStringLiteral("created_at"), QStringLiteral("updated_at")}),
+                        [&domainNameFolders, currentTime](const QSqlQuery &q, QVariantList &row) -> bool {
+        const QString name = q.value(0).toString();
+        row << name << q.value(1) << q.value(2) << q.value(3) << q.value(4) << q.value(5);
+        row << (q.value(6).toString() == QLatin1String("YES")) << (q.value(7).toString() == QLatin1String("YES"));
+        row << currentTime << currentTime;
+        const QStringList folders = q.value(8).toString().split(QLatin1Char(','), QString::SkipEmptyParts);
+        if (!folders.empty()) {
+            domainNameFolders.insert(name, folders);
+        }
+        return true;
+    });
 
-    printStatus(tr("Importing domains"));
-    if (!wq.exec(QStringLiteral("SELECT domain_name, prefix, maxaccounts, quota, domainquota, transport, freenames, freeaddress, folders FROM domain"))) {
-        printFailed();
-        return dbError(wq.lastError());
+    int rc = importTable(domains, wdb.getDb(), sdb.getDb());
+    if (rc != 0) {
+        return rc;
     }
 
-    QHash<QString,dbid_t> domainPrefixId;
     QHash<QString,dbid_t> domainNameId;
-    QHash<dbid_t,QStringList> domainFolders;
-
-    if (sq.prepare(QStringLiteral("INSERT INTO domain (domain_name, prefix, maxaccounts, quota, domainquota, transport, freenames, freeaddress, created_at, updated_at) VALUES (?,?,?,?,?,?,?,?,?,?)"))) {
-        while (wq.next()) {
-            const QString name = wq.value(0).toString();
-            const QString prefix = wq.value(1).toString();
-            sq.addBindValue(name);
-            sq.addBindValue(prefix);
-            sq.addBindValue(wq.value(2));
-            sq.addBindValue(wq.value(3));
-            sq.addBindValue(wq.value(4));
-            sq.addBindValue(wq.value(5));
-            sq.addBindValue(wq.value(6).toString() == QLatin1String("YES"));
-            sq.addBindValue(wq.value(7).toString() == QLatin1String("YES"));
-            sq.addBindValue(currentTime);
-            sq.addBindValue(currentTime);
-
-            const QStringList folders = wq.value(8).toString().split(QLatin1Char(','));
-
-            if (sq.exec()) {
-                const dbid_t id = sq.lastInsertId().value<dbid_t>();
-                domainPrefixId.insert(prefix, id);
-                domainNameId.insert(name, id);
-                if (!folders.empty()) {
-                    domainFolders.insert(id, folders);
-                }
-            } else {
-                printFailed();
-                return dbError(sq.lastError());
-            }
-        }
-    } else {
-        printFailed();
+
+    if (!sq.exec(QStringLiteral("SELECT id, domain_name FROM domain"))) {
         return dbError(sq.lastError());
     }
-
-    printDone(tr("%n domain(s)", "", domainPrefixId.size()));
+    while (sq.next()) {
+        domainNameId.insert(sq.value(1).toString(), sq.value(0).value<dbid_t>());
+    }
 
     printStatus(tr("Importing domain default folders"));
 
-    if (!domainFolders.empty()) {
+    if (!domainNameFolders.empty()) {
+        int folderCount = 0;
+        sdb.getDb().transaction();
         if (sq.prepare(QStringLiteral("INSERT INTO folder (domain_id, name) VALUES (?,?)"))) {
 
-            auto i = domainFolders.constBegin();
-            while (i != domainFolders.constEnd()) {
-                const dbid_t id = i.key();
+            auto i = domainNameFolders.constBegin();
+            while (i != domainNameFolders.constEnd()) {
+                const dbid_t id = domainNameId.value(i.key());
                 const QStringList folders = i.value();
                 for (const QString &folder : folders) {
                     sq.addBindValue(id);
                     sq.addBindValue(folder);
                     if (!sq.exec()) {
                         printFailed();
+                        sdb.getDb().rollback();
                         return dbError(sq.lastError());
                     }
+                    folderCount++;
                 }
                 ++i;
             }
 
         } else {
             printFailed();
+            sdb.getDb().rollback();
             return dbError(sq.lastError());
         }
-        printDone(tr("%n domain(s)", "", domainFolders.size()));
+        if (!sdb.getDb().commit()) {
+            printFailed();
+            return dbError(sdb.getDb().lastError());
+        }
+        printDone(tr("%n folder(s)", "", folderCount));
     } else {
         printDesc(tr("None"));
     }
 
 
-    printStatus(tr("Importing administrator accounts"));
+    TableCopier admins(tr("administrator accounts"),
+                       QStringLiteral("adminuser"),
+                       QStringList({QStringLiteral("username"), QStringLiteral("password"), QStringLiteral("type")}),
+                       QStringLiteral("adminuser"),
+                       QStringList({QStringLiteral("username"), QStringLiteral("password"), QStringLiteral("type"), QStringLiteral("created_at"), QStringLiteral("updated_at")}),
+                       [currentTime](const QSqlQuery &q, QVariantList &row) -> bool {
+        row << q.value(0).toString() << q.value(1).toString() << q.value(2).value<quint8>() << currentTime << currentTime;
+        return true;
+    });
 
-    if (!wq.exec(QStringLiteral("SELECT username, password, type FROM adminuser"))) {
-        printFailed();
-        return dbError(wq.lastError());
+    rc = importTable(admins, wdb.getDb(), sdb.getDb());
+    if (rc != 0) {
+        return rc;
     }
 
     QHash<QString,dbid_t> adminNameIds;
 
-    if (sq.prepare(QStringLiteral("INSERT INTO adminuser (username, password, type, created_at, updated_at) VALUES (?,?,?,?,?)"))) {
-        while (wq.next()) {
-            const QString name = wq.value(0).toString();
-            sq.addBindValue(name);
-            sq.addBindValue(wq.value(1).toString());
-            sq.addBindValue(wq.value(2).value<quint8>());
-            sq.addBindValue(currentTime);
-            sq.addBindValue(currentTime);
-
-            if (sq.exec()) {
-                adminNameIds.insert(name, sq.lastInsertId().value<dbid_t>());
-            } else {
-                printFailed();
-                return dbError(sq.lastError());
-            }
-        }
-        printDone(tr("%n administrator(s)", "", adminNameIds.size()));
-    } else {
-        printFailed();
+    if (!sq.exec(QStringLiteral("SELECT id, username FROM adminuser"))) {
         return dbError(sq.lastError());
     }
-
-    printStatus(tr("Importing administrator to domain connections"));
-
-    if (!wq.exec(QStringLiteral("SELECT domain_name, adminuser FROM domainadmin WHERE domain_name != '*'"))) {
-        printFailed();
-        return dbError(wq.lastError());
+    while (sq.next()) {
+        adminNameIds.insert(sq.value(1).toString(), sq.value(0).value<dbid_t>());
     }
 
-    if (sq.prepare(QStringLiteral("INSERT INTO domainadmin (domain_id, admin_id) VALUES (?,?)"))) {
-        int adminDomainConnectionCount = 0;
-        while (wq.next()) {
-            sq.addBindValue(domainNameId.value(wq.value(0).toString()));
-            sq.addBindValue(adminNameIds.value(wq.value(1).toString()));
 
-            if (!sq.exec()) {
-                printFailed();
-                return dbError(sq.lastError());
-            }
-            adminDomainConnectionCount++;
-        }
-        printDone(tr("%n connection(s)", "", adminDomainConnectionCount));
-    } else {
-        printFailed();
-        return dbError(sq.lastError());
+    TableCopier domainAdmins(tr("administrator to domain connections"),
+                             QStringLiteral("domainadmin"),
+                             QStringList({QStringLiteral("domain_name"), QStringLiteral("adminuser")}),
+                             QStringLiteral("domainadmin"),
+                             QStringList({QStringLiteral("domain_id"), QStringLiteral("admin_id")}),
+                             [&domainNameId, &adminNameIds](const QSqlQuery &q, QVariantList &row) -> bool {
+        row << domainNameId.value(q.value(0).toString()) << adminNameIds.value(q.value(1).toString());
+        return true;
+    });
+    domainAdmins.setFilter(QStringLiteral("domain_name != '*'"));
+
+    rc = importTable(domainAdmins, wdb.getDb(), sdb.getDb());
+    if (rc != 0) {
+        return rc;
     }
 
 
-    printStatus(tr("Importing administrator settings"));
+    TableCopier adminSettings(tr("administrator settings"),
+                              QStringLiteral("settings"),
+                              QStringList({QStringLiteral("username"), QStringLiteral("maxdisplay"), QStringLiteral("warnlevel")}),
+                              QStringLiteral("settings"),
+                              QStringList({QStringLiteral("admin_id"), QStringLiteral("maxdisplay"), QStringLiteral("warnlevel"), QStringLiteral("tz"), QStringLiteral("lang")}),
+                              [&adminNameIds, &defaultTimezone, &defaultLang](const QSqlQuery &q, QVariantList &row) -> bool {
+        row << adminNameIds.value(q.value(0).toString()) << q.value(1) << q.value(2) << defaultTimezone << defaultLang;
+        return true;
+    });
 
-    if (!wq.exec(QStringLiteral("SELECT username, maxdisplay, warnlevel FROM settings"))) {
-        printFailed();
-        return dbError(wq.lastError());
+    rc = importTable(adminSettings, wdb.getDb(), sdb.getDb());
+    if (rc != 0) {
+        return rc;
     }
 
-    if (sq.prepare(QStringLiteral("INSERT INTO settings (admin_id, maxdisplay, warnlevel, tz, lang) VALUES (?,?,?,?,?)"))) {
-        while (wq.next()) {
-            sq.addBindValue(adminNameIds.value(wq.value(0).toString()));
-            sq.addBindValue(wq.value(1));
-            sq.addBindValue(wq.value(2));
-            sq.addBindValue(defaultTimezone);
-            sq.addBindValue(defaultLang);
-
-            if (!sq.exec()) {
-                printFailed();
-                return dbError(sq.lastError());
-            }
-        }
-        printDone(tr("%n administrator(s)", "", adminNameIds.size()));
-    } else {
-        printFailed();
-        return dbError(sq.lastError());
-    }
 
+    TableCopier accounts(tr("user accounts"),
+                         QStringLiteral("accountuser"),
+                         QStringList({QStringLiteral("username"), QStringLiteral("password"), QStringLiteral("domain_name"), QStringLiteral("imap"), QStringLiteral("pop"), QStringLiteral("sieve"), QStringLiteral("smtpauth")}),
+                         QStringLiteral("accountuser"),
+                         QStringList({QStringLiteral("domain_id"), QStringLiteral("username"), QStringLiteral("password"), QStringLiteral("imap"), QStringLiteral("pop"), QStringLiteral("sieve"), QStringLiteral("smtpauth"), QStringLiteral("created_at"), QStringLiteral("updated_at")}),
+                         [&domainNameId, currentTime](const QSqlQuery &q, QVariantList &row) -> bool {
+        row << domainNameId.value(q.value(2).toString()) << q.value(0).toString() << q.value(1) << q.value(3) << q.value(4) << q.value(5) << q.value(6);
+        row << currentTime << currentTime;
+        return true;
+    });
+    accounts.setProgressCallback(progressPrinter());
 
-    printStatus(tr("Importing user accounts and quota"));
+    rc = importTable(accounts, wdb.getDb(), sdb.getDb());
+    if (rc != 0) {
+        return rc;
+    }
 
-    if (!wq.exec(QStringLiteral("SELECT username, password, prefix, domain_name, imap, pop, sieve, smtpauth FROM accountuser"))) {
-        printFailed();
-        return dbError(wq.lastError());
-    }
-
-    if (sq.prepare(QStringLiteral("INSERT INTO accountuser (domain_id, username, password, imap, pop, sieve, smtpauth, quota, created_at, updated_at) "
-                                  "VALUES (?,?,?,?,?,?,?,?,?,?)"))) {
-
-        int usercount = 0;
-        imap.login();
-        while (wq.next()) {
-            const QString username = wq.value(0).toString();
-            const QString domainName = wq.value(3).toString();
-            quota_pair quota = imap.getQuota(username);
-            sq.addBindValue(domainNameId.value(domainName));
-            sq.addBindValue(username);
-            sq.addBindValue(wq.value(1));
-            sq.addBindValue(wq.value(4));
-            sq.addBindValue(wq.value(5));
-            sq.addBindValue(wq.value(6));
-            sq.addBindValue(wq.value(7));
-            sq.addBindValue(quota.second);
-            sq.addBindValue(currentTime);
-            sq.addBindValue(currentTime);
 
-            if (!sq.exec()) {
-                printFailed();
-                return dbError(sq.lastError());
-            }
-            usercount++;
-        }
-        imap.logout();
-        printDone(tr("%n user(s)", "", usercount));
+    printStatus(tr("Importing account quotas"));
 
-    } else {
+    // the quota is only stored on the IMAP server, the GETQUOTA commands are sent in chunks
+    // to not wait for a round trip per account
+    if (!sq.exec(QStringLiteral("SELECT username FROM accountuser"))) {
         printFailed();
         return dbError(sq.lastError());
     }
 
+    QStringList usernames;
+    while (sq.next()) {
+        usernames << sq.value(0).toString();
+    }
 
-    printStatus(tr("Importing virtual entries"));
-
-    if (!wq.exec(QStringLiteral("SELECT alias, dest, username, status FROM virtual"))) {
+    if (!sq.prepare(QStringLiteral("UPDATE accountuser SET quota = ? WHERE username = ?"))) {
         printFailed();
-        return dbError(wq.lastError());
+        return dbError(sq.lastError());
     }
 
-    if (sq.prepare(QStringLiteral("INSERT INTO virtual (alias, dest, username, status) VALUES (?,?,?,?)"))) {
-        int virtualCount = 0;
-        while (wq.next()) {
-            sq.addBindValue(wq.value(0));
-            sq.addBindValue(wq.value(1));
-            sq.addBindValue(wq.value(2));
-            sq.addBindValue(wq.value(3));
+    imap.login();
+    int quotaCount = 0;
+    for (int i = 0; i < usernames.size(); i += 500) {
+        if (!imap.requestQuotas(usernames.mid(i, 500))) {
+            printFailed();
+            imap.logout();
+            return imapError(imap.lastError());
+        }
+        const QHash<QString,quota_pair> quotas = imap.receiveQuotas();
 
+        sdb.getDb().transaction();
+        auto quotaIt = quotas.constBegin();
+        while (quotaIt != quotas.constEnd()) {
+            sq.addBindValue(quotaIt.value().second);
+            sq.addBindValue(quotaIt.key());
             if (!sq.exec()) {
                 printFailed();
+                sdb.getDb().rollback();
+                imap.logout();
                 return dbError(sq.lastError());
             }
-            virtualCount++;
+            ++quotaIt;
         }
-        printDone(tr("%n entrie(s)", "", virtualCount));
-    } else {
-        printFailed();
-        return dbError(sq.lastError());
+        if (!sdb.getDb().commit()) {
+            printFailed();
+            imap.logout();
+            return dbError(sdb.getDb().lastError());
+        }
+        quotaCount += quotas.size();
     }
+    imap.logout();
 
+    printDone(tr("%n user(s)", "", quotaCount));
 
-    printStatus(tr("Importing aliases"));
 
-    if (!wq.exec(QStringLiteral("SELECT alias, dest, username, status FROM alias"))) {
-        printFailed();
-        return dbError(wq.lastError());
+    // the remaining tables do not depend on each other and can be imported concurrently
+    const QStringList addressColumns({QStringLiteral("alias"), QStringLiteral("dest"), QStringLiteral("username"), QStringLiteral("status")});
+    TableCopier virtuals(tr("virtual entries"), QStringLiteral("virtual"), addressColumns, QStringLiteral("virtual"), addressColumns);
+    TableCopier aliases(tr("aliases"), QStringLiteral("alias"), addressColumns, QStringLiteral("alias"), addressColumns);
+    const QStringList logColumns({QStringLiteral("id"), QStringLiteral("msg"), QStringLiteral("user"), QStringLiteral("host"), QStringLiteral("time"), QStringLiteral("pid")});
+    TableCopier logs(tr("log entries"), QStringLiteral("log"), logColumns, QStringLiteral("log"), logColumns);
+    logs.setKeyColumn(QStringLiteral("id"));
+
+    rc = importTables({&virtuals, &aliases, &logs}, wdb.getDb(), sdb.getDb());
+    if (rc != 0) {
+        return rc;
     }
 
-    if (sq.prepare(QStringLiteral("INSERT INTO alias (alias, dest, username, status) VALUES (?,?,?,?)"))) {
-        int aliasCount = 0;
-        while (wq.next()) {
-            sq.addBindValue(wq.value(0));
-            sq.addBindValue(wq.value(1));
-            sq.addBindValue(wq.value(2));
-            sq.addBindValue(wq.value(3));
 
-            if (!sq.exec()) {
-                printFailed();
-                return dbError(sq.lastError());
-            }
-            aliasCount++;
-        }
-        printDone(tr("%n alias(es)", "", aliasCount));
-    } else {
+    printStatus(tr("Updating domain data"));
+
+    if (!sq.exec(QStringLiteral("UPDATE domain d JOIN (SELECT domain_id, COUNT(*) AS users, SUM(quota) AS quotaused FROM accountuser GROUP BY domain_id) a ON a.domain_id = d.id "
+                                "SET d.accountcount = a.users, d.domainquotaused = a.quotaused"))) {
         printFailed();
         return dbError(sq.lastError());
     }
 
+    printDone(tr("%n domain(s)", "", domainNameId.size()));
 
-    printStatus(tr("Importing log entries"));
 
-    if (!wq.exec(QStringLiteral("SELECT id, msg, user, host, time, pid FROM log"))) {
+    printStatus(tr("Rebuilding search index"));
+    if (!sdb.rebuildSearchIndex()) {
         printFailed();
-        return dbError(wq.lastError());
+        return dbError(sdb.lastDbError());
     }
+    printDone();
 
-    if (sq.prepare(QStringLiteral("INSERT INTO log (id, msg, user, host, time, pid) VALUES (?,?,?,?,?,?)"))) {
-        int logEntries = 0;
-        while (wq.next()) {
-            sq.addBindValue(wq.value(0));
-            sq.addBindValue(wq.value(1));
-            sq.addBindValue(wq.value(2));
-            sq.addBindValue(wq.value(3));
-            sq.addBindValue(wq.value(4));
-            sq.addBindValue(wq.value(5));
 
-            if (!sq.exec()) {
-                printFailed();
-                return dbError(sq.lastError());
-            }
-            logEntries++;
-        }
-        printDone(tr("%n entrie(s)", "", logEntries));
-    } else {
+    printStatus(tr("Updating statistics"));
+    if (!sdb.updateStatistics()) {
         printFailed();
-        return dbError(sq.lastError());
-    }
-
-
-
-    printStatus(tr("Updating domain data"));
-
-    auto domainIt = domainPrefixId.constBegin();
-    while (domainIt != domainPrefixId.constEnd()) {
-        quint32 users;
-        quota_size_t quotaused;
-        const dbid_t domainId = domainIt.value();
-        if (sq.prepare(QStringLiteral("SELECT COUNT(*) FROM accountuser WHERE domain_id = ?"))) {
-            sq.addBindValue(domainId);
-            if (sq.exec() && sq.next()) {
-                users = sq.value(0).value<quint32>();
-            } else {
-                printFailed();
-                return dbError(sq.lastError());
-            }
-        } else {
-            printFailed();
-            return dbError(sq.lastError());
-        }
-        if (sq.prepare(QStringLiteral("SELECT SUM(quota) FROM accountuser WHERE domain_id = ?"))) {
-            sq.addBindValue(domainId);
-            if (sq.exec() && sq.next()) {
-                quotaused = sq.value(0).value<quota_size_t>();
-            } else {
-                printFailed();
-                return dbError(sq.lastError());
-            }
-        } else {
-            printFailed();
-            return dbError(sq.lastError());
-        }
-        if (sq.prepare(QStringLiteral("UPDATE domain SET domainquotaused = ?, accountcount = ? WHERE id = ?"))) {
-            sq.addBindValue(quotaused);
-            sq.addBindValue(users);
-            sq.addBindValue(domainId);
-            if (!sq.exec()) {
-                printFailed();
-                return dbError(sq.lastError());
-            }
-        } else {
-            printFailed();
-            return dbError(sq.lastError());
-        }
-        domainIt++;
+        return dbError(sdb.lastDbError());
     }
-
     printDone();
 
 
@@ -884,6 +869,91 @@ int WebCyradmImporter::exec() const
 
 
 
+TableCopier::ProgressCallback WebCyradmImporter::progressPrinter() const
+{
+    return [this](const TableCopier &copier, quint64 rows, double rowsPerSecond) {
+        QMutexLocker locker(&outputMutex);
+        printMessage(tr("Importing %1: %2 rows, %3 rows/s").arg(copier.description(), QString::number(rows), QString::number(rowsPerSecond, 'f', 0)));
+    };
+}
+
+
+
+void WebCyradmImporter::printImportResult(const TableCopier &copier) const
+{
+    printStatus(tr("Imported %1").arg(copier.description()));
+    printDone(tr("%n row(s) in %1 s (%2 rows/s)", "", static_cast<int>(copier.rows())).arg(QString::number(static_cast<double>(copier.elapsed()) / 1000.0, 'f', 1), QString::number(copier.rowsPerSecond(), 'f', 0)));
+}
+
+
+
+int WebCyradmImporter::importTable(TableCopier &copier, const QSqlDatabase &source, const QSqlDatabase &target) const
+{
+    if (!copier.copy(source, target)) {
+        printStatus(tr("Importing %1").arg(copier.description()));
+        printFailed();
+        return dbError(copier.lastError());
+    }
+
+    printImportResult(copier);
+
+    return 0;
+}
+
+
+
+int WebCyradmImporter::importTables(const std::vector<TableCopier*> &copiers, const QSqlDatabase &source, const QSqlDatabase &target) const
+{
+    for (TableCopier *copier : copiers) {
+        copier->setProgressCallback(progressPrinter());
+    }
+
+    if (m_jobs < 2) {
+        for (TableCopier *copier : copiers) {
+            const int rc = importTable(*copier, source, target);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+        return 0;
+    }
+
+    const int threadCount = qMin(m_jobs, static_cast<int>(copiers.size()));
+    printMessage(tr("Importing %n tables concurrently.", "", static_cast<int>(copiers.size())));
+
+    std::vector<TableCopier*> queue = copiers;
+    QMutex queueMutex;
+    std::vector<CopyThread*> threads;
+    threads.reserve(static_cast<std::size_t>(threadCount));
+    for (int i = 0; i < threadCount; ++i) {
+        auto thread = new CopyThread(&queue, &queueMutex, source, target, i + 1);
+        threads.push_back(thread);
+        thread->start();
+    }
+
+    QSqlError error;
+    for (CopyThread *thread : threads) {
+        thread->wait();
+        if ((error.type() == QSqlError::NoError) && (thread->error().type() != QSqlError::NoError)) {
+            error = thread->error();
+        }
+        delete thread;
+    }
+
+    if (error.type() != QSqlError::NoError) {
+        printError(tr("Failed to import tables concurrently."));
+        return dbError(error);
+    }
+
+    for (TableCopier *copier : copiers) {
+        printImportResult(*copier);
+    }
+
+    return 0;
+}
+
+
+
 QString WebCyradmImporter::getArrayEntry(const QString &array, const QString &key) const
 {
     QString result;
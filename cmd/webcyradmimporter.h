@@ -21,7 +21,9 @@
 
 #include <QFileInfo>
 #include <QCoreApplication>
+#include <vector>
 #include "configinput.h"
+#include "tablecopier.h"
 
 /*!
  * \ingroup skaffaricmd
@@ -35,8 +37,9 @@ public:
      * \brief Constructs a new WebCyradmImporter object with the given parameters.
      * \param confFileName  absolute path to the web-cyradm configuration file
      * \param iniFileName   absolute path to the Skaffari configuration file
+     * \param jobs          maximum number of tables that will be imported concurrently
      */
-    WebCyradmImporter(const QString &confFileName, const QString &iniFileName);
+    WebCyradmImporter(const QString &confFileName, const QString &iniFileName, int jobs = 1);
 
     /*!
      * \brief Executes the import routines and returns \c 0 on success.
@@ -46,8 +49,13 @@ public:
 private:
     QFileInfo m_webCyradmConfFile;
     QFileInfo m_iniFile;
+    int m_jobs = 1;
 
     QString getArrayEntry(const QString &array, const QString &key) const;
+    TableCopier::ProgressCallback progressPrinter() const;
+    void printImportResult(const TableCopier &copier) const;
+    int importTable(TableCopier &copier, const QSqlDatabase &source, const QSqlDatabase &target) const;
+    int importTables(const std::vector<TableCopier*> &copiers, const QSqlDatabase &source, const QSqlDatabase &target) const;
 };
 
 #endif // WEBCYRADMIMPORTER_H
@@ -55,6 +55,17 @@ typedef std::pair<quota_size_t,quota_size_t> quota_pair;
 # define SKAFFARI_STRING_TO_DBID(str) str.toULong()
 #endif
 
+/*!
+ * \def SK_FORWARDS_MAX_LENGTH
+ * \brief Maximum length of the comma separated list of forward addresses of an account.
+ *
+ * The list is stored in the dest column of the virtual table that is only indexed by its
+ * first 255 characters.
+ */
+#ifndef SK_FORWARDS_MAX_LENGTH
+# define SK_FORWARDS_MAX_LENGTH 4096
+#endif
+
 #define DEFAULT_FOLDER_TYPES {QStringLiteral("sentFolder"), QStringLiteral("draftsFolder"), QStringLiteral("trashFolder"), QStringLiteral("junkFolder"), QStringLiteral("archiveFolder"), QStringLiteral("otherFolders")}
 
 #endif // SKAFFARIGLOBAL_H
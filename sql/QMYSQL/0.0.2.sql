@@ -0,0 +1,6 @@
+ALTER TABLE accountuser
+  ADD COLUMN quota_usage bigint unsigned NOT NULL DEFAULT 0 AFTER quota,
+  ADD COLUMN quota_limit bigint unsigned NOT NULL DEFAULT 0 AFTER quota_usage,
+  ADD COLUMN usage_updated_at datetime NULL DEFAULT NULL AFTER quota_limit;
+
+UPDATE systeminfo SET val = '0.0.2' WHERE name = 'skaffari_db_version';
@@ -0,0 +1,8 @@
+ALTER TABLE accountuser
+  ADD KEY idx_accountuser_domain_username (domain_id, username),
+  ADD KEY idx_accountuser_domain_created (domain_id, created_at),
+  ADD KEY idx_accountuser_domain_updated (domain_id, updated_at),
+  ADD KEY idx_accountuser_domain_valid (domain_id, valid_until),
+  ADD KEY idx_accountuser_domain_quota (domain_id, quota);
+
+UPDATE systeminfo SET val = '0.0.3' WHERE name = 'skaffari_db_version';
@@ -0,0 +1,13 @@
+CREATE TABLE IF NOT EXISTS account_search (
+  account_id int unsigned NOT NULL,
+  domain_id int unsigned NOT NULL,
+  role tinyint unsigned NOT NULL,
+  trigram char(3) CHARACTER SET utf8 COLLATE utf8_unicode_ci NOT NULL,
+  PRIMARY KEY (domain_id, role, trigram, account_id),
+  KEY idx_account_search_account_id (account_id),
+  FOREIGN KEY account_to_account_search (account_id) REFERENCES accountuser(id) ON DELETE CASCADE
+) ENGINE = InnoDB DEFAULT CHARSET=utf8 COLLATE=utf8_unicode_ci;
+
+-- the table is filled by skaffaricmd after this file has been applied, see Database::rebuildSearchIndex()
+
+UPDATE systeminfo SET val = '0.0.4' WHERE name = 'skaffari_db_version';
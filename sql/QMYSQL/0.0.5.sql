@@ -0,0 +1,21 @@
+CREATE TABLE IF NOT EXISTS job (
+  id int unsigned NOT NULL PRIMARY KEY AUTO_INCREMENT,
+  type tinyint unsigned NOT NULL,
+  status tinyint unsigned NOT NULL DEFAULT 0,
+  object_id int unsigned NOT NULL DEFAULT 0,
+  admin_id int unsigned NOT NULL,
+  lang varchar(20) NOT NULL DEFAULT '',
+  params text,
+  result longtext,
+  progress int unsigned NOT NULL DEFAULT 0,
+  total int unsigned NOT NULL DEFAULT 0,
+  cancel_requested tinyint(1) unsigned NOT NULL DEFAULT 0,
+  created_at datetime NOT NULL DEFAULT '2000-01-01 00:00:00',
+  updated_at datetime NOT NULL DEFAULT '2000-01-01 00:00:00',
+  started_at datetime DEFAULT NULL,
+  finished_at datetime DEFAULT NULL,
+  KEY idx_job_status (status, id),
+  KEY idx_job_object (type, object_id, status)
+) ENGINE = InnoDB DEFAULT CHARSET=utf8 COLLATE=utf8_unicode_ci;
+
+UPDATE systeminfo SET val = '0.0.5' WHERE name = 'skaffari_db_version';
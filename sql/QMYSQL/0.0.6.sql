@@ -0,0 +1,6 @@
+ALTER TABLE accountuser
+  ADD KEY idx_accountuser_valid_status (valid_until, status),
+  ADD KEY idx_accountuser_pwd_status (pwd_expire, status),
+  ADD KEY idx_accountuser_status (status);
+
+UPDATE systeminfo SET val = '0.0.6' WHERE name = 'skaffari_db_version';
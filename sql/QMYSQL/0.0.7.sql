@@ -0,0 +1,8 @@
+CREATE TABLE IF NOT EXISTS account_expiry_change (
+  id int unsigned NOT NULL PRIMARY KEY AUTO_INCREMENT,
+  account_id int unsigned NOT NULL,
+  created_at datetime NOT NULL DEFAULT '2000-01-01 00:00:00',
+  KEY idx_account_expiry_change_created (created_at)
+) ENGINE = InnoDB DEFAULT CHARSET=utf8 COLLATE=utf8_unicode_ci;
+
+UPDATE systeminfo SET val = '0.0.7' WHERE name = 'skaffari_db_version';
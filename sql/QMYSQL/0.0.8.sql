@@ -0,0 +1,15 @@
+ALTER TABLE virtual
+  ADD PRIMARY KEY (id),
+  DROP KEY alias,
+  ADD KEY idx_virtual_alias_username (alias, username),
+  ADD KEY idx_virtual_username_dest (username, dest(255)),
+  ADD KEY idx_virtual_dest (dest(255));
+
+ALTER TABLE accountuser
+  ADD KEY idx_accountuser_created (created_at);
+
+ALTER TABLE domain
+  ADD KEY idx_domain_parent_id (parent_id),
+  ADD KEY idx_domain_idn_id (idn_id);
+
+UPDATE systeminfo SET val = '0.0.8' WHERE name = 'skaffari_db_version';
@@ -0,0 +1,29 @@
+ALTER TABLE accountuser
+  ADD addresscount int NOT NULL DEFAULT 0;
+
+CREATE TABLE IF NOT EXISTS statistics (
+  domain_id int unsigned NOT NULL,
+  domains int NOT NULL DEFAULT 0,
+  accounts int NOT NULL DEFAULT 0,
+  addresses int NOT NULL DEFAULT 0,
+  admins int NOT NULL DEFAULT 0,
+  accountquota bigint NOT NULL DEFAULT 0,
+  domainquota bigint NOT NULL DEFAULT 0,
+  updated_at datetime NOT NULL DEFAULT '2000-01-01 00:00:00',
+  PRIMARY KEY (domain_id)
+) ENGINE = InnoDB DEFAULT CHARSET=latin1;
+
+UPDATE accountuser a
+  LEFT JOIN (SELECT username, COUNT(*) AS cnt FROM virtual WHERE alias LIKE '%@%' AND idn_id = 0 AND username <> '' GROUP BY username) v ON v.username = a.username
+  SET a.addresscount = COALESCE(v.cnt, 0);
+
+INSERT INTO statistics (domain_id, domains, accounts, addresses, admins, accountquota, domainquota, updated_at)
+  SELECT d.id, 1, COUNT(a.id), COALESCE(SUM(a.addresscount), 0), 0, COALESCE(SUM(a.quota), 0), d.domainquota, UTC_TIMESTAMP()
+  FROM domain d LEFT JOIN accountuser a ON a.domain_id = d.id
+  WHERE d.idn_id = 0 GROUP BY d.id, d.domainquota;
+
+INSERT INTO statistics (domain_id, domains, accounts, addresses, admins, accountquota, domainquota, updated_at)
+  SELECT 0, COUNT(*), COALESCE(SUM(accounts), 0), COALESCE(SUM(addresses), 0), (SELECT COUNT(*) FROM adminuser), COALESCE(SUM(accountquota), 0), COALESCE(SUM(domainquota), 0), UTC_TIMESTAMP()
+  FROM statistics WHERE domain_id > 0;
+
+UPDATE systeminfo SET val = '0.0.9' WHERE name = 'skaffari_db_version';
@@ -39,6 +39,7 @@
 #include <Cutelyst/Plugins/Utils/validatorboolean.h>
 #include <Cutelyst/Plugins/Utils/validatorfilesize.h>
 #include <Cutelyst/Plugins/Utils/validatormin.h>
+#include <Cutelyst/Plugins/Utils/validatormax.h>
 #include <Cutelyst/Plugins/Utils/validatortime.h>
 #include <Cutelyst/Plugins/Utils/validatordate.h>
 #ifdef CUTELYST_VALIDATOR_WITH_PWQUALITY
@@ -741,6 +742,7 @@ void AccountEditor::add_forward(Context *c)
 
         static Validator v({
                                new ValidatorRequired(QStringLiteral("newforward")),
+                               new ValidatorMax(QStringLiteral("newforward"), QMetaType::QString, 254),
                                new ValidatorEmail(QStringLiteral("newforward"))
                            });
 
@@ -827,6 +829,7 @@ void AccountEditor::edit_forward(Context *c, const QString &oldForward)
 
         static Validator v({
                                new ValidatorRequired(QStringLiteral("newforward")),
+                               new ValidatorMax(QStringLiteral("newforward"), QMetaType::QString, 254),
                                new ValidatorEmail(QStringLiteral("newforward"))
                            });
 
@@ -958,7 +961,8 @@ void AccountEditor::check(Context *c)
 {
     const bool isAjax = c->req()->xhr();
     static Validator v({
-                           new ValidatorBoolean(QStringLiteral("checkChildAddresses"))
+                           new ValidatorBoolean(QStringLiteral("checkChildAddresses")),
+                           new ValidatorBoolean(QStringLiteral("skipMailboxCheck"))
                        });
 
     const ValidatorResult vr = isAjax ? v.validate(c) : v.validate(c, Validator::FillStashOnError|Validator::BodyParamsOnly);
@@ -18,15 +18,38 @@
 
 #include "authstoresql.h"
 #include "objects/adminaccount.h"
+#include "utils/skaffariconfig.h"
 
 #include <Cutelyst/Plugins/Utils/Sql>
+#include <Cutelyst/Plugins/Memcached/Memcached>
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariantList>
+#include <QVariantHash>
+#include <QCryptographicHash>
 #include <QLoggingCategory>
 
+#define MEMC_AUTHUSER_KEY QLatin1String("sk_authuser_")
+#define MEMC_AUTHUSER_EXP 300
+#define MEMC_AUTHUSER_NOTFOUND_EXP 60
+
 Q_LOGGING_CATEGORY(SK_AUTHSTORE, "skaffari.authstore")
 
+namespace {
+
+/*!
+ * \internal
+ * \brief Returns the memcached key for \a username.
+ *
+ * User names are entered on the login page, so they are hashed to get a valid key.
+ */
+QString cacheKey(const QString &username)
+{
+    return MEMC_AUTHUSER_KEY + QString::fromLatin1(QCryptographicHash::hash(username.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+}
+
 AuthStoreSql::AuthStoreSql(QObject *parent) : AuthenticationStore(parent)
 {
 
@@ -40,10 +63,45 @@ AuthenticationUser AuthStoreSql::findUser(Context *c, const ParamsMultiMap &user
 
     const QString username = userinfo.value(QStringLiteral("username"));
 
+    QString memKey;
+    if (SkaffariConfig::useMemcached()) {
+        memKey = cacheKey(username);
+        Cutelyst::Memcached::MemcachedReturnType memrt = Cutelyst::Memcached::NotFound;
+        const QVariantHash cached = Cutelyst::Memcached::get<QVariantHash>(memKey, nullptr, &memrt);
+        if (memrt == Cutelyst::Memcached::Success) {
+            // an empty entry marks a user name that does not exist
+            if (cached.empty()) {
+                qCWarning(SK_AUTHSTORE, "Can not find user \"%s\" in the database.", qUtf8Printable(username));
+            } else {
+                // the password hash is not cached, so it is the only value requested from the database
+                QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT password FROM adminuser WHERE id = :id"));
+                q.bindValue(QStringLiteral(":id"), cached.value(QStringLiteral("id")));
+                if (Q_LIKELY(q.exec())) {
+                    if (Q_LIKELY(q.next())) {
+                        user.setId(cached.value(QStringLiteral("id")));
+                        for (auto it = cached.constBegin(); it != cached.constEnd(); ++it) {
+                            user.insert(it.key(), it.value());
+                        }
+                        user.insert(QStringLiteral("password"), q.value(0));
+                    } else {
+                        qCWarning(SK_AUTHSTORE, "Can not find user \"%s\" in the database.", qUtf8Printable(username));
+                        clearCache(username);
+                    }
+                } else {
+                    qCCritical(SK_AUTHSTORE, "Failed to execute database query to get the password of user \"%s\" from the database: %s", qUtf8Printable(username), qUtf8Printable(q.lastError().text()));
+                }
+            }
+            return user;
+        }
+    }
+
+    bool found = false;
+
     QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT au.id, au.username, au.password, au.type, au.created_at, au.updated_at, au.valid_until, au.pwd_expire, se.template, se.maxdisplay, se.warnlevel, se.lang, se.tz FROM adminuser au JOIN settings se ON au.id = se.admin_id WHERE au.username = :username AND au.type > 0"));
     q.bindValue(QStringLiteral(":username"), username);
 
     if (Q_LIKELY(q.exec())) {
+        found = true;
         if (Q_LIKELY(q.next())) {
             user.setId(q.value(0));
             user.insert(QStringLiteral("username"),     q.value(1));
@@ -76,11 +134,33 @@ AuthenticationUser AuthStoreSql::findUser(Context *c, const ParamsMultiMap &user
             }
             user.insert(QStringLiteral("domains"), domIds);
         } else {
+            found = false;
             qCCritical(SK_AUTHSTORE, "Failed to execute database query to get associated domain IDs for user \"%s\" from the database: %s", qUtf8Printable(username), qUtf8Printable(q.lastError().text()));
         }
     }
 
+    // do not cache incomplete results caused by database errors
+    if (found && !memKey.isEmpty()) {
+        QVariantHash cached;
+        if (!user.isNull()) {
+            for (auto it = user.constBegin(); it != user.constEnd(); ++it) {
+                cached.insert(it.key(), it.value());
+            }
+            // never put the password hash into the shared cache
+            cached.remove(QStringLiteral("password"));
+            cached.insert(QStringLiteral("id"), user.id());
+        }
+        Cutelyst::Memcached::set<QVariantHash>(memKey, cached, cached.empty() ? MEMC_AUTHUSER_NOTFOUND_EXP : MEMC_AUTHUSER_EXP);
+    }
+
     return user;
 }
 
+void AuthStoreSql::clearCache(const QString &username)
+{
+    if (SkaffariConfig::useMemcached()) {
+        Cutelyst::Memcached::remove(cacheKey(username));
+    }
+}
+
 #include "moc_authstoresql.cpp"
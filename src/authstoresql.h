@@ -26,6 +26,11 @@ using namespace Cutelyst;
 /*!
  * \ingroup skaffaricore
  * \brief SQL based Cutelyst authentication store.
+ *
+ * If memcached is enabled, the users found in the database will be cached together with their
+ * associated domain IDs. The password hash is not cached, on a cache hit only the password is
+ * queried from the database. User names that could not be found are cached for a shorter time, so
+ * repeated login attempts with unknown user names do not hit the database.
  */
 class AuthStoreSql : public AuthenticationStore
 {
@@ -34,6 +39,13 @@ public:
     explicit AuthStoreSql(QObject *parent = nullptr);
     
     AuthenticationUser findUser(Context *c, const ParamsMultiMap &userinfo) override;
+
+    /*!
+     * \brief Removes the cached data for the administrator identified by \a username.
+     *
+     * Has to be called after an administrator account has been created, changed or removed.
+     */
+    static void clearCache(const QString &username);
 };
 
 #endif // AUTHSTORESQL_H
@@ -18,6 +18,8 @@
 
 #include "autoconfig.h"
 #include "utils/skaffariconfig.h"
+#include "utils/autoconfigcache.h"
+#include "utils/autoconfigguard.h"
 #include "objects/autoconfigserver.h"
 #include "objects/skaffarierror.h"
 #include <Cutelyst/Plugins/Utils/validatoremail.h>
@@ -25,10 +27,11 @@
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QUrl>
-#include <QDomDocument>
-#include <QDomElement>
-#include <QDomAttr>
-#include <QDomText>
+#include <QXmlStreamWriter>
+#include <QCryptographicHash>
+#include <QStringList>
+
+#define SK_AUTOCONFIG_MAX_AGE "private, max-age=300"
 
 Q_LOGGING_CATEGORY(SK_AUTOCONFIG, "skaffari.autoconfig")
 
@@ -63,169 +66,211 @@ void Autoconfig::index(Context *c)
         return;
     }
 
-    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT username FROM virtual WHERE alias = :alias"));
-    q.bindValue(QStringLiteral(":alias"), email);
-
-    if (Q_UNLIKELY(!q.exec())) {
-        qCCritical(SK_AUTOCONFIG, "Failed to query database for username: %s", qUtf8Printable(q.lastError().text()));
-        c->res()->setBody(c->translate("Autoconfig", "SQL query failed."));
-        c->res()->setStatus(Response::InternalServerError);
-        return;
-    }
+    const AutoconfigCache cache;
 
-    const QString username = q.next() ? q.value(0).toString() : QString();
+    QString username = cache.username(email);
 
     if (username.isEmpty()) {
-        qCWarning(SK_AUTOCONFIG, "Autoconfiguration requested for unknown email address %s from %s", qUtf8Printable(email), qUtf8Printable(c->req()->addressString()));
-        c->res()->setBody(c->translate("Autoconfig", "Email address not found."));
-        c->res()->setStatus(Response::NotFound);
-        return;
+        if (AutoconfigGuard::isKnownMissing(email)) {
+            c->res()->setBody(c->translate("Autoconfig", "Email address not found."));
+            c->res()->setStatus(Response::NotFound);
+            return;
+        }
+
+        int retryAfter = 0;
+        const QString clientAddress = AutoconfigGuard::clientAddress(c->req()->address(), c->req()->header(QStringLiteral("X-Forwarded-For")), SkaffariConfig::trustedProxies());
+        if (!AutoconfigGuard::acquire(clientAddress, SkaffariConfig::autoconfigRatelimit(), &retryAfter)) {
+            qCWarning(SK_AUTOCONFIG, "Rejected autoconfig lookup for %s from %s: rate limit exceeded.", qUtf8Printable(email), qUtf8Printable(clientAddress));
+            c->res()->setHeader(QStringLiteral("Retry-After"), QString::number(retryAfter));
+            c->res()->setBody(c->translate("Autoconfig", "Too many requests."));
+            c->res()->setStatus(429);
+            return;
+        }
+
+        QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT username FROM virtual WHERE alias = :alias"));
+        q.bindValue(QStringLiteral(":alias"), email);
+
+        if (Q_UNLIKELY(!q.exec())) {
+            qCCritical(SK_AUTOCONFIG, "Failed to query database for username: %s", qUtf8Printable(q.lastError().text()));
+            c->res()->setBody(c->translate("Autoconfig", "SQL query failed."));
+            c->res()->setStatus(Response::InternalServerError);
+            return;
+        }
+
+        username = q.next() ? q.value(0).toString() : QString();
+
+        if (username.isEmpty()) {
+            qCWarning(SK_AUTOCONFIG, "Autoconfiguration requested for unknown email address %s from %s", qUtf8Printable(email), qUtf8Printable(c->req()->addressString()));
+            AutoconfigGuard::addMissing(email);
+            c->res()->setBody(c->translate("Autoconfig", "Email address not found."));
+            c->res()->setStatus(Response::NotFound);
+            return;
+        }
+
+        cache.setUsername(email, username);
     }
 
     const QString mailDomain = email.mid(email.lastIndexOf(QLatin1Char('@')) + 1);
 
-    q = CPreparedSqlQueryThread(QStringLiteral("SELECT id, autoconfig FROM domain WHERE domain_name = :domain_name"));
-    q.bindValue(QStringLiteral(":domain_name"), mailDomain);
+    QList<QByteArray> segments = cache.document(AutoconfigCache::Autoconfig, mailDomain);
 
-    if (Q_UNLIKELY(!q.exec())) {
-        qCCritical(SK_AUTOCONFIG, "Failed to query database for domain’s autoconfig strategy.");
-        c->res()->setBody(c->translate("Autoconfig", "SQL query failed."));
-        c->res()->setStatus(Response::InternalServerError);
-        return;
-    }
+    if (segments.empty()) {
+        QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT id, autoconfig FROM domain WHERE domain_name = :domain_name"));
+        q.bindValue(QStringLiteral(":domain_name"), mailDomain);
 
-    if (Q_UNLIKELY(!q.next())) {
-        qCCritical(SK_AUTOCONFIG, "Can not find autoconfig strategy for domain %s.", qUtf8Printable(mailDomain));
-        c->res()->setBody(c->translate("Autoconfig", "Domain not found."));
-        c->res()->setStatus(Response::NotFound);
-        return;
-    }
+        if (Q_UNLIKELY(!q.exec())) {
+            qCCritical(SK_AUTOCONFIG, "Failed to query database for domain’s autoconfig strategy.");
+            c->res()->setBody(c->translate("Autoconfig", "SQL query failed."));
+            c->res()->setStatus(Response::InternalServerError);
+            return;
+        }
 
-    const dbid_t domainId = q.value(0).value<dbid_t>();
-    const qint8 autoconfigStrategy = q.value(1).value<qint8>();
+        if (Q_UNLIKELY(!q.next())) {
+            qCCritical(SK_AUTOCONFIG, "Can not find autoconfig strategy for domain %s.", qUtf8Printable(mailDomain));
+            c->res()->setBody(c->translate("Autoconfig", "Domain not found."));
+            c->res()->setStatus(Response::NotFound);
+            return;
+        }
 
-    if (autoconfigStrategy == 0) {
-        c->res()->setBody(c->translate("Autoconfig", "Autoconfig is not enabled."));
-        c->res()->setStatus(Response::NotFound);
-        return;
-    }
+        const dbid_t domainId = q.value(0).value<dbid_t>();
+        const qint8 autoconfigStrategy = q.value(1).value<qint8>();
 
-    SkaffariError e(c);
-    const std::vector<AutoconfigServer> servers = autoconfigStrategy == 1 ? AutoconfigServer::list(c, 0, e) : AutoconfigServer::list(c, domainId, e);
+        if (autoconfigStrategy == 0) {
+            c->res()->setBody(c->translate("Autoconfig", "Autoconfig is not enabled."));
+            c->res()->setStatus(Response::NotFound);
+            return;
+        }
 
-    if (e.type() != SkaffariError::NoError) {
-        c->res()->setStatus(Response::InternalServerError);
-        c->res()->setBody(e.type() == SkaffariError::SqlError ? c->translate("Autoconfig", "SQL query failed.") : c->translate("Autoconfig", "Internal server error."));
-        return;
-    }
+        SkaffariError e(c);
+        const std::vector<AutoconfigServer> servers = autoconfigStrategy == 1 ? AutoconfigServer::list(c, 0, e) : AutoconfigServer::list(c, domainId, e);
 
-    if (servers.empty()) {
-        qCWarning(SK_AUTOCONFIG, "No autoconfig servers found for domain ID %u.", domainId);
-        c->res()->setBody(c->translate("Autoconfig", "Autoconfig is not enabled."));
-        c->res()->setStatus(Response::NotFound);
-        return;
+        if (e.type() != SkaffariError::NoError) {
+            c->res()->setStatus(Response::InternalServerError);
+            c->res()->setBody(e.type() == SkaffariError::SqlError ? c->translate("Autoconfig", "SQL query failed.") : c->translate("Autoconfig", "Internal server error."));
+            return;
+        }
+
+        if (servers.empty()) {
+            qCWarning(SK_AUTOCONFIG, "No autoconfig servers found for domain ID %u.", domainId);
+            c->res()->setBody(c->translate("Autoconfig", "Autoconfig is not enabled."));
+            c->res()->setStatus(Response::NotFound);
+            return;
+        }
+
+        segments = AutoconfigCache::split(clientConfig(mailDomain, servers));
+        cache.setDocument(AutoconfigCache::Autoconfig, mailDomain, segments);
     }
 
-    QStringList providerDomains{SkaffariConfig::autoconfigId()};
-    if (SkaffariConfig::autoconfigId() != mailDomain) {
-        providerDomains.push_back(mailDomain);
+    const QByteArray body = AutoconfigCache::render(segments, username);
+    const QString etag = QLatin1Char('"') + QString::fromLatin1(QCryptographicHash::hash(body, QCryptographicHash::Sha1).toHex()) + QLatin1Char('"');
+
+    c->res()->setHeader(QStringLiteral("ETag"), etag);
+    c->res()->setHeader(QStringLiteral("Cache-Control"), QStringLiteral(SK_AUTOCONFIG_MAX_AGE));
+
+    const QString ifNoneMatch = c->req()->header(QStringLiteral("If-None-Match"));
+    if (!ifNoneMatch.isEmpty()) {
+        const QStringList tags = ifNoneMatch.split(QLatin1Char(','), QString::SkipEmptyParts);
+        for (const QString &tag : tags) {
+            QString t = tag.trimmed();
+            if (t.startsWith(QLatin1String("W/"))) {
+                t.remove(0, 2);
+            }
+            if (t == etag || t == QLatin1String("*")) {
+                c->res()->setStatus(Response::NotModified);
+                return;
+            }
+        }
     }
 
-    QDomDocument xml;
+    c->res()->setBody(body);
+    c->res()->setContentType(QStringLiteral("text/xml; charset=utf-8"));
+}
 
-    auto root = xml.createElement(QStringLiteral("clientConfig"));
-    root.setAttribute(QStringLiteral("version"), QStringLiteral("1.1"));
-    xml.appendChild(root);
+QByteArray Autoconfig::clientConfig(const QString &mailDomain, const std::vector<AutoconfigServer> &servers)
+{
+    QByteArray out;
+    QXmlStreamWriter xml(&out);
+    xml.setAutoFormatting(true);
+    xml.setAutoFormattingIndent(2);
 
-    auto provider = xml.createElement(QStringLiteral("emailProvider"));
-    provider.setAttribute(QStringLiteral("id"), SkaffariConfig::autoconfigId());
-    root.appendChild(provider);
+    xml.writeStartDocument();
 
-    for (const QString &d : providerDomains) {
-        auto providerDomain = xml.createElement(QStringLiteral("domain"));
-        provider.appendChild(providerDomain);
-        providerDomain.appendChild(xml.createTextNode(d));
-    }
+    xml.writeStartElement(QStringLiteral("clientConfig"));
+    xml.writeAttribute(QStringLiteral("version"), QStringLiteral("1.1"));
 
-    auto displayName = xml.createElement(QStringLiteral("displayName"));
-    provider.appendChild(displayName);
-    displayName.appendChild(xml.createTextNode(SkaffariConfig::autoconfigDisplayName()));
+    xml.writeStartElement(QStringLiteral("emailProvider"));
+    xml.writeAttribute(QStringLiteral("id"), SkaffariConfig::autoconfigId());
 
-    auto displayShortName = xml.createElement(QStringLiteral("displayShortName"));
-    provider.appendChild(displayShortName);
-    displayShortName.appendChild(xml.createTextNode(SkaffariConfig::autoconfigDisplayNameShort()));
+    xml.writeTextElement(QStringLiteral("domain"), SkaffariConfig::autoconfigId());
+    if (SkaffariConfig::autoconfigId() != mailDomain) {
+        xml.writeTextElement(QStringLiteral("domain"), mailDomain);
+    }
+
+    xml.writeTextElement(QStringLiteral("displayName"), SkaffariConfig::autoconfigDisplayName());
+    xml.writeTextElement(QStringLiteral("displayShortName"), SkaffariConfig::autoconfigDisplayNameShort());
 
     for (const AutoconfigServer &server : servers) {
-        QDomElement s;
         switch (server.type()) {
         case AutoconfigServer::Imap:
-            s = xml.createElement(QStringLiteral("incomingServer"));
-            s.setAttribute(QStringLiteral("type"), QStringLiteral("imap"));
+            xml.writeStartElement(QStringLiteral("incomingServer"));
+            xml.writeAttribute(QStringLiteral("type"), QStringLiteral("imap"));
             break;
         case AutoconfigServer::Pop3:
-            s = xml.createElement(QStringLiteral("incomingServer"));
-            s.setAttribute(QStringLiteral("type"), QStringLiteral("pop3"));
+            xml.writeStartElement(QStringLiteral("incomingServer"));
+            xml.writeAttribute(QStringLiteral("type"), QStringLiteral("pop3"));
             break;
         case AutoconfigServer::Smtp:
-            s = xml.createElement(QStringLiteral("outgoingServer"));
-            s.setAttribute(QStringLiteral("type"), QStringLiteral("smtp"));
+            xml.writeStartElement(QStringLiteral("outgoingServer"));
+            xml.writeAttribute(QStringLiteral("type"), QStringLiteral("smtp"));
             break;
         }
-        provider.appendChild(s);
 
-        auto host = xml.createElement(QStringLiteral("hostname"));
-        s.appendChild(host);
-        host.appendChild(xml.createTextNode(server.hostname()));
+        xml.writeTextElement(QStringLiteral("hostname"), server.hostname());
+        xml.writeTextElement(QStringLiteral("port"), QString::number(server.port()));
 
-        auto port = xml.createElement(QStringLiteral("port"));
-        s.appendChild(port);
-        port.appendChild(xml.createTextNode(QString::number(server.port())));
-
-        auto socketType = xml.createElement(QStringLiteral("socketType"));
-        s.appendChild(socketType);
         switch (server.socketType()) {
         case AutoconfigServer::Plain:
-            socketType.appendChild(xml.createTextNode(QStringLiteral("plain")));
+            xml.writeTextElement(QStringLiteral("socketType"), QStringLiteral("plain"));
             break;
         case AutoconfigServer::StartTls:
-            socketType.appendChild(xml.createTextNode(QStringLiteral("STARTTLS")));
+            xml.writeTextElement(QStringLiteral("socketType"), QStringLiteral("STARTTLS"));
             break;
         case AutoconfigServer::Ssl:
-            socketType.appendChild(xml.createTextNode(QStringLiteral("SSL")));
+            xml.writeTextElement(QStringLiteral("socketType"), QStringLiteral("SSL"));
             break;
         }
 
-        auto authentication = xml.createElement(QStringLiteral("authentication"));
-        s.appendChild(authentication);
         switch (server.authentication()) {
         case AutoconfigServer::Cleartext:
-            authentication.appendChild(xml.createTextNode(QStringLiteral("password-cleartext")));
+            xml.writeTextElement(QStringLiteral("authentication"), QStringLiteral("password-cleartext"));
             break;
         case AutoconfigServer::Encrypted:
-            authentication.appendChild(xml.createTextNode(QStringLiteral("password-encrypted")));
+            xml.writeTextElement(QStringLiteral("authentication"), QStringLiteral("password-encrypted"));
             break;
         case AutoconfigServer::Ntlm:
-            authentication.appendChild(xml.createTextNode(QStringLiteral("NTLM")));
+            xml.writeTextElement(QStringLiteral("authentication"), QStringLiteral("NTLM"));
             break;
         case AutoconfigServer::Gssapi:
-            authentication.appendChild(xml.createTextNode(QStringLiteral("GSSAPI")));
+            xml.writeTextElement(QStringLiteral("authentication"), QStringLiteral("GSSAPI"));
             break;
         case AutoconfigServer::ClientIpAddress:
-            authentication.appendChild(xml.createTextNode(QStringLiteral("client-IP-address")));
+            xml.writeTextElement(QStringLiteral("authentication"), QStringLiteral("client-IP-address"));
             break;
         case AutoconfigServer::TlsClientCert:
-            authentication.appendChild(xml.createTextNode(QStringLiteral("TLS-client-cert")));
+            xml.writeTextElement(QStringLiteral("authentication"), QStringLiteral("TLS-client-cert"));
             break;
         }
 
-        auto user = xml.createElement(QStringLiteral("username"));
-        s.appendChild(user);
-        user.appendChild(xml.createTextNode(username));
+        xml.writeStartElement(QStringLiteral("username"));
+        AutoconfigCache::writeUsernamePlaceholder(&xml);
+        xml.writeEndElement();
 
+        xml.writeEndElement();
     }
 
-    c->res()->setBody(xml.toString(2));
-    c->res()->setContentType(QStringLiteral("text/xml; charset=utf-8"));
+    xml.writeEndDocument();
+
+    return out;
 }
 
 #include "moc_autoconfig.cpp"
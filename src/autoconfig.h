@@ -21,11 +21,14 @@
 
 #include <Cutelyst/Controller>
 #include <QLoggingCategory>
+#include <vector>
 
 Q_DECLARE_LOGGING_CATEGORY(SK_AUTOCONFIG)
 
 using namespace Cutelyst;
 
+class AutoconfigServer;
+
 /*!
  * \ingroup skaffaricontrollers
  * \brief Controller for the Microsoft autoconfiguration feature.
@@ -39,6 +42,9 @@ public:
 
     C_ATTR(index, :Path)
     void index(Context *c);
+
+private:
+    static QByteArray clientConfig(const QString &mailDomain, const std::vector<AutoconfigServer> &servers);
 };
 
 #endif // AUTOCONFIG_H
@@ -18,6 +18,9 @@
 
 #include "autodiscover.h"
 #include "utils/skaffariconfig.h"
+#include "utils/autoconfigcache.h"
+#include "utils/autoconfigguard.h"
+#include "utils/autodiscoverrequest.h"
 #include "objects/autoconfigserver.h"
 #include "objects/skaffarierror.h"
 #include <Cutelyst/Plugins/Utils/validatoremail.h>
@@ -25,10 +28,7 @@
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QUrl>
-#include <QDomDocument>
-#include <QDomElement>
-#include <QDomAttr>
-#include <QDomText>
+#include <QXmlStreamWriter>
 #include <QTime>
 #include <QDateTime>
 #include <QCryptographicHash>
@@ -75,18 +75,23 @@ void Autodiscover::index(Context *c)
             return;
         }
 
-        QDomDocument xml;
-        QString errorMsg;
+        AutodiscoverRequest request;
+        const AutodiscoverRequest::Result result = request.parse(c->req()->body());
+        c->req()->body()->close();
+
+        if (result == AutodiscoverRequest::TooLarge) {
+            qCWarning(SK_AUTODISCOVER, "Autodiscover request from %s exceeds the maximum size of %i bytes.", qUtf8Printable(c->req()->addressString()), SK_AUTODISCOVER_MAX_REQUEST_SIZE);
+            setError(c, Response::RequestEntityTooLarge, c->translate("Autodiscover", "Request XML is too large."), 600);
+            return;
+        }
 
-        if (!xml.setContent(c->req()->body(), &errorMsg)) {
+        if (result == AutodiscoverRequest::InvalidXml) {
             qCWarning(SK_AUTODISCOVER, "%s", "Failed to parse autodiscover request xml.");
-            setError(c, Response::BadRequest, c->translate("Autodiscover", "Failed to parse request XML: %1").arg(errorMsg), 600);
-            c->req()->body()->close();
+            setError(c, Response::BadRequest, c->translate("Autodiscover", "Failed to parse request XML: %1").arg(request.errorString()), 600);
             return;
         }
-        c->req()->body()->close();
 
-        email = xml.documentElement().firstChildElement(QStringLiteral("Request")).firstChildElement(QStringLiteral("EMailAddress")).text();
+        email = request.emailAddress();
     }
 
     if (email.isEmpty()) {
@@ -101,163 +106,160 @@ void Autodiscover::index(Context *c)
         return;
     }
 
-    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT username FROM virtual WHERE alias = :alias"));
-    q.bindValue(QStringLiteral(":alias"), email);
-
-    if (Q_UNLIKELY(!q.exec())) {
-        qCCritical(SK_AUTODISCOVER, "Failed to query database for username: %s", qUtf8Printable(q.lastError().text()));
-        setError(c, Response::InternalServerError, c->translate("Autodiscover", "Internal server error."), 603);
-        return;
-    }
+    const AutoconfigCache cache;
 
-    const QString username = q.next() ? q.value(0).toString() : QString();
+    QString username = cache.username(email);
 
     if (username.isEmpty()) {
-        qCWarning(SK_AUTODISCOVER, "Autoconfiguration requested for unknown email address %s from %s", qUtf8Printable(email), qUtf8Printable(c->req()->addressString()));
-        setError(c, Response::NotFound, c->translate("Autodiscover", "Email address not found."), 500);
-        return;
+        if (AutoconfigGuard::isKnownMissing(email)) {
+            setError(c, Response::NotFound, c->translate("Autodiscover", "Email address not found."), 500);
+            return;
+        }
+
+        int retryAfter = 0;
+        const QString clientAddress = AutoconfigGuard::clientAddress(c->req()->address(), c->req()->header(QStringLiteral("X-Forwarded-For")), SkaffariConfig::trustedProxies());
+        if (!AutoconfigGuard::acquire(clientAddress, SkaffariConfig::autoconfigRatelimit(), &retryAfter)) {
+            qCWarning(SK_AUTODISCOVER, "Rejected autodiscover lookup for %s from %s: rate limit exceeded.", qUtf8Printable(email), qUtf8Printable(clientAddress));
+            c->res()->setHeader(QStringLiteral("Retry-After"), QString::number(retryAfter));
+            setError(c, Response::ServiceUnavailable, c->translate("Autodiscover", "Too many requests."), 603);
+            return;
+        }
+
+        QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT username FROM virtual WHERE alias = :alias"));
+        q.bindValue(QStringLiteral(":alias"), email);
+
+        if (Q_UNLIKELY(!q.exec())) {
+            qCCritical(SK_AUTODISCOVER, "Failed to query database for username: %s", qUtf8Printable(q.lastError().text()));
+            setError(c, Response::InternalServerError, c->translate("Autodiscover", "Internal server error."), 603);
+            return;
+        }
+
+        username = q.next() ? q.value(0).toString() : QString();
+
+        if (username.isEmpty()) {
+            qCWarning(SK_AUTODISCOVER, "Autoconfiguration requested for unknown email address %s from %s", qUtf8Printable(email), qUtf8Printable(c->req()->addressString()));
+            AutoconfigGuard::addMissing(email);
+            setError(c, Response::NotFound, c->translate("Autodiscover", "Email address not found."), 500);
+            return;
+        }
+
+        cache.setUsername(email, username);
     }
 
     qCInfo(SK_AUTODISCOVER, "Autodiscover requested for email address \"%s\".", qUtf8Printable(email));
 
     const QString mailDomain = email.mid(email.lastIndexOf(QLatin1Char('@')) + 1);
 
-    q = CPreparedSqlQueryThread(QStringLiteral("SELECT id, autoconfig FROM domain WHERE domain_name = :domain_name"));
-    q.bindValue(QStringLiteral(":domain_name"), mailDomain);
+    QList<QByteArray> segments = cache.document(AutoconfigCache::Autodiscover, mailDomain);
 
-    if (Q_UNLIKELY(!q.exec())) {
-        qCCritical(SK_AUTODISCOVER, "Failed to query database for domain’s autoconfig strategy.");
-        setError(c, Response::InternalServerError, c->translate("Autodiscover", "Internal server error."), 603);
-        return;
-    }
+    if (segments.empty()) {
+        QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT id, autoconfig FROM domain WHERE domain_name = :domain_name"));
+        q.bindValue(QStringLiteral(":domain_name"), mailDomain);
 
-    if (Q_UNLIKELY(!q.next())) {
-        qCCritical(SK_AUTODISCOVER, "Can not find autoconfig strategy for domain %s.", qUtf8Printable(mailDomain));
-        setError(c, Response::InternalServerError, c->translate("Autodiscover", "Can not determine autoconfiguration."), 602);
-        return;
-    }
+        if (Q_UNLIKELY(!q.exec())) {
+            qCCritical(SK_AUTODISCOVER, "Failed to query database for domain’s autoconfig strategy.");
+            setError(c, Response::InternalServerError, c->translate("Autodiscover", "Internal server error."), 603);
+            return;
+        }
+
+        if (Q_UNLIKELY(!q.next())) {
+            qCCritical(SK_AUTODISCOVER, "Can not find autoconfig strategy for domain %s.", qUtf8Printable(mailDomain));
+            setError(c, Response::InternalServerError, c->translate("Autodiscover", "Can not determine autoconfiguration."), 602);
+            return;
+        }
 
-    const dbid_t domainId = q.value(0).value<dbid_t>();
-    const qint8 autoconfigStrategy = q.value(1).value<qint8>();
+        const dbid_t domainId = q.value(0).value<dbid_t>();
+        const qint8 autoconfigStrategy = q.value(1).value<qint8>();
 
-    if (autoconfigStrategy == 0) {
-        setError(c, Response::NotFound, c->translate("Autodiscover", "Autodiscover is not enabled."), 601);
-        return;
-    }
+        if (autoconfigStrategy == 0) {
+            setError(c, Response::NotFound, c->translate("Autodiscover", "Autodiscover is not enabled."), 601);
+            return;
+        }
 
-    SkaffariError e(c);
-    const std::vector<AutoconfigServer> servers = autoconfigStrategy == 1 ? AutoconfigServer::list(c, 0, e) : AutoconfigServer::list(c, domainId, e);
+        SkaffariError e(c);
+        const std::vector<AutoconfigServer> servers = autoconfigStrategy == 1 ? AutoconfigServer::list(c, 0, e) : AutoconfigServer::list(c, domainId, e);
 
-    if (e.type() != SkaffariError::NoError) {
-        setError(c, Response::InternalServerError, c->translate("Autodiscover", "Internal server error."), 603);
-        return;
-    }
+        if (e.type() != SkaffariError::NoError) {
+            setError(c, Response::InternalServerError, c->translate("Autodiscover", "Internal server error."), 603);
+            return;
+        }
 
-    if (servers.empty()) {
-        qCWarning(SK_AUTODISCOVER, "No autoconfig servers found for domain ID %u.", domainId);
-        setError(c, Response::InternalServerError, c->translate("Autodiscover", "Can not determine autoconfiguration."), 602);
-        return;
+        if (servers.empty()) {
+            qCWarning(SK_AUTODISCOVER, "No autoconfig servers found for domain ID %u.", domainId);
+            setError(c, Response::InternalServerError, c->translate("Autodiscover", "Can not determine autoconfiguration."), 602);
+            return;
+        }
+
+        segments = AutoconfigCache::split(response(servers));
+        cache.setDocument(AutoconfigCache::Autodiscover, mailDomain, segments);
     }
 
-    QDomDocument xml;
-    auto autodiscover = xml.createElement(QStringLiteral("Autodiscover"));
-    autodiscover.setAttribute(QStringLiteral("xmlns"), QStringLiteral("http://schemas.microsoft.com/exchange/autodiscover/responseschema/2006"));
-    xml.appendChild(autodiscover);
+    c->res()->setBody(AutoconfigCache::render(segments, username));
+    c->res()->setContentType(QStringLiteral("application/xml"));
+}
+
+QByteArray Autodiscover::response(const std::vector<AutoconfigServer> &servers)
+{
+    QByteArray out;
+    QXmlStreamWriter xml(&out);
+    xml.setAutoFormatting(true);
+    xml.setAutoFormattingIndent(4);
 
-    auto response = xml.createElement(QStringLiteral("Response"));
-    response.setAttribute(QStringLiteral("xmlns"), QStringLiteral("http://schemas.microsoft.com/exchange/autodiscover/outlook/responseschema/2006a"));
-    autodiscover.appendChild(response);
+    xml.writeStartDocument();
 
-    auto account = xml.createElement(QStringLiteral("Account"));
-    response.appendChild(account);
+    xml.writeStartElement(QStringLiteral("Autodiscover"));
+    xml.writeDefaultNamespace(QStringLiteral("http://schemas.microsoft.com/exchange/autodiscover/responseschema/2006"));
 
-    auto accountType = xml.createElement(QStringLiteral("AccountType"));
-    account.appendChild(accountType);
-    accountType.appendChild(xml.createTextNode(QStringLiteral("email")));
+    xml.writeStartElement(QStringLiteral("Response"));
+    xml.writeDefaultNamespace(QStringLiteral("http://schemas.microsoft.com/exchange/autodiscover/outlook/responseschema/2006a"));
 
-    auto action = xml.createElement(QStringLiteral("Action"));
-    account.appendChild(action);
-    action.appendChild(xml.createTextNode(QStringLiteral("settings")));
+    xml.writeStartElement(QStringLiteral("Account"));
+    xml.writeTextElement(QStringLiteral("AccountType"), QStringLiteral("email"));
+    xml.writeTextElement(QStringLiteral("Action"), QStringLiteral("settings"));
 
     for (const AutoconfigServer &server : servers) {
-        auto proto = xml.createElement(QStringLiteral("Protocol"));
-        account.appendChild(proto);
+        xml.writeStartElement(QStringLiteral("Protocol"));
 
-        auto serverType = xml.createElement(QStringLiteral("Type"));
-        proto.appendChild(serverType);
         switch(server.type()) {
         case AutoconfigServer::Imap:
-            serverType.appendChild(xml.createTextNode(QStringLiteral("IMAP")));
+            xml.writeTextElement(QStringLiteral("Type"), QStringLiteral("IMAP"));
             break;
         case AutoconfigServer::Pop3:
-            serverType.appendChild(xml.createTextNode(QStringLiteral("POP3")));
+            xml.writeTextElement(QStringLiteral("Type"), QStringLiteral("POP3"));
             break;
         case AutoconfigServer::Smtp:
-            serverType.appendChild(xml.createTextNode(QStringLiteral("SMTP")));
+            xml.writeTextElement(QStringLiteral("Type"), QStringLiteral("SMTP"));
             break;
         }
 
-        auto hostname = xml.createElement(QStringLiteral("Server"));
-        proto.appendChild(hostname);
-        hostname.appendChild(xml.createTextNode(server.hostname()));
+        xml.writeTextElement(QStringLiteral("Server"), server.hostname());
+        xml.writeTextElement(QStringLiteral("Port"), QString::number(server.port()));
 
-        auto port = xml.createElement(QStringLiteral("Port"));
-        proto.appendChild(port);
-        port.appendChild(xml.createTextNode(QString::number(server.port())));
+        xml.writeStartElement(QStringLiteral("LoginName"));
+        AutoconfigCache::writeUsernamePlaceholder(&xml);
+        xml.writeEndElement();
 
-        auto loginName = xml.createElement(QStringLiteral("LoginName"));
-        proto.appendChild(loginName);
-        loginName.appendChild(xml.createTextNode(username));
-
-        auto domainRequired = xml.createElement(QStringLiteral("DomainRequired"));
-        proto.appendChild(domainRequired);
-        domainRequired.appendChild(xml.createTextNode(QStringLiteral("off")));
-
-        auto spa = xml.createElement(QStringLiteral("SPA"));
-        proto.appendChild(spa);
-        spa.appendChild(xml.createTextNode(QStringLiteral("off")));
-
-        auto ssl = xml.createElement(QStringLiteral("SSL"));
-        proto.appendChild(ssl);
-        switch (server.socketType()) {
-        case AutoconfigServer::Plain:
-            ssl.appendChild(xml.createTextNode(QStringLiteral("off")));
-            break;
-        case AutoconfigServer::Ssl:
-            ssl.appendChild(xml.createTextNode(QStringLiteral("on")));
-            break;
-        case AutoconfigServer::StartTls:
-            ssl.appendChild(xml.createTextNode(QStringLiteral("on")));
-            break;
-        }
+        xml.writeTextElement(QStringLiteral("DomainRequired"), QStringLiteral("off"));
+        xml.writeTextElement(QStringLiteral("SPA"), QStringLiteral("off"));
+        xml.writeTextElement(QStringLiteral("SSL"), server.socketType() == AutoconfigServer::Plain ? QStringLiteral("off") : QStringLiteral("on"));
 
         if (server.socketType() != AutoconfigServer::Plain) {
-            auto encryption = xml.createElement(QStringLiteral("Encryption"));
-            proto.appendChild(encryption);
-            if (server.socketType() == AutoconfigServer::StartTls) {
-                encryption.appendChild(xml.createTextNode(QStringLiteral("TLS")));
-            } else {
-                encryption.appendChild(xml.createTextNode(QStringLiteral("SSL")));
-            }
+            xml.writeTextElement(QStringLiteral("Encryption"), server.socketType() == AutoconfigServer::StartTls ? QStringLiteral("TLS") : QStringLiteral("SSL"));
         }
 
-        auto authRequired = xml.createElement(QStringLiteral("AuthRequired"));
-        proto.appendChild(authRequired);
-        authRequired.appendChild(xml.createTextNode(QStringLiteral("on")));
+        xml.writeTextElement(QStringLiteral("AuthRequired"), QStringLiteral("on"));
 
         if (server.type() == AutoconfigServer::Smtp) {
-            auto usepopauth = xml.createElement(QStringLiteral("UsePOPAuth"));
-            proto.appendChild(usepopauth);
-            usepopauth.appendChild(xml.createTextNode(QStringLiteral("on")));
-
-            auto smtplast = xml.createElement(QStringLiteral("SMTPLast"));
-            proto.appendChild(smtplast);
-            smtplast.appendChild(xml.createTextNode(QStringLiteral("off")));
+            xml.writeTextElement(QStringLiteral("UsePOPAuth"), QStringLiteral("on"));
+            xml.writeTextElement(QStringLiteral("SMTPLast"), QStringLiteral("off"));
         }
+
+        xml.writeEndElement();
     }
 
-    c->res()->setBody(xml.toString(4));
-    c->res()->setContentType(QStringLiteral("application/xml"));
+    xml.writeEndDocument();
+
+    return out;
 }
 
 void Autodiscover::setError(Context *c, Response::HttpStatus status, const QString &msg, int errorCode)
@@ -267,31 +269,29 @@ void Autodiscover::setError(Context *c, Response::HttpStatus status, const QStri
 //    c->res()->setStatus(status);
     Q_UNUSED(status)
 
-    QDomDocument xml;
-    auto autodiscover = xml.createElement(QStringLiteral("Autodiscover"));
-    autodiscover.setAttribute(QStringLiteral("xmlns"), QStringLiteral("http://schemas.microsoft.com/exchange/autodiscover/responseschema/2006"));
-    xml.appendChild(autodiscover);
+    QByteArray out;
+    QXmlStreamWriter xml(&out);
+    xml.setAutoFormatting(true);
+    xml.setAutoFormattingIndent(4);
+
+    xml.writeStartDocument();
 
-    auto response = xml.createElement(QStringLiteral("Response"));
-    autodiscover.appendChild(response);
+    xml.writeStartElement(QStringLiteral("Autodiscover"));
+    xml.writeDefaultNamespace(QStringLiteral("http://schemas.microsoft.com/exchange/autodiscover/responseschema/2006"));
 
-    auto error = xml.createElement(QStringLiteral("Error"));
-    error.setAttribute(QStringLiteral("Time"), QDateTime::currentDateTimeUtc().time().toString(Qt::ISODateWithMs));
-    error.setAttribute(QStringLiteral("Id"), QString::fromLatin1(QCryptographicHash::hash(c->req()->uri().host().toUtf8(), QCryptographicHash::Md5).toHex()));
-    response.appendChild(error);
+    xml.writeStartElement(QStringLiteral("Response"));
 
-    auto code = xml.createElement(QStringLiteral("ErrorCode"));
-    error.appendChild(code);
-    code.appendChild(xml.createTextNode(QString::number(errorCode)));
+    xml.writeStartElement(QStringLiteral("Error"));
+    xml.writeAttribute(QStringLiteral("Time"), QDateTime::currentDateTimeUtc().time().toString(Qt::ISODateWithMs));
+    xml.writeAttribute(QStringLiteral("Id"), QString::fromLatin1(QCryptographicHash::hash(c->req()->uri().host().toUtf8(), QCryptographicHash::Md5).toHex()));
 
-    auto message = xml.createElement(QStringLiteral("Message"));
-    error.appendChild(message);
-    message.appendChild(xml.createTextNode(msg));
+    xml.writeTextElement(QStringLiteral("ErrorCode"), QString::number(errorCode));
+    xml.writeTextElement(QStringLiteral("Message"), msg);
+    xml.writeEmptyElement(QStringLiteral("DebugData"));
 
-    auto debugdata = xml.createElement(QStringLiteral("DebugData"));
-    error.appendChild(debugdata);
+    xml.writeEndDocument();
 
-    c->res()->setBody(xml.toString(4));
+    c->res()->setBody(out);
     c->res()->setContentType(QStringLiteral("application/xml"));
 }
 
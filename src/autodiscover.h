@@ -21,11 +21,14 @@
 
 #include <Cutelyst/Controller>
 #include <QLoggingCategory>
+#include <vector>
 
 Q_DECLARE_LOGGING_CATEGORY(SK_AUTODISCOVER)
 
 using namespace Cutelyst;
 
+class AutoconfigServer;
+
 /*!
  * \ingroup skaffaricontrollers
  * \brief Controller for the autodiscover feature supported by Thunderbird and others.
@@ -41,6 +44,8 @@ public:
     void index(Context *c);
 
 private:
+    static QByteArray response(const std::vector<AutoconfigServer> &servers);
+
     void setError(Context *c, Response::HttpStatus status, const QString &msg, int errorCode);
 };
 
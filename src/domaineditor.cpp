@@ -21,6 +21,7 @@
 #include "objects/account.h"
 #include "objects/skaffarierror.h"
 #include "objects/helpentry.h"
+#include "objects/job.h"
 #include "utils/skaffariconfig.h"
 #include "utils/utils.h"
 #include "validators/skvalidatoruniquedb.h"
@@ -83,6 +84,20 @@ void DomainEditor::index(Context *c)
     }
 
     c->setStash(QStringLiteral("domains"), QVariant::fromValue<std::vector<Domain>>(doms));
+
+    // domains that are still removed in the background are marked as pending by the template
+    if (AdminAccount::getUserType(c) >= AdminAccount::Administrator) {
+        SkaffariError je(c);
+        const std::vector<Job> jobs = Job::listActive(c, je, Job::RemoveDomain);
+        if (!jobs.empty()) {
+            QJsonArray removeJobs;
+            for (const Job &job : jobs) {
+                removeJobs.append(job.toJson());
+            }
+            c->setStash(QStringLiteral("remove_jobs"), QString::fromUtf8(QJsonDocument(removeJobs).toJson(QJsonDocument::Compact)));
+        }
+    }
+
     c->setStash(QStringLiteral("template"), QStringLiteral("domain/index.html"));
     c->setStash(QStringLiteral("site_title"), c->translate("DomainEditor", "Domains"));
 }
@@ -295,8 +310,9 @@ void DomainEditor::accounts(Context* c)
     const bool loadAccounts = (!SkaffariConfig::tmplAsyncAccountList() || isAjax);
 
     SkaffariError e(c);
+    QStringList pendingQuotas;
     if (loadAccounts) {
-        pag = Account::list(c, e, dom, pag, sortBy, sortOrder, searchRole, searchString);
+        pag = Account::list(c, e, dom, pag, sortBy, sortOrder, searchRole, searchString, p.value(QStringLiteral("after")), &pendingQuotas);
     }
 
     const QString newCookieData = accountsPerPage + QLatin1Char(';') + currentPage + QLatin1Char(';') + sortBy + QLatin1Char(';') + sortOrder + QLatin1Char(';') + searchRole + QLatin1Char(';') + searchString;
@@ -305,6 +321,24 @@ void DomainEditor::accounts(Context* c)
     newCookie.setPath(path);
     c->res()->setCookie(newCookie);
 
+    if (!pendingQuotas.empty() && (e.type() == SkaffariError::NoError)) {
+        // serve other requests while the quotas are requested from the IMAP server
+        c->detachAsync();
+        const std::vector<Account> lst = pag.value(QStringLiteral("accounts")).value<std::vector<Account>>();
+        Account::loadQuotasAsync(c, lst, pendingQuotas, [c, pag, isAjax, loadAccounts, searchString, searchRole, sortOrder, sortBy](const std::vector<Account> &accounts) {
+            Pagination result = pag;
+            result.insert(QStringLiteral("accounts"), QVariant::fromValue<std::vector<Account>>(accounts));
+            accountsResponse(c, result, SkaffariError(c), isAjax, loadAccounts, searchString, searchRole, sortOrder, sortBy);
+            c->attachAsync();
+        });
+        return;
+    }
+
+    accountsResponse(c, pag, e, isAjax, loadAccounts, searchString, searchRole, sortOrder, sortBy);
+}
+
+void DomainEditor::accountsResponse(Context *c, const Pagination &pag, const SkaffariError &e, bool isAjax, bool loadAccounts, const QString &searchString, const QString &searchRole, const QString &sortOrder, const QString &sortBy)
+{
     if (isAjax) {
         QJsonObject json;
 
@@ -333,6 +367,7 @@ void DomainEditor::accounts(Context* c)
             json.insert(QStringLiteral("accountsPerPage"), pag.limit());
             json.insert(QStringLiteral("currentPage"), pag.currentPage());
             json.insert(QStringLiteral("lastPage"), pag.lastPage());
+            json.insert(QStringLiteral("nextCursor"), pag.value(QStringLiteral("nextCursor")).toString());
 
             QVariantList pagesList;
             const QVector<int> pages = pag.pages();
@@ -507,14 +542,19 @@ void DomainEditor::remove(Context* c)
 
                 if (Q_LIKELY(newParentIdOk)) {
                     SkaffariError e(c);
-                    if (dom.remove(c, e, newParentId, false)) {
+                    // removing all accounts of a large domain takes too long for a request
+                    const Job job = Job::enqueue(c, e, Job::RemoveDomain, dom.id(), {
+                                                     {QStringLiteral("newParentId"), newParentId},
+                                                     {QStringLiteral("deleteChildren"), false}
+                                                 });
+                    if (job.isValid()) {
 
-                        const QString statusMsg = c->translate("DomainEditor", "The domain %1 has been successfully deleted.").arg(dom.name());
+                        const QString statusMsg = c->translate("DomainEditor", "The domain %1 will be deleted in the background.").arg(dom.name());
 
+                        // the domain list keeps the domain as pending until the job has been finished
                         if (isAjax) {
                             json.insert(QStringLiteral("status_msg"), statusMsg);
-                            json.insert(QStringLiteral("deleted_id"), static_cast<qint64>(dom.id()));
-                            json.insert(QStringLiteral("deleted_name"), dom.name());
+                            json.insert(QStringLiteral("job"), job.toJson());
                         } else {
                             c->res()->redirect(c->uriFor(QStringLiteral("/domain"), StatusMessage::statusQuery(c, statusMsg)));
                         }
@@ -853,22 +893,68 @@ void DomainEditor::add_account(Context* c)
 void DomainEditor::check(Context *c)
 {
     auto d = Domain::fromStash(c);
+    auto req = c->req();
+    const bool isAjax = req->xhr();
+
+    if (req->isPost()) {
 
-    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT id FROM accountuser WHERE domain_id = :domain_id"));
-    q.bindValue(QStringLiteral(":domain_id"), d.id());
+        SkaffariError e(c);
+        const Job job = Job::enqueue(c, e, Job::CheckDomain, d.id(), {
+                                         {QStringLiteral("checkChildAddresses"), Utils::checkCheckbox(req->bodyParameters(), QStringLiteral("checkChildAddresses"))}
+                                     });
+
+        if (isAjax) {
+            QJsonObject json;
+            if (job.isValid()) {
+                json.insert(QStringLiteral("job"), job.toJson());
+            } else {
+                json.insert(QStringLiteral("error_msg"), e.errorText());
+                c->res()->setStatus(e.status());
+            }
+            c->res()->setJsonObjectBody(json);
+            return;
+        }
 
-    if (Q_LIKELY(q.exec())) {
-        QStringList accountIds;
-        while (q.next()) {
-            accountIds << QString::number(q.value(0).value<dbid_t>());
+        if (job.isValid()) {
+            Job::toStash(c, job);
+        } else {
+            c->setStash(QStringLiteral("error_msg"), e.errorText());
         }
-        c->setStash(QStringLiteral("accountids"), accountIds.join(QLatin1Char(',')));
+
     } else {
-        c->setStash(QStringLiteral("error_msg"), c->translate("DomainEditor", "Failed to query all account IDs for domain %1 from database: %2").arg(d.name(), q.lastError().text()));
-        qCCritical(SK_DOMAIN, "Failed to query all account IDs for domain %s from database: %s", d.name().toUtf8().constData(), q.lastError().text().toUtf8().constData());
+
+        // continue to show the progress of a check that is already running
+        SkaffariError e(c);
+        const Job job = Job::getActive(c, e, Job::CheckDomain, d.id());
+        if (job.isValid()) {
+            Job::toStash(c, job);
+        }
     }
 
     c->setStash(QStringLiteral("template"), QStringLiteral("domain/check.html"));
 }
 
+void DomainEditor::check_mailboxes(Context *c)
+{
+    if (Utils::ajaxPostOnly(c, c->req()->xhr())) {
+        return;
+    }
+
+    auto d = Domain::fromStash(c);
+
+    SkaffariError e(c);
+    const QStringList actions = d.checkMailboxes(c, e);
+
+    QJsonObject result;
+    if (e.type() != SkaffariError::NoError) {
+        result.insert(QStringLiteral("error_msg"), e.errorText());
+        c->res()->setStatus(Response::InternalServerError);
+    }
+    if (!actions.empty()) {
+        result.insert(QStringLiteral("actions"), QJsonArray::fromStringList(actions));
+    }
+
+    c->res()->setJsonObjectBody(result);
+}
+
 #include "moc_domaineditor.cpp"
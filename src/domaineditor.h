@@ -26,6 +26,11 @@ Q_DECLARE_LOGGING_CATEGORY(SK_ACCOUNT)
 
 using namespace Cutelyst;
 class SkaffariEngine;
+class SkaffariError;
+
+namespace Cutelyst {
+class Pagination;
+}
 
 /*!
  * \ingroup skaffaricontrollers
@@ -60,8 +65,14 @@ public:
     C_ATTR(check, :Chained("base") :PathPart("check") :Args(0))
     void check(Context *c);
 
+    C_ATTR(check_mailboxes, :Chained("base") :PathPart("check_mailboxes") :Args(0))
+    void check_mailboxes(Context *c);
+
     C_ATTR(create, :Local("create") :Args(0))
     void create(Context *c);
+
+private:
+    static void accountsResponse(Context *c, const Pagination &pag, const SkaffariError &e, bool isAjax, bool loadAccounts, const QString &searchString, const QString &searchRole, const QString &sortOrder, const QString &sortBy);
 };
 
 #endif //DOMAINEDITOR_H
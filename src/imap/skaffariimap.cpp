@@ -17,6 +17,7 @@
  */
 
 #include "skaffariimap.h"
+#include "skaffariimapparser.h"
 #include "../utils/skaffariconfig.h"
 #include <unicode/ucnv_err.h>
 #include <unicode/uenum.h>
@@ -27,10 +28,64 @@
 #include <Cutelyst/Context>
 #include <QMessageAuthenticationCode>
 #include <QSysInfo>
+#include <QCoreApplication>
+#include <QGlobalStatic>
+#include <QReadWriteLock>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <memory>
+
+#define SK_IMAP_TIMEOUT 30000
 
 Q_LOGGING_CATEGORY(SK_IMAP, "skaffari.imap")
 
-QStringList SkaffariIMAP::m_capabilities = QStringList();
+namespace {
+
+/*!
+ * \internal
+ * \brief Extracts the STORAGE values from a QUOTA response line into \a quota.
+ *
+ * Returns \c false if the line does not contain STORAGE values.
+ */
+bool parseStorageQuota(const QByteArray &respLine, quota_pair &quota)
+{
+    int startUsage = respLine.indexOf(QByteArrayLiteral("STORAGE"));
+    if (startUsage < 0) {
+        return false;
+    }
+
+    // 8 is the length of "STORAGE" + 1
+    startUsage += 8;
+    int startQuota = respLine.indexOf(' ', startUsage);
+    quota.first = respLine.mid(startUsage, startQuota - (startUsage)).toULongLong();
+    // advancing 1 to be at the start of the quota value
+    startQuota++;
+    int endQuota = respLine.indexOf(' ', startQuota);
+    if (endQuota < 0) {
+        endQuota = respLine.indexOf(')', startQuota);
+    }
+    quota.second = respLine.mid(startQuota, endQuota - startQuota).toULongLong();
+
+    return true;
+}
+
+/*!
+ * \internal
+ * \brief Capabilities of the IMAP servers Skaffari is connected to, keyed by host:port.
+ */
+struct CapabilityRegistry
+{
+    struct Entry {
+        QStringList list;
+        SkaffariIMAP::Capabilities flags;
+    };
+
+    mutable QReadWriteLock lock;
+    QHash<QString,Entry> servers;
+};
+Q_GLOBAL_STATIC(CapabilityRegistry, capRegistry)
+
+}
 
 SkaffariIMAP::SkaffariIMAP(Cutelyst::Context *context, QObject *parent) :
     QSslSocket(parent),
@@ -43,13 +98,22 @@ SkaffariIMAP::SkaffariIMAP(Cutelyst::Context *context, QObject *parent) :
     m_encType(SkaffariConfig::imapEncryption()),
     m_authMech(SkaffariConfig::imapAuthmech())
 {
-    Q_ASSERT_X(m_c, "Skaffari IMAP", "invalid context");
-
     if (SkaffariConfig::imapUnixhierarchysep()) {
         m_hierarchysep = QLatin1Char('/');
     }
 
     setPeerVerifyName(SkaffariConfig::imapPeername());
+
+    // read after the settings, a reload in between will only discard this connection earlier
+    m_configGeneration = SkaffariConfig::generation();
+
+    m_timeoutTimer.setSingleShot(true);
+    m_timeoutTimer.setInterval(SK_IMAP_TIMEOUT);
+
+    connect(this, &QIODevice::readyRead, this, &SkaffariIMAP::processIncoming);
+    connect(this, &QSslSocket::encrypted, this, &SkaffariIMAP::onEncrypted);
+    connect(this, static_cast<void(QAbstractSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error), this, &SkaffariIMAP::onSocketError);
+    connect(&m_timeoutTimer, &QTimer::timeout, this, &SkaffariIMAP::onTimeout);
 }
 
 SkaffariIMAP::~SkaffariIMAP()
@@ -59,252 +123,300 @@ SkaffariIMAP::~SkaffariIMAP()
 
 bool SkaffariIMAP::login()
 {
-    setNoError();
+    bool finished = false;
+    bool ok = false;
 
-    if (m_loggedIn) {
-        return true;
-    }
+    loginAsync([&finished, &ok](bool _ok) {
+        ok = _ok;
+        finished = true;
+    });
 
-    if (m_encType != IMAPS) {
-        connectToHost(m_host, m_port, ReadWrite, m_protocol);
-    } else {
-        connectToHostEncrypted(m_host, m_port, ReadWrite, m_protocol);
-    }
+    waitForFinished(finished);
 
-    if (m_encType != IMAPS) {
-        if (Q_UNLIKELY(!waitForConnected())) {
-            abort();
-            return connectionTimeOut();
-        }
-    } else {
-        if (Q_UNLIKELY(!waitForEncrypted())) {
-            const QList<QSslError> sslErrs = sslErrors();
-            if (!sslErrs.empty()) {
-                m_imapError = SkaffariIMAPError(sslErrs.first());
-                abort();
-                return false;
-            } else {
-                abort();
-                return connectionTimeOut();
-            }
-        }
-    }
+    return ok;
+}
 
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        return false;
-    }
+void SkaffariIMAP::loginAsync(const std::function<void (bool)> &callback)
+{
+    setNoError();
 
-    QVector<QByteArray> response;
-    if (Q_UNLIKELY(!checkResponse(readAll(), QStringLiteral("*"), &response))) {
-        return disconnectOnError();
+    if (m_loggedIn && (state() == ConnectedState)) {
+        if (callback) {
+            callback(true);
+        }
+        return;
     }
 
-    const QByteArray respLine = response.first();
+    m_loginCallbacks.push_back(callback);
+    if (m_loginCallbacks.size() > 1) {
+        // there is already a login in progress
+        return;
+    }
 
-    if (m_encType == StartTLS) {
+    m_loggedIn = false;
+    m_startTls = false;
+    m_tagSequence = 0;
+    // capabilities will be refreshed for the new connection
+    m_capList.clear();
+    m_capFlags = NoCapability;
 
-        if (respLine.contains(QByteArrayLiteral("STARTTLS"))) {
+    if (!m_pending.empty()) {
+        // commands sent on a connection that has been closed by the server in the meantime
+        failPending(SkaffariIMAPError(SkaffariIMAPError::SocketError, translate("SkaffariIMAP", "Connection to the IMAP server has been closed.")));
+    }
 
-            const QString tag = getTag();
-            if (Q_UNLIKELY(!sendCommand(tag, QStringLiteral("STARTTLS")))) {
-                return disconnectOnError();
-            }
+    if (state() != UnconnectedState) {
+        abort();
+    }
 
-            if (Q_UNLIKELY(!waitForResponse(true))) {
-                return false;
-            }
+    // the server greeting completes the first response
+    PendingCommand greeting;
+    greeting.tag = QByteArrayLiteral("*");
+    greeting.callback = [this](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+        onGreeting(response, error);
+    };
+    m_pending.push_back(greeting);
+    m_parser.reset(greeting.tag);
+    m_timeoutTimer.start();
 
-            if (Q_UNLIKELY(!checkResponse(readAll(), tag))) {
-                return disconnectOnError();
-            }
+    if (m_encType != IMAPS) {
+        connectToHost(m_host, m_port, ReadWrite, m_protocol);
+    } else {
+        connectToHostEncrypted(m_host, m_port, ReadWrite, m_protocol);
+    }
+}
 
-            startClientEncryption();
+void SkaffariIMAP::onGreeting(const SkaffariIMAPParser &response, const SkaffariIMAPError &error)
+{
+    if (Q_UNLIKELY(error.type() != SkaffariIMAPError::NoError)) {
+        loginFailed(error);
+        return;
+    }
 
-            waitForEncrypted();
+    if (m_encType != StartTLS) {
+        authenticate();
+        return;
+    }
 
-            if ((mode() != QSslSocket::SslClientMode || !isEncrypted())) {
-                QString sslErrorString;
-                if (!sslErrors().empty()) {
-                    sslErrorString = sslErrors().constFirst().errorString();
-                }
-                m_imapError = SkaffariIMAPError(SkaffariIMAPError::EncryptionError, m_c->translate("SkaffariIMAP", "Failed to initiate STARTTLS: %1").arg(sslErrorString));
-                abort();
-                return false;
-            }
+    if (Q_UNLIKELY(!response.statusLine().contains(QByteArrayLiteral("STARTTLS")))) {
+        loginFailed(SkaffariIMAPError(SkaffariIMAPError::EncryptionError, translate("SkaffariIMAP", "STARTTLS is not supported.")));
+        return;
+    }
 
-        } else {
-            return disconnectOnError(SkaffariIMAPError::EncryptionError, m_c->translate("SkaffariIMAP", "STARTTLS is not supported."));
+    sendLoginCommandAsync(QStringLiteral("STARTTLS"), [this](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+        Q_UNUSED(response);
+        if (Q_UNLIKELY(error.type() != SkaffariIMAPError::NoError)) {
+            loginFailed(error);
+            return;
         }
+        // authentication will be started by onEncrypted()
+        m_startTls = true;
+        startClientEncryption();
+    });
+}
+
+void SkaffariIMAP::onEncrypted()
+{
+    if (m_startTls) {
+        m_startTls = false;
+        authenticate();
     }
+}
 
-    if (m_authMech == CLEAR) {
-        const QString tag2 = getTag();
-        const QString cmd = QLatin1String("LOGIN \"") + m_user + QLatin1String("\" \"") + m_password + QLatin1Char('"');
+void SkaffariIMAP::authenticate()
+{
+    const auto authenticated = [this](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+        onAuthenticated(response, error);
+    };
 
-        if (Q_UNLIKELY(!sendCommand(tag2, cmd))) {
-            return disconnectOnError();
-        }
+    if (m_authMech == CLEAR) {
 
-        if (Q_UNLIKELY(!waitForResponse(true))) {
-            return false;
-        }
+        const QString cmd = QLatin1String("LOGIN \"") + m_user + QLatin1String("\" \"") + m_password + QLatin1Char('"');
+        sendLoginCommandAsync(cmd, authenticated);
 
-        if (Q_UNLIKELY(!checkResponse(readAll(), tag2, &response))) {
-            return disconnectOnError();
-        }
     } else if (m_authMech == LOGIN) {
-        const QString tag2 = getTag();
-        if (Q_UNLIKELY(!sendCommand(tag2, QStringLiteral("AUTHENTICATE LOGIN")))){
-            return disconnectOnError();
-        }
 
-        if (Q_UNLIKELY(!waitForResponse(true))) {
-            return false;
-        }
-
-        if (Q_UNLIKELY(!readAll().startsWith('+'))) {
-            return disconnectOnError();
-        }
+        // the server asks first for the user name and then for the password
+        auto step = std::make_shared<int>(0);
+        sendLoginCommandAsync(QStringLiteral("AUTHENTICATE LOGIN"), [this, step, authenticated](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+            if (response.state() == SkaffariIMAPParser::Continuation) {
+                const int current = (*step)++;
+                if (current == 0) {
+                    sendCommand(m_user.toUtf8().toBase64());
+                } else if (current == 1) {
+                    sendCommand(m_password.toUtf8().toBase64());
+                } else {
+                    // cancel the authentication exchange
+                    sendCommand(QByteArrayLiteral("*"));
+                }
+                return;
+            }
+            authenticated(response, error);
+        });
 
-        if (Q_UNLIKELY(!sendCommand(m_user.toUtf8().toBase64()))) {
-            return disconnectOnError();
-        }
+    } else if (m_authMech == PLAIN) {
 
-        if (Q_UNLIKELY(!waitForResponse(true))) {
-            return false;
-        }
+        sendLoginCommandAsync(QStringLiteral("AUTHENTICATE PLAIN"), [this, authenticated](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+            if (response.state() == SkaffariIMAPParser::Continuation) {
+                const QByteArray cmd = QByteArrayLiteral("\0") + m_user.toUtf8() + QByteArrayLiteral("\0") + m_password.toUtf8();
+                sendCommand(cmd.toBase64());
+                return;
+            }
+            authenticated(response, error);
+        });
 
-        if (Q_UNLIKELY(!readAll().startsWith('+'))) {
-            return disconnectOnError();
-        }
+    } else if (m_authMech == CRAMMD5) {
 
-        if (Q_UNLIKELY(!sendCommand(m_password.toUtf8().toBase64()))) {
-            return disconnectOnError();
-        }
+        sendLoginCommandAsync(QStringLiteral("AUTHENTICATE CRAM-MD5"), [this, authenticated](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+            if (response.state() == SkaffariIMAPParser::Continuation) {
+                const QByteArray challenge = QByteArray::fromBase64(response.status());
+                if (Q_UNLIKELY(!(challenge.startsWith('<') && challenge.endsWith('>')))) {
+                    loginFailed(SkaffariIMAPError(SkaffariIMAPError::ResponseError, translate("SkaffariIMAP", "Invalid challenge format for CRAM-MD5 authentication mechanism.")));
+                    return;
+                }
+                if (Q_UNLIKELY(!sendCommand(QMessageAuthenticationCode::hash(challenge, m_password.toUtf8(), QCryptographicHash::Md5).toHex().toLower().toBase64()))) {
+                    loginFailed(SkaffariIMAPError(SkaffariIMAPError::ResponseError, translate("SkaffariIMAP", "Failed to send challenge response for CRAM-MD5 to the IMAP server: %1").arg(errorString())));
+                }
+                return;
+            }
+            authenticated(response, error);
+        });
 
-        if (Q_UNLIKELY(!waitForResponse(true))) {
-            return false;
-        }
+    } else {
+        loginFailed(SkaffariIMAPError(SkaffariIMAPError::ConfigError, translate("SkaffariIMAP", "Authentication mechanism is not supported by Skaffari.")));
+    }
+}
 
-        if (Q_UNLIKELY(!checkResponse(readAll(), tag2, &response))) {
-            return disconnectOnError();
-        }
-    } else if (m_authMech == PLAIN) {
+void SkaffariIMAP::onAuthenticated(const SkaffariIMAPParser &response, const SkaffariIMAPError &error)
+{
+    if (Q_UNLIKELY(error.type() != SkaffariIMAPError::NoError)) {
+        loginFailed(error);
+        return;
+    }
 
-        const QString tag2 = getTag();
-        if (Q_UNLIKELY(!sendCommand(tag2, QStringLiteral("AUTHENTICATE PLAIN")))) {
-            return disconnectOnError();
-        }
+    m_loggedIn = true;
 
-        if (Q_UNLIKELY(!waitForResponse(true))) {
-            return false;
+    // the capabilities might be part of the login response, either as response code of the
+    // status line or as untagged CAPABILITY response, in that case the registry is refreshed
+    QStringList caps;
+    const QByteArray capLine = response.statusLine();
+    int start = capLine.indexOf(QByteArrayLiteral("[CAPABILITY"));
+    if (start > -1) {
+        // advancing start 12 positions to be at the start of the capability list
+        // 12 is the length of "[CAPABILITY" + 1
+        start += 12;
+        const int end = capLine.indexOf(']', start);
+        if (end > -1) {
+            const QString capstring = QString::fromLatin1(capLine.mid(start, end - start));
+            caps = capstring.split(QChar(QChar::Space), QString::SkipEmptyParts);
         }
+    } else {
+        caps = parseCapabilities(response);
+    }
 
-        if (Q_UNLIKELY(!readAll().startsWith('+'))) {
-            return disconnectOnError();
-        }
+    if (!caps.empty()) {
+        setCapabilities(caps);
+    } else if (!loadCapabilities()) {
+        sendCommandAsync(QStringLiteral("CAPABILITY"), [this](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+            const QStringList caps = (error.type() == SkaffariIMAPError::NoError) ? parseCapabilities(response) : QStringList();
+            if (Q_UNLIKELY(caps.empty())) {
+                loginFailed(SkaffariIMAPError(SkaffariIMAPError::ResponseError, translate("SkaffariIMAP", "Failed to request capabilities from the IMAP server.")));
+                return;
+            }
+            setCapabilities(caps);
+            sendId();
+            finishLogin(true);
+        });
+        return;
+    }
 
-        const QByteArray cmd = QByteArrayLiteral("\0") + m_user.toUtf8() + QByteArrayLiteral("\0") + m_password.toUtf8();
-        if (Q_UNLIKELY(!sendCommand(cmd))) {
-            return disconnectOnError();
-        }
+    sendId();
+    finishLogin(true);
+}
 
-        if (Q_UNLIKELY(!waitForResponse(true))) {
-            return false;
-        }
+void SkaffariIMAP::sendId()
+{
+    if (!m_capFlags.testFlag(CapID)) {
+        return;
+    }
 
-        if (!Q_UNLIKELY(!checkResponse(readAll(), tag2, &response))) {
-            return disconnectOnError();
-        }
+    QString os = QSysInfo::productType();
+    QString osVersion = QSysInfo::productVersion();
+    if (os == QLatin1String("unknown")) {
+        os = QSysInfo::kernelType();
+        osVersion = QSysInfo::kernelVersion();
+    } else {
+        os = QSysInfo::prettyProductName();
+    }
 
-    } else if (m_authMech == CRAMMD5) {
-        const QString tag2 = getTag();
-        if (Q_UNLIKELY(!sendCommand(tag2, QStringLiteral("AUTHENTICATE CRAM-MD5")))) {
-            return disconnectOnError();
-        }
+    const QString cmd = QStringLiteral("ID (\"name\" \"%1\" \"version\" \"%2\" \"os\" \"%3\" \"os-version\" \"%4\")").arg(QCoreApplication::applicationName(), QCoreApplication::applicationVersion(), os, osVersion);
 
-        if (Q_UNLIKELY(!waitForResponse(true))) {
-            return false;
+    // nobody has to wait for the ID response, it will be read together with the response of the next command
+    sendCommandAsync(cmd, [](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+        if (Q_LIKELY((error.type() == SkaffariIMAPError::NoError) && (response.count() > 0) && response.response(0).startsWith(QByteArrayLiteral("* ID (")))) {
+            // 6 is the length of "* ID ("
+            const QString respString = QString::fromLatin1(response.response(0).mid(6));
+            qCDebug(SK_IMAP, "IMAP server ID response: %s", qUtf8Printable(respString));
         }
+    });
+}
 
-        QByteArray challenge = readAll();
-        if (Q_UNLIKELY(!challenge.startsWith('+'))) {
-            return disconnectOnError(SkaffariIMAPError::ResponseError, m_c->translate("SkaffariIMAP", "Invalid response from the IMAP server to %1.").arg(QStringLiteral("AUTHENTICATE CRAM-MD5")));
-        }
+void SkaffariIMAP::loginFailed(const SkaffariIMAPError &error)
+{
+    m_imapError = error;
+    m_loggedIn = false;
+    m_startTls = false;
+    failPending(error);
+    abort();
+    finishLogin(false);
+}
 
-        challenge = challenge.mid(2);
-        challenge = QByteArray::fromBase64(challenge);
+void SkaffariIMAP::finishLogin(bool ok)
+{
+    if (m_loginCallbacks.empty()) {
+        return;
+    }
 
-        if (Q_UNLIKELY(!(challenge.startsWith('<') && challenge.endsWith('>')))) {
-            return disconnectOnError(SkaffariIMAPError::ResponseError, m_c->translate("SkaffariIMAP", "Invalid challenge format for CRAM-MD5 authentication mechanism."));
-        }
+    if (m_pending.empty()) {
+        m_timeoutTimer.stop();
+    }
 
-        if (Q_UNLIKELY(!sendCommand(QMessageAuthenticationCode::hash(challenge, m_password.toUtf8(), QCryptographicHash::Md5).toHex().toLower().toBase64()))) {
-            return disconnectOnError(SkaffariIMAPError::ResponseError, m_c->translate("SkaffariIMAP", "Failed to send challenge response for CRAM-MD5 to the IMAP server: %1").arg(errorString()));
-        }
+    std::vector<std::function<void(bool)>> callbacks;
+    callbacks.swap(m_loginCallbacks);
 
-        if (Q_UNLIKELY(!waitForResponse(true))) {
-            return false;
+    // commands sent while the login was in progress go out now, before the ones sent by the callbacks
+    std::deque<QueuedCommand> queued;
+    queued.swap(m_queued);
+    for (const QueuedCommand &cmd : queued) {
+        if (ok && m_loggedIn) {
+            sendCommandAsync(cmd.tag, cmd.command, cmd.callback);
+        } else if (cmd.callback) {
+            cmd.callback(SkaffariIMAPParser(cmd.tag), m_imapError);
         }
+    }
 
-        if (!Q_UNLIKELY(!checkResponse(readAll(), tag2, &response))) {
-            return disconnectOnError();
+    for (const auto &callback : callbacks) {
+        if (callback) {
+            callback(ok);
         }
-    } else {
-        return disconnectOnError(SkaffariIMAPError::ConfigError, m_c->translate("SkaffariIMAP", "Authentication mechanism is not supported by Skaffari."));
     }
+}
 
-    m_loggedIn = true;
+bool SkaffariIMAP::noop()
+{
+    setNoError();
 
-    if (SkaffariIMAP::m_capabilities.empty()) {
-        if (response.size() == 1) {
-            const QByteArray loginRespLine = response.first();
-            int start = loginRespLine.indexOf(QByteArrayLiteral("[CAPABILITY"));
-            if (start > -1) {
-                // advancing start 12 positions to be at the start of the capability list
-                // 12 is the length of "[CAPABILITY" + 1
-                start += 12;
-                int end = loginRespLine.indexOf(QByteArrayLiteral("]"), start);
-                if (end > -1) {
-                    const QString capstring = QString::fromLatin1(loginRespLine.mid(start, end - start));
-                    SkaffariIMAP::m_capabilities = capstring.split(QChar(QChar::Space), QString::SkipEmptyParts);
-                }
-            }
-            if (SkaffariIMAP::m_capabilities.empty()) {
-                SkaffariIMAP::m_capabilities = getCapabilities();
-                if (SkaffariIMAP::m_capabilities.empty()) {
-                    logout();
-                    return false;
-                }
-            }
-        }
+    if (!m_loggedIn) {
+        return false;
     }
 
-    if (hasCapability(QStringLiteral("ID"))) {
-        const QString tag = getTag();
-        QString os = QSysInfo::productType();
-        QString osVersion = QSysInfo::productVersion();
-        if (os == QLatin1String("unknown")) {
-            os = QSysInfo::kernelType();
-            osVersion = QSysInfo::kernelVersion();
-        } else {
-            os = QSysInfo::prettyProductName();
-        }
-
-        const QString cmd = QStringLiteral("ID (\"name\" \"%1\" \"version\" \"%2\" \"os\" \"%3\" \"os-version\" \"%4\")").arg(QCoreApplication::applicationName(), QCoreApplication::applicationVersion(), os, osVersion);
+    if (state() != ConnectedState) {
+        m_loggedIn = false;
+        return false;
+    }
 
-        if (Q_LIKELY(sendCommand(tag, cmd))) {
-            if (Q_LIKELY(waitForResponse())) {
-                QVector<QByteArray> response;
-                if (Q_LIKELY(checkResponse(readAll(), tag, &response))) {
-                    if (Q_LIKELY(!response.empty())) {
-                        // 7 is the length of "* ID (" + 1
-                        const QString respString = QString::fromLatin1(response.first().mid(7));
-                        qCDebug(SK_IMAP, "IMAP server ID response: %s", qUtf8Printable(respString));
-                    }
-                }
-            }
-        }
+    if (Q_UNLIKELY(!runCommand(QStringLiteral("NOOP"), nullptr, 5000))) {
+        return disconnectOnError();
     }
 
     return true;
@@ -328,22 +440,7 @@ bool SkaffariIMAP::logout()
         return true;
     }
 
-    const QString tag = getTag();
-
-    if (Q_UNLIKELY(!sendCommand(tag, QStringLiteral("LOGOUT")))) {
-        disconnectOnError();
-        m_loggedIn = false;
-        m_tagSequence = 0;
-        return true;
-    }
-
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        m_loggedIn = false;
-        m_tagSequence = 0;
-        return true;
-    }
-
-    if (Q_UNLIKELY(!checkResponse(readAll(), tag))) {
+    if (Q_UNLIKELY(!runCommand(QStringLiteral("LOGOUT")))) {
         disconnectOnError();
         m_loggedIn = false;
         m_tagSequence = 0;
@@ -367,163 +464,337 @@ QStringList SkaffariIMAP::getCapabilities(bool forceReload)
 {
     setNoError();
 
-    if (SkaffariIMAP::m_capabilities.empty() || forceReload) {
+    if ((m_capList.empty() && !loadCapabilities()) || forceReload) {
 
-        SkaffariIMAP::m_capabilities.clear();
+        SkaffariIMAPParser response;
+        if (Q_UNLIKELY(!runCommand(QStringLiteral("CAPABILITY"), &response))) {
+            return m_capList;
+        }
 
-        const QString tag = getTag();
+        const QStringList caps = parseCapabilities(response);
 
-        if (Q_UNLIKELY(!sendCommand(tag, QStringLiteral("CAPABILITY")))) {
-            return SkaffariIMAP::m_capabilities;
+        if (Q_UNLIKELY(caps.empty())) {
+            m_imapError = SkaffariIMAPError(SkaffariIMAPError::ResponseError, translate("SkaffariIMAP", "Failed to request capabilities from the IMAP server."));
+            return m_capList;
         }
 
-        if (Q_UNLIKELY(!waitForResponse())) {
-            return SkaffariIMAP::m_capabilities;
-        }
+        setCapabilities(caps);
+    }
 
-        QVector<QByteArray> response;
-        if (Q_UNLIKELY(!checkResponse(readAll(), tag, &response))) {
-            return SkaffariIMAP::m_capabilities;
-        }
+    return m_capList;
+}
 
-        if (response.isEmpty()) {
-            m_imapError = SkaffariIMAPError(SkaffariIMAPError::ResponseError, m_c->translate("SkaffariIMAP", "Failed to request capabilities from the IMAP server."));
-            return SkaffariIMAP::m_capabilities;
-        }
+SkaffariIMAP::Capabilities SkaffariIMAP::capabilities(bool forceReload)
+{
+    if (m_capList.empty() || forceReload) {
+        getCapabilities(forceReload);
+    }
+    return m_capFlags;
+}
 
-        // 13 is the length of "* CAPABILITY " + 1
-        const QString respString = QString::fromLatin1(response.first().mid(13));
+bool SkaffariIMAP::hasCapability(Capability capability) const
+{
+    return m_capFlags.testFlag(capability);
+}
 
-        if (!respString.isEmpty()) {
-            SkaffariIMAP::m_capabilities = respString.split(QChar(QChar::Space), QString::SkipEmptyParts);
-        }
+bool SkaffariIMAP::hasCapability(const QString &capability, bool forceReload)
+{
+    const QStringList caps = getCapabilities(forceReload);
+    // known capabilities are checked without scanning the list
+    const Capabilities flag = capabilityFlags(QStringList(capability));
+    if (flag != NoCapability) {
+        return (m_capFlags & flag) != 0;
+    }
+    return caps.contains(capability, Qt::CaseInsensitive);
+}
 
-        if (Q_UNLIKELY(SkaffariIMAP::m_capabilities.empty())) {
-            m_imapError = SkaffariIMAPError(SkaffariIMAPError::ResponseError, m_c->translate("SkaffariIMAP", "Failed to request capabilities from the IMAP server."));
+SkaffariIMAP::Capabilities SkaffariIMAP::capabilityFlags(const QStringList &capabilities)
+{
+    static const QHash<QString,Capability> known({
+                                                     {QStringLiteral("ID"),                 CapID},
+                                                     {QStringLiteral("CREATE-SPECIAL-USE"), CapCreateSpecialUse},
+                                                     {QStringLiteral("SPECIAL-USE"),        CapSpecialUse},
+                                                     {QStringLiteral("METADATA"),           CapMetadata},
+                                                     {QStringLiteral("LITERAL+"),           CapLiteralPlus},
+                                                     {QStringLiteral("LITERAL-"),           CapLiteralMinus},
+                                                     {QStringLiteral("SASL-IR"),            CapSaslIR},
+                                                     {QStringLiteral("STATUS=SIZE"),        CapStatusSize},
+                                                     {QStringLiteral("COMPRESS=DEFLATE"),   CapCompress},
+                                                     {QStringLiteral("QUOTA"),              CapQuota},
+                                                     {QStringLiteral("ACL"),                CapAcl},
+                                                     {QStringLiteral("STARTTLS"),           CapStartTLS},
+                                                     {QStringLiteral("IDLE"),               CapIdle},
+                                                     {QStringLiteral("NAMESPACE"),          CapNamespace},
+                                                     {QStringLiteral("UIDPLUS"),            CapUidPlus},
+                                                     {QStringLiteral("AUTH=PLAIN"),         CapAuthPlain},
+                                                     {QStringLiteral("AUTH=LOGIN"),         CapAuthLogin},
+                                                     {QStringLiteral("AUTH=CRAM-MD5"),      CapAuthCramMD5}
+                                                 });
+
+    Capabilities flags = NoCapability;
+    for (const QString &cap : capabilities) {
+        flags |= known.value(cap.toUpper(), NoCapability);
+    }
+    return flags;
+}
+
+void SkaffariIMAP::setCapabilities(const QStringList &capabilities)
+{
+    m_capList = capabilities;
+    m_capFlags = capabilityFlags(capabilities);
+
+    CapabilityRegistry::Entry entry;
+    entry.list = m_capList;
+    entry.flags = m_capFlags;
+
+    QWriteLocker locker(&capRegistry->lock);
+    capRegistry->servers.insert(capabilityKey(), entry);
+}
+
+bool SkaffariIMAP::loadCapabilities()
+{
+    CapabilityRegistry::Entry entry;
+    {
+        QReadLocker locker(&capRegistry->lock);
+        const auto it = capRegistry->servers.constFind(capabilityKey());
+        if (it == capRegistry->servers.constEnd()) {
+            return false;
         }
+        entry = it.value();
     }
 
-    return SkaffariIMAP::m_capabilities;
+    m_capList = entry.list;
+    m_capFlags = entry.flags;
+
+    return true;
 }
 
-bool SkaffariIMAP::hasCapability(const QString &capability, bool forceReload)
+QString SkaffariIMAP::capabilityKey() const
 {
-    return SkaffariIMAP::getCapabilities(forceReload).contains(capability, Qt::CaseInsensitive);
+    return m_host + QLatin1Char(':') + QString::number(m_port);
 }
 
 quota_pair SkaffariIMAP::getQuota(const QString &user)
 {
     quota_pair quota(0, 0);
+    bool finished = false;
 
     setNoError();
 
-    const QString tag = getTag();
+    getQuotaAsync(user, [&quota, &finished](quota_pair _quota) {
+        quota = _quota;
+        finished = true;
+    });
+
+    waitForFinished(finished);
+
+    return quota;
+}
+
+void SkaffariIMAP::getQuotaAsync(const QString &user, const std::function<void (quota_pair)> &callback)
+{
     const QString command = QLatin1String("GETQUOTA \"user") + m_hierarchysep + user + QLatin1Char('"');
 
-    if (Q_LIKELY(sendCommand(tag, command))) {
-        if (Q_LIKELY(waitForResponse(true))) {
-            QVector<QByteArray> response;
-            if (Q_LIKELY(checkResponse(readAll(), tag, &response))) {
-                if (Q_UNLIKELY(response.empty())) {
-                    qCCritical(SK_IMAP, "Failed to request storage quota for user %s.", user.toUtf8().constData());
-                    m_imapError = SkaffariIMAPError(SkaffariIMAPError::ResponseError, m_c->translate("SkaffariIMAP", "Failed to request storage quota."));
-                    return quota;
-                }
-                const QByteArray respLine = response.first();
-                int startUsage = respLine.indexOf(QByteArrayLiteral("STORAGE"));
-                if (startUsage > -1) {
-                    // 8 is the length of "STORAGE" + 1
-                    startUsage += 8;
-                    int startQuota = respLine.indexOf(' ', startUsage);
-                    quota.first = respLine.mid(startUsage, startQuota - (startUsage)).toULongLong();
-                    // advancing 1 to be at the start of the quota value
-                    startQuota++;
-                    int endQuota = respLine.indexOf(' ', startQuota);
-                    if (endQuota < 0) {
-                        endQuota = respLine.indexOf(')', startQuota);
+    sendCommandAsync(command, [this, user, callback](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+        quota_pair quota(0, 0);
+        if (Q_LIKELY(error.type() == SkaffariIMAPError::NoError)) {
+            if (Q_UNLIKELY(response.count() == 0)) {
+                qCCritical(SK_IMAP, "Failed to request storage quota for user %s.", user.toUtf8().constData());
+                m_imapError = SkaffariIMAPError(SkaffariIMAPError::ResponseError, translate("SkaffariIMAP", "Failed to request storage quota."));
+            } else if (!parseStorageQuota(response.response(0), quota)) {
+                qCWarning(SK_IMAP, "Can not extract storage quota values for user %s from IMAP server response.", user.toUtf8().constData());
+            }
+        } else {
+            m_imapError = error;
+        }
+        if (callback) {
+            callback(quota);
+        }
+    });
+}
+
+QHash<QString,quota_pair> SkaffariIMAP::getQuotas(const QStringList &users)
+{
+    QHash<QString,quota_pair> quotas;
+    bool finished = false;
+
+    setNoError();
+
+    getQuotasAsync(users, [&quotas, &finished](const QHash<QString,quota_pair> &_quotas) {
+        quotas = _quotas;
+        finished = true;
+    });
+
+    waitForFinished(finished);
+
+    return quotas;
+}
+
+void SkaffariIMAP::getQuotasAsync(const QStringList &users, const std::function<void (const QHash<QString,quota_pair> &)> &callback)
+{
+    if (users.empty()) {
+        if (callback) {
+            callback(QHash<QString,quota_pair>());
+        }
+        return;
+    }
+
+    struct QuotaBatch {
+        QHash<QString,quota_pair> quotas;
+        int remaining = 0;
+        bool connectionError = false;
+    };
+
+    const int total = users.size();
+    auto batch = std::make_shared<QuotaBatch>();
+    batch->quotas.reserve(users.size());
+    batch->remaining = total;
+
+    // all commands are written at once without waiting for the responses in between,
+    // the server answers them in order and every response is dispatched to its command
+    for (const QString &user : users) {
+        const QString command = QLatin1String("GETQUOTA \"user") + m_hierarchysep + user + QLatin1Char('"');
+
+        sendCommandAsync(command, [this, user, batch, callback, total](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+            quota_pair quota(0, 0);
+            switch (error.type()) {
+            case SkaffariIMAPError::NoError:
+                for (int i = 0; i < response.count(); ++i) {
+                    const QByteArray line = response.response(i);
+                    if (line.startsWith(QByteArrayLiteral("* QUOTA ")) && parseStorageQuota(line, quota)) {
+                        break;
                     }
-                    quota.second = respLine.mid(startQuota, endQuota - startQuota).toULongLong();
-                } else {
-                    qCWarning(SK_IMAP, "Can not extract storage quota values for user %s from IMAP server response.", user.toUtf8().constData());
                 }
+                batch->quotas.insert(user, quota);
+                break;
+            case SkaffariIMAPError::NoResponse:
+            case SkaffariIMAPError::BadResponse:
+                qCWarning(SK_IMAP, "Failed to request storage quota for user %s: %s", qUtf8Printable(user), qUtf8Printable(error.errorText()));
+                batch->quotas.insert(user, quota);
+                break;
+            default:
+                if (!batch->connectionError) {
+                    batch->connectionError = true;
+                    m_imapError = error;
+                }
+                break;
             }
-        }
-    }
 
-    return quota;
+            if (--batch->remaining == 0) {
+                if (Q_UNLIKELY(batch->quotas.size() != total)) {
+                    qCWarning(SK_IMAP, "Received storage quota values for %i of %i users.", batch->quotas.size(), total);
+                }
+                if (callback) {
+                    callback(batch->connectionError ? QHash<QString,quota_pair>() : batch->quotas);
+                }
+            }
+        });
+    }
 }
 
 bool SkaffariIMAP::setQuota(const QString &user, quota_size_t quota)
 {
     bool ok = false;
+    bool finished = false;
 
     setNoError();
 
-    const QString tag = getTag();
-    const QString command = QLatin1String("SETQUOTA \"user") + m_hierarchysep + user + QLatin1String("\" (STORAGE ") + QString::number(quota) + QLatin1Char(')');
-
-    if (Q_UNLIKELY(!sendCommand(tag, command))) {
-        return ok;
-    }
+    setQuotaAsync(user, quota, [&ok, &finished](bool _ok) {
+        ok = _ok;
+        finished = true;
+    });
 
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        return ok;
-    }
+    waitForFinished(finished);
 
-    ok = checkResponse(readAll(), tag);
+    return ok;
+}
 
-    if (Q_UNLIKELY(!ok)) {
-        qCCritical(SK_IMAP, "Failed to set quota value of %llu for user %s.", quota, qUtf8Printable(user));
-    }
+void SkaffariIMAP::setQuotaAsync(const QString &user, quota_size_t quota, const std::function<void (bool)> &callback)
+{
+    const QString command = QLatin1String("SETQUOTA \"user") + m_hierarchysep + user + QLatin1String("\" (STORAGE ") + QString::number(quota) + QLatin1Char(')');
 
-    return ok;
+    sendCommandAsync(command, [this, user, quota, callback](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+        Q_UNUSED(response);
+        const bool ok = (error.type() == SkaffariIMAPError::NoError);
+        if (Q_UNLIKELY(!ok)) {
+            m_imapError = error;
+            qCCritical(SK_IMAP, "Failed to set quota value of %llu for user %s.", quota, qUtf8Printable(user));
+        }
+        if (callback) {
+            callback(ok);
+        }
+    });
 }
 
 bool SkaffariIMAP::createMailbox(const QString &user)
 {
     bool ok = false;
-
-    Q_ASSERT_X(!user.isEmpty(), "create mailbox", "empty username");
+    bool finished = false;
 
     setNoError();
 
-    const QString tag = getTag();
-    const QString command = QLatin1String("CREATE \"user") + m_hierarchysep + user + QLatin1Char('"');
+    createMailboxAsync(user, [&ok, &finished](bool _ok) {
+        ok = _ok;
+        finished = true;
+    });
 
-    if (Q_UNLIKELY(!sendCommand(tag, command))) {
-        return ok;
-    }
+    waitForFinished(finished);
 
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        return ok;
-    }
+    return ok;
+}
 
-    ok = checkResponse(readAll(), tag);
-    if (Q_UNLIKELY(!ok)) {
-        qCCritical(SK_IMAP, "Failed to create mailbox for user %s.", user.toUtf8().constData());
-    }
+void SkaffariIMAP::createMailboxAsync(const QString &user, const std::function<void (bool)> &callback)
+{
+    Q_ASSERT_X(!user.isEmpty(), "create mailbox", "empty username");
 
-    return ok;
+    const QString command = QLatin1String("CREATE \"user") + m_hierarchysep + user + QLatin1Char('"');
+
+    sendCommandAsync(command, [this, user, callback](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+        Q_UNUSED(response);
+        const bool ok = (error.type() == SkaffariIMAPError::NoError);
+        if (Q_UNLIKELY(!ok)) {
+            m_imapError = error;
+            qCCritical(SK_IMAP, "Failed to create mailbox for user %s.", user.toUtf8().constData());
+        }
+        if (callback) {
+            callback(ok);
+        }
+    });
 }
 
 bool SkaffariIMAP::deleteMailbox(const QString &user)
 {
-    Q_ASSERT_X(!user.isEmpty(), "delete mailbox", "empty username");
+    bool ok = false;
+    bool finished = false;
 
     setNoError();
 
-    const QString tag = getTag();
-    const QString command = QLatin1String("DELETE \"user") + m_hierarchysep + user + QLatin1Char('"');
+    deleteMailboxAsync(user, [&ok, &finished](bool _ok) {
+        ok = _ok;
+        finished = true;
+    });
 
-    if (Q_UNLIKELY(!sendCommand(tag, command))) {
-        return false;
-    }
+    waitForFinished(finished);
 
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        return false;
-    }
+    return ok;
+}
 
-    return checkResponse(readAll(), tag);
+void SkaffariIMAP::deleteMailboxAsync(const QString &user, const std::function<void (bool)> &callback)
+{
+    Q_ASSERT_X(!user.isEmpty(), "delete mailbox", "empty username");
+
+    const QString command = QLatin1String("DELETE \"user") + m_hierarchysep + user + QLatin1Char('"');
+
+    sendCommandAsync(command, [this, callback](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+        Q_UNUSED(response);
+        const bool ok = (error.type() == SkaffariIMAPError::NoError);
+        if (Q_UNLIKELY(!ok)) {
+            m_imapError = error;
+        }
+        if (callback) {
+            callback(ok);
+        }
+    });
 }
 
 bool SkaffariIMAP::createFolder(const QString &user, const QString &folder, SpecialUse specialUse)
@@ -535,21 +806,20 @@ bool SkaffariIMAP::createFolder(const QString &user, const QString &folder, Spec
 
     const QString _user = user.trimmed();
     if (Q_UNLIKELY(_user.isEmpty())) {
-        m_imapError = SkaffariIMAPError(SkaffariIMAPError::InternalError, m_c->translate("SkaffariIMAP", "Can not create new folder for empty user name."));
+        m_imapError = SkaffariIMAPError(SkaffariIMAPError::InternalError, translate("SkaffariIMAP", "Can not create new folder for empty user name."));
         return false;
     }
 
     const QString _folder = toUTF7Imap(folder.trimmed());
 
     if (Q_UNLIKELY(_folder.isEmpty())) {
-        m_imapError = SkaffariIMAPError(SkaffariIMAPError::InternalError, m_c->translate("SkaffariIMAP", "Failed to convert folder name into UTF-7-IMAP."));
+        m_imapError = SkaffariIMAPError(SkaffariIMAPError::InternalError, translate("SkaffariIMAP", "Failed to convert folder name into UTF-7-IMAP."));
         return false;
     }
 
-    const QString tag1 = getTag();
     QString command1 = QLatin1String("CREATE \"user") + m_hierarchysep + _user + m_hierarchysep + _folder + QLatin1Char('"');
 
-    if (hasCapability(QStringLiteral("CREATE-SPECIAL-USE"))) {
+    if (hasCapability(CapCreateSpecialUse)) {
         switch (specialUse) {
         case Archive:
             command1 += QLatin1String(" (USE (\\Archive))");
@@ -571,22 +841,13 @@ bool SkaffariIMAP::createFolder(const QString &user, const QString &folder, Spec
         }
     }
 
-    if (Q_UNLIKELY(!sendCommand(tag1, command1))) {
-        return false;
-    }
-
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        return false;
-    }
-
-    return checkResponse(readAll(), tag1);
+    return runCommand(command1);
 }
 
 bool SkaffariIMAP::subscribeFolder(const QString &folder)
 {
     setNoError();
 
-    const QString tag = getTag();
     QString command;
 
     if (folder.isEmpty()) {
@@ -595,22 +856,14 @@ bool SkaffariIMAP::subscribeFolder(const QString &folder)
         const QString _folder = toUTF7Imap(folder.trimmed());
 
         if (Q_UNLIKELY(_folder.isEmpty())) {
-            m_imapError = SkaffariIMAPError(SkaffariIMAPError::InternalError, m_c->translate("SkaffariIMAP", "Failed to convert folder name into UTF-7-IMAP."));
+            m_imapError = SkaffariIMAPError(SkaffariIMAPError::InternalError, translate("SkaffariIMAP", "Failed to convert folder name into UTF-7-IMAP."));
             return false;
         }
 
         command = QLatin1String("SUBSCRIBE \"INBOX") + m_hierarchysep + _folder + QLatin1Char('"');
     }
 
-    if (Q_UNLIKELY(!sendCommand(tag, command))) {
-        return false;
-    }
-
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        return false;
-    }
-
-    return checkResponse(readAll(), tag);
+    return runCommand(command);
 }
 
 bool SkaffariIMAP::setSpecialUse(const QString &folder, SpecialUse specialUse)
@@ -622,11 +875,10 @@ bool SkaffariIMAP::setSpecialUse(const QString &folder, SpecialUse specialUse)
     const QString _folder = toUTF7Imap(folder.trimmed());
 
     if (Q_UNLIKELY(_folder.isEmpty())) {
-        m_imapError = SkaffariIMAPError(SkaffariIMAPError::InternalError, m_c->translate("SkaffariIMAP", "Failed to convert folder name into UTF-7-IMAP."));
+        m_imapError = SkaffariIMAPError(SkaffariIMAPError::InternalError, translate("SkaffariIMAP", "Failed to convert folder name into UTF-7-IMAP."));
         return false;
     }
 
-    const QString tag = getTag();
 
     QString command = QLatin1String("SETMETADATA \"INBOX") + m_hierarchysep + _folder + QLatin1String("\" (/private/specialuse ");
 
@@ -651,15 +903,7 @@ bool SkaffariIMAP::setSpecialUse(const QString &folder, SpecialUse specialUse)
         break;
     }
 
-    if (Q_UNLIKELY(!sendCommand(tag, command))) {
-        return false;
-    }
-
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        return false;
-    }
-
-    return checkResponse(readAll(), tag);
+    return runCommand(command);
 }
 
 bool SkaffariIMAP::setAcl(const QString &mailbox, const QString &user, const QString &acl)
@@ -670,18 +914,30 @@ bool SkaffariIMAP::setAcl(const QString &mailbox, const QString &user, const QSt
         _acl = QStringLiteral("lrswipkxtecda");
     }
 
-    const QString tag = getTag();
     const QString command = QLatin1String("SETACL \"user") + m_hierarchysep + mailbox + QLatin1String("\" \"") + user + QLatin1String("\" ") + _acl;
 
-    if (Q_UNLIKELY(!sendCommand(tag, command))) {
-        return false;
-    }
+    return runCommand(command);
+}
 
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        return false;
-    }
+void SkaffariIMAP::setAclAsync(const QString &mailbox, const QString &user, const QString &acl, const std::function<void (bool)> &callback)
+{
+    Q_ASSERT_X(!mailbox.isEmpty(), "set acl", "empty mailbox name");
+    Q_ASSERT_X(!user.isEmpty(), "set acl", "empty user name");
 
-    return checkResponse(readAll(), tag);
+    const QString _acl = acl.isEmpty() ? QStringLiteral("lrswipkxtecda") : acl;
+
+    const QString command = QLatin1String("SETACL \"user") + m_hierarchysep + mailbox + QLatin1String("\" \"") + user + QLatin1String("\" ") + _acl;
+
+    sendCommandAsync(command, [this, callback](const SkaffariIMAPParser &response, const SkaffariIMAPError &error) {
+        Q_UNUSED(response);
+        const bool ok = (error.type() == SkaffariIMAPError::NoError);
+        if (Q_UNLIKELY(!ok)) {
+            m_imapError = error;
+        }
+        if (callback) {
+            callback(ok);
+        }
+    });
 }
 
 bool SkaffariIMAP::deleteAcl(const QString &mailbox, const QString &user)
@@ -691,18 +947,9 @@ bool SkaffariIMAP::deleteAcl(const QString &mailbox, const QString &user)
     Q_ASSERT_X(!mailbox.isEmpty(), "delete acl", "empty mailbox name");
     Q_ASSERT_X(!user.isEmpty(), "delete acl", "empty user name");
 
-    const QString tag = getTag();
     const QString command = QLatin1String("DELETEACL \"user") + m_hierarchysep + mailbox + QLatin1String("\" \"") + user + QLatin1Char('"');
 
-    if (Q_UNLIKELY(!sendCommand(tag, command))) {
-        return false;
-    }
-
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        return false;
-    }
-
-    return checkResponse(readAll(), tag);
+    return runCommand(command);
 }
 
 QStringList SkaffariIMAP::getMailboxes()
@@ -712,28 +959,24 @@ QStringList SkaffariIMAP::getMailboxes()
     setNoError();
 
     const QString user = QLatin1String("user") + m_hierarchysep;
-    const QString tag = getTag();
     const QString command = QLatin1String("LIST \"") + user + QLatin1String("\" %");
 
-    if (Q_UNLIKELY(!sendCommand(tag, command))) {
-        return list;
-    }
-
-    if (Q_UNLIKELY(!waitForResponse(true))) {
-        return list;
-    }
-
-    QVector<QByteArray> respLines;
-    if (Q_UNLIKELY(!checkResponse(readAll(), tag, &respLines))) {
+    SkaffariIMAPParser parser;
+    if (Q_UNLIKELY(!runCommand(command, &parser))) {
         return list;
     }
 
     const QByteArray userBa = user.toLatin1();
-    for (auto i = respLines.cbegin(); i != respLines.cend(); ++i) {
-        const QByteArray line = *i;
+    list.reserve(parser.count());
+    for (int i = 0; i < parser.count(); ++i) {
+        const QByteArray line = parser.response(i);
         const int idx = line.lastIndexOf(userBa);
         if (idx > -1) {
-            const QByteArray mbox = line.mid(idx + 5);
+            QByteArray mbox = line.mid(idx + userBa.size());
+            // quoted mailbox names
+            if (mbox.endsWith('"')) {
+                mbox.chop(1);
+            }
             list.push_back(QString::fromLatin1(mbox));
         }
     }
@@ -741,80 +984,326 @@ QStringList SkaffariIMAP::getMailboxes()
     return list;
 }
 
-bool SkaffariIMAP::connectionTimeOut()
+bool SkaffariIMAP::mailboxExists(const QString &user)
 {
-    qCWarning(SK_IMAP) << "Connection to IMAP server timed out.";
-    m_imapError = SkaffariIMAPError(SkaffariIMAPError::ConnectionTimeout, m_c->translate("SkaffariIMAP", "Connection to IMAP server timed out."));
-    abort();
+    setNoError();
+
+    const QString command = QLatin1String("LIST \"\" \"user") + m_hierarchysep + user + QLatin1Char('"');
+
+    SkaffariIMAPParser parser;
+    if (Q_UNLIKELY(!runCommand(command, &parser))) {
+        return false;
+    }
+
+    for (int i = 0; i < parser.count(); ++i) {
+        if ((parser.kind(i) == SkaffariIMAPParser::Untagged) && parser.response(i).startsWith(QByteArrayLiteral("* LIST "))) {
+            return true;
+        }
+    }
+
     return false;
 }
 
-bool SkaffariIMAP::checkResponse(const QByteArray &data, const QString &tag, QVector<QByteArray> *response)
+QByteArray SkaffariIMAP::sendCommandAsync(const QString &command, const ResponseCallback &callback)
 {
-    bool ret = false;
+    const QByteArray tag = getTag().toLatin1();
 
-    if (Q_UNLIKELY(data.isEmpty())) {
-        qCWarning(SK_IMAP) << "The IMAP response is undefined.";
-        m_imapError = SkaffariIMAPError(SkaffariIMAPError::UndefinedResponse, m_c->translate("SkaffariIMAP", "The IMAP response is undefined."));
-        return ret;
+    if (!m_loggedIn && !m_loginCallbacks.empty()) {
+        // nothing but the login commands may be sent before the authentication has been completed,
+        // otherwise they would go out in cleartext before STARTTLS
+        QueuedCommand cmd;
+        cmd.tag = tag;
+        cmd.command = command;
+        cmd.callback = callback;
+        m_queued.push_back(cmd);
+        return tag;
     }
 
-    const QList<QByteArray> lines = data.split('\n');
-    if (Q_UNLIKELY(lines.empty())) {
-        qCWarning(SK_IMAP) << "The IMAP response is undefined.";
-        m_imapError = SkaffariIMAPError(SkaffariIMAPError::UndefinedResponse, m_c->translate("SkaffariIMAP", "The IMAP response is undefined."));
-        return ret;
+    return sendCommandAsync(tag, command, callback);
+}
+
+QByteArray SkaffariIMAP::sendLoginCommandAsync(const QString &command, const ResponseCallback &callback)
+{
+    return sendCommandAsync(getTag().toLatin1(), command, callback);
+}
+
+QByteArray SkaffariIMAP::sendCommandAsync(const QByteArray &tag, const QString &command, const ResponseCallback &callback)
+{
+    PendingCommand cmd;
+    cmd.tag = tag;
+    cmd.callback = callback;
+
+    if (m_pending.empty()) {
+        m_parser.reset(cmd.tag);
     }
+    m_pending.push_back(cmd);
+    m_timeoutTimer.start();
 
-    const QByteArray tagLatin1 = tag.toLatin1();
+    if (Q_UNLIKELY(!sendCommand(cmd.tag, command.toLatin1()))) {
+        // the state of the connection is unknown now, so it is not safe to wait for other responses
+        const SkaffariIMAPError error = m_imapError;
+        failPending(error);
+        abort();
+        m_loggedIn = false;
+        if (!m_loginCallbacks.empty()) {
+            loginFailed(error);
+        }
+        return QByteArray();
+    }
 
-    QByteArray statusLine;
-    QVector<QByteArray> trimmedList;
-    for (const QByteArray &ba : lines) {
-        if (!ba.isEmpty()) {
-            const QByteArray baTrimmed = ba.trimmed();
-            if (!baTrimmed.isEmpty()) {
-                if (baTrimmed.startsWith(tagLatin1)) {
-                    statusLine = baTrimmed;
-                } else {
-                    trimmedList.push_back(baTrimmed);
-                }
+    return cmd.tag;
+}
+
+int SkaffariIMAP::pendingCommands() const
+{
+    return static_cast<int>(m_pending.size() + m_queued.size());
+}
+
+quint64 SkaffariIMAP::configGeneration() const
+{
+    return m_configGeneration;
+}
+
+bool SkaffariIMAP::waitForPendingCommands(int msecs)
+{
+    if (Q_UNLIKELY(m_processing)) {
+        qCCritical(SK_IMAP, "Blocking IMAP operation started from inside a response callback.");
+        return false;
+    }
+
+    while (!m_pending.empty() || !m_loginCallbacks.empty()) {
+        if (bytesAvailable() > 0) {
+            processIncoming();
+            continue;
+        }
+
+        if (Q_UNLIKELY(!waitForReadyRead(msecs))) {
+            if (!m_pending.empty() || !m_loginCallbacks.empty()) {
+                abortPending();
             }
+            return false;
         }
+
+        processIncoming();
     }
 
-    if (Q_UNLIKELY(statusLine.isEmpty() && (trimmedList.size() == 1))) {
-        statusLine = trimmedList.last();
+    return true;
+}
+
+bool SkaffariIMAP::runCommand(const QString &command, SkaffariIMAPParser *response, int msecs)
+{
+    bool finished = false;
+    SkaffariIMAPError error;
+
+    sendCommandAsync(command, [&finished, &error, response](const SkaffariIMAPParser &resp, const SkaffariIMAPError &err) {
+        if (resp.state() == SkaffariIMAPParser::Continuation) {
+            return;
+        }
+        error = err;
+        if (response) {
+            *response = resp;
+        }
+        finished = true;
+    });
+
+    waitForFinished(finished, msecs);
+
+    if (Q_UNLIKELY(error.type() != SkaffariIMAPError::NoError)) {
+        m_imapError = error;
+        return false;
     }
 
-    if (Q_UNLIKELY(statusLine.isEmpty())) {
-        m_imapError = SkaffariIMAPError(SkaffariIMAPError::UndefinedResponse, m_c->translate("SkaffariIMAP", "The IMAP response is undefined."));
-        return ret;
+    return true;
+}
+
+void SkaffariIMAP::waitForFinished(const bool &finished, int msecs)
+{
+    if (Q_UNLIKELY(m_processing && !finished)) {
+        // called from a response callback, the response can not be read before the callback returns
+        qCCritical(SK_IMAP, "Blocking IMAP operation started from inside a response callback.");
+        abortPending(SkaffariIMAPError(SkaffariIMAPError::InternalError, translate("SkaffariIMAP", "Blocking IMAP operation started from inside a response callback.")));
+        return;
     }
 
-    if (trimmedList.empty()) {
-        trimmedList.push_back(statusLine);
+    while (!finished) {
+        if (bytesAvailable() > 0) {
+            processIncoming();
+            continue;
+        }
+
+        // QSslSocket::waitForReadyRead() also waits for the connection to be established
+        // and encrypted and emits the readyRead() signal that is connected to processIncoming()
+        if (Q_UNLIKELY(!waitForReadyRead(msecs))) {
+            if (!finished) {
+                abortPending();
+            }
+            return;
+        }
+
+        processIncoming();
     }
+}
 
-    const QByteArray status = statusLine.mid(tagLatin1.size()+1);
+void SkaffariIMAP::processIncoming()
+{
+    if (m_processing) {
+        return;
+    }
 
-    if (status.startsWith(QByteArrayLiteral("OK"))) {
-        ret = true;
-        if (response) {
-            response->swap(trimmedList);
-        }
-    } else if (status.startsWith(QByteArrayLiteral("BAD"))) {
-        m_imapError = SkaffariIMAPError(SkaffariIMAPError::BadResponse, m_c->translate("SkaffariIMAP", "We received a BAD response from the IMAP server: %1").arg(QString::fromLatin1(status.mid(4))));
-        qCCritical(SK_IMAP) << "We received a BAD response from the IMAP server:" << QString::fromLatin1(status.mid(4));
-    } else if (status.startsWith(QByteArrayLiteral("NO"))) {
-        m_imapError = SkaffariIMAPError(SkaffariIMAPError::NoResponse, m_c->translate("SkaffariIMAP", "We received a NO response from the IMAP server: %1").arg(QString::fromLatin1(status.mid(3))));
-        qCCritical(SK_IMAP) << "We received a NO response from the IMAP server:" << QString::fromLatin1(status.mid(3));
+    QByteArray data = readAll();
+    if (data.isEmpty()) {
+        return;
+    }
+
+    m_processing = true;
+
+    if (m_pending.empty()) {
+        // unsolicited data like a BYE response before the server closes an idle connection
+        qCDebug(SK_IMAP, "Discarding unsolicited data from the IMAP server: %s", qUtf8Printable(QString::fromLatin1(data)));
     } else {
-        m_imapError = SkaffariIMAPError(SkaffariIMAPError::UndefinedResponse, m_c->translate("SkaffariIMAP", "The IMAP response is undefined."));
-        qCCritical(SK_IMAP) << "The IMAP response is undefined.";
+        m_parser.feed(data);
     }
 
-    return ret;
+    // pipelined responses are parsed in place, the copy of the parser shares its buffer
+    while (!m_pending.empty() && (m_parser.state() != SkaffariIMAPParser::Incomplete)) {
+
+        const SkaffariIMAPParser response = m_parser;
+
+        if (response.state() == SkaffariIMAPParser::Continuation) {
+            // the command is still in progress, the callback has to send the continuation data
+            const ResponseCallback callback = m_pending.front().callback;
+            m_parser.next(response.tag());
+            if (callback) {
+                callback(response, SkaffariIMAPError());
+            }
+            continue;
+        }
+
+        const PendingCommand cmd = m_pending.front();
+        m_pending.pop_front();
+        if (m_pending.empty()) {
+            if (Q_UNLIKELY(m_parser.hasTrailingData())) {
+                qCDebug(SK_IMAP, "Discarding unsolicited data from the IMAP server: %s", qUtf8Printable(QString::fromLatin1(m_parser.trailingData())));
+            }
+            m_parser.reset(QByteArray());
+        } else {
+            m_parser.next(m_pending.front().tag);
+        }
+
+        if (cmd.callback) {
+            cmd.callback(response, statusError(response.status()));
+        }
+    }
+
+    m_processing = false;
+
+    if (m_pending.empty() && m_loginCallbacks.empty()) {
+        m_timeoutTimer.stop();
+    } else {
+        m_timeoutTimer.start();
+    }
+}
+
+void SkaffariIMAP::failPending(const SkaffariIMAPError &error)
+{
+    std::deque<PendingCommand> pending;
+    pending.swap(m_pending);
+    m_parser.reset(QByteArray());
+
+    for (const PendingCommand &cmd : pending) {
+        if (cmd.callback) {
+            cmd.callback(SkaffariIMAPParser(cmd.tag), error);
+        }
+    }
+}
+
+void SkaffariIMAP::abortPending(const SkaffariIMAPError &error)
+{
+    SkaffariIMAPError _error = error;
+    if (_error.type() == SkaffariIMAPError::NoError) {
+        if ((state() == ConnectedState) || (state() == ConnectingState) || (state() == HostLookupState)) {
+            qCWarning(SK_IMAP) << "Connection to IMAP server timed out.";
+            _error = SkaffariIMAPError(SkaffariIMAPError::ConnectionTimeout, translate("SkaffariIMAP", "Connection to the IMAP server timed out."));
+        } else {
+            _error = SkaffariIMAPError(SkaffariIMAPError::SocketError, errorString());
+        }
+    }
+
+    m_imapError = _error;
+    m_loggedIn = false;
+    m_timeoutTimer.stop();
+    failPending(_error);
+    abort();
+    if (!m_loginCallbacks.empty()) {
+        loginFailed(_error);
+    }
+}
+
+void SkaffariIMAP::onTimeout()
+{
+    if (!m_pending.empty() || !m_loginCallbacks.empty()) {
+        abortPending();
+    }
+}
+
+void SkaffariIMAP::onSocketError(QAbstractSocket::SocketError socketError)
+{
+    m_loggedIn = false;
+
+    if (m_pending.empty() && m_loginCallbacks.empty()) {
+        return;
+    }
+
+    SkaffariIMAPError error;
+    const QList<QSslError> sslErrs = sslErrors();
+    if ((socketError == QAbstractSocket::SslHandshakeFailedError) && !sslErrs.empty()) {
+        error = SkaffariIMAPError(sslErrs.first());
+    } else if (m_startTls) {
+        error = SkaffariIMAPError(SkaffariIMAPError::EncryptionError, translate("SkaffariIMAP", "Failed to initiate STARTTLS: %1").arg(errorString()));
+    } else {
+        error = SkaffariIMAPError(SkaffariIMAPError::SocketError, errorString());
+    }
+
+    qCCritical(SK_IMAP, "Connection to the IMAP server failed: %s", qUtf8Printable(errorString()));
+
+    abortPending(error);
+}
+
+SkaffariIMAPError SkaffariIMAP::statusError(const QByteArray &status) const
+{
+    if (status.startsWith(QByteArrayLiteral("OK"))) {
+        return SkaffariIMAPError();
+    }
+
+    if (status.startsWith(QByteArrayLiteral("BAD"))) {
+        const QString msg = QString::fromLatin1(status.mid(4));
+        qCCritical(SK_IMAP) << "We received a BAD response from the IMAP server:" << msg;
+        return SkaffariIMAPError(SkaffariIMAPError::BadResponse, translate("SkaffariIMAP", "We received a BAD response from the IMAP server: %1").arg(msg));
+    }
+
+    if (status.startsWith(QByteArrayLiteral("NO"))) {
+        const QString msg = QString::fromLatin1(status.mid(3));
+        qCCritical(SK_IMAP) << "We received a NO response from the IMAP server:" << msg;
+        return SkaffariIMAPError(SkaffariIMAPError::NoResponse, translate("SkaffariIMAP", "We received a NO response from the IMAP server: %1").arg(msg));
+    }
+
+    qCCritical(SK_IMAP) << "The IMAP response is undefined.";
+    return SkaffariIMAPError(SkaffariIMAPError::UndefinedResponse, translate("SkaffariIMAP", "The IMAP response is undefined."));
+}
+
+QStringList SkaffariIMAP::parseCapabilities(const SkaffariIMAPParser &response)
+{
+    QStringList caps;
+    for (int i = 0; i < response.count(); ++i) {
+        const QByteArray respLine = response.response(i);
+        if (respLine.startsWith(QByteArrayLiteral("* CAPABILITY "))) {
+            // 13 is the length of "* CAPABILITY "
+            const QString respString = QString::fromLatin1(respLine.mid(13));
+            caps = respString.split(QChar(QChar::Space), QString::SkipEmptyParts);
+            break;
+        }
+    }
+    return caps;
 }
 
 void SkaffariIMAP::setUser ( const QString& user )
@@ -847,6 +1336,11 @@ void SkaffariIMAP::setEncryptionType(SkaffariIMAP::EncryptionType encType)
     m_encType = encType;
 }
 
+void SkaffariIMAP::setContext(Cutelyst::Context *context)
+{
+    m_c = context;
+}
+
 void SkaffariIMAP::setNoError()
 {
     if (m_imapError.type() != SkaffariIMAPError::NoError) {
@@ -922,22 +1416,19 @@ bool SkaffariIMAP::isLoggedIn() const
     return m_loggedIn;
 }
 
-QString SkaffariIMAP::getTag()
+QString SkaffariIMAP::translate(const char *context, const char *sourceText, const char *disambiguation, int n) const
 {
-    return QStringLiteral("a%1").arg(++m_tagSequence, 6, 10, QLatin1Char('0'));
+    if (m_c) {
+        return m_c->translate(context, sourceText, disambiguation, n);
+    }
+    return QCoreApplication::translate(context, sourceText, disambiguation, n);
 }
 
-
-bool SkaffariIMAP::sendCommand(const QString &command)
+QString SkaffariIMAP::getTag()
 {
-    return sendCommand(command.toLatin1());
+    return QStringLiteral("a%1").arg(++m_tagSequence, 6, 10, QLatin1Char('0'));
 }
 
-bool SkaffariIMAP::sendCommand(const QString &tag, const QString &command)
-{
-    const QString cmd = tag + QChar(QChar::Space) + command;
-    return sendCommand(cmd.toLatin1());
-}
 
 bool SkaffariIMAP::sendCommand(const QByteArray &command)
 {
@@ -947,7 +1438,7 @@ bool SkaffariIMAP::sendCommand(const QByteArray &command)
 
     if (Q_UNLIKELY(write(cmd) != cmd.size())) {
         qCCritical(SK_IMAP, "Failed to send command \"%s\" to the IMAP server: %s", command.constData(), qUtf8Printable(errorString()));
-        m_imapError = SkaffariIMAPError(SkaffariIMAPError::SocketError, m_c->translate("SkaffariIMAP", "Failed to send command to IMAP server: %1").arg(errorString()));
+        m_imapError = SkaffariIMAPError(SkaffariIMAPError::SocketError, translate("SkaffariIMAP", "Failed to send command to IMAP server: %1").arg(errorString()));
         return false;
     }
 
@@ -975,19 +1466,4 @@ bool SkaffariIMAP::disconnectOnError(SkaffariIMAPError::ErrorType type, const QS
     return false;
 }
 
-bool SkaffariIMAP::waitForResponse(bool disConn, const QString &error, int msecs)
-{
-    if (Q_UNLIKELY(!waitForReadyRead(msecs))) {
-        const QString _error = !error.isEmpty() ? error : m_c->translate("SkaffariIMAP", "Connection to the IMAP server timed out.");
-        if (disConn) {
-            return disconnectOnError(SkaffariIMAPError::ConnectionTimeout, _error);
-        } else {
-            m_imapError = SkaffariIMAPError(SkaffariIMAPError::ConnectionTimeout, _error);
-            return false;
-        }
-    } else {
-        return true;
-    }
-}
-
 #include "moc_skaffariimap.cpp"
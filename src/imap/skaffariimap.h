@@ -21,8 +21,14 @@
 
 #include <QSslSocket>
 #include <QLoggingCategory>
+#include <QHash>
+#include <QTimer>
+#include <functional>
+#include <deque>
+#include <vector>
 
 #include "skaffariimaperror.h"
+#include "skaffariimapparser.h"
 #include "../../common/global.h"
 
 Q_DECLARE_LOGGING_CATEGORY(SK_IMAP)
@@ -41,12 +47,36 @@ class Context;
  * All default values for performing the IMAP operations will be read from the Skaffari configuration file (see SkaffariConfig)
  * but can be changed via the setter functions.
  *
+ * Internally all commands are sent asynchronously: the response of the server is read when the
+ * socket emits readyRead() and dispatched to the callback of the command it belongs to. Multiple commands
+ * can be in flight at the same time, the server answers them in order. The blocking functions like login()
+ * or createMailbox() are thin wrappers around their asynchronous counterparts that wait for the response
+ * with QSslSocket::waitForReadyRead(). Response callbacks must never call the blocking functions.
+ *
  * \par Usage example
  * \code
  * SkaffariIMAP imap(c);
  * if (imap.login()) {
  *     imap.createMailbox("jhondoe");
  * }
+ * \endcode
+ *
+ * \par Asynchronous usage example
+ * \code
+ * auto imap = new SkaffariIMAP(c, c);
+ * c->detachAsync();
+ * imap->loginAsync([c, imap](bool ok) {
+ *     if (!ok) {
+ *         c->res()->setBody(imap->lastError().errorText());
+ *         c->attachAsync();
+ *         return;
+ *     }
+ *     imap->getQuotasAsync(users, [c](const QHash<QString,quota_pair> &quotas) {
+ *         c->setStash(QStringLiteral("quotas"), QVariant::fromValue(quotas));
+ *         c->attachAsync();
+ *     });
+ * });
+ * \endcode
  */
 class SkaffariIMAP : public QSslSocket
 {
@@ -94,12 +124,51 @@ public:
         SkaffariOtherFolders    = 255
     };
 
+    /*!
+     * \brief Capabilities known to Skaffari.
+     *
+     * The capability strings sent by the server are converted into these flags once per connection,
+     * so hasCapability() does not need to scan the capability list.
+     */
+    enum Capability : quint32 {
+        NoCapability        = 0x00000000,
+        CapID               = 0x00000001,   /**< ID (RFC 2971) */
+        CapCreateSpecialUse = 0x00000002,   /**< CREATE-SPECIAL-USE (RFC 6154) */
+        CapSpecialUse       = 0x00000004,   /**< SPECIAL-USE (RFC 6154) */
+        CapMetadata         = 0x00000008,   /**< METADATA (RFC 5464) */
+        CapLiteralPlus      = 0x00000010,   /**< LITERAL+ (RFC 7888) */
+        CapLiteralMinus     = 0x00000020,   /**< LITERAL- (RFC 7888) */
+        CapSaslIR           = 0x00000040,   /**< SASL-IR (RFC 4959) */
+        CapStatusSize       = 0x00000080,   /**< STATUS=SIZE (RFC 8438) */
+        CapCompress         = 0x00000100,   /**< COMPRESS=DEFLATE (RFC 4978) */
+        CapQuota            = 0x00000200,   /**< QUOTA (RFC 2087) */
+        CapAcl              = 0x00000400,   /**< ACL (RFC 4314) */
+        CapStartTLS         = 0x00000800,   /**< STARTTLS */
+        CapIdle             = 0x00001000,   /**< IDLE (RFC 2177) */
+        CapNamespace        = 0x00002000,   /**< NAMESPACE (RFC 2342) */
+        CapUidPlus          = 0x00004000,   /**< UIDPLUS (RFC 4315) */
+        CapAuthPlain        = 0x00008000,   /**< AUTH=PLAIN */
+        CapAuthLogin        = 0x00010000,   /**< AUTH=LOGIN */
+        CapAuthCramMD5      = 0x00020000    /**< AUTH=CRAM-MD5 */
+    };
+    Q_DECLARE_FLAGS(Capabilities, Capability)
+
+    /*!
+     * \brief Callback for the responses of asynchronous commands.
+     *
+     * \a response contains the untagged responses and the status line of the command. If the server
+     * requested more data for the command, the callback is invoked with a \a response in the
+     * SkaffariIMAPParser::Continuation state before it is invoked again for the final status.
+     * If the command failed or the connection broke, \a error will contain information about the error.
+     */
+    typedef std::function<void(const SkaffariIMAPParser &response, const SkaffariIMAPError &error)> ResponseCallback;
+
     /*!
      * \brief Constructs a new SkaffariIMAP object.
      *
      * A newly created object will have the configuration read from the Skaffari configuration file IMAP section.
      *
-     * \param context   Pointer to the current context. Used for translation of strings.
+     * \param context   Pointer to the current context. Used for translation of strings. Might be \c nullptr.
      * \param parent    Pointer to a parent object.
      */
     explicit SkaffariIMAP(Cutelyst::Context *context, QObject *parent = nullptr);
@@ -121,6 +190,18 @@ public:
      */
     bool login();
 
+    /*!
+     * \brief Starts the login operation for the current user without blocking.
+     *
+     * The \a callback is invoked with \c true when the user has been logged in. On failure,
+     * lastError() will provide further information. Commands can already be sent while the login
+     * is in progress, they are queued and sent to the server after the authentication has been
+     * completed. If the login fails, the queued commands fail with the same error.
+     *
+     * \sa login()
+     */
+    void loginAsync(const std::function<void(bool)> &callback);
+
     /*!
      * \brief Performs logout operation for the current user.
      *
@@ -131,6 +212,16 @@ public:
      */
     bool logout();
 
+    /*!
+     * \brief Sends a NOOP command to the server to check if the connection is still alive.
+     *
+     * If the connection has been closed by the server in the meantime, isLoggedIn() will
+     * return \c false afterwards and the next call to login() will establish a new connection.
+     *
+     * \return \c true if the server responded with OK.
+     */
+    bool noop();
+
     /*!
      * \brief Returns true if the current user is logged in.
      * \return True if the current user is logged in.
@@ -140,19 +231,38 @@ public:
     /*!
      * \brief Requests the capabilities from the server.
      *
-     * The list of capabilities is cached. To reload the capabilities, set \a forceReload
-     * to \c true. If the list is empty, lastError() will provide further information.
+     * The capabilities are cached per server for all connections and refreshed on every
+     * login if the server sends them with the login response. To reload the capabilities,
+     * set \a forceReload to \c true. If the list is empty, lastError() will provide further
+     * information.
      *
      * \param forceReload   Set to true to force a reload and don't use the cached values.
      * \return List of capability strings.
      */
     QStringList getCapabilities(bool forceReload = false);
 
+    /*!
+     * \brief Returns the known capabilities of the server as flags.
+     *
+     * If there are no capabilities for the current connection or \a forceReload is \c true,
+     * getCapabilities() will be used to request them.
+     */
+    Capabilities capabilities(bool forceReload = false);
+
+    /*!
+     * \brief Returns \c true if \a capability is available.
+     *
+     * Only tests the flags of the current connection, the capabilities are not requested from
+     * the server, so call this after login().
+     */
+    bool hasCapability(Capability capability) const;
+
     /*!
      * \brief Returns \c true if \a capability is available.
      *
      * If capabilities are empty or \a forceReload is set to \c true, getCapabilities()
-     * will be used to request the capabilities from the server.
+     * will be used to request the capabilities from the server. Prefer the overload taking
+     * a Capability flag for capabilities known by Skaffari.
      *
      * \param capability    The capability to check for.
      * \param forceReload   Set to \c true to force a reload and don’t use the cached values.
@@ -160,6 +270,11 @@ public:
      */
     bool hasCapability(const QString &capability, bool forceReload = false);
 
+    /*!
+     * \brief Converts a list of capability strings into flags, unknown capabilities are ignored.
+     */
+    static Capabilities capabilityFlags(const QStringList &capabilities);
+
     /*!
      * \brief Requests the quota values for \a user.
      *
@@ -171,6 +286,34 @@ public:
      */
     quota_pair getQuota(const QString &user);
 
+    /*!
+     * \brief Requests the quota values for \a user without blocking.
+     *
+     * The \a callback is invoked with the quota values, see getQuota().
+     */
+    void getQuotaAsync(const QString &user, const std::function<void(quota_pair)> &callback);
+
+    /*!
+     * \brief Requests the quota values for all \a users at once.
+     *
+     * All GETQUOTA commands are sent to the server at once and the responses are dispatched
+     * to the users as they arrive. So this needs only a single round trip instead
+     * of one per user like getQuota(). Users the server returned no quota for will have both
+     * values set to \c 0. On connection errors the returned hash is empty and lastError() will
+     * provide further information.
+     *
+     * \param users The users to request the quota values for.
+     * \return Hash with user names as keys and quota pairs as values, both values in KiB.
+     */
+    QHash<QString,quota_pair> getQuotas(const QStringList &users);
+
+    /*!
+     * \brief Requests the quota values for all \a users without blocking.
+     *
+     * The \a callback is invoked after the responses for all \a users have been received, see getQuotas().
+     */
+    void getQuotasAsync(const QStringList &users, const std::function<void(const QHash<QString,quota_pair> &)> &callback);
+
     /*!
      * \brief Sets the storage \a quota for the \a user.
      *
@@ -182,6 +325,13 @@ public:
      */
     bool setQuota(const QString &user, quota_size_t quota);
 
+    /*!
+     * \brief Sets the storage \a quota for the \a user without blocking.
+     *
+     * The \a callback is invoked with \c true on success.
+     */
+    void setQuotaAsync(const QString &user, quota_size_t quota, const std::function<void(bool)> &callback);
+
     /*!
      * \brief Creates the mailbox for the \a user.
      *
@@ -193,6 +343,13 @@ public:
      */
     bool createMailbox(const QString &user);
 
+    /*!
+     * \brief Creates the mailbox for the \a user without blocking.
+     *
+     * The \a callback is invoked with \c true on success.
+     */
+    void createMailboxAsync(const QString &user, const std::function<void(bool)> &callback);
+
     /*!
      * \brief Deletes the mailbox for the \a user.
      *
@@ -204,6 +361,13 @@ public:
      */
     bool deleteMailbox(const QString &user);
 
+    /*!
+     * \brief Deletes the mailbox for the \a user without blocking.
+     *
+     * The \a callback is invoked with \c true on success.
+     */
+    void deleteMailboxAsync(const QString &user, const std::function<void(bool)> &callback);
+
     /*!
      * \brief Creates a new \a folder in the mailbox of \a user.
      *
@@ -249,6 +413,13 @@ public:
      */
     bool setAcl(const QString &mailbox, const QString &user, const QString &acl = QString());
 
+    /*!
+     * \brief Sets the \a acl for the \a user on the \a mailbox without blocking.
+     *
+     * If \a acl is empty, all rights will be granted. The \a callback is invoked with \c true on success.
+     */
+    void setAclAsync(const QString &mailbox, const QString &user, const QString &acl, const std::function<void(bool)> &callback);
+
     /*!
      * \brief Deletes the ACL for the \a user on the \a mailbox.
      *
@@ -267,6 +438,46 @@ public:
      */
     QStringList getMailboxes();
 
+    /*!
+     * \brief Returns \c true if the mailbox of \a user exists on the server.
+     *
+     * Other than getMailboxes() this only lists the mailbox of \a user. If the server returns an error,
+     * this returns \c false and lastError() will contain information about the error.
+     */
+    bool mailboxExists(const QString &user);
+
+    /*!
+     * \brief Sends \a command to the server without waiting for the response.
+     *
+     * The \a callback is invoked when the response has been received or the command failed. If
+     * the command could not be sent, the \a callback is invoked before this function returns.
+     *
+     * \return The tag of the command or an empty byte array if the command could not be sent.
+     */
+    QByteArray sendCommandAsync(const QString &command, const ResponseCallback &callback);
+
+    /*!
+     * \brief Returns the number of commands that are waiting for a response.
+     */
+    int pendingCommands() const;
+
+    /*!
+     * \brief Returns the generation of the configuration this connection has been created with.
+     *
+     * \sa SkaffariConfig::generation()
+     */
+    quint64 configGeneration() const;
+
+    /*!
+     * \brief Blocks until the responses for all pending commands have been received.
+     *
+     * Waits at most \a msecs milliseconds for new data. On timeout all pending commands fail
+     * and the connection will be closed.
+     *
+     * \return \c false on timeout or connection errors.
+     */
+    bool waitForPendingCommands(int msecs = 30000);
+
     /*!
      * \brief Returns the last occurred error.
      * \return Last error object.
@@ -322,6 +533,14 @@ public:
      */
     void setEncryptionType(EncryptionType encType);
 
+    /*!
+     * \brief Sets the \a context used for translation of error strings.
+     *
+     * If \a context is a \c nullptr, strings will be translated by QCoreApplication::translate().
+     * Used by SkaffariIMAPPool to reuse a connection across different requests.
+     */
+    void setContext(Cutelyst::Context *context);
+
     /*!
      * \brief Converts an UTF-8 string into UTF-7-IMAP
      * \param str UTF-8 string to convert.
@@ -336,24 +555,111 @@ public:
      */
     static QString fromUTF7Imap(const QByteArray &ba);
 
+private Q_SLOTS:
+    /*!
+     * \brief Feeds newly received data into the parser and dispatches complete responses to their callbacks.
+     */
+    void processIncoming();
+
+    void onEncrypted();
+    void onSocketError(QAbstractSocket::SocketError socketError);
+    void onTimeout();
+
 private:
     /*!
-     * \brief Sets the last error object to a timeout error and aborts the operation.
-     * \return Always false.
+     * \brief Command that has been sent to the server and waits for its response.
      */
-    bool connectionTimeOut();
+    struct PendingCommand {
+        QByteArray tag;
+        ResponseCallback callback;
+    };
 
     /*!
-     * \brief Checks the response of the IMAP server.
+     * \brief Command that has been sent while the login is in progress and waits for the authentication.
+     */
+    struct QueuedCommand {
+        QByteArray tag;
+        QString command;
+        ResponseCallback callback;
+    };
+
+    void onGreeting(const SkaffariIMAPParser &response, const SkaffariIMAPError &error);
+    void authenticate();
+    void onAuthenticated(const SkaffariIMAPParser &response, const SkaffariIMAPError &error);
+    /*!
+     * \brief Sends the client ID to the server if it supports the ID extension.
+     */
+    void sendId();
+    /*!
+     * \brief Sets \a error as lastError(), closes the connection and invokes the login callbacks.
+     */
+    void loginFailed(const SkaffariIMAPError &error);
+    void finishLogin(bool ok);
+    /*!
+     * \brief Sends \a command of the login process, bypassing the queue used for other commands while the login is in progress.
+     */
+    QByteArray sendLoginCommandAsync(const QString &command, const ResponseCallback &callback);
+    QByteArray sendCommandAsync(const QByteArray &tag, const QString &command, const ResponseCallback &callback);
+
+    /*!
+     * \brief Sends \a command and blocks until its response has been received.
      *
-     * If the check fails, lastError() will provide further information.
+     * If \a response is not a \c nullptr, the complete response will be copied into it. If the
+     * command fails, lastError() will provide further information.
      *
-     * \param data      The data requested from the IMAP server.
-     * \param tag       The tag used for the request.
-     * \param response  Pointer to a vector that will contain the resulting lines (if any).
-     * \return True on success.
+     * \return \c true if the server responded with OK.
+     */
+    bool runCommand(const QString &command, SkaffariIMAPParser *response = nullptr, int msecs = 30000);
+
+    /*!
+     * \brief Blocks until \a finished becomes \c true or no data has been received for \a msecs milliseconds.
+     *
+     * On timeout all pending commands fail, so \a finished will be \c true afterwards.
+     */
+    void waitForFinished(const bool &finished, int msecs = 30000);
+
+    /*!
+     * \brief Invokes the callbacks of all pending commands with \a error.
+     */
+    void failPending(const SkaffariIMAPError &error);
+
+    /*!
+     * \brief Fails all pending commands and a running login and closes the connection.
+     *
+     * If \a error is empty, a timeout or socket error is set depending on the socket state.
+     */
+    void abortPending(const SkaffariIMAPError &error = SkaffariIMAPError());
+
+    /*!
+     * \brief Returns the error for the \a status of a tagged response, NoError if the status is OK.
+     */
+    SkaffariIMAPError statusError(const QByteArray &status) const;
+
+    /*!
+     * \brief Returns the capabilities from an untagged CAPABILITY response.
      */
-    bool checkResponse(const QByteArray &data, const QString &tag = QString(), QVector<QByteArray> *response = nullptr);
+    static QStringList parseCapabilities(const SkaffariIMAPParser &response);
+
+    /*!
+     * \brief Sets the \a capabilities for the current connection and stores them in the per server registry.
+     */
+    void setCapabilities(const QStringList &capabilities);
+
+    /*!
+     * \brief Loads the capabilities for the current server from the registry.
+     * \return \c false if there are no capabilities for the server in the registry.
+     */
+    bool loadCapabilities();
+
+    /*!
+     * \brief Returns the key of the current server in the capability registry.
+     */
+    QString capabilityKey() const;
+
+    /*!
+     * \brief Translates \a sourceText by the current context or by QCoreApplication if there is no context.
+     */
+    QString translate(const char *context, const char *sourceText, const char *disambiguation = nullptr, int n = -1) const;
     /*!
      * \brief Returns a new tag.
      * \return New sequential tag.
@@ -364,17 +670,13 @@ private:
      */
     void setNoError();
     /*!
-     * \brief Sends the \a command to the IMAP server.
+     * \brief Writes the \a command to the IMAP server.
      *
      * If sending the command failed, lastError() will provide further information.
      *
      * \param command   The command to send.
      * \return True on success.
      */
-    bool sendCommand(const QString &command);
-
-    bool sendCommand(const QString &tag, const QString &command);
-
     bool sendCommand(const QByteArray &command);
 
     bool sendCommand(const QByteArray &tag, const QByteArray &command);
@@ -385,33 +687,32 @@ private:
      */
     bool disconnectOnError(SkaffariIMAPError::ErrorType type = SkaffariIMAPError::NoError, const QString &error = QString());
 
-    /*!
-     * \brief Waits for a response from the IMAP server by calling QSslSocket::waitForReadyRead().
-     *
-     * If \a disConn is set to \c true, a disconnection will be performed. If \a error is not empty, that string
-     * will be set to the generated SkaffariIMAPError. The timeout in \a msecs will be set to the
-     * QSslSocket::waitForReadyRead() funciton.
-     *
-     * \return \c true if the was a response within timeout in \a msecs, otherwise \c false.
-     */
-    bool waitForResponse(bool disConn = false, const QString &error = QString(), int msecs = 30000);
-
-    static QStringList m_capabilities;
-
     QString m_user;
     QString m_password;
     QString m_host;
+    QStringList m_capList;
     SkaffariIMAPError m_imapError;
-    Cutelyst::Context *m_c;
+    SkaffariIMAPParser m_parser;
+    std::deque<PendingCommand> m_pending;
+    std::deque<QueuedCommand> m_queued;
+    std::vector<std::function<void(bool)>> m_loginCallbacks;
+    QTimer m_timeoutTimer;
+    Cutelyst::Context *m_c = nullptr;
+    quint64 m_configGeneration = 0;
     quint32 m_tagSequence = 0;
     quint16 m_port = 143;
     QChar m_hierarchysep = QLatin1Char('.');
+    Capabilities m_capFlags = NoCapability;
     NetworkLayerProtocol m_protocol = QAbstractSocket::AnyIPProtocol;
     EncryptionType m_encType = StartTLS;
     AuthMech m_authMech = CLEAR;
     bool m_loggedIn = false;
+    bool m_startTls = false;
+    bool m_processing = false;
 
     Q_DISABLE_COPY(SkaffariIMAP)
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(SkaffariIMAP::Capabilities)
+
 #endif // SKAFFARIIMAP_H
@@ -0,0 +1,270 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "skaffariimapparser.h"
+#include <cstring>
+
+SkaffariIMAPParser::SkaffariIMAPParser(const QByteArray &tag) :
+    m_tag(tag)
+{
+
+}
+
+void SkaffariIMAPParser::reset(const QByteArray &tag)
+{
+    m_buffer.clear();
+    m_tag = tag;
+    m_responses.clear();
+    m_status = {0, 0, Tagged};
+    m_base = 0;
+    m_pos = 0;
+    m_segmentStart = 0;
+    m_responseStart = 0;
+    m_literalRemaining = 0;
+    m_state = Incomplete;
+}
+
+SkaffariIMAPParser::State SkaffariIMAPParser::next(const QByteArray &tag)
+{
+    m_tag = tag;
+    m_responses.clear();
+    m_base = m_pos;
+    m_status = {m_pos, 0, Tagged};
+    m_segmentStart = m_pos;
+    m_responseStart = m_pos;
+    m_literalRemaining = 0;
+    m_state = Incomplete;
+    parse();
+    return m_state;
+}
+
+SkaffariIMAPParser::State SkaffariIMAPParser::feed(const QByteArray &data)
+{
+    if (!data.isEmpty()) {
+        compact();
+        m_buffer.append(data);
+        parse();
+    }
+    return m_state;
+}
+
+void SkaffariIMAPParser::compact()
+{
+    if (m_base == 0) {
+        return;
+    }
+
+    // only the unparsed rest of a partially received response is moved
+    m_buffer.remove(0, m_base);
+    for (Range &r : m_responses) {
+        r.start -= m_base;
+    }
+    m_status.start -= m_base;
+    m_pos -= m_base;
+    m_segmentStart -= m_base;
+    m_responseStart -= m_base;
+    m_base = 0;
+}
+
+void SkaffariIMAPParser::parse()
+{
+    while (m_state == Incomplete) {
+
+        if (m_literalRemaining > 0) {
+            const int available = m_buffer.size() - m_pos;
+            if (available < m_literalRemaining) {
+                m_literalRemaining -= available;
+                m_pos = m_buffer.size();
+                return;
+            }
+            m_pos += m_literalRemaining;
+            m_literalRemaining = 0;
+            m_segmentStart = m_pos;
+        }
+
+        const int lf = m_buffer.indexOf('\n', m_pos);
+        if (lf < 0) {
+            // no complete line yet, continue scanning at the end of the buffer on the next feed
+            m_pos = m_buffer.size();
+            return;
+        }
+
+        int lineEnd = lf;
+        if ((lineEnd > m_segmentStart) && (m_buffer.at(lineEnd - 1) == '\r')) {
+            --lineEnd;
+        }
+
+        int size = 0;
+        if (literalSize(m_segmentStart, lineEnd, &size)) {
+            // the response continues after the literal
+            m_literalRemaining = size;
+            m_pos = lf + 1;
+            m_segmentStart = m_pos;
+            continue;
+        }
+
+        addResponse(m_responseStart, lineEnd);
+        m_pos = lf + 1;
+        m_segmentStart = m_pos;
+        m_responseStart = m_pos;
+    }
+}
+
+bool SkaffariIMAPParser::literalSize(int lineStart, int lineEnd, int *size) const
+{
+    if ((lineEnd - lineStart) < 3) {
+        return false;
+    }
+
+    const char *data = m_buffer.constData();
+
+    if (data[lineEnd - 1] != '}') {
+        return false;
+    }
+
+    int pos = lineEnd - 2;
+    // non-synchronizing literal of LITERAL+ (RFC 7888)
+    if (data[pos] == '+') {
+        --pos;
+    }
+
+    const int digitsEnd = pos + 1;
+    while ((pos >= lineStart) && (data[pos] >= '0') && (data[pos] <= '9')) {
+        --pos;
+    }
+
+    if ((pos < lineStart) || (data[pos] != '{') || (pos + 1 == digitsEnd)) {
+        return false;
+    }
+
+    bool ok = false;
+    const int _size = QByteArray::fromRawData(data + pos + 1, digitsEnd - pos - 1).toInt(&ok);
+    if (!ok || (_size < 0)) {
+        return false;
+    }
+
+    *size = _size;
+    return true;
+}
+
+void SkaffariIMAPParser::addResponse(int start, int end)
+{
+    const int length = end - start;
+    if (length <= 0) {
+        return;
+    }
+
+    const char *data = m_buffer.constData() + start;
+
+    Kind kind = Tagged;
+    if (data[0] == '*') {
+        kind = Untagged;
+    } else if (data[0] == '+') {
+        kind = ContinuationReq;
+    }
+
+    if (kind == ContinuationReq) {
+        m_status = {start, length, kind};
+        m_state = Continuation;
+        return;
+    }
+
+    const int tagSize = m_tag.size();
+    const bool isAwaited = (tagSize > 0)
+            && (length > tagSize)
+            && (data[tagSize] == ' ')
+            && (std::memcmp(data, m_tag.constData(), static_cast<std::size_t>(tagSize)) == 0);
+
+    if (isAwaited) {
+        m_status = {start, length, kind};
+        m_state = Complete;
+        return;
+    }
+
+    m_responses.push_back({start, length, kind});
+}
+
+SkaffariIMAPParser::State SkaffariIMAPParser::state() const
+{
+    return m_state;
+}
+
+QByteArray SkaffariIMAPParser::tag() const
+{
+    return m_tag;
+}
+
+int SkaffariIMAPParser::count() const
+{
+    return m_responses.size();
+}
+
+SkaffariIMAPParser::Kind SkaffariIMAPParser::kind(int idx) const
+{
+    return m_responses.at(idx).kind;
+}
+
+QByteArray SkaffariIMAPParser::response(int idx) const
+{
+    const Range &r = m_responses.at(idx);
+    return QByteArray::fromRawData(m_buffer.constData() + r.start, r.length);
+}
+
+QByteArray SkaffariIMAPParser::statusLine() const
+{
+    if (m_state == Incomplete) {
+        return QByteArray();
+    }
+    return QByteArray::fromRawData(m_buffer.constData() + m_status.start, m_status.length);
+}
+
+QByteArray SkaffariIMAPParser::status() const
+{
+    if (m_state == Incomplete) {
+        return QByteArray();
+    }
+
+    // skip the tag or the plus sign and the following space
+    const int skip = (m_state == Continuation) ? 1 : m_tag.size();
+    int start = m_status.start + skip;
+    int length = m_status.length - skip;
+    if ((length > 0) && (m_buffer.at(start) == ' ')) {
+        ++start;
+        --length;
+    }
+
+    return QByteArray::fromRawData(m_buffer.constData() + start, length);
+}
+
+QByteArray SkaffariIMAPParser::buffer() const
+{
+    return m_buffer;
+}
+
+bool SkaffariIMAPParser::hasTrailingData() const
+{
+    return (m_state != Incomplete) && (m_pos < m_buffer.size());
+}
+
+QByteArray SkaffariIMAPParser::trailingData() const
+{
+    if (!hasTrailingData()) {
+        return QByteArray();
+    }
+    return m_buffer.mid(m_pos);
+}
@@ -0,0 +1,185 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SKAFFARIIMAPPARSER_H
+#define SKAFFARIIMAPPARSER_H
+
+#include <QByteArray>
+#include <QVector>
+
+/*!
+ * \ingroup skaffaricore
+ * \brief Incremental parser for IMAP4rev1 server responses.
+ *
+ * The data received from the server is fed into the parser chunk by chunk as it arrives, so
+ * responses that are split over multiple TCP segments are handled correctly. The parser
+ * collects all responses until it finds the status line of the awaited tag or a command
+ * continuation request. Literals in the form <code>{n}</code> and <code>{n+}</code> at the
+ * end of a line are skipped byte exact, so data inside a literal will never be mistaken for
+ * a line ending or status line.
+ *
+ * Responses are stored as byte ranges into the internal buffer. The QByteArray objects returned
+ * by response() and status() are views created with QByteArray::fromRawData() that are only valid
+ * as long as the parser exists and no more data is fed into it.
+ *
+ * If the server sends the responses of multiple pipelined commands at once, next() continues
+ * with the data after the status line in the same buffer. Consumed data is only removed from the
+ * buffer on the next call of feed().
+ *
+ * \par Usage example
+ * \code
+ * SkaffariIMAPParser parser("a000001");
+ * while (parser.state() == SkaffariIMAPParser::Incomplete && socket->waitForReadyRead()) {
+ *     parser.feed(socket->readAll());
+ * }
+ * if (parser.status().startsWith("OK")) {
+ *     for (int i = 0; i < parser.count(); ++i) {
+ *         qDebug() << parser.response(i);
+ *     }
+ * }
+ * \endcode
+ */
+class SkaffariIMAPParser
+{
+public:
+    /*!
+     * \brief Parsing states.
+     */
+    enum State : quint8 {
+        Incomplete      = 0,    /**< the status line of the awaited tag has not been received yet */
+        Complete        = 1,    /**< the status line of the awaited tag has been received */
+        Continuation    = 2     /**< the server sent a command continuation request */
+    };
+
+    /*!
+     * \brief Kinds of responses.
+     */
+    enum Kind : quint8 {
+        Untagged        = 0,    /**< untagged response starting with <code>*</code> */
+        Tagged          = 1,    /**< status line of a tag, not necessarily the awaited one */
+        ContinuationReq = 2     /**< command continuation request starting with <code>+</code> */
+    };
+
+    /*!
+     * \brief Constructs a new parser waiting for the status line of \a tag.
+     *
+     * If \a tag is \c "*", the first untagged response, like the server greeting, completes the response.
+     */
+    explicit SkaffariIMAPParser(const QByteArray &tag = QByteArray());
+
+    /*!
+     * \brief Clears all data and waits for the status line of \a tag.
+     */
+    void reset(const QByteArray &tag);
+
+    /*!
+     * \brief Drops the responses of the current tag and parses the remaining data for \a tag.
+     *
+     * Other than reset(), the data received after the status line or continuation request is
+     * kept without being copied.
+     * \return The parsing state after processing the remaining data.
+     */
+    State next(const QByteArray &tag);
+
+    /*!
+     * \brief Appends \a data to the internal buffer and parses it.
+     * \return The parsing state after processing \a data.
+     */
+    State feed(const QByteArray &data);
+
+    /*!
+     * \brief Returns the current parsing state.
+     */
+    State state() const;
+
+    /*!
+     * \brief Returns the tag the parser is waiting for.
+     */
+    QByteArray tag() const;
+
+    /*!
+     * \brief Returns the number of complete responses excluding the awaited status line.
+     */
+    int count() const;
+
+    /*!
+     * \brief Returns the kind of the response at \a idx.
+     */
+    Kind kind(int idx) const;
+
+    /*!
+     * \brief Returns a view of the response at \a idx without the trailing line break.
+     *
+     * Literals are part of the returned data.
+     */
+    QByteArray response(int idx) const;
+
+    /*!
+     * \brief Returns a view of the awaited status line.
+     *
+     * Returns an empty byte array as long as state() is not Complete.
+     */
+    QByteArray statusLine() const;
+
+    /*!
+     * \brief Returns a view of the awaited status line without the leading tag, like \c "OK LOGIN completed".
+     *
+     * If state() is Continuation, this returns the continuation request without the leading <code>+ </code>.
+     */
+    QByteArray status() const;
+
+    /*!
+     * \brief Returns the complete raw data fed into the parser.
+     */
+    QByteArray buffer() const;
+
+    /*!
+     * \brief Returns \c true if the server sent more data after the awaited status line.
+     */
+    bool hasTrailingData() const;
+
+    /*!
+     * \brief Returns a copy of the data the server sent after the awaited status line or continuation request.
+     */
+    QByteArray trailingData() const;
+
+private:
+    struct Range {
+        int start;
+        int length;
+        Kind kind;
+    };
+
+    void parse();
+    void compact();
+    void addResponse(int start, int end);
+    bool literalSize(int lineStart, int lineEnd, int *size) const;
+
+    QByteArray m_buffer;
+    QByteArray m_tag;
+    QVector<Range> m_responses;
+    Range m_status = {0, 0, Tagged};
+    int m_base = 0;
+    int m_pos = 0;
+    int m_segmentStart = 0;
+    int m_responseStart = 0;
+    int m_literalRemaining = 0;
+    State m_state = Incomplete;
+};
+
+#endif // SKAFFARIIMAPPARSER_H
@@ -0,0 +1,178 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "skaffariimappool.h"
+#include "../utils/skaffariconfig.h"
+#include <QThreadStorage>
+#include <QElapsedTimer>
+#include <vector>
+
+#define SK_IMAP_POOL_KEEPALIVE 60000
+#define SK_IMAP_POOL_MAX_IDLE_CONNECTIONS 2
+
+namespace {
+
+struct IdleConnection {
+    SkaffariIMAP *imap;
+    QElapsedTimer idleSince;
+};
+
+class ConnectionPool {
+public:
+    ~ConnectionPool()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        for (const IdleConnection &con : idle) {
+            delete con.imap;
+        }
+        idle.clear();
+    }
+
+    void evict(qint64 maxIdle, quint64 generation)
+    {
+        auto it = idle.begin();
+        while (it != idle.end()) {
+            if (it->imap->configGeneration() != generation) {
+                qCDebug(SK_IMAP, "Closing idle IMAP connection established with a previous configuration.");
+                delete it->imap;
+                it = idle.erase(it);
+            } else if ((it->idleSince.elapsed() > maxIdle) || (it->idleSince.elapsed() > SK_IMAP_POOL_KEEPALIVE) || (it->imap->state() != QAbstractSocket::ConnectedState)) {
+                // the server might have closed the connection in the meantime, so do not
+                // block the request that evicts it with a LOGOUT round trip
+                qCDebug(SK_IMAP, "Closing idle IMAP connection after %lli ms.", it->idleSince.elapsed());
+                it->imap->abort();
+                delete it->imap;
+                it = idle.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::vector<IdleConnection> idle;
+};
+
+QThreadStorage<ConnectionPool*> pools;
+
+ConnectionPool *localPool()
+{
+    if (!pools.hasLocalData()) {
+        pools.setLocalData(new ConnectionPool);
+    }
+    return pools.localData();
+}
+
+}
+
+SkaffariIMAPPool::Connection::Connection(Cutelyst::Context *context) :
+    m_imap(SkaffariIMAPPool::checkout(context))
+{
+
+}
+
+SkaffariIMAPPool::Connection::~Connection()
+{
+    SkaffariIMAPPool::checkin(m_imap);
+}
+
+SkaffariIMAP *SkaffariIMAPPool::checkout(Cutelyst::Context *context)
+{
+    const qint64 maxIdle = static_cast<qint64>(SkaffariConfig::imapPoolmaxidle()) * 1000;
+
+    if (maxIdle > 0) {
+        ConnectionPool *pool = localPool();
+        pool->evict(maxIdle, SkaffariConfig::generation());
+
+        if (!pool->idle.empty()) {
+            // the most recently used connection is the one with the
+            // lowest risk of having been closed by the server
+            const IdleConnection con = pool->idle.back();
+            pool->idle.pop_back();
+
+            con.imap->setContext(context);
+
+            return con.imap;
+        }
+    }
+
+    return new SkaffariIMAP(context);
+}
+
+void SkaffariIMAPPool::checkin(SkaffariIMAP *imap)
+{
+    if (!imap) {
+        return;
+    }
+
+    imap->setContext(nullptr);
+
+    const qint64 maxIdle = static_cast<qint64>(SkaffariConfig::imapPoolmaxidle()) * 1000;
+
+    if (maxIdle <= 0) {
+        delete imap;
+        return;
+    }
+
+    if (imap->pendingCommands() > 0) {
+        // responses to commands nobody waited for, like the client ID sent after login
+        imap->waitForPendingCommands();
+    }
+
+    const quint64 generation = SkaffariConfig::generation();
+
+    ConnectionPool *pool = localPool();
+    pool->evict(maxIdle, generation);
+
+    // after timeouts or undefined responses the connection might have unread data
+    // pending, the same applies to connections with asynchronous commands in flight
+    const SkaffariIMAPError::ErrorType errorType = imap->lastError().type();
+    const bool reusable = imap->isLoggedIn()
+            && (imap->configGeneration() == generation)
+            && (imap->state() == QAbstractSocket::ConnectedState)
+            && (imap->pendingCommands() == 0)
+            && (errorType != SkaffariIMAPError::ConnectionTimeout)
+            && (errorType != SkaffariIMAPError::UndefinedResponse)
+            && (errorType != SkaffariIMAPError::SocketError)
+            && (errorType != SkaffariIMAPError::EncryptionError)
+            && (pool->idle.size() < SK_IMAP_POOL_MAX_IDLE_CONNECTIONS);
+
+    if (reusable) {
+        IdleConnection con;
+        con.imap = imap;
+        con.idleSince.start();
+        pool->idle.push_back(con);
+    } else {
+        delete imap;
+    }
+}
+
+void SkaffariIMAPPool::clear()
+{
+    if (pools.hasLocalData()) {
+        pools.localData()->clear();
+    }
+}
+
+int SkaffariIMAPPool::idleCount()
+{
+    return pools.hasLocalData() ? static_cast<int>(pools.localData()->idle.size()) : 0;
+}
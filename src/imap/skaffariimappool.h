@@ -0,0 +1,118 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SKAFFARIIMAPPOOL_H
+#define SKAFFARIIMAPPOOL_H
+
+#include "skaffariimap.h"
+
+namespace Cutelyst {
+class Context;
+}
+
+/*!
+ * \ingroup skaffaricore
+ * \brief Per thread pool of logged in IMAP administrator connections.
+ *
+ * Establishing a new connection to the IMAP server, including the TLS handshake and the
+ * authentication, is much more expensive than the few commands Skaffari sends afterwards.
+ * So the pool keeps idle administrator connections per worker thread and hands them out
+ * again on the next request.
+ *
+ * Connections that have been idle for longer than SkaffariConfig::imapPoolmaxidle(), but at most
+ * for 60 seconds, are closed without sending LOGOUT instead of being handed out, so checking out a
+ * connection never waits for the server. If the server has closed a connection in the meantime
+ * for another reason, the next call to SkaffariIMAP::login() will establish a new one.
+ * After the configuration has been reloaded, connections established with the previous settings
+ * are closed instead of being handed out or put back into the pool.
+ *
+ * Only use pooled connections for operations of the IMAP administrator configured in the
+ * Skaffari configuration file. Connections logged in as another user must not be put back
+ * into the pool.
+ *
+ * \par Usage example
+ * \code
+ * SkaffariIMAPPool::Connection imap(c);
+ * if (imap->login()) {
+ *     imap->createMailbox("jhondoe");
+ * }
+ * \endcode
+ */
+class SkaffariIMAPPool
+{
+public:
+    /*!
+     * \brief Scoped handle to a pooled connection.
+     *
+     * Checks out a connection in the constructor and puts it back into the pool on destruction.
+     */
+    class Connection
+    {
+    public:
+        /*!
+         * \brief Checks out a connection for the current thread and sets the \a context on it.
+         */
+        explicit Connection(Cutelyst::Context *context);
+
+        /*!
+         * \brief Puts the connection back into the pool.
+         */
+        ~Connection();
+
+        SkaffariIMAP *operator->() const { return m_imap; }
+        SkaffariIMAP &operator*() const { return *m_imap; }
+
+        /*!
+         * \brief Returns a pointer to the pooled connection.
+         */
+        SkaffariIMAP *get() const { return m_imap; }
+
+    private:
+        SkaffariIMAP *m_imap = nullptr;
+
+        Q_DISABLE_COPY(Connection)
+    };
+
+    /*!
+     * \brief Returns an idle connection for the current thread or a new one if there is none.
+     *
+     * The returned connection might not be logged in, so always call SkaffariIMAP::login() before
+     * using it. The connection has to be returned to the pool with checkin().
+     */
+    static SkaffariIMAP *checkout(Cutelyst::Context *context);
+
+    /*!
+     * \brief Puts the \a imap connection back into the pool of the current thread.
+     *
+     * Connections that are not logged in anymore or that are in an undefined state will be
+     * closed and deleted instead.
+     */
+    static void checkin(SkaffariIMAP *imap);
+
+    /*!
+     * \brief Logs out and deletes all idle connections of the current thread.
+     */
+    static void clear();
+
+    /*!
+     * \brief Returns the number of idle connections in the pool of the current thread.
+     */
+    static int idleCount();
+};
+
+#endif // SKAFFARIIMAPPOOL_H
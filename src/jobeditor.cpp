@@ -0,0 +1,101 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jobeditor.h"
+#include "objects/job.h"
+#include "objects/adminaccount.h"
+#include "objects/skaffarierror.h"
+#include "utils/utils.h"
+#include <QJsonObject>
+#include <QJsonValue>
+
+JobEditor::JobEditor(QObject *parent) : Controller(parent)
+{
+
+}
+
+JobEditor::~JobEditor()
+{
+
+}
+
+void JobEditor::base(Context *c, const QString &id)
+{
+    bool ok = true;
+    const dbid_t jobId = Utils::strToDbid(id, &ok);
+    if (Q_UNLIKELY(!ok)) {
+        SkaffariError e(c, SkaffariError::InputError, c->translate("JobEditor", "Invalid job database ID."));
+        e.toStash(c);
+        c->detach(c->getAction(QStringLiteral("error")));
+        return;
+    }
+
+    SkaffariError e(c);
+    const Job job = Job::get(c, e, jobId);
+    if (Q_UNLIKELY(!job.isValid())) {
+        e.toStash(c);
+        c->detach(c->getAction(QStringLiteral("error")));
+        return;
+    }
+
+    // only administrators are allowed to see the jobs of other admins
+    if ((job.adminId() != AdminAccount::getUserId(c)) && (AdminAccount::getUserType(c) < AdminAccount::Administrator)) {
+        SkaffariError ae(c, SkaffariError::AuthorizationError, c->translate("JobEditor", "You are not allowed to access this job."));
+        ae.toStash(c);
+        c->detach(c->getAction(QStringLiteral("error")));
+        return;
+    }
+
+    Job::toStash(c, job);
+}
+
+void JobEditor::status(Context *c)
+{
+    const Job job = Job::fromStash(c);
+
+    c->res()->setJsonObjectBody({
+                                    {QStringLiteral("job"), job.toJson()}
+                                });
+}
+
+void JobEditor::cancel(Context *c)
+{
+    if (Utils::ajaxPostOnly(c, c->req()->xhr())) {
+        return;
+    }
+
+    Job job = Job::fromStash(c);
+
+    QJsonObject json;
+
+    if (c->req()->isPost()) {
+        SkaffariError e(c);
+        if (job.cancel(c, e)) {
+            json.insert(QStringLiteral("status_msg"), c->translate("JobEditor", "The job has been canceled."));
+        } else {
+            json.insert(QStringLiteral("error_msg"), e.errorText());
+            c->res()->setStatus(e.status());
+        }
+    }
+
+    json.insert(QStringLiteral("job"), job.toJson());
+
+    c->res()->setJsonObjectBody(json);
+}
+
+#include "moc_jobeditor.cpp"
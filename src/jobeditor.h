@@ -0,0 +1,50 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JOBEDITOR_H
+#define JOBEDITOR_H
+
+#include <Cutelyst/Controller>
+
+using namespace Cutelyst;
+
+/*!
+ * \ingroup skaffaricontrollers
+ * \brief Routes for the job namespace.
+ *
+ * Provides the status and the progress of background jobs as JSON and the cancellation of active jobs.
+ */
+class JobEditor : public Controller
+{
+    Q_OBJECT
+    C_NAMESPACE("job")
+public:
+    explicit JobEditor(QObject *parent = nullptr);
+    ~JobEditor();
+
+    C_ATTR(base, :Chained("/") :PathPart("job") :CaptureArgs(1))
+    void base(Context *c, const QString &id);
+
+    C_ATTR(status, :Chained("base") :PathPart("") :Args(0))
+    void status(Context *c);
+
+    C_ATTR(cancel, :Chained("base") :PathPart("cancel") :Args(0))
+    void cancel(Context *c);
+};
+
+#endif // JOBEDITOR_H
@@ -22,8 +22,12 @@
 #include "adminaccount.h"
 #include "../utils/utils.h"
 #include "../imap/skaffariimap.h"
+#include "../imap/skaffariimappool.h"
 #include "../../common/password.h"
 #include "../utils/skaffariconfig.h"
+#include "../utils/searchindex.h"
+#include "../utils/statistics.h"
+#include "../utils/autoconfigguard.h"
 #include <Cutelyst/Context>
 #include <Cutelyst/Plugins/Utils/Sql>
 #include <Cutelyst/Response>
@@ -38,9 +42,13 @@
 #include <QUrl>
 #include <QStringList>
 #include <QCollator>
+#include <QHash>
+#include <QCryptographicHash>
 #include <QJsonArray>
 #include <QJsonValue>
 #include <QLocale>
+#include <QTimer>
+#include <QAtomicInteger>
 
 Q_LOGGING_CATEGORY(SK_ACCOUNT, "skaffari.account")
 
@@ -50,6 +58,9 @@ Q_LOGGING_CATEGORY(SK_ACCOUNT, "skaffari.account")
 
 #define MEMC_QUOTA_EXP 900
 #define MEMC_QUOTA_KEY QLatin1String("sk_quotausage_")
+#define MEMC_COUNT_EXP 300
+#define MEMC_COUNT_KEY QLatin1String("sk_accountcount_")
+#define MEMC_COUNT_VERSION_KEY QLatin1String("sk_accountcountversion_")
 
 Account::Account() :
     d(new AccountData)
@@ -291,6 +302,7 @@ dbid_t insertVirtual(dbid_t idn_id, dbid_t ace_id, const QString &alias, const Q
 
     if (Q_LIKELY(q.exec())) {
         ret = q.lastInsertId().value<dbid_t>();
+        AutoconfigGuard::removeMissing(alias);
     } else {
         error = q.lastError();
     }
@@ -406,6 +418,20 @@ QSqlError updateAceID(dbid_t id, dbid_t ace_id)
     return ret;
 }
 
+/*!
+ * \internal
+ * \brief Tells the expiry scheduler of skaffaricmd that the expiration times of the account identified by \a id have changed.
+ */
+void notifyExpiryChange(dbid_t id)
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("INSERT INTO account_expiry_change (account_id, created_at) VALUES (:account_id, :created_at)"));
+    q.bindValue(QStringLiteral(":account_id"), id);
+    q.bindValue(QStringLiteral(":created_at"), QDateTime::currentDateTimeUtc());
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_ACCOUNT, "Failed to add changed expiration times of the user account with ID %u to the database: %s", id, qUtf8Printable(q.lastError().text()));
+    }
+}
+
 /*!
  * \internal
  * \brief Queries the current list of forwards for the account identified by \a username from the database.
@@ -485,6 +511,255 @@ std::pair<QStringList, bool> queryAddresses(Cutelyst::Context *c, const QString
     return ret;
 }
 
+/*!
+ * \internal
+ * \brief Queries the forwards of all accounts identified by \a usernames with a single query.
+ *
+ * Works like queryFowards() for a single account, but returns a hash with the user names as keys.
+ * Accounts without forwards are not part of the returned hash.
+ *
+ * \param c Current context, used for translations.
+ * \param usernames  Names of the users to query the forwards for.
+ * \param e Pointer to an object taking error information.
+ */
+QHash<QString,std::pair<QStringList,bool>> queryFowards(Cutelyst::Context *c, const QStringList &usernames, SkaffariError *e = nullptr)
+{
+    QHash<QString,std::pair<QStringList,bool>> ret;
+
+    if (usernames.empty()) {
+        return ret;
+    }
+
+    // the number of placeholders depends on the page size, so this can not be a cached prepared query
+    QSqlQuery q(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread()));
+    q.prepare(QStringLiteral("SELECT alias, dest FROM virtual WHERE username = '' AND alias IN (%1)").arg(Utils::inPlaceholders(usernames.size())));
+    for (const QString &username : usernames) {
+        q.addBindValue(username);
+    }
+
+    if (Q_UNLIKELY(!q.exec())) {
+        if (e) {
+            e->setSqlError(q.lastError(), c->translate("Account", "Cannot retrieve current list of forwarding addresses for user accounts from the database."));
+        }
+        qCCritical(SK_ACCOUNT, "%s failed to query list of forwarding addresses for %i user accounts from the database: %s", qUtf8Printable(AdminAccount::getUserNameIdString(c)), usernames.size(), qUtf8Printable(q.lastError().text()));
+        return ret;
+    }
+
+    ret.reserve(usernames.size());
+    while (q.next()) {
+        const QString username = q.value(0).toString();
+        std::pair<QStringList,bool> &fwPair = ret[username];
+        const auto fws = q.value(1).toString().split(QLatin1Char(','), QString::SkipEmptyParts);
+        fwPair.first.reserve(fwPair.first.size() + fws.size());
+        for (const QString &fw : fws) {
+            if (fw != username) {
+                fwPair.first << fw;
+            } else {
+                fwPair.second = true;
+            }
+        }
+    }
+
+    return ret;
+}
+
+/*!
+ * \internal
+ * \brief Queries the email addresses of all accounts identified by \a usernames with a single query.
+ *
+ * Works like queryAddresses() for a single account, but returns a hash with the user names as keys.
+ * Accounts without addresses are not part of the returned hash.
+ *
+ * \param c Current context, used for translations.
+ * \param usernames  Names of the users to query the addresses for.
+ * \param e Pointer to an object taking error information.
+ */
+QHash<QString,std::pair<QStringList,bool>> queryAddresses(Cutelyst::Context *c, const QStringList &usernames, SkaffariError *e = nullptr)
+{
+    QHash<QString,std::pair<QStringList,bool>> ret;
+
+    if (usernames.empty()) {
+        return ret;
+    }
+
+    // the number of placeholders depends on the page size, so this can not be a cached prepared query
+    QSqlQuery q(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread()));
+    q.prepare(QStringLiteral("SELECT username, alias FROM virtual WHERE dest = username AND idn_id = 0 AND username IN (%1) ORDER BY alias ASC").arg(Utils::inPlaceholders(usernames.size())));
+    for (const QString &username : usernames) {
+        q.addBindValue(username);
+    }
+
+    if (Q_UNLIKELY(!q.exec())) {
+        if (e) {
+            e->setSqlError(q.lastError(), c->translate("Account", "Cannot retrieve current list of email addresses for user accounts from the database."));
+        }
+        qCCritical(SK_ACCOUNT, "%s failed to query list of email addresses for %i user accounts from the database: %s", qUtf8Printable(AdminAccount::getUserNameIdString(c)), usernames.size(), qUtf8Printable(q.lastError().text()));
+        return ret;
+    }
+
+    ret.reserve(usernames.size());
+    while (q.next()) {
+        std::pair<QStringList,bool> &addrPair = ret[q.value(0).toString()];
+        const QString address = q.value(1).toString();
+        if (!address.startsWith(QLatin1Char('@'))) {
+            addrPair.first << address;
+        } else {
+            addrPair.second = true;
+        }
+    }
+
+    return ret;
+}
+
+/*!
+ * \internal
+ * \brief Returns the index of the \a sortBy column in the result of the account list query.
+ */
+int listSortColumnIndex(const QString &sortBy)
+{
+    if (sortBy == QLatin1String("quota")) {
+        return 6;
+    } else if (sortBy == QLatin1String("created_at")) {
+        return 7;
+    } else if (sortBy == QLatin1String("updated_at")) {
+        return 8;
+    } else if (sortBy == QLatin1String("valid_until")) {
+        return 9;
+    } else {
+        return 1;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Encodes the position after the account with \a id and the \a value in the \a sortBy column into a cursor string.
+ */
+QString encodeListCursor(const QString &sortBy, const QVariant &value, dbid_t id)
+{
+    QString valStr;
+    if (value.type() == QVariant::DateTime) {
+        valStr = value.toDateTime().toString(QStringLiteral("yyyy-MM-dd HH:mm:ss"));
+    } else {
+        valStr = value.toString();
+    }
+    const QString raw = sortBy + QLatin1Char('\n') + valStr + QLatin1Char('\n') + QString::number(id);
+    return QString::fromLatin1(raw.toUtf8().toBase64(QByteArray::Base64UrlEncoding|QByteArray::OmitTrailingEquals));
+}
+
+/*!
+ * \internal
+ * \brief Decodes a \a cursor created by encodeListCursor().
+ *
+ * Returns \c false if the \a cursor is empty, invalid or has been created for another sort column than \a sortBy.
+ */
+bool decodeListCursor(const QString &cursor, const QString &sortBy, QVariant *value, dbid_t *id)
+{
+    if (cursor.isEmpty()) {
+        return false;
+    }
+
+    const QStringList parts = QString::fromUtf8(QByteArray::fromBase64(cursor.toLatin1(), QByteArray::Base64UrlEncoding)).split(QLatin1Char('\n'));
+    if ((parts.size() != 3) || (parts.at(0) != sortBy)) {
+        return false;
+    }
+
+    bool ok = false;
+    *id = parts.at(2).toUInt(&ok);
+    if (!ok || (*id == 0)) {
+        return false;
+    }
+
+    if (sortBy == QLatin1String("quota")) {
+        *value = parts.at(1).toULongLong(&ok);
+        if (!ok) {
+            return false;
+        }
+    } else {
+        *value = parts.at(1);
+    }
+
+    return true;
+}
+
+/*!
+ * \internal
+ * \brief Returns the version of the cached search result counts of the domain identified by \a domainId.
+ *
+ * Returns \c "0" if the version has not been set yet.
+ */
+QByteArray accountCountVersion(dbid_t domainId)
+{
+    const QByteArray version = Cutelyst::Memcached::get(MEMC_COUNT_VERSION_KEY + QString::number(domainId));
+    return version.isNull() ? QByteArrayLiteral("0") : version;
+}
+
+/*!
+ * \internal
+ * \brief Invalidates the cached search result counts of the domain identified by \a domainId.
+ *
+ * Has to be called whenever an account of the domain is created or removed or its names, addresses or forwards change.
+ */
+void bumpAccountCountVersion(dbid_t domainId)
+{
+    if (!SkaffariConfig::useMemcached()) {
+        return;
+    }
+
+    // the time makes the version unique across processes, the counter inside the same millisecond
+    static QAtomicInteger<quint32> counter;
+    const QByteArray version = QByteArray::number(QDateTime::currentMSecsSinceEpoch()) + '.' + QByteArray::number(counter.fetchAndAddRelaxed(1));
+    Cutelyst::Memcached::set(MEMC_COUNT_VERSION_KEY + QString::number(domainId), version, 0);
+}
+
+/*!
+ * \internal
+ * \brief Returns the number of accounts of domain \a d matching a search.
+ *
+ * \a fromWhere is the FROM and WHERE part of the list query, \a binds contain the values for its placeholders. If memcached is enabled, the result will be cached.
+ * The count version of the domain is part of the cache key, it is changed by bumpAccountCountVersion() whenever
+ * accounts are created, removed or updated, so the cached counts are never outdated.
+ */
+quint32 countFilteredAccounts(Cutelyst::Context *c, SkaffariError &e, const Domain &d, const QString &fromWhere, const QVariantHash &binds, const QString &searchRole, const QString &searchString)
+{
+    quint32 count = 0;
+
+    QString cacheKey;
+    if (SkaffariConfig::useMemcached()) {
+        const QByteArray searchHash = QCryptographicHash::hash(QString(searchRole + QLatin1Char('\n') + searchString).toUtf8(), QCryptographicHash::Sha1).toHex();
+        cacheKey = MEMC_COUNT_KEY + QString::number(d.id()) + QLatin1Char('_') + QString::fromLatin1(accountCountVersion(d.id())) + QLatin1Char('_') + QString::fromLatin1(searchHash);
+        const QByteArray countBa = Cutelyst::Memcached::get(cacheKey);
+        if (!countBa.isNull()) {
+            bool ok = false;
+            count = countBa.toUInt(&ok);
+            if (ok) {
+                return count;
+            }
+        }
+    }
+
+    QSqlQuery q(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread()));
+    q.prepare(QLatin1String("SELECT COUNT(*) ") + fromWhere);
+    for (auto it = binds.constBegin(); it != binds.constEnd(); ++it) {
+        q.bindValue(it.key(), it.value());
+    }
+
+    if (Q_UNLIKELY(!q.exec())) {
+        e.setSqlError(q.lastError(), c->translate("Account", "Total result could not be retrieved from the database."));
+        qCCritical(SK_ACCOUNT, "%s failed to query total result for domain %s from the database: %s", qUtf8Printable(AdminAccount::getUserNameIdString(c)), qUtf8Printable(d.nameIdString()), qUtf8Printable(q.lastError().text()));
+        return count;
+    }
+
+    if (q.next()) {
+        count = q.value(0).value<quint32>();
+    }
+
+    if (!cacheKey.isEmpty()) {
+        Cutelyst::Memcached::set(cacheKey, QByteArray::number(count), MEMC_COUNT_EXP);
+    }
+
+    return count;
+}
+
 Account Account::create(Cutelyst::Context *c, SkaffariError &e, const QVariantHash &p, const Domain &d, const QStringList &selectedKids)
 {
     Account a;
@@ -848,12 +1123,19 @@ Account Account::create(Cutelyst::Context *c, SkaffariError &e, const QVariantHa
     if (Q_UNLIKELY(!q.exec())) {
         qCWarning(SK_ACCOUNT, "%s failed to update count of accounts and domain quota usage for domain %s afert creating new account %s: %s", uniStr, qUtf8Printable(d.nameIdString()), aunStr, qUtf8Printable(q.lastError().text()));
     }
+    Domain::clearCache(c);
+    Statistics::changeAccounts(d.id(), 1, static_cast<qint64>(quota));
+
+    if ((validUntil != defDateTime) || (pwExpires != defDateTime)) {
+        notifyExpiryChange(id);
+    }
 
     a = Account(id, d.id(), username, imap, pop, sieve, smtpauth, QStringList(email), QStringList(), quota, 0, currentUtc, currentUtc, validUntil, pwExpires, false, _catchAll, Account::calcStatus(validUntil, pwExpires));
 
     if (SkaffariConfig::useMemcached()) {
         Cutelyst::Memcached::set(MEMC_QUOTA_KEY + QString::number(id), QByteArray::number(0), MEMC_QUOTA_EXP);
     }
+    bumpAccountCountVersion(d.id());
 
     // now lets subscribe the new user to its folders
     // and set special use flags if CREATE-SPECIAL-USE is not available
@@ -874,7 +1156,7 @@ Account Account::create(Cutelyst::Context *c, SkaffariError &e, const QVariantHa
                 }
             }
 
-            if (!imap.hasCapability(QStringLiteral("CREATE-SPECIAL-USE")) && imap.hasCapability(QStringLiteral("SPECIAL-USE")) && imap.hasCapability(QStringLiteral("METADATA"))) {
+            if (!imap.hasCapability(SkaffariIMAP::CapCreateSpecialUse) && imap.hasCapability(SkaffariIMAP::CapSpecialUse) && imap.hasCapability(SkaffariIMAP::CapMetadata)) {
                 for (auto i = folders.constBegin(); i != folders.constEnd(); ++i) {
                     if (Q_UNLIKELY(!imap.setSpecialUse(i.value(), i.key()))) {
                         qCWarning(SK_ACCOUNT, "%s failed to set special use flag %u on folder \"%s\" for newly created user \"%s\": %s", uniStr, static_cast<uint>(i.key()), qUtf8Printable(i.value()), aunStr, qUtf8Printable(imap.lastError().errorText()));
@@ -887,6 +1169,9 @@ Account Account::create(Cutelyst::Context *c, SkaffariError &e, const QVariantHa
         }
     }
 
+    SearchIndex::update(id);
+    Statistics::updateAddresses(id);
+
     qCInfo(SK_ACCOUNT, "%s created new account %s in domain %s", uniStr, qUtf8Printable(a.nameIdString()), qUtf8Printable(d.nameIdString()));
 
     return a;
@@ -904,37 +1189,33 @@ bool Account::remove(Cutelyst::Context *c, SkaffariError &e) const
     const QByteArray aniBa = nameIdString().toUtf8();
     const char *aniStr = aniBa.constData();
 
-    SkaffariIMAP imap(c);
-    if (Q_UNLIKELY(!imap.login())) {
-        e.setImapError(imap.lastError(), c->translate("Account", "Logging in to IMAP server to delete the mailbox %1 failed.").arg(d->username));
-        qCCritical(SK_ACCOUNT, "%s failed to login as admin into IMAP server to delete the mailbox of account %s: %s", uniStr, aniStr, qUtf8Printable(imap.lastError().errorText()));
+    SkaffariIMAPPool::Connection imap(c);
+    if (Q_UNLIKELY(!imap->login())) {
+        e.setImapError(imap->lastError(), c->translate("Account", "Logging in to IMAP server to delete the mailbox %1 failed.").arg(d->username));
+        qCCritical(SK_ACCOUNT, "%s failed to login as admin into IMAP server to delete the mailbox of account %s: %s", uniStr, aniStr, qUtf8Printable(imap->lastError().errorText()));
         return ret;
     }
 
-    if (Q_UNLIKELY(!imap.setAcl(d->username, SkaffariConfig::imapUser()))) {
+    if (Q_UNLIKELY(!imap->setAcl(d->username, SkaffariConfig::imapUser()))) {
         // if Skaffari is responsible for mailbox creation, direct or indirect,
         // remove will fail if we can not delete the mailbox on the IMAP server
         if (SkaffariConfig::imapCreatemailbox() > DoNotCreate) {
-            e.setImapError(imap.lastError(), c->translate("Account", "Setting the access rights for the IMAP administrator to delete the mailbox %1 failed.").arg(d->username));
-            qCCritical(SK_ACCOUNT, "%s failed to set the access rights for the IMAP administrator to delete the mailbox of account %s: %s", uniStr, aniStr, qUtf8Printable(imap.lastError().errorText()));
-            imap.logout();
+            e.setImapError(imap->lastError(), c->translate("Account", "Setting the access rights for the IMAP administrator to delete the mailbox %1 failed.").arg(d->username));
+            qCCritical(SK_ACCOUNT, "%s failed to set the access rights for the IMAP administrator to delete the mailbox of account %s: %s", uniStr, aniStr, qUtf8Printable(imap->lastError().errorText()));
             return ret;
         }
     }
 
-    if (!imap.deleteMailbox(d->username) && (SkaffariConfig::imapCreatemailbox() != DoNotCreate)) {
+    if (!imap->deleteMailbox(d->username) && (SkaffariConfig::imapCreatemailbox() != DoNotCreate)) {
         // if Skaffari is responsible for mailbox creation, direct or indirect,
         // remove will fail if we can not delete the mailbox on the IMAP server
         if (SkaffariConfig::imapCreatemailbox() > DoNotCreate) {
-            e.setImapError(imap.lastError(), c->translate("Account", "Mailbox %1 could not be deleted from the IMAP server.").arg(d->username));
-            qCCritical(SK_ACCOUNT, "%s failed to delete mailbox of account %s from the IMAP server: %s", uniStr, aniStr, qUtf8Printable(imap.lastError().errorText()));
-            imap.logout();
+            e.setImapError(imap->lastError(), c->translate("Account", "Mailbox %1 could not be deleted from the IMAP server.").arg(d->username));
+            qCCritical(SK_ACCOUNT, "%s failed to delete mailbox of account %s from the IMAP server: %s", uniStr, aniStr, qUtf8Printable(imap->lastError().errorText()));
             return ret;
         }
     }
 
-    imap.logout();
-
     QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT quota FROM accountuser WHERE username = :username"));
     q.bindValue(QStringLiteral(":username"), d->username);
 
@@ -963,12 +1244,16 @@ bool Account::remove(Cutelyst::Context *c, SkaffariError &e) const
         return ret;
     }
 
+    // uses the stored quota and number of addresses of the account
+    Statistics::removeAccount(d->id);
+
     sqlError = removeAccountByID(d->id);
     if (sqlError.type() != QSqlError::NoError) {
         e.setSqlError(sqlError, c->translate("Account", "User account %1 could not be deleted from the database.").arg(d->username));
         qCCritical(SK_ACCOUNT, "%s failed to delete user account %s from the databsae: %s", uniStr, aniStr, qUtf8Printable(sqlError.text()));
         return ret;
     }
+    bumpAccountCountVersion(d->domainId);
 
     q = CPreparedSqlQueryThread(QStringLiteral("DELETE FROM log WHERE user = :username"));
     q.bindValue(QStringLiteral(":username"), d->username);
@@ -986,6 +1271,9 @@ bool Account::remove(Cutelyst::Context *c, SkaffariError &e) const
         e.setSqlError(q.lastError(), c->translate("Account", "Number of user accounts in the domain and domain quota used could not be updated in the database."));
         qCWarning(SK_ACCOUNT, "%s failed to update count of domain accounts and used quota for domain ID %u after deleting account %s: %s", uniStr, d->domainId, aniStr, qUtf8Printable(q.lastError().text()));
     }
+    Domain::clearCache(c);
+
+    SkaffariConfig::removeOrphanedDefaultAccounts();
 
     qCInfo(SK_ACCOUNT, "%s deleted account %s.", qUtf8Printable(AdminAccount::getUserNameIdString(c)), qUtf8Printable(nameIdString()));
 
@@ -994,7 +1282,7 @@ bool Account::remove(Cutelyst::Context *c, SkaffariError &e) const
     return ret;
 }
 
-Cutelyst::Pagination Account::list(Cutelyst::Context *c, SkaffariError &e, const Domain &d, const Cutelyst::Pagination &p, const QString &sortBy, const QString &sortOrder, const QString &searchRole, const QString &searchString)
+Cutelyst::Pagination Account::list(Cutelyst::Context *c, SkaffariError &e, const Domain &d, const Cutelyst::Pagination &p, const QString &sortBy, const QString &sortOrder, const QString &searchRole, const QString &searchString, const QString &cursor, QStringList *pendingQuotas)
 {
     Cutelyst::Pagination pag;
     std::vector<Account> lst;
@@ -1007,56 +1295,92 @@ Cutelyst::Pagination Account::list(Cutelyst::Context *c, SkaffariError &e, const
     const QByteArray dniBa = d.nameIdString().toUtf8();
     const char *dniStr = dniBa.constData();
 
-    QSqlQuery q(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread()));
-
-    if (searchString.isEmpty()) {
-        q.prepare(QStringLiteral("SELECT SQL_CALC_FOUND_ROWS au.id, au.username, au.imap, au.pop, au.sieve, au.smtpauth, au.quota, au.created_at, au.updated_at, au.valid_until, au.pwd_expire, au.status FROM accountuser au WHERE au.domain_id = :domain_id ORDER BY au.%1 %2 LIMIT %3 OFFSET %4").arg(sortBy, sortOrder, QString::number(p.limit()), QString::number(p.offset())));
-    } else {
-        const QString _searchString = QLatin1Char('%') + searchString + QLatin1Char('%');
-        if (searchRole == QLatin1String("username")) {
-            q.prepare(QStringLiteral("SELECT SQL_CALC_FOUND_ROWS au.id, au.username, au.imap, au.pop, au.sieve, au.smtpauth, au.quota, au.created_at, au.updated_at, au.valid_until, au.pwd_expire, au.status FROM accountuser au WHERE au.domain_id = :domain_id AND au.username LIKE '%5' ORDER BY au.%1 %2 LIMIT %3 OFFSET %4").arg(sortBy, sortOrder, QString::number(p.limit()), QString::number(p.offset()), _searchString));
-        } else if (searchRole == QLatin1String("email")) {
-            q.prepare(QStringLiteral("SELECT SQL_CALC_FOUND_ROWS DISTINCT au.id, au.username, au.imap, au.pop, au.sieve, au.smtpauth, au.quota, au.created_at, au.updated_at, au.valid_until, au.pwd_expire, au.status FROM accountuser au LEFT JOIN virtual vi ON au.username = vi.username WHERE au.domain_id = :domain_id AND vi.dest = au.username AND vi.username = au.username AND vi.alias LIKE '%5' ORDER BY au.%1 %2 LIMIT %3 OFFSET %4").arg(sortBy, sortOrder, QString::number(p.limit()), QString::number(p.offset()), _searchString));
-        } else if (searchRole == QLatin1String("forward")) {
-            q.prepare(QStringLiteral("SELECT SQL_CALC_FOUND_ROWS DISTINCT au.id, au.username, au.imap, au.pop, au.sieve, au.smtpauth, au.quota, au.created_at, au.updated_at, au.valid_until, au.pwd_expire, au.status FROM accountuser au LEFT JOIN virtual vi ON au.username = vi.alias WHERE au.domain_id = :domain_id AND vi.username = '' AND vi.dest LIKE '%5' ORDER BY au.%1 %2 LIMIT %3 OFFSET %4").arg(sortBy, sortOrder, QString::number(p.limit()), QString::number(p.offset()), _searchString));
+    // the list is ordered by the sort column and the account ID to get a stable order for keyset pagination
+    const bool desc = (sortOrder.compare(QLatin1String("desc"), Qt::CaseInsensitive) == 0);
+    const QString dir = desc ? QStringLiteral("DESC") : QStringLiteral("ASC");
+
+    // values of the placeholders in the FROM and WHERE part that is shared by the list and the count query
+    QVariantHash binds;
+    binds.insert(QStringLiteral(":domain_id"), d.id());
+
+    QString fromWhere = QStringLiteral("FROM accountuser au WHERE au.domain_id = :domain_id");
+    if (!searchString.isEmpty()) {
+        const SearchIndex::Role role = SearchIndex::roleFromString(searchRole);
+        // candidates from the trigram index, the LIKE conditions remove the false positives
+        fromWhere += SearchIndex::condition(role, searchString, &binds);
+        binds.insert(QStringLiteral(":search"), SearchIndex::likePattern(searchString));
+        if (role == SearchIndex::Address) {
+            fromWhere += QStringLiteral(" AND EXISTS (SELECT 1 FROM virtual vi WHERE vi.dest = au.username AND vi.username = au.username AND vi.alias LIKE :search)");
+        } else if (role == SearchIndex::Forward) {
+            fromWhere += QStringLiteral(" AND EXISTS (SELECT 1 FROM virtual vi WHERE vi.alias = au.username AND vi.username = '' AND vi.dest LIKE :search)");
+        } else {
+            fromWhere += QStringLiteral(" AND au.username LIKE :search");
         }
     }
 
-    q.bindValue(QStringLiteral(":domain_id"), d.id());
-
-    if (Q_UNLIKELY(!q.exec())) {
-        e.setSqlError(q.lastError(), c->translate("Account", "User accounts could not be queried from the database."));
-        qCCritical(SK_ACCOUNT, "%s failed to query accounts for domain %s from the database: %s", uniStr, dniStr, qUtf8Printable(q.lastError().text()));
+    // the total number of unfiltered accounts is already counted in the domain table
+    quint32 foundRows = searchString.isEmpty() ? d.accounts() : countFilteredAccounts(c, e, d, fromWhere, binds, searchRole, searchString);
+    if (foundRows == 0) {
         return pag;
     }
 
-    QSqlQuery countQuery = CPreparedSqlQueryThread(QStringLiteral("SELECT FOUND_ROWS()"));
-    if (Q_UNLIKELY(!countQuery.exec())) {
-        e.setSqlError(q.lastError(), c->translate("Account", "Total result could not be retrieved from the database."));
-        qCCritical(SK_ACCOUNT, "%s failed to query total result for domain %s from the database: %s", uniStr, dniStr, qUtf8Printable(q.lastError().text()));
-        return pag;
+    QVariant cursorValue;
+    dbid_t cursorId = 0;
+    const bool useCursor = decodeListCursor(cursor, sortBy, &cursorValue, &cursorId);
+
+    QString keyset;
+    if (useCursor) {
+        keyset = QStringLiteral(" AND (au.%1 %2 :cursor_val OR (au.%1 = :cursor_val AND au.id %2 :cursor_id))").arg(sortBy, desc ? QStringLiteral("<") : QStringLiteral(">"));
     }
 
-    quint32 foundRows = 0;
-    if (countQuery.next()) {
-        foundRows = countQuery.value(0).value<quint32>();
+    // fetch one more row than requested to know if there is a next page
+    QString limitOffset = QStringLiteral("LIMIT %1").arg(p.limit() + 1);
+    if (!useCursor && (p.offset() > 0)) {
+        limitOffset += QStringLiteral(" OFFSET %1").arg(p.offset());
     }
 
-    if (foundRows == 0) {
+    QSqlQuery q(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread()));
+    q.prepare(QStringLiteral("SELECT au.id, au.username, au.imap, au.pop, au.sieve, au.smtpauth, au.quota, au.created_at, au.updated_at, au.valid_until, au.pwd_expire, au.status, au.quota_usage, au.usage_updated_at %1%2 ORDER BY au.%3 %4, au.id %4 %5").arg(fromWhere, keyset, sortBy, dir, limitOffset));
+
+    for (auto it = binds.constBegin(); it != binds.constEnd(); ++it) {
+        q.bindValue(it.key(), it.value());
+    }
+    if (useCursor) {
+        q.bindValue(QStringLiteral(":cursor_val"), cursorValue);
+        q.bindValue(QStringLiteral(":cursor_id"), cursorId);
+    }
+
+    if (Q_UNLIKELY(!q.exec())) {
+        e.setSqlError(q.lastError(), c->translate("Account", "User accounts could not be queried from the database."));
+        qCCritical(SK_ACCOUNT, "%s failed to query accounts for domain %s from the database: %s", uniStr, dniStr, qUtf8Printable(q.lastError().text()));
         return pag;
     }
 
     pag = Cutelyst::Pagination(static_cast<int>(foundRows), p.limit(), p.currentPage(), p.pages().size());
 
-    SkaffariIMAP imap(c);
-    if (!imap.login()) {
-        qCWarning(SK_ACCOUNT, "%s failed to log IMAP admin into IMAP server to query account quotas while listing accounts for domain %s: %s", uniStr, dniStr, qUtf8Printable(imap.lastError().errorText()));
-    }
-
     QCollator col(c->locale());
-    lst.reserve(foundRows);
+    lst.reserve(qMin(static_cast<int>(foundRows), p.limit()));
+
+    QStringList usernames;
+    usernames.reserve(qMin(static_cast<int>(foundRows), p.limit()));
+
+    QString nextCursor;
+    QVariant lastSortValue;
+    const int sortIdx = listSortColumnIndex(sortBy);
+
+    // accounts whose usage could not be found in the cache
+    QStringList quotaUsers;
+    std::vector<std::size_t> quotaIdxs;
 
     while (q.next()) {
+        if (static_cast<int>(lst.size()) == p.limit()) {
+            // the additional row, continue after the last listed account on the next page
+            nextCursor = encodeListCursor(sortBy, lastSortValue, lst.back().id());
+            break;
+        }
+
+        lastSortValue = q.value(sortIdx);
+
         const dbid_t _id = q.value(0).value<dbid_t>();
         const QString _username = q.value(1).toString();
         quota_size_t quota = q.value(6).value<quota_size_t>();
@@ -1069,24 +1393,12 @@ Cutelyst::Pagination Account::list(Cutelyst::Context *c, SkaffariError &e, const
         QDateTime accountPwExpires = q.value(10).toDateTime();
         accountPwExpires.setTimeSpec(Qt::UTC);
 
-        std::pair<QStringList,bool> emailAddresses = queryAddresses(c, _username);
-
-        std::pair<QStringList,bool> forwards = queryFowards(c, _username);
-
-        if ((emailAddresses.first.size() > 1) || (forwards.first.size() > 1)) {
-
-            if (emailAddresses.first.size() > 1) {
-                std::sort(emailAddresses.first.begin(), emailAddresses.first.end(), col);
-            }
-
-            if (forwards.first.size() > 1) {
-                std::sort(forwards.first.begin(), forwards.first.end(), col);
-            }
-        }
+        usernames.push_back(_username);
 
-        bool gotQuota = false;
-        quota_size_t usage = 0;
-        if (SkaffariConfig::useMemcached()) {
+        // the usage stored by skaffaricmd --sync-usage
+        bool gotQuota = !q.value(13).isNull();
+        quota_size_t usage = gotQuota ? q.value(12).value<quota_size_t>() : 0;
+        if (!gotQuota && SkaffariConfig::useMemcached()) {
             const QByteArray usageBa = Cutelyst::Memcached::get(MEMC_QUOTA_KEY + QString::number(_id));
             if (!usageBa.isNull()) {
                 bool ok = false;
@@ -1098,14 +1410,8 @@ Cutelyst::Pagination Account::list(Cutelyst::Context *c, SkaffariError &e, const
         }
 
         if (!gotQuota) {
-            if (Q_LIKELY(imap.isLoggedIn())) {
-                quota_pair quotaVals = imap.getQuota(_username);
-                usage = quotaVals.first;
-                quota = quotaVals.second;
-                if (SkaffariConfig::useMemcached()) {
-                    Cutelyst::Memcached::set(MEMC_QUOTA_KEY + QString::number(_id), QByteArray::number(quotaVals.first), MEMC_QUOTA_EXP);
-                }
-            }
+            quotaUsers.push_back(_username);
+            quotaIdxs.push_back(lst.size());
         }
 
         lst.emplace_back(_id,
@@ -1115,33 +1421,121 @@ Cutelyst::Pagination Account::list(Cutelyst::Context *c, SkaffariError &e, const
                          q.value(3).toBool(),
                          q.value(4).toBool(),
                          q.value(5).toBool(),
-                         emailAddresses.first,
-                         forwards.first,
+                         QStringList(),
+                         QStringList(),
                          quota,
                          usage,
                          accountCreated,
                          accountUpdated,
                          accountValidUntil,
                          accountPwExpires,
-                         forwards.second,
-                         emailAddresses.second,
+                         false,
+                         false,
                          q.value(11).value<quint8>());
     }
 
-    imap.logout();
+    // fetch the addresses and forwards of the complete page at once instead of two queries per account
+    const QHash<QString,std::pair<QStringList,bool>> addresses = queryAddresses(c, usernames);
+    const QHash<QString,std::pair<QStringList,bool>> forwards = queryFowards(c, usernames);
+
+    for (Account &a : lst) {
+        const auto addrIt = addresses.constFind(a.d->username);
+        if (addrIt != addresses.constEnd()) {
+            a.d->addresses = addrIt.value().first;
+            a.d->catchAll = addrIt.value().second;
+            if (a.d->addresses.size() > 1) {
+                std::sort(a.d->addresses.begin(), a.d->addresses.end(), col);
+            }
+        }
+
+        const auto fwIt = forwards.constFind(a.d->username);
+        if (fwIt != forwards.constEnd()) {
+            a.d->forwards = fwIt.value().first;
+            a.d->keepLocal = fwIt.value().second;
+            if (a.d->forwards.size() > 1) {
+                std::sort(a.d->forwards.begin(), a.d->forwards.end(), col);
+            }
+        }
+    }
+
+    if (pendingQuotas) {
+        *pendingQuotas = quotaUsers;
+    } else if (!quotaUsers.empty()) {
+        SkaffariIMAPPool::Connection imap(c);
+        if (Q_LIKELY(imap->login())) {
+            const QHash<QString,quota_pair> quotas = imap->getQuotas(quotaUsers);
+            for (std::size_t idx : quotaIdxs) {
+                Account &a = lst[idx];
+                const auto quotaIt = quotas.constFind(a.d->username);
+                if (quotaIt != quotas.constEnd()) {
+                    a.d->usage = quotaIt.value().first;
+                    a.d->quota = quotaIt.value().second;
+                    if (SkaffariConfig::useMemcached()) {
+                        Cutelyst::Memcached::set(MEMC_QUOTA_KEY + QString::number(a.d->id), QByteArray::number(quotaIt.value().first), MEMC_QUOTA_EXP);
+                    }
+                }
+            }
+        } else {
+            qCWarning(SK_ACCOUNT, "%s failed to log IMAP admin into IMAP server to query account quotas while listing accounts for domain %s: %s", uniStr, dniStr, qUtf8Printable(imap->lastError().errorText()));
+        }
+    }
 
     pag.insert(QStringLiteral("accounts"), QVariant::fromValue<std::vector<Account>>(lst));
+    if (!nextCursor.isEmpty()) {
+        pag.insert(QStringLiteral("nextCursor"), nextCursor);
+    }
 
     return pag;
 }
 
+void Account::loadQuotasAsync(Cutelyst::Context *c, const std::vector<Account> &accounts, const QStringList &users, const std::function<void (const std::vector<Account> &)> &callback)
+{
+    Q_ASSERT_X(c, "load quotas async", "invalid context object");
+    Q_ASSERT_X(callback, "load quotas async", "invalid callback");
+
+    const QString uniStr = AdminAccount::getUserNameIdString(c);
+    SkaffariIMAP *imap = SkaffariIMAPPool::checkout(c);
+
+    // the connection is only put back from the event loop, because it might be deleted and
+    // the callbacks are invoked from the readyRead() handler of the connection
+    auto finish = [imap, callback](const std::vector<Account> &result) {
+        QTimer::singleShot(0, [imap, callback, result]() {
+            SkaffariIMAPPool::checkin(imap);
+            callback(result);
+        });
+    };
+
+    imap->loginAsync([imap, accounts, users, uniStr, finish](bool ok) {
+        if (Q_UNLIKELY(!ok)) {
+            qCWarning(SK_ACCOUNT, "%s failed to log IMAP admin into IMAP server to query account quotas: %s", qUtf8Printable(uniStr), qUtf8Printable(imap->lastError().errorText()));
+            finish(accounts);
+            return;
+        }
+
+        imap->getQuotasAsync(users, [accounts, finish](const QHash<QString,quota_pair> &quotas) {
+            std::vector<Account> lst = accounts;
+            for (Account &a : lst) {
+                const auto quotaIt = quotas.constFind(a.d->username);
+                if (quotaIt != quotas.constEnd()) {
+                    a.d->usage = quotaIt.value().first;
+                    a.d->quota = quotaIt.value().second;
+                    if (SkaffariConfig::useMemcached()) {
+                        Cutelyst::Memcached::set(MEMC_QUOTA_KEY + QString::number(a.d->id), QByteArray::number(quotaIt.value().first), MEMC_QUOTA_EXP);
+                    }
+                }
+            }
+            finish(lst);
+        });
+    });
+}
+
 Account Account::get(Cutelyst::Context *c, SkaffariError &e, dbid_t id)
 {
     Account a;
 
     Q_ASSERT_X(c, "get account", "invalid context object");
 
-    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT au.domain_id, au.username, au.imap, au.pop, au.sieve, au.smtpauth, au.quota, au.created_at, au.updated_at, au.valid_until, au.pwd_expire, au.status FROM accountuser au WHERE au.id = :id"));
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT au.domain_id, au.username, au.imap, au.pop, au.sieve, au.smtpauth, au.quota, au.created_at, au.updated_at, au.valid_until, au.pwd_expire, au.status, au.quota_usage, au.usage_updated_at FROM accountuser au WHERE au.id = :id"));
     q.bindValue(QStringLiteral(":id"), id);
 
     if (Q_UNLIKELY(!q.exec())) {
@@ -1184,9 +1578,10 @@ Account Account::get(Cutelyst::Context *c, SkaffariError &e, dbid_t id)
         }
     }
 
-    bool gotUsage = false;
-    quota_size_t usage = 0;
-    if (SkaffariConfig::useMemcached()) {
+    // the usage stored by skaffaricmd --sync-usage
+    bool gotUsage = !q.value(13).isNull();
+    quota_size_t usage = gotUsage ? q.value(12).value<quota_size_t>() : 0;
+    if (!gotUsage && SkaffariConfig::useMemcached()) {
         const QByteArray usageBa = Cutelyst::Memcached::get(MEMC_QUOTA_KEY + QString::number(id));
         if (!usageBa.isNull()) {
             bool ok = false;
@@ -1198,15 +1593,14 @@ Account Account::get(Cutelyst::Context *c, SkaffariError &e, dbid_t id)
     }
 
     if (!gotUsage) {
-        SkaffariIMAP imap(c);
-        if (imap.login()) {
-            quota_pair quotaPair = imap.getQuota(userName);
+        SkaffariIMAPPool::Connection imap(c);
+        if (imap->login()) {
+            quota_pair quotaPair = imap->getQuota(userName);
             usage = quotaPair.first;
             quota = quotaPair.second;
-            imap.logout();
 
             if (SkaffariConfig::useMemcached()) {
-                Cutelyst::Memcached::set(MEMC_QUOTA_KEY + QString::number(id), QByteArray::number(quota), MEMC_QUOTA_EXP);
+                Cutelyst::Memcached::set(MEMC_QUOTA_KEY + QString::number(id), QByteArray::number(usage), MEMC_QUOTA_EXP);
             }
         }
     }
@@ -1304,16 +1698,16 @@ bool Account::update(Cutelyst::Context *c, SkaffariError &e, Domain *dom, const
     const quota_size_t quota = p.contains(QStringLiteral("quota")) ? static_cast<quota_size_t>(p.value(QStringLiteral("quota")).value<quota_size_t>()/Q_UINT64_C(1024)) : d->quota;
 
     if (quota != d->quota) {
-        SkaffariIMAP imap(c);
-        if (Q_LIKELY(imap.login())) {
-            if (Q_UNLIKELY(!imap.setQuota(d->username, quota))) {
-                e.setImapError(imap.lastError(), c->translate("Account", "Changing the storage quota failed."));
-                qCCritical(SK_ACCOUNT, "%s failed to set storage quota for account %s on IMAP server: %s", uniStr, aniStr, qUtf8Printable(imap.lastError().errorText()));
+        SkaffariIMAPPool::Connection imap(c);
+        if (Q_LIKELY(imap->login())) {
+            if (Q_UNLIKELY(!imap->setQuota(d->username, quota))) {
+                e.setImapError(imap->lastError(), c->translate("Account", "Changing the storage quota failed."));
+                qCCritical(SK_ACCOUNT, "%s failed to set storage quota for account %s on IMAP server: %s", uniStr, aniStr, qUtf8Printable(imap->lastError().errorText()));
                 return ret;
             }
         } else {
-            e.setImapError(imap.lastError(), c->translate("Account", "Logging in to IMAP server to change the storage quota failed."));
-            qCCritical(SK_ACCOUNT, "%s faild to log into IMAP server as %s to change storage quota of account %s: %s", uniStr, qUtf8Printable(SkaffariConfig::imapUser()), aniStr, qUtf8Printable(imap.lastError().errorText()));
+            e.setImapError(imap->lastError(), c->translate("Account", "Logging in to IMAP server to change the storage quota failed."));
+            qCCritical(SK_ACCOUNT, "%s faild to log into IMAP server as %s to change storage quota of account %s: %s", uniStr, qUtf8Printable(SkaffariConfig::imapUser()), aniStr, qUtf8Printable(imap->lastError().errorText()));
             return ret;
         }
     }
@@ -1330,10 +1724,10 @@ bool Account::update(Cutelyst::Context *c, SkaffariError &e, Domain *dom, const
 
     QSqlQuery q;
     if (!password.isEmpty()) {
-        q = CPreparedSqlQueryThread(QStringLiteral("UPDATE accountuser SET password = :password, quota = :quota, valid_until = :valid_until, updated_at = :updated_at, imap = :imap, pop = :pop, sieve = :sieve, smtpauth =:smtpauth, pwd_expire = :pwd_expire WHERE id = :id"));
+        q = CPreparedSqlQueryThread(QStringLiteral("UPDATE accountuser SET password = :password, quota = :quota, quota_limit = :quota, valid_until = :valid_until, updated_at = :updated_at, imap = :imap, pop = :pop, sieve = :sieve, smtpauth =:smtpauth, pwd_expire = :pwd_expire WHERE id = :id"));
         q.bindValue(QStringLiteral(":password"), encPw);
     } else {
-        q = CPreparedSqlQueryThread(QStringLiteral("UPDATE accountuser SET quota = :quota, valid_until = :valid_until, updated_at = :updated_at, imap = :imap, pop = :pop, sieve = :sieve, smtpauth =:smtpauth, pwd_expire = :pwd_expire WHERE id = :id"));
+        q = CPreparedSqlQueryThread(QStringLiteral("UPDATE accountuser SET quota = :quota, quota_limit = :quota, valid_until = :valid_until, updated_at = :updated_at, imap = :imap, pop = :pop, sieve = :sieve, smtpauth =:smtpauth, pwd_expire = :pwd_expire WHERE id = :id"));
     }
     q.bindValue(QStringLiteral(":quota"), quota);
     q.bindValue(QStringLiteral(":valid_until"), validUntil);
@@ -1352,6 +1746,11 @@ bool Account::update(Cutelyst::Context *c, SkaffariError &e, Domain *dom, const
         return ret;
     }
 
+    if ((validUntil != d->validUntil) || (pwExpires != d->passwordExpires)) {
+        notifyExpiryChange(d->id);
+    }
+
+    const bool oldCatchAll = d->catchAll;
     if (_catchAll != d->catchAll) {
         const QString catchAllAlias = QLatin1Char('@') + dom->name();
         const QString catchAllAliasAce = QLatin1Char('@') + dom->aceName();
@@ -1430,6 +1829,9 @@ bool Account::update(Cutelyst::Context *c, SkaffariError &e, Domain *dom, const
     if (Q_UNLIKELY(!q.exec())) {
         qCWarning(SK_ACCOUNT, "%s failed to update used domain quota for domain %s after updating account %s: %s", uniStr, dniStr, aniStr, qUtf8Printable(q.lastError().text()));
     }
+    Domain::clearCache(c);
+
+    Statistics::changeAccounts(d->domainId, 0, static_cast<qint64>(quota) - static_cast<qint64>(d->quota));
 
     d->validUntil = validUntil;
     d->passwordExpires = pwExpires;
@@ -1450,6 +1852,11 @@ bool Account::update(Cutelyst::Context *c, SkaffariError &e, Domain *dom, const
         }
     }
 
+    if (_catchAll != oldCatchAll) {
+        SearchIndex::update(d->id);
+        Statistics::updateAddresses(d->id);
+    }
+
     qCInfo(SK_ACCOUNT, "%s updated account %s in domain %s", uniStr, aniStr, dniStr);
 
     ret = true;
@@ -1488,27 +1895,30 @@ QStringList Account::check(Cutelyst::Context *c, SkaffariError &e, const Domain
     const QByteArray dniBa = dom.nameIdString().toUtf8();
     const char *dniStr = dniBa.constData();
 
-    SkaffariIMAP imap(c);
-    if (Q_UNLIKELY(!imap.login())) {
-        e.setImapError(imap.lastError());
-        qCCritical(SK_ACCOUNT, "%s failed to login as IMAP admin %s into IMAP server while checking user account %s: %s", uniStr, qUtf8Printable(SkaffariConfig::imapUser()), aniStr, qUtf8Printable(imap.lastError().errorText()));
+    SkaffariIMAPPool::Connection imap(c);
+    if (Q_UNLIKELY(!imap->login())) {
+        e.setImapError(imap->lastError());
+        qCCritical(SK_ACCOUNT, "%s failed to login as IMAP admin %s into IMAP server while checking user account %s: %s", uniStr, qUtf8Printable(SkaffariConfig::imapUser()), aniStr, qUtf8Printable(imap->lastError().errorText()));
         return actions;
     }
 
-    const QStringList mboxes = imap.getMailboxes();
+    // the domain check already compared the mailboxes of all accounts with the list from the server
+    const bool skipMailboxCheck = Utils::checkCheckbox(p, QStringLiteral("skipMailboxCheck"));
 
-    if (mboxes.empty() && (imap.lastError().type() != SkaffariIMAPError::NoError)) {
-        e.setImapError(imap.lastError(), c->translate("Account", "Could not retrieve a list of all mailboxes from the IMAP server."));
-        qCCritical(SK_ACCOUNT, "%s failed to query a list of all mailboxes from the IMAP server while checking user account %s: %s", uniStr, aniStr, qUtf8Printable(imap.lastError().errorText()));
-        imap.logout();
-        return actions;
+    bool mailboxExists = true;
+    if (!skipMailboxCheck && (SkaffariConfig::imapCreatemailbox() != DoNotCreate)) {
+        mailboxExists = imap->mailboxExists(d->username);
+        if (!mailboxExists && (imap->lastError().type() != SkaffariIMAPError::NoError)) {
+            e.setImapError(imap->lastError(), c->translate("Account", "Could not check if the mailbox exists on the IMAP server."));
+            qCCritical(SK_ACCOUNT, "%s failed to check if the mailbox exists on the IMAP server while checking user account %s: %s", uniStr, aniStr, qUtf8Printable(imap->lastError().errorText()));
+            return actions;
+        }
     }
 
-    if ((SkaffariConfig::imapCreatemailbox() != DoNotCreate) && !mboxes.contains(d->username)) {
-        if (Q_UNLIKELY(!imap.createMailbox(d->username))) {
-            e.setImapError(imap.lastError());
-            qCCritical(SK_ACCOUNT, "%s failed to create missing mailbox on IMAP server for user account %s: %s", uniStr, aniStr, qUtf8Printable(imap.lastError().errorText()));
-            imap.logout();
+    if (!mailboxExists) {
+        if (Q_UNLIKELY(!imap->createMailbox(d->username))) {
+            e.setImapError(imap->lastError());
+            qCCritical(SK_ACCOUNT, "%s failed to create missing mailbox on IMAP server for user account %s: %s", uniStr, aniStr, qUtf8Printable(imap->lastError().errorText()));
             return actions;
         } else {
             qCInfo(SK_ACCOUNT, "%s created missing mailbox on IMAP server for user account %s.", uniStr, aniStr);
@@ -1516,15 +1926,14 @@ QStringList Account::check(Cutelyst::Context *c, SkaffariError &e, const Domain
         }
     }
 
-    quota_pair quota = imap.getQuota(d->username);
+    quota_pair quota = imap->getQuota(d->username);
 
     if ((dom.domainQuota() > 0) && ((d->quota == 0) || (quota.second == 0))) {
         const quota_size_t newQuota = (dom.quota() > 0) ? dom.quota() : (SkaffariConfig::defQuota() > 0) ? SkaffariConfig::defQuota() : 10240;
         if (quota.second == 0) {
-            if (Q_UNLIKELY(!imap.setQuota(d->username, newQuota))) {
-                e.setImapError(imap.lastError());
-                qCCritical(SK_ACCOUNT, "%s failed to set correct mailbox storage quota of %llu on IMAP sever for user account %s: %s", uniStr, newQuota, aniStr, qUtf8Printable(imap.lastError().errorText()));
-                imap.logout();
+            if (Q_UNLIKELY(!imap->setQuota(d->username, newQuota))) {
+                e.setImapError(imap->lastError());
+                qCCritical(SK_ACCOUNT, "%s failed to set correct mailbox storage quota of %llu on IMAP sever for user account %s: %s", uniStr, newQuota, aniStr, qUtf8Printable(imap->lastError().errorText()));
                 return actions;
             } else {
                 qCInfo(SK_ACCOUNT, "%s set correct mailbox storage quota of %llu on IMAP server for user account %s.", uniStr, newQuota, aniStr);
@@ -1544,6 +1953,7 @@ QStringList Account::check(Cutelyst::Context *c, SkaffariError &e, const Domain
             } else {
                 qCInfo(SK_ACCOUNT, "%s set correct mailbox storage quota of %llu in database for user account %s.",  uniStr, newQuota, aniStr);
                 actions.push_back(c->translate("Account", "Storage quota in database fixed."));
+                Statistics::changeAccounts(d->domainId, 0, static_cast<qint64>(newQuota));
                 d->quota = newQuota;
 
                 q = CPreparedSqlQueryThread(QStringLiteral("UPDATE domain SET domainquotaused = (SELECT SUM(quota) FROM accountuser WHERE domain_id = :domain_id) WHERE id = :domain_id"));
@@ -1551,15 +1961,15 @@ QStringList Account::check(Cutelyst::Context *c, SkaffariError &e, const Domain
                 if (Q_UNLIKELY(!q.exec())) {
                     qCWarning(SK_ACCOUNT, "%s failed to update used domain quota for domain %s after checking account %s: %s", uniStr, dniStr, aniStr, qUtf8Printable(q.lastError().text()));
                 }
+                Domain::clearCache(c);
             }
         }
     }
 
     if (quota.second != d->quota) {
-        if (Q_UNLIKELY(!imap.setQuota(d->username, d->quota))) {
-            e.setImapError(imap.lastError());
-            qCCritical(SK_ACCOUNT, "%s failed to set correct mailbox storage quota of %llu on IMAP server for user account %s: %s", uniStr, d->quota, aniStr, qUtf8Printable(imap.lastError().text()));
-            imap.logout();
+        if (Q_UNLIKELY(!imap->setQuota(d->username, d->quota))) {
+            e.setImapError(imap->lastError());
+            qCCritical(SK_ACCOUNT, "%s failed to set correct mailbox storage quota of %llu on IMAP server for user account %s: %s", uniStr, d->quota, aniStr, qUtf8Printable(imap->lastError().text()));
             return actions;
         } else {
             qCInfo(SK_ACCOUNT, "%s set correct mailbox storage quota of %llu on IMAP server for user account %s.", uniStr, d->quota, aniStr);
@@ -1568,8 +1978,6 @@ QStringList Account::check(Cutelyst::Context *c, SkaffariError &e, const Domain
         }
     }
 
-    imap.logout();
-
     const QDateTime now = QDateTime::currentDateTimeUtc();
 
     quint8 newStatus = 0;
@@ -1640,6 +2048,7 @@ QStringList Account::check(Cutelyst::Context *c, SkaffariError &e, const Domain
                                 qq.bindValue(QStringLiteral(":status"), 1);
 
                                 if (Q_LIKELY(qq.exec())) {
+                                    AutoconfigGuard::removeMissing(childAddress);
                                     const QString newAddress = parts.first + QLatin1Char('@') + kid.name();
                                     newAddresses.push_back(newAddress);
                                     qCInfo(SK_ACCOUNT, "%s added a new address for child domain %s to account %s.", qUtf8Printable(AdminAccount::getUserNameIdString(c)), qUtf8Printable(kid.nameIdString()), qUtf8Printable(nameIdString()));
@@ -1792,6 +2201,9 @@ QString Account::updateEmail(Cutelyst::Context *c, SkaffariError &e, const QVari
         return ret;
     }
 
+    AutoconfigGuard::removeMissing(address);
+    AutoconfigGuard::removeMissing(aceAddress);
+
     d->addresses.removeOne(oldAddress);
     d->addresses.push_back(address);
     if (d->addresses.size() > 1) {
@@ -2004,19 +2416,26 @@ bool Account::addForward(Cutelyst::Context *c, SkaffariError &e, const QString &
 
     forwards.first.append(forward);
 
+    QStringList _fws = forwards.first;
+    if (forwards.second) {
+        _fws.append(d->username);
+    }
+    const QString dest = _fws.join(QLatin1Char(','));
+
+    if (Q_UNLIKELY(dest.size() > SK_FORWARDS_MAX_LENGTH)) {
+        e.setErrorType(SkaffariError::InputError);
+        e.setErrorText(c->translate("Account", "Can not add forward email address %1 to account %2. The list of forward addresses would exceed the maximum length of %n character(s).", "", SK_FORWARDS_MAX_LENGTH).arg(forward, d->username));
+        qCWarning(SK_ACCOUNT, "%s failed to add new forward address %s to account %s: list of forward addresses exceeds the maximum length.", uniStr, fwStr, aniStr);
+        return ret;
+    }
+
     QSqlQuery q;
     if (oldDataAvailable) {
         q = CPreparedSqlQueryThread(QStringLiteral("UPDATE virtual SET dest = :dest WHERE alias = :alias AND username = ''"));
     } else {
         q = CPreparedSqlQueryThread(QStringLiteral("INSERT INTO virtual (alias, dest, username) VALUES (:alias, :dest, '')"));
     }
-    if (!forwards.second) {
-        q.bindValue(QStringLiteral(":dest"), forwards.first.join(QLatin1Char(',')));
-    } else {
-        QStringList _fws = forwards.first;
-        _fws.append(d->username);
-        q.bindValue(QStringLiteral(":dest"), _fws.join(QLatin1Char(',')));
-    }
+    q.bindValue(QStringLiteral(":dest"), dest);
     q.bindValue(QStringLiteral(":alias"), d->username);
 
     if (Q_UNLIKELY(!q.exec())) {
@@ -2150,15 +2569,22 @@ bool Account::editForward(Cutelyst::Context *c, SkaffariError &e, const QString
     forwards.first.removeAll(oldForward);
     forwards.first.append(newForward);
 
-    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE virtual SET dest = :dest WHERE alias = :alias AND username = ''"));
-    q.bindValue(QStringLiteral(":alias"), d->username);
-    if (!forwards.second) {
-        q.bindValue(QStringLiteral(":dest"), forwards.first.join(QLatin1Char(',')));
-    } else {
-        QStringList _fws = forwards.first;
+    QStringList _fws = forwards.first;
+    if (forwards.second) {
         _fws.append(d->username);
-        q.bindValue(QStringLiteral(":dest"), _fws.join(QLatin1Char(',')));
     }
+    const QString dest = _fws.join(QLatin1Char(','));
+
+    if (Q_UNLIKELY(dest.size() > SK_FORWARDS_MAX_LENGTH)) {
+        e.setErrorType(SkaffariError::InputError);
+        e.setErrorText(c->translate("Account", "Forwarding address %1 for user account %2 cannot be changed to %3. The list of forward addresses would exceed the maximum length of %n character(s).", "", SK_FORWARDS_MAX_LENGTH).arg(oldForward, d->username, newForward));
+        qCWarning(SK_ACCOUNT, "%s failed to change forward address of account %s to %s: list of forward addresses exceeds the maximum length.", uniStr, aniStr, nfwStr);
+        return ret;
+    }
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE virtual SET dest = :dest WHERE alias = :alias AND username = ''"));
+    q.bindValue(QStringLiteral(":alias"), d->username);
+    q.bindValue(QStringLiteral(":dest"), dest);
 
     if (Q_UNLIKELY(!q.exec())) {
         e.setSqlError(q.lastError(), c->translate("Account", "Cannot update the list of forwarding addresses for user account %1 in the database.").arg(d->username));
@@ -2300,6 +2726,11 @@ void Account::markUpdated(Cutelyst::Context *c)
     }
 
     d->updated = current;
+
+    // all methods changing addresses or forwards mark the account as updated
+    SearchIndex::update(d->id);
+    Statistics::updateAddresses(d->id);
+    bumpAccountCountVersion(d->domainId);
 }
 
 QString AccountData::nameIdString() const
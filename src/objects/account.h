@@ -29,6 +29,7 @@
 #include <QLoggingCategory>
 #include <QDateTime>
 #include <QJsonObject>
+#include <functional>
 #include <utility>
 
 Q_DECLARE_LOGGING_CATEGORY(SK_ACCOUNT)
@@ -429,9 +430,26 @@ public:
      * \param sortOrder     Order to sort the accounts by, valid values: ASC, DESC
      * \param searchRole    The column to search in for the \a searchString.
      * \param searchString  The string to search for in the column defined by \a searchRole.
-     * \return A pagination object containing information about the pagination and the list of accounts.
+     * \param cursor        Position returned as \c nextCursor by a previous call. If valid, the list continues after this
+     *                      position instead of using the offset of \a p.
+     * \param pendingQuotas If not a \c nullptr, the quotas that are neither stored in the database nor cached are not
+     *                      requested from the IMAP server. The user names of these accounts are added to this list
+     *                      instead, to request them with loadQuotasAsync().
+     * \return A pagination object containing information about the pagination and the list of accounts. If there are
+     * more accounts, it also contains a \c nextCursor that can be used to request the next page.
      */
-    static Cutelyst::Pagination list(Cutelyst::Context *c, SkaffariError &e, const Domain &d, const Cutelyst::Pagination &p, const QString &sortBy = QStringLiteral("username"), const QString &sortOrder = QStringLiteral("ASC"), const QString &searchRole = QStringLiteral("username"), const QString &searchString = QString());
+    static Cutelyst::Pagination list(Cutelyst::Context *c, SkaffariError &e, const Domain &d, const Cutelyst::Pagination &p, const QString &sortBy = QStringLiteral("username"), const QString &sortOrder = QStringLiteral("ASC"), const QString &searchRole = QStringLiteral("username"), const QString &searchString = QString(), const QString &cursor = QString(), QStringList *pendingQuotas = nullptr);
+
+    /*!
+     * \brief Requests the quotas of the \a users from the IMAP server without blocking.
+     *
+     * The quotas are sent as one pipelined batch on a pooled connection. When the responses have
+     * been received, \a callback is called from the event loop with a copy of \a accounts that
+     * contains the quotas. If the IMAP server can not be reached, the unchanged \a accounts are
+     * returned. The \a callback is never called before this function returns, so it can be used
+     * together with Cutelyst::Context::detachAsync().
+     */
+    static void loadQuotasAsync(Cutelyst::Context *c, const std::vector<Account> &accounts, const QStringList &users, const std::function<void(const std::vector<Account> &)> &callback);
 
     /*!
      * \brief Gets the account defined by database ID \a id from the database.
@@ -489,6 +507,8 @@ public:
      * \brief Checks if all account data is available and creates missing data.
      *
      * This will for example check for missing mailbox on the IMAP server and wrong or missing storage quotas.
+     * If \a p contains a true \c skipMailboxCheck value, the existence of the mailbox will not be checked. Use this
+     * if the mailboxes of the complete domain have already been checked by Domain::checkMailboxes().
      *
      * \param c         Pointer to the current context, used for string translation and user authentication.
      * \param e         Object taking information about occurring errors.
@@ -18,8 +18,11 @@
 
 #include "adminaccount_p.h"
 #include "skaffarierror.h"
+#include "domain.h"
+#include "../authstoresql.h"
 #include "../utils/utils.h"
 #include "../utils/skaffariconfig.h"
+#include "../utils/statistics.h"
 #include <Cutelyst/Context>
 #include <Cutelyst/Plugins/Utils/Sql>
 #include <Cutelyst/Plugins/Authentication/credentialpassword.h>
@@ -395,6 +398,13 @@ AdminAccount AdminAccount::create(Cutelyst::Context *c, const QVariantHash &para
         return aa;
     }
 
+    // cached domains contain their responsible administrators
+    Domain::clearCache(c);
+    // the user name might be cached as not existing
+    AuthStoreSql::clearCache(username);
+
+    Statistics::changeAdmins(1);
+
     aa = AdminAccount(id, username, type, domIds, SkaffariConfig::defTimezone(), SkaffariConfig::defLanguage(), QStringLiteral("default"), SkaffariConfig::defMaxdisplay(), SkaffariConfig::defWarnlevel(), currentUtc, currentUtc);
 
     qCInfo(SK_ADMIN, "%s created new admin acccount %s of type %s.", qUtf8Printable(AdminAccount::getUserNameIdString(c)), qUtf8Printable(aa.nameIdString()), AdminAccount::staticMetaObject.enumerator(AdminAccount::staticMetaObject.indexOfEnumerator("AdminAccountType")).valueToKey(type));
@@ -651,6 +661,9 @@ bool AdminAccount::update(Cutelyst::Context *c, SkaffariError &e, const QVariant
         return ret;
     }
 
+    Domain::clearCache(c);
+    AuthStoreSql::clearCache(d->username);
+
     d->domains = domIdList;
     d->type = type;
     d->updated = currentUtc;
@@ -801,6 +814,8 @@ bool AdminAccount::updateOwn(Cutelyst::Context *c, SkaffariError &e, const QVari
         return ret;
     }
 
+    AuthStoreSql::clearCache(d->username);
+
     Cutelyst::Session::setValue(c, QStringLiteral("maxdisplay"), maxdisplay);
     Cutelyst::Session::setValue(c, QStringLiteral("warnlevel"), warnlevel);
     Cutelyst::Session::setValue(c, QStringLiteral("lang"), lang);
@@ -874,6 +889,10 @@ bool AdminAccount::remove(Cutelyst::Context *c, SkaffariError &e)
         return ret;
     }
 
+    Domain::clearCache(c);
+    AuthStoreSql::clearCache(d->username);
+    Statistics::changeAdmins(-1);
+
     ret = true;
     qCInfo(SK_ADMIN, "%s removed admin %s of type %s.", qUtf8Printable(AdminAccount::getUserNameIdString(c)), qUtf8Printable(nameIdString()), AdminAccount::staticMetaObject.enumerator(AdminAccount::staticMetaObject.indexOfEnumerator("AdminAccountType")).valueToKey(d->type));
     qCDebug(SK_ADMIN) << *this;
@@ -19,6 +19,7 @@
 #include "autoconfigserver.h"
 #include "skaffarierror.h"
 #include "../utils/skaffariconfig.h"
+#include "../utils/autoconfigcache.h"
 #include <Cutelyst/Context>
 #include <Cutelyst/Plugins/Utils/Sql>
 #include <Cutelyst/Plugins/Memcached/Memcached>
@@ -319,6 +320,8 @@ AutoconfigServer AutoconfigServer::create(Cutelyst::Context *c, dbid_t domainId,
         Cutelyst::Memcached::remove(memKey);
     }
 
+    AutoconfigCache::clear();
+
     return s;
 }
 
@@ -349,6 +352,8 @@ bool AutoconfigServer::remove(Cutelyst::Context *c, SkaffariError &e)
         Cutelyst::Memcached::remove(memKey);
     }
 
+    AutoconfigCache::clear();
+
     return true;
 }
 
@@ -398,6 +403,8 @@ bool AutoconfigServer::update(Cutelyst::Context *c, const QVariantHash &p, Skaff
         Cutelyst::Memcached::remove(memKey);
     }
 
+    AutoconfigCache::clear();
+
     return true;
 }
 
@@ -22,6 +22,9 @@
 #include "adminaccount.h"
 #include "../utils/utils.h"
 #include "../utils/skaffariconfig.h"
+#include "../utils/statistics.h"
+#include "../utils/autoconfigcache.h"
+#include "../imap/skaffariimappool.h"
 #include "../../common/global.h"
 #include <Cutelyst/ParamsMultiMap>
 #include <Cutelyst/Response>
@@ -43,6 +46,8 @@
 Q_LOGGING_CATEGORY(SK_DOMAIN, "skaffari.domain")
 
 #define DOMAIN_STASH_KEY "domain"
+#define DOMAIN_CACHE_STASH_KEY "_domain_cache"
+#define SK_DOMAIN_REMOVE_CHUNK_SIZE 500
 
 Domain::Domain() : d(new DomainData)
 {
@@ -555,6 +560,11 @@ Domain Domain::create(Cutelyst::Context *c, const QVariantHash &params, Skaffari
         return dom;
     }
 
+    // the parent domain got a new child
+    Domain::clearCache(c);
+
+    Statistics::addDomain(domainId, domainQuota);
+
     dom = Domain(domainId, domainAceId, domainName, prefix, transport, quota, maxAccounts, domainQuota, 0, freeNames, freeAddress, 0, currentTimeUtc, currentTimeUtc, validUntil, autoconfig, parent, std::vector<SimpleDomain>(), std::vector<SimpleAdmin>(), foldersVect);
 
     qCInfo(SK_DOMAIN, "%s created new domain %s.", qUtf8Printable(AdminAccount::getUserNameIdString(c)), qUtf8Printable(dom.nameIdString()));
@@ -569,113 +579,145 @@ Domain Domain::get(Cutelyst::Context *c, dbid_t domId, SkaffariError &errorData)
 
     Q_ASSERT_X(c, "get domain", "invalid Cutelyst context");
 
+    // domains already loaded in this request
+    const QString cacheKey = QString::number(domId);
+    const QVariantHash cache = c->stash(QStringLiteral(DOMAIN_CACHE_STASH_KEY)).toHash();
+    if (cache.contains(cacheKey)) {
+        dom = cache.value(cacheKey).value<Domain>();
+        return dom;
+    }
+
     // for logging
     const QString errStr = AdminAccount::getUserNameIdString(c) + QLatin1String(" failed to get domain with ID ") + QString::number(domId);
     const QByteArray errBa = errStr.toUtf8();
     const char *err = errBa.constData();
 
-    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT parent_id, ace_id, domain_name, prefix, transport, quota, maxaccounts, domainquota, domainquotaused, freenames, freeaddress, accountcount, created_at, updated_at, valid_until, autoconfig FROM domain WHERE id = :id"));
-    q.bindValue(QStringLiteral(":id"), domId);
+    // domain data, default folders, responsible admins and child domains are queried in one round trip,
+    // the first column tells the part of a row, unused columns are filled with NULL
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT 0, d.parent_id, d.domain_name, d.ace_id, d.prefix, d.transport, d.quota, d.maxaccounts, d.domainquota, d.domainquotaused, d.freenames, d.freeaddress, d.accountcount, d.created_at, d.updated_at, d.valid_until, d.autoconfig, p.domain_name FROM domain d LEFT JOIN domain p ON p.id = d.parent_id AND p.idn_id = 0 WHERE d.id = ? "
+                                                         "UNION ALL SELECT 1, f.id, f.name, f.special_use, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL FROM folder f WHERE f.domain_id = ? "
+                                                         "UNION ALL SELECT 2, a.id, a.username, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL FROM domainadmin da JOIN adminuser a ON a.id = da.admin_id WHERE da.domain_id = ? "
+                                                         "UNION ALL SELECT 3, c.id, c.domain_name, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL FROM domain c WHERE c.parent_id = ?"));
+    for (int i = 0; i < 4; ++i) {
+        q.addBindValue(domId);
+    }
 
-    if (Q_LIKELY(q.exec() && q.next())) {
+    if (Q_UNLIKELY(!q.exec())) {
+        errorData.setSqlError(q.lastError(), c->translate("Domain", "Failed to query domain data from the database."));
+        qCCritical(SK_DOMAIN, "%s: can not execute database query: %s", err, qUtf8Printable(q.lastError().text()));
+        return dom;
+    }
 
-        QSqlQuery fq = CPreparedSqlQueryThread(QStringLiteral("SELECT id, name, special_use FROM folder WHERE domain_id = :domain_id"));
-        fq.bindValue(QStringLiteral(":domain_id"), domId);
+    bool found = false;
+    dbid_t parentId = 0;
+    dbid_t aceId = 0;
+    QString domainName;
+    QString prefix;
+    QString transport;
+    quota_size_t quota = 0;
+    quint32 maxAccounts = 0;
+    quota_size_t domainQuota = 0;
+    quota_size_t domainQuotaUsed = 0;
+    bool freeNames = false;
+    bool freeAddress = false;
+    quint32 accounts = 0;
+    QDateTime createdTime;
+    QDateTime updatedTime;
+    QDateTime validUntilTime;
+    Domain::AutoconfigStrategy autoconfig = Domain::AutoconfigDisabled;
+    SimpleDomain parentDom;
+    std::vector<Folder> defFolders;
+    std::vector<SimpleAdmin> admins;
+    std::vector<SimpleDomain> children;
 
-        if (Q_LIKELY(fq.exec())) {
-            std::vector<Folder> defFolders;
-            defFolders.reserve(static_cast<std::vector<Folder>::size_type>(fq.size()));
-            while (fq.next()) {
-                defFolders.emplace_back(fq.value(0).value<dbid_t>(), domId, fq.value(1).toString(), static_cast<SkaffariIMAP::SpecialUse>(static_cast<quint8>(fq.value(2).toUInt())));
+    while (q.next()) {
+        switch (q.value(0).toInt()) {
+        case 0:
+            found = true;
+            parentId = q.value(1).value<dbid_t>();
+            domainName = q.value(2).toString();
+            aceId = q.value(3).value<dbid_t>();
+            prefix = q.value(4).toString();
+            transport = q.value(5).toString();
+            quota = q.value(6).value<quota_size_t>();
+            maxAccounts = q.value(7).value<quint32>();
+            domainQuota = q.value(8).value<quota_size_t>();
+            domainQuotaUsed = q.value(9).value<quota_size_t>();
+            freeNames = q.value(10).toBool();
+            freeAddress = q.value(11).toBool();
+            accounts = q.value(12).value<quint32>();
+            createdTime = q.value(13).toDateTime();
+            createdTime.setTimeSpec(Qt::UTC);
+            updatedTime = q.value(14).toDateTime();
+            updatedTime.setTimeSpec(Qt::UTC);
+            validUntilTime = q.value(15).toDateTime();
+            validUntilTime.setTimeSpec(Qt::UTC);
+            autoconfig = static_cast<Domain::AutoconfigStrategy>(q.value(16).value<qint8>());
+            if ((parentId > 0) && !q.value(17).isNull()) {
+                parentDom = SimpleDomain(parentId, q.value(17).toString());
             }
+            break;
+        case 1:
+            defFolders.emplace_back(q.value(1).value<dbid_t>(), domId, q.value(2).toString(), static_cast<SkaffariIMAP::SpecialUse>(static_cast<quint8>(q.value(3).toUInt())));
+            break;
+        case 2:
+            admins.emplace_back(q.value(1).value<dbid_t>(), q.value(2).toString());
+            break;
+        case 3:
+            children.emplace_back(q.value(1).value<dbid_t>(), q.value(2).toString());
+            break;
+        default:
+            break;
+        }
+    }
 
-            QSqlQuery aq = CPreparedSqlQueryThread(QStringLiteral("SELECT a.id, a.username FROM domainadmin da JOIN adminuser a ON a.id = da.admin_id WHERE da.domain_id = :domain_id"));
-            aq.bindValue(QStringLiteral(":domain_id"), domId);
-
-            if (Q_LIKELY(aq.exec())) {
-                std::vector<SimpleAdmin> admins;
-                admins.reserve(static_cast<std::vector<SimpleAdmin>::size_type>(aq.size()));
-                while (aq.next()) {
-                    admins.emplace_back(aq.value(0).value<dbid_t>(), aq.value(1).toString());
-                }
-
-                const dbid_t parentId = q.value(0).value<dbid_t>();
-                SimpleDomain parentDom;
-                std::vector<SimpleDomain> children;
-                if (parentId > 0) {
-                    parentDom = SimpleDomain::get(c, errorData, parentId);
-                    if (!parentDom.isValid()) {
-                        if (errorData.type() == SkaffariError::NotFound) {
-                            errorData.setErrorText(c->translate("Domain", "Can not find parent domain with ID %1.").arg(parentId));
-                            qCCritical(SK_DOMAIN, "%s: can not find parent domain with ID %u.", err, parentId);
-                        } else {
-                            errorData.setSqlError(errorData.qSqlError(), c->translate("Domain", "Failed to query parent domain from database."));
-                            qCCritical(SK_DOMAIN, "%s: failed to query database for parent domain.", err);
-                        }
-                    }
-                } else {
-                    QSqlQuery cq = CPreparedSqlQueryThread(QStringLiteral("SELECT id, domain_name FROM domain WHERE parent_id = :id"));
-                    cq.bindValue(QStringLiteral(":id"), domId);
-                    if (Q_UNLIKELY(!cq.exec())) {
-                        errorData.setSqlError(cq.lastError(), c->translate("Domain", "Failed to query child domains from the database."));
-                        qCCritical(SK_DOMAIN, "%s: failed to execute database query to get child domains: %s", err, qUtf8Printable(cq.lastError().text()));
-                    }
-                }
-
-                if (errorData.type() == SkaffariError::NoError) {
-                    QDateTime createdTime = q.value(12).toDateTime();
-                    createdTime.setTimeSpec(Qt::UTC);
-                    QDateTime updatedTime = q.value(13).toDateTime();
-                    updatedTime.setTimeSpec(Qt::UTC);
-                    QDateTime validUntilTime = q.value(14).toDateTime();
-                    validUntilTime.setTimeSpec(Qt::UTC);
-
-                    dom = Domain(domId,
-                                 q.value(1).value<dbid_t>(),
-                                 q.value(2).toString(),
-                                 q.value(3).toString(),
-                                 q.value(4).toString(),
-                                 q.value(5).value<quota_size_t>(),
-                                 q.value(6).value<quint32>(),
-                                 q.value(7).value<quota_size_t>(),
-                                 q.value(8).value<quota_size_t>(),
-                                 q.value(9).toBool(),
-                                 q.value(10).toBool(),
-                                 q.value(11).value<quint32>(),
-                                 createdTime,
-                                 updatedTime,
-                                 validUntilTime,
-                                 static_cast<Domain::AutoconfigStrategy>(q.value(15).value<qint8>()),
-                                 parentDom,
-                                 children,
-                                 admins,
-                                 defFolders);
-                }
-
-            } else {
-                errorData.setSqlError(aq.lastError(), c->translate("Domain", "Failed to query responsible administrators from the database."));
-                qCCritical(SK_DOMAIN, "%s: failed to execute database query to get responsible admins: %s", err, qUtf8Printable(aq.lastError().text()));
-            }
+    if (!found) {
+        errorData.setErrorType(SkaffariError::NotFound);
+        errorData.setErrorText(c->translate("Domain", "The domain with ID %1 could not be found in the database.").arg(domId));
+        qCWarning(SK_DOMAIN, "%s: not found in database.", err);
+        return dom;
+    }
 
-        } else {
+    if ((parentId > 0) && !parentDom.isValid()) {
+        errorData.setErrorType(SkaffariError::NotFound);
+        errorData.setErrorText(c->translate("Domain", "Can not find parent domain with ID %1.").arg(parentId));
+        qCCritical(SK_DOMAIN, "%s: can not find parent domain with ID %u.", err, parentId);
+        return dom;
+    }
 
-            errorData.setSqlError(fq.lastError(), c->translate("Domain", "Failed to query default folders from the database."));
-            qCCritical(SK_DOMAIN, "%s: failed to execute dabase query to get default folders: %s", err, qUtf8Printable(fq.lastError().text()));
+    dom = Domain(domId,
+                 aceId,
+                 domainName,
+                 prefix,
+                 transport,
+                 quota,
+                 maxAccounts,
+                 domainQuota,
+                 domainQuotaUsed,
+                 freeNames,
+                 freeAddress,
+                 accounts,
+                 createdTime,
+                 updatedTime,
+                 validUntilTime,
+                 autoconfig,
+                 parentDom,
+                 children,
+                 admins,
+                 defFolders);
+
+    QVariantHash newCache = cache;
+    newCache.insert(cacheKey, QVariant::fromValue<Domain>(dom));
+    c->setStash(QStringLiteral(DOMAIN_CACHE_STASH_KEY), newCache);
 
-        }
+    return dom;
+}
 
-    } else {
-        if (q.lastError().type() != QSqlError::NoError) {
-            errorData.setSqlError(q.lastError());
-            qCCritical(SK_DOMAIN, "%s: can not execute database query: %s", err, qUtf8Printable(q.lastError().text()));
-        } else {
-            errorData.setErrorType(SkaffariError::NotFound);
-            errorData.setErrorText(c->translate("Domain", "The domain with ID %1 could not be found in the database.").arg(domId));
-            qCWarning(SK_DOMAIN, "%s: not found in database.", err);
-        }
-    }
+void Domain::clearCache(Cutelyst::Context *c)
+{
+    Q_ASSERT_X(c, "clear domain cache", "invalid Cutelyst context");
 
-    return dom;
+    c->stash().remove(QStringLiteral(DOMAIN_CACHE_STASH_KEY));
 }
 
 std::vector<Domain> Domain::list(Cutelyst::Context *c, SkaffariError &errorData, const Cutelyst::AuthenticationUser &user, const QString &orderBy, const QString &sort, quint32 limit)
@@ -691,7 +733,7 @@ std::vector<Domain> Domain::list(Cutelyst::Context *c, SkaffariError &errorData,
 
     QSqlQuery q(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread()));
 
-    QString prepString = QStringLiteral("SELECT dom.id, dom.parent_id, dom.ace_id, dom.domain_name, dom.prefix, dom.transport, dom.quota, dom.maxaccounts, dom.domainquota, dom.domainquotaused, dom.freenames, dom.freeaddress, dom.accountcount, dom.created_at, dom.updated_at, dom.valid_until, dom.autoconfig FROM domain dom");
+    QString prepString = QStringLiteral("SELECT dom.id, dom.parent_id, dom.ace_id, dom.domain_name, dom.prefix, dom.transport, dom.quota, dom.maxaccounts, dom.domainquota, dom.domainquotaused, dom.freenames, dom.freeaddress, dom.accountcount, dom.created_at, dom.updated_at, dom.valid_until, dom.autoconfig, parent.domain_name FROM domain dom LEFT JOIN domain parent ON parent.id = dom.parent_id AND parent.idn_id = 0");
     const bool isAdmin = AdminAccount::getUserType(user) >= AdminAccount::Administrator;
     if (isAdmin) {
         prepString.append(QStringLiteral(" WHERE dom.idn_id = 0"));
@@ -719,9 +761,10 @@ std::vector<Domain> Domain::list(Cutelyst::Context *c, SkaffariError &errorData,
             const dbid_t domId = q.value(0).value<dbid_t>();
             const dbid_t parentId = q.value(1).value<dbid_t>();
 
+            // the parent name is part of the list query to not query every parent on its own
             SimpleDomain parentDom;
-            if (parentId > 0) {
-                parentDom = SimpleDomain::get(c, errorData, parentId);
+            if ((parentId > 0) && !q.value(17).isNull()) {
+                parentDom = SimpleDomain(parentId, q.value(17).toString());
             }
 
             QDateTime createdTime = q.value(13).toDateTime();
@@ -783,7 +826,7 @@ bool Domain::isAvailable(const QString &domainName)
     return available;
 }
 
-bool Domain::remove(Cutelyst::Context *c, SkaffariError &error, dbid_t newParentId, bool deleteChildren)
+bool Domain::remove(Cutelyst::Context *c, SkaffariError &error, dbid_t newParentId, bool deleteChildren, const std::function<bool(quint32,quint32)> &progress)
 {
     bool ret = false;
 
@@ -794,39 +837,42 @@ bool Domain::remove(Cutelyst::Context *c, SkaffariError &error, dbid_t newParent
     const QByteArray errBa = errStr.toUtf8();
     const char *err = errBa.constData();
 
-    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT id FROM accountuser WHERE domain_id = :domain_id"));
-    q.bindValue(QStringLiteral(":domain_id"), d->id);
+    // accounts are removed in chunks, so cached domain data gets outdated even if removal fails
+    Domain::clearCache(c);
 
-    if (Q_UNLIKELY(!q.exec())) {
-        error.setSqlError(q.lastError(), c->translate("Domain", "Failed to get database IDs of the accounts for this domain."));
-        qCCritical(SK_DOMAIN, "%s: failed to execute query to get acount IDs for the domain: %s", err, qUtf8Printable(q.lastError().text()));
+    if (Q_UNLIKELY(!removeAccounts(c, error, err, progress))) {
         return ret;
     }
 
-    while (q.next()) {
-        Account a = Account::get(c, error, q.value(0).value<dbid_t>());
-        if (a.isValid()) {
-            if (Q_UNLIKELY(!a.remove(c, error))) {
-                qCCritical(SK_DOMAIN, "%s: failed to remove account %s.", err, qUtf8Printable(a.nameIdString()));
-                return ret;
-            }
-        }
-        d->accounts--;
-    }
+    QSqlQuery q;
 
     if (deleteChildren) {
-        auto childrenStart = d->children.cbegin();
-        while (childrenStart != d->children.cend()) {
-            const SimpleDomain kid = d->children.back();
-            Domain child = Domain::get(c, kid.id(), error);
+        // query the children directly, they might not have been loaded into this object
+        q = CPreparedSqlQueryThread(QStringLiteral("SELECT id FROM domain WHERE parent_id = :parent_id"));
+        q.bindValue(QStringLiteral(":parent_id"), d->id);
+
+        if (Q_UNLIKELY(!q.exec())) {
+            error.setSqlError(q.lastError(), c->translate("Domain", "Failed to get database IDs of the child domains for this domain."));
+            qCCritical(SK_DOMAIN, "%s: failed to execute query to get child domain IDs: %s", err, qUtf8Printable(q.lastError().text()));
+            return ret;
+        }
+
+        std::vector<dbid_t> kidIds;
+        while (q.next()) {
+            kidIds.push_back(q.value(0).value<dbid_t>());
+        }
+
+        for (dbid_t kidId : kidIds) {
+            Domain child = Domain::get(c, kidId, error);
             if (child) {
-                if (Q_UNLIKELY(!child.remove(c, error, 0, true))) {
+                if (Q_UNLIKELY(!child.remove(c, error, 0, true, progress))) {
                     qCCritical(SK_DOMAIN, "%s: failed to remove child domain %s.", err, qUtf8Printable(child.nameIdString()));
                     return ret;
                 }
             }
-            d->children.pop_back();
         }
+
+        d->children.clear();
     }
 
     QSqlDatabase db = QSqlDatabase::database(Cutelyst::Sql::databaseNameThread());
@@ -904,6 +950,19 @@ bool Domain::remove(Cutelyst::Context *c, SkaffariError &error, dbid_t newParent
 
     const QString emailLike = QLatin1String("%@") + d->name;
 
+    // accounts of other domains can have addresses in this domain, their address statistics have to be updated
+    std::vector<dbid_t> otherAccounts;
+    if (Q_LIKELY(q.prepare(QStringLiteral("SELECT DISTINCT a.id FROM virtual v JOIN accountuser a ON a.username = v.username WHERE v.alias LIKE :alias")))) {
+        q.bindValue(QStringLiteral(":alias"), emailLike);
+        if (Q_LIKELY(q.exec())) {
+            while (q.next()) {
+                otherAccounts.push_back(q.value(0).value<dbid_t>());
+            }
+        } else {
+            qCWarning(SK_DOMAIN, "%s: can not query accounts of other domains with addresses in this domain: %s", err, qUtf8Printable(q.lastError().text()));
+        }
+    }
+
     if (Q_UNLIKELY(!q.prepare(QStringLiteral("DELETE FROM virtual WHERE alias LIKE :alias")))) {
         error.setSqlError(q.lastError(), c->translate("Domain", "Failed to remove email addresses from database."));
         qCCritical(SK_DOMAIN, "%s: can not prepare query to remove email addresses from database: %s", err, qUtf8Printable(q.lastError().text()));
@@ -943,6 +1002,16 @@ bool Domain::remove(Cutelyst::Context *c, SkaffariError &error, dbid_t newParent
         return ret;
     }
 
+    Domain::clearCache(c);
+    AutoconfigCache::clear();
+
+    Statistics::removeDomain(d->id);
+    for (dbid_t accountId : otherAccounts) {
+        Statistics::updateAddresses(accountId);
+    }
+
+    SkaffariConfig::removeOrphanedDefaultAccounts();
+
     ret = true;
 
     qCInfo(SK_DOMAIN, "%s removed domain %s", qUtf8Printable(AdminAccount::getUserNameIdString(c)), qUtf8Printable(nameIdString()));
@@ -951,6 +1020,177 @@ bool Domain::remove(Cutelyst::Context *c, SkaffariError &error, dbid_t newParent
     return ret;
 }
 
+bool Domain::removeAccounts(Cutelyst::Context *c, SkaffariError &error, const char *err, const std::function<bool(quint32,quint32)> &progress)
+{
+    bool ret = false;
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT username, quota FROM accountuser WHERE domain_id = :domain_id ORDER BY id ASC"));
+    q.bindValue(QStringLiteral(":domain_id"), d->id);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        error.setSqlError(q.lastError(), c->translate("Domain", "Failed to get the accounts for this domain from the database."));
+        qCCritical(SK_DOMAIN, "%s: failed to execute query to get the accounts of the domain: %s", err, qUtf8Printable(q.lastError().text()));
+        return ret;
+    }
+
+    std::vector<std::pair<QString,quota_size_t>> accounts;
+    if (q.size() > 0) {
+        accounts.reserve(static_cast<std::size_t>(q.size()));
+    }
+    while (q.next()) {
+        accounts.push_back(std::make_pair(q.value(0).toString(), q.value(1).value<quota_size_t>()));
+    }
+
+    const quint32 total = static_cast<quint32>(accounts.size());
+
+    if (total == 0) {
+        ret = true;
+        return ret;
+    }
+
+    SkaffariIMAPPool::Connection imap(c);
+    if (Q_UNLIKELY(!imap->login())) {
+        error.setImapError(imap->lastError(), c->translate("Domain", "Logging in to the IMAP server to delete the mailboxes of domain %1 failed.").arg(d->name));
+        qCCritical(SK_DOMAIN, "%s: failed to login as admin into IMAP server to delete the mailboxes: %s", err, qUtf8Printable(imap->lastError().errorText()));
+        return ret;
+    }
+
+    // if Skaffari is responsible for mailbox creation, direct or indirect,
+    // an account will not be removed if its mailbox can not be deleted
+    const bool mailboxRequired = (SkaffariConfig::imapCreatemailbox() > Account::DoNotCreate);
+    const QString imapUser = SkaffariConfig::imapUser();
+
+    QSqlDatabase db = QSqlDatabase::database(Cutelyst::Sql::databaseNameThread());
+
+    const QStringList statements({
+                                     QStringLiteral("DELETE FROM alias WHERE username IN (%1)"),
+                                     QStringLiteral("DELETE FROM virtual WHERE username IN (%1)"),
+                                     QStringLiteral("DELETE FROM virtual WHERE username = '' AND alias IN (%1)"),
+                                     QStringLiteral("DELETE FROM log WHERE user IN (%1)"),
+                                     QStringLiteral("DELETE FROM accountuser WHERE username IN (%1)")
+                                 });
+
+    quint32 removed = 0;
+    auto chunkStart = accounts.cbegin();
+
+    while (chunkStart != accounts.cend()) {
+
+        const auto chunkEnd = ((accounts.cend() - chunkStart) > SK_DOMAIN_REMOVE_CHUNK_SIZE) ? (chunkStart + SK_DOMAIN_REMOVE_CHUNK_SIZE) : accounts.cend();
+
+        // send the commands for the complete chunk before waiting for the responses
+        std::vector<char> deleted(static_cast<std::size_t>(chunkEnd - chunkStart), 0);
+        for (auto it = chunkStart; it != chunkEnd; ++it) {
+            char *ok = &deleted[static_cast<std::size_t>(it - chunkStart)];
+            imap->setAclAsync(it->first, imapUser, QString(), nullptr);
+            imap->deleteMailboxAsync(it->first, [ok](bool _ok) {
+                *ok = _ok ? 1 : 0;
+            });
+        }
+
+        if (Q_UNLIKELY(!imap->waitForPendingCommands())) {
+            error.setImapError(imap->lastError(), c->translate("Domain", "Failed to delete the mailboxes of domain %1 from the IMAP server.").arg(d->name));
+            qCCritical(SK_DOMAIN, "%s: failed to receive the responses to the mailbox deletion commands: %s", err, qUtf8Printable(imap->lastError().errorText()));
+            return ret;
+        }
+
+        QStringList usernames;
+        QStringList failed;
+        quota_size_t quota = 0;
+        for (auto it = chunkStart; it != chunkEnd; ++it) {
+            if (deleted.at(static_cast<std::size_t>(it - chunkStart)) || !mailboxRequired) {
+                usernames.push_back(it->first);
+                quota += it->second;
+            } else {
+                failed.push_back(it->first);
+            }
+        }
+
+        if (!usernames.empty()) {
+
+            if (Q_UNLIKELY(!db.transaction())) {
+                error.setSqlError(db.lastError(), c->translate("Domain", "Failed to remove the accounts of domain %1 from the database.").arg(d->name));
+                qCCritical(SK_DOMAIN, "%s: can not initiate database transaction to remove accounts: %s", err, qUtf8Printable(db.lastError().text()));
+                return ret;
+            }
+
+            QSqlError statsError;
+            if (Q_UNLIKELY(!Statistics::removeAccounts(db, d->id, usernames, &statsError))) {
+                error.setSqlError(statsError, c->translate("Domain", "Failed to remove the accounts of domain %1 from the database.").arg(d->name));
+                qCCritical(SK_DOMAIN, "%s: can not update the statistics: %s", err, qUtf8Printable(statsError.text()));
+                db.rollback();
+                return ret;
+            }
+
+            // the number of placeholders depends on the chunk size, so these can not be cached prepared queries
+            const QString placeholders = Utils::inPlaceholders(usernames.size());
+
+            for (const QString &statement : statements) {
+                QSqlQuery dq(db);
+                if (Q_UNLIKELY(!dq.prepare(statement.arg(placeholders)))) {
+                    error.setSqlError(dq.lastError(), c->translate("Domain", "Failed to remove the accounts of domain %1 from the database.").arg(d->name));
+                    qCCritical(SK_DOMAIN, "%s: can not prepare database query to remove accounts: %s", err, qUtf8Printable(dq.lastError().text()));
+                    db.rollback();
+                    return ret;
+                }
+                for (const QString &username : usernames) {
+                    dq.addBindValue(username);
+                }
+                if (Q_UNLIKELY(!dq.exec())) {
+                    error.setSqlError(dq.lastError(), c->translate("Domain", "Failed to remove the accounts of domain %1 from the database.").arg(d->name));
+                    qCCritical(SK_DOMAIN, "%s: can not execute database query to remove accounts: %s", err, qUtf8Printable(dq.lastError().text()));
+                    db.rollback();
+                    return ret;
+                }
+            }
+
+            QSqlQuery uq(db);
+            uq.prepare(QStringLiteral("UPDATE domain SET accountcount = accountcount - :count, domainquotaused = domainquotaused - :quota WHERE id = :id"));
+            uq.bindValue(QStringLiteral(":count"), usernames.size());
+            uq.bindValue(QStringLiteral(":quota"), quota);
+            uq.bindValue(QStringLiteral(":id"), d->id);
+
+            if (Q_UNLIKELY(!uq.exec())) {
+                error.setSqlError(uq.lastError(), c->translate("Domain", "Failed to remove the accounts of domain %1 from the database.").arg(d->name));
+                qCCritical(SK_DOMAIN, "%s: can not update the account count of the domain: %s", err, qUtf8Printable(uq.lastError().text()));
+                db.rollback();
+                return ret;
+            }
+
+            if (Q_UNLIKELY(!db.commit())) {
+                error.setSqlError(db.lastError(), c->translate("Domain", "Failed to remove the accounts of domain %1 from the database.").arg(d->name));
+                qCCritical(SK_DOMAIN, "%s: can not commit database transaction to remove accounts: %s", err, qUtf8Printable(db.lastError().text()));
+                db.rollback();
+                return ret;
+            }
+
+            removed += static_cast<quint32>(usernames.size());
+            d->accounts -= static_cast<quint32>(usernames.size());
+            d->domainQuotaUsed = (quota < d->domainQuotaUsed) ? (d->domainQuotaUsed - quota) : 0;
+        }
+
+        qCInfo(SK_DOMAIN, "%s removed %u of %u accounts of domain %s.", qUtf8Printable(AdminAccount::getUserNameIdString(c)), removed, total, qUtf8Printable(nameIdString()));
+
+        if (Q_UNLIKELY(!failed.empty())) {
+            error.setImapError(imap->lastError(), c->translate("Domain", "The mailboxes of the following accounts could not be deleted from the IMAP server: %1").arg(failed.join(QStringLiteral(", "))));
+            qCCritical(SK_DOMAIN, "%s: failed to delete the mailboxes of %i accounts from the IMAP server: %s", err, failed.size(), qUtf8Printable(imap->lastError().errorText()));
+            return ret;
+        }
+
+        if (progress && !progress(removed, total)) {
+            error.setErrorType(SkaffariError::ApplicationError);
+            error.setErrorText(c->translate("Domain", "Removal of domain %1 has been canceled after %2 of %3 accounts.").arg(d->name, QString::number(removed), QString::number(total)));
+            qCWarning(SK_DOMAIN, "%s: removal has been canceled after %u of %u accounts.", err, removed, total);
+            return ret;
+        }
+
+        chunkStart = chunkEnd;
+    }
+
+    ret = true;
+
+    return ret;
+}
+
 bool Domain::update(Cutelyst::Context *c, const QVariantHash &p, SkaffariError &e)
 {
     bool ret = false;
@@ -1142,6 +1382,7 @@ bool Domain::update(Cutelyst::Context *c, const QVariantHash &p, SkaffariError &
     }
 
     if (admin.type() >= AdminAccount::Administrator) {
+        Statistics::changeDomainQuota(d->id, static_cast<qint64>(domainQuota) - static_cast<qint64>(d->domainQuota));
         d->maxAccounts = maxAccounts;
         d->parent = parentDom;
         d->domainQuota = domainQuota;
@@ -1156,6 +1397,9 @@ bool Domain::update(Cutelyst::Context *c, const QVariantHash &p, SkaffariError &
     d->folders = foldersVect;
     d->updated = currentTimeUtc;
 
+    Domain::clearCache(c);
+    AutoconfigCache::clear();
+
     qCInfo(SK_DOMAIN, "%s updated domain %s.", qUtf8Printable(admin.nameIdString()), qUtf8Printable(nameIdString()));
     qCDebug(SK_DOMAIN) << *this;
 
@@ -1164,6 +1408,96 @@ bool Domain::update(Cutelyst::Context *c, const QVariantHash &p, SkaffariError &
     return ret;
 }
 
+QStringList Domain::checkMailboxes(Cutelyst::Context *c, SkaffariError &e) const
+{
+    QStringList actions;
+
+    Q_ASSERT_X(c, "check domain mailboxes", "invalid context object");
+
+    // for logging
+    const QByteArray uniBa = AdminAccount::getUserNameIdString(c).toUtf8();
+    const char *uniStr = uniBa.constData();
+    const QByteArray dniBa = nameIdString().toUtf8();
+    const char *dniStr = dniBa.constData();
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT username FROM accountuser WHERE domain_id = :domain_id"));
+    q.bindValue(QStringLiteral(":domain_id"), d->id);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        e.setSqlError(q.lastError(), c->translate("Domain", "Failed to query the user accounts of this domain from the database."));
+        qCCritical(SK_DOMAIN, "%s failed to query the user accounts of domain %s to check their mailboxes: %s", uniStr, dniStr, qUtf8Printable(q.lastError().text()));
+        return actions;
+    }
+
+    QStringList usernames;
+    if (q.size() > 0) {
+        usernames.reserve(q.size());
+    }
+    while (q.next()) {
+        usernames.push_back(q.value(0).toString());
+    }
+
+    if (usernames.empty()) {
+        return actions;
+    }
+
+    SkaffariIMAPPool::Connection imap(c);
+    if (Q_UNLIKELY(!imap->login())) {
+        e.setImapError(imap->lastError());
+        qCCritical(SK_DOMAIN, "%s failed to login as IMAP admin %s into IMAP server while checking the mailboxes of domain %s: %s", uniStr, qUtf8Printable(SkaffariConfig::imapUser()), dniStr, qUtf8Printable(imap->lastError().errorText()));
+        return actions;
+    }
+
+    // the list of all mailboxes is requested only once for the complete domain
+    QStringList mboxes = imap->getMailboxes();
+    if (mboxes.empty() && (imap->lastError().type() != SkaffariIMAPError::NoError)) {
+        e.setImapError(imap->lastError(), c->translate("Domain", "Could not retrieve a list of all mailboxes from the IMAP server."));
+        qCCritical(SK_DOMAIN, "%s failed to query a list of all mailboxes from the IMAP server while checking the mailboxes of domain %s: %s", uniStr, dniStr, qUtf8Printable(imap->lastError().errorText()));
+        return actions;
+    }
+
+    std::sort(usernames.begin(), usernames.end());
+    std::sort(mboxes.begin(), mboxes.end());
+
+    QStringList missing;
+    int mboxIdx = 0;
+    const int mboxCount = mboxes.size();
+    for (const QString &username : usernames) {
+        while ((mboxIdx < mboxCount) && (mboxes.at(mboxIdx) < username)) {
+            ++mboxIdx;
+        }
+        if ((mboxIdx < mboxCount) && (mboxes.at(mboxIdx) == username)) {
+            ++mboxIdx;
+        } else {
+            missing.push_back(username);
+        }
+    }
+
+    if (missing.empty()) {
+        qCInfo(SK_DOMAIN, "%s checked the mailboxes of domain %s, all %i mailboxes exist.", uniStr, dniStr, usernames.size());
+        return actions;
+    }
+
+    if (SkaffariConfig::imapCreatemailbox() == Account::DoNotCreate) {
+        for (const QString &username : missing) {
+            actions.push_back(c->translate("Domain", "Mailbox of user account %1 does not exist on the IMAP server.").arg(username));
+        }
+        return actions;
+    }
+
+    for (const QString &username : missing) {
+        if (Q_UNLIKELY(!imap->createMailbox(username))) {
+            e.setImapError(imap->lastError(), c->translate("Domain", "Failed to create missing mailbox for user account %1 on the IMAP server.").arg(username));
+            qCCritical(SK_DOMAIN, "%s failed to create missing mailbox on IMAP server for user account %s in domain %s: %s", uniStr, qUtf8Printable(username), dniStr, qUtf8Printable(imap->lastError().errorText()));
+            return actions;
+        }
+        qCInfo(SK_DOMAIN, "%s created missing mailbox on IMAP server for user account %s in domain %s.", uniStr, qUtf8Printable(username), dniStr);
+        actions.push_back(c->translate("Domain", "Missing mailbox for user account %1 created on IMAP server.").arg(username));
+    }
+
+    return actions;
+}
+
 bool Domain::toStash(Cutelyst::Context *c) const
 {
     Q_ASSERT_X(c, "domain to stash", "invalid context object");
@@ -35,6 +35,7 @@
 
 #include <math.h>
 #include <vector>
+#include <functional>
 
 Q_DECLARE_LOGGING_CATEGORY(SK_DOMAIN)
 
@@ -401,12 +402,26 @@ public:
 
     /*!
      * \brief Returns the domain identified by \a domId from the database.
+     *
+     * The domain data, the default folders, the responsible administrators and the child domains
+     * are queried with a single statement. The result is cached for the current request, see clearCache().
+     *
      * \param c         pointer to the current context, used for translating strings
      * \param domId     database ID of the domain to query
      * \param errorData object taking error information
      */
     static Domain get(Cutelyst::Context *c, dbid_t domId, SkaffariError &errorData);
 
+    /*!
+     * \brief Removes all domains loaded by get() from the cache of the current request.
+     *
+     * get() stores every loaded domain in the stash of context \a c, so that nested helpers
+     * do not query the same domain again. Every function that changes domain data, default
+     * folders, responsible administrators or the account counters of a domain in the database
+     * has to call this afterwards.
+     */
+    static void clearCache(Cutelyst::Context *c);
+
     /*!
      * \brief Returns a list of domains from the database.
      * \param c         pointer to the current context, used for translating strings
@@ -428,13 +443,21 @@ public:
     /*!
      * \brief Removes the %Domain and all of their accounts from the database and the IMAP server.
      *
+     * Accounts are removed in chunks. The mailboxes of a chunk are deleted with pipelined commands
+     * over a single IMAP connection, the database rows of a chunk are deleted set-wise in one
+     * transaction. If removal fails, the accounts of the chunks that have already been processed
+     * stay removed. Child domains are removed the same way.
+     *
      * \param c                 Pointer to the current context, used for translations.
      * \param error             Object to give feedback on database and IMAP errors.
      * \param newParent         Database ID of the new parent domain if the domain to remove has child domains.
      * \param deleteChildren    If \c true, child domains will be removed too.
+     * \param progress          Optional function that is called after every chunk with the number of removed
+     *                          and the total number of accounts of the domain currently processed. If it
+     *                          returns \c false, the removal will be canceled.
      * \return \c true on success
      */
-    bool remove(Cutelyst::Context *c, SkaffariError &error, dbid_t newParentId, bool deleteChildren);
+    bool remove(Cutelyst::Context *c, SkaffariError &error, dbid_t newParentId, bool deleteChildren, const std::function<bool(quint32,quint32)> &progress = nullptr);
 
     /*!
      * \brief Updates domain \a d in the database.
@@ -445,6 +468,20 @@ public:
      */
     bool update(Cutelyst::Context *c, const QVariantHash &p, SkaffariError &e);
 
+    /*!
+     * \brief Checks if the mailboxes of all accounts in this domain exist on the IMAP server.
+     *
+     * Requests the list of all mailboxes from the IMAP server only once and compares it with the
+     * sorted list of user accounts of this domain. Missing mailboxes will be created if
+     * SkaffariConfig::imapCreatemailbox() allows it. Use this before checking the single accounts
+     * with Account::check() and the \a skipMailboxCheck parameter.
+     *
+     * \param c Pointer to the current context, used for translations.
+     * \param e Object to give feedback on database and IMAP errors.
+     * \return List of performed actions.
+     */
+    QStringList checkMailboxes(Cutelyst::Context *c, SkaffariError &e) const;
+
     /*!
      * \brief Puts this domain into the current context stash.
      * If the domain it not valid, a 404 error will be returned and the processing
@@ -486,6 +523,8 @@ public:
     QString getCatchAllAccount(Cutelyst::Context *c, SkaffariError &e) const;
 
 private:
+    bool removeAccounts(Cutelyst::Context *c, SkaffariError &error, const char *err, const std::function<bool(quint32,quint32)> &progress);
+
     QSharedDataPointer<DomainData> d;
 
     friend QDataStream &operator>>(QDataStream &stream, Domain &domain);
@@ -0,0 +1,494 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "job.h"
+#include "skaffarierror.h"
+#include "adminaccount.h"
+#include <Cutelyst/Context>
+#include <Cutelyst/Plugins/Utils/Sql>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QJsonDocument>
+#include <QJsonValue>
+
+Q_LOGGING_CATEGORY(SK_JOB, "skaffari.job")
+
+#define JOB_STASH_KEY "job"
+#define JOB_SELECT_COLUMNS "id, type, status, object_id, admin_id, lang, params, result, progress, total, cancel_requested, created_at, started_at, finished_at"
+
+Job::Job(dbid_t id, Type type, Status status, dbid_t objectId, dbid_t adminId, const QString &lang, const QVariantHash &params, const QJsonObject &result, quint32 progress, quint32 total, bool cancelRequested, const QDateTime &created, const QDateTime &started, const QDateTime &finished) :
+    m_lang(lang),
+    m_params(params),
+    m_result(result),
+    m_created(created),
+    m_started(started),
+    m_finished(finished),
+    m_id(id),
+    m_objectId(objectId),
+    m_adminId(adminId),
+    m_progress(progress),
+    m_total(total),
+    m_type(type),
+    m_status(status),
+    m_cancelRequested(cancelRequested)
+{
+
+}
+
+dbid_t Job::id() const
+{
+    return m_id;
+}
+
+Job::Type Job::type() const
+{
+    return m_type;
+}
+
+Job::Status Job::status() const
+{
+    return m_status;
+}
+
+dbid_t Job::objectId() const
+{
+    return m_objectId;
+}
+
+dbid_t Job::adminId() const
+{
+    return m_adminId;
+}
+
+QString Job::lang() const
+{
+    return m_lang;
+}
+
+QVariantHash Job::params() const
+{
+    return m_params;
+}
+
+QJsonObject Job::result() const
+{
+    return m_result;
+}
+
+quint32 Job::progress() const
+{
+    return m_progress;
+}
+
+quint32 Job::total() const
+{
+    return m_total;
+}
+
+bool Job::isCancelRequested() const
+{
+    return m_cancelRequested;
+}
+
+QDateTime Job::created() const
+{
+    return m_created;
+}
+
+QDateTime Job::started() const
+{
+    return m_started;
+}
+
+QDateTime Job::finished() const
+{
+    return m_finished;
+}
+
+bool Job::isValid() const
+{
+    return (m_id > 0) && (m_type != Invalid);
+}
+
+bool Job::isActive() const
+{
+    return isValid() && ((m_status == Queued) || (m_status == Running));
+}
+
+QJsonObject Job::toJson() const
+{
+    QJsonObject job;
+
+    job.insert(QStringLiteral("id"), static_cast<qint64>(m_id));
+    job.insert(QStringLiteral("type"), static_cast<int>(m_type));
+    job.insert(QStringLiteral("status"), static_cast<int>(m_status));
+    job.insert(QStringLiteral("objectId"), static_cast<qint64>(m_objectId));
+    job.insert(QStringLiteral("progress"), static_cast<qint64>(m_progress));
+    job.insert(QStringLiteral("total"), static_cast<qint64>(m_total));
+    job.insert(QStringLiteral("active"), isActive());
+    job.insert(QStringLiteral("cancelRequested"), m_cancelRequested);
+    job.insert(QStringLiteral("result"), m_result);
+    job.insert(QStringLiteral("created"), m_created.toString(Qt::ISODate));
+    job.insert(QStringLiteral("started"), m_started.isValid() ? QJsonValue(m_started.toString(Qt::ISODate)) : QJsonValue());
+    job.insert(QStringLiteral("finished"), m_finished.isValid() ? QJsonValue(m_finished.toString(Qt::ISODate)) : QJsonValue());
+
+    return job;
+}
+
+Job Job::enqueue(Cutelyst::Context *c, SkaffariError &e, Type type, dbid_t objectId, const QVariantHash &params)
+{
+    Job job;
+
+    Q_ASSERT_X(c, "enqueue job", "invalid context object");
+    Q_ASSERT_X(type != Invalid, "enqueue job", "invalid job type");
+
+    job = Job::getActive(c, e, type, objectId);
+    if (job.isValid() || (e.type() != SkaffariError::NoError)) {
+        return job;
+    }
+
+    const dbid_t adminId = AdminAccount::getUserId(c);
+    const QString lang = c->locale().name();
+    const QDateTime currentTimeUtc = QDateTime::currentDateTimeUtc();
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("INSERT INTO job (type, status, object_id, admin_id, lang, params, result, created_at, updated_at) "
+                                                         "VALUES (:type, :status, :object_id, :admin_id, :lang, :params, '', :created_at, :updated_at)"));
+    q.bindValue(QStringLiteral(":type"), static_cast<quint8>(type));
+    q.bindValue(QStringLiteral(":status"), static_cast<quint8>(Queued));
+    q.bindValue(QStringLiteral(":object_id"), objectId);
+    q.bindValue(QStringLiteral(":admin_id"), adminId);
+    q.bindValue(QStringLiteral(":lang"), lang);
+    q.bindValue(QStringLiteral(":params"), QString::fromUtf8(QJsonDocument(QJsonObject::fromVariantHash(params)).toJson(QJsonDocument::Compact)));
+    q.bindValue(QStringLiteral(":created_at"), currentTimeUtc);
+    q.bindValue(QStringLiteral(":updated_at"), currentTimeUtc);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        e.setSqlError(q.lastError(), c->translate("Job", "Failed to add the job to the queue."));
+        qCCritical(SK_JOB, "%s failed to insert new job of type %u for object ID %u into the database: %s", qUtf8Printable(AdminAccount::getUserNameIdString(c)), static_cast<quint32>(type), objectId, qUtf8Printable(q.lastError().text()));
+        return job;
+    }
+
+    const dbid_t id = q.lastInsertId().value<dbid_t>();
+
+    job = Job(id, type, Queued, objectId, adminId, lang, params, QJsonObject(), 0, 0, false, currentTimeUtc, QDateTime(), QDateTime());
+
+    qCInfo(SK_JOB, "%s queued job %u of type %u for object ID %u.", qUtf8Printable(AdminAccount::getUserNameIdString(c)), id, static_cast<quint32>(type), objectId);
+
+    return job;
+}
+
+Job Job::get(Cutelyst::Context *c, SkaffariError &e, dbid_t id)
+{
+    Q_ASSERT_X(c, "get job", "invalid context object");
+
+    QSqlError sqlError;
+    const Job job = Job::fetch(id, &sqlError);
+
+    if (Q_UNLIKELY(sqlError.type() != QSqlError::NoError)) {
+        e.setSqlError(sqlError, c->translate("Job", "Failed to query the job from the database."));
+        qCCritical(SK_JOB, "%s failed to query job with ID %u from the database: %s", qUtf8Printable(AdminAccount::getUserNameIdString(c)), id, qUtf8Printable(sqlError.text()));
+    } else if (!job.isValid()) {
+        e.setErrorType(SkaffariError::NotFound);
+        e.setErrorText(c->translate("Job", "Can not find the job with database ID %1.").arg(id));
+    }
+
+    return job;
+}
+
+Job Job::getActive(Cutelyst::Context *c, SkaffariError &e, Type type, dbid_t objectId)
+{
+    Job job;
+
+    Q_ASSERT_X(c, "get active job", "invalid context object");
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT " JOB_SELECT_COLUMNS " FROM job WHERE type = :type AND object_id = :object_id AND status IN (:queued, :running) ORDER BY id DESC LIMIT 1"));
+    q.bindValue(QStringLiteral(":type"), static_cast<quint8>(type));
+    q.bindValue(QStringLiteral(":object_id"), objectId);
+    q.bindValue(QStringLiteral(":queued"), static_cast<quint8>(Queued));
+    q.bindValue(QStringLiteral(":running"), static_cast<quint8>(Running));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        e.setSqlError(q.lastError(), c->translate("Job", "Failed to query the job from the database."));
+        qCCritical(SK_JOB, "%s failed to query active job of type %u for object ID %u from the database: %s", qUtf8Printable(AdminAccount::getUserNameIdString(c)), static_cast<quint32>(type), objectId, qUtf8Printable(q.lastError().text()));
+        return job;
+    }
+
+    if (q.next()) {
+        job = Job::fromQuery(q);
+    }
+
+    return job;
+}
+
+std::vector<Job> Job::listActive(Cutelyst::Context *c, SkaffariError &e, Type type)
+{
+    std::vector<Job> jobs;
+
+    Q_ASSERT_X(c, "list active jobs", "invalid context object");
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT " JOB_SELECT_COLUMNS " FROM job WHERE type = :type AND status IN (:queued, :running) ORDER BY id ASC"));
+    q.bindValue(QStringLiteral(":type"), static_cast<quint8>(type));
+    q.bindValue(QStringLiteral(":queued"), static_cast<quint8>(Queued));
+    q.bindValue(QStringLiteral(":running"), static_cast<quint8>(Running));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        e.setSqlError(q.lastError(), c->translate("Job", "Failed to query the jobs from the database."));
+        qCCritical(SK_JOB, "%s failed to query active jobs of type %u from the database: %s", qUtf8Printable(AdminAccount::getUserNameIdString(c)), static_cast<quint32>(type), qUtf8Printable(q.lastError().text()));
+        return jobs;
+    }
+
+    if (q.size() > 0) {
+        jobs.reserve(static_cast<std::vector<Job>::size_type>(q.size()));
+    }
+
+    while (q.next()) {
+        jobs.push_back(Job::fromQuery(q));
+    }
+
+    return jobs;
+}
+
+bool Job::cancel(Cutelyst::Context *c, SkaffariError &e)
+{
+    bool ret = false;
+
+    Q_ASSERT_X(c, "cancel job", "invalid context object");
+
+    // assignments are evaluated from left to right, so finished_at already sees the new status
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE job SET cancel_requested = 1, "
+                                                         "status = IF(status = :queued, :canceled, status), "
+                                                         "finished_at = IF(status = :canceled, :finished_at, finished_at), "
+                                                         "updated_at = :updated_at "
+                                                         "WHERE id = :id AND status IN (:queued, :running)"));
+    const QDateTime currentTimeUtc = QDateTime::currentDateTimeUtc();
+    q.bindValue(QStringLiteral(":queued"), static_cast<quint8>(Queued));
+    q.bindValue(QStringLiteral(":running"), static_cast<quint8>(Running));
+    q.bindValue(QStringLiteral(":canceled"), static_cast<quint8>(Canceled));
+    q.bindValue(QStringLiteral(":finished_at"), currentTimeUtc);
+    q.bindValue(QStringLiteral(":updated_at"), currentTimeUtc);
+    q.bindValue(QStringLiteral(":id"), m_id);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        e.setSqlError(q.lastError(), c->translate("Job", "Failed to cancel the job."));
+        qCCritical(SK_JOB, "%s failed to cancel job %u: %s", qUtf8Printable(AdminAccount::getUserNameIdString(c)), m_id, qUtf8Printable(q.lastError().text()));
+        return ret;
+    }
+
+    if (q.numRowsAffected() < 1) {
+        e.setErrorType(SkaffariError::InputError);
+        e.setErrorText(c->translate("Job", "The job has already been finished."));
+        return ret;
+    }
+
+    m_cancelRequested = true;
+    if (m_status == Queued) {
+        m_status = Canceled;
+        m_finished = currentTimeUtc;
+    }
+
+    qCInfo(SK_JOB, "%s canceled job %u.", qUtf8Printable(AdminAccount::getUserNameIdString(c)), m_id);
+
+    ret = true;
+
+    return ret;
+}
+
+Job Job::claim(QSqlError *error)
+{
+    Job job;
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT id FROM job WHERE status = :queued ORDER BY id ASC LIMIT 1"));
+    q.bindValue(QStringLiteral(":queued"), static_cast<quint8>(Queued));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        if (error) {
+            *error = q.lastError();
+        }
+        return job;
+    }
+
+    if (!q.next()) {
+        return job;
+    }
+
+    const dbid_t id = q.value(0).value<dbid_t>();
+    const QDateTime currentTimeUtc = QDateTime::currentDateTimeUtc();
+
+    // the status condition makes sure that only one worker gets the job
+    q = CPreparedSqlQueryThread(QStringLiteral("UPDATE job SET status = :running, started_at = :started_at, updated_at = :updated_at WHERE id = :id AND status = :queued"));
+    q.bindValue(QStringLiteral(":running"), static_cast<quint8>(Running));
+    q.bindValue(QStringLiteral(":started_at"), currentTimeUtc);
+    q.bindValue(QStringLiteral(":updated_at"), currentTimeUtc);
+    q.bindValue(QStringLiteral(":id"), id);
+    q.bindValue(QStringLiteral(":queued"), static_cast<quint8>(Queued));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        if (error) {
+            *error = q.lastError();
+        }
+        return job;
+    }
+
+    if (q.numRowsAffected() < 1) {
+        return job;
+    }
+
+    job = Job::fetch(id, error);
+
+    return job;
+}
+
+bool Job::setProgress(dbid_t id, quint32 progress, quint32 total, bool *cancelRequested)
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE job SET progress = :progress, total = :total, updated_at = :updated_at WHERE id = :id"));
+    q.bindValue(QStringLiteral(":progress"), progress);
+    q.bindValue(QStringLiteral(":total"), total);
+    q.bindValue(QStringLiteral(":updated_at"), QDateTime::currentDateTimeUtc());
+    q.bindValue(QStringLiteral(":id"), id);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_JOB, "Failed to update progress of job %u: %s", id, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    if (cancelRequested) {
+        q = CPreparedSqlQueryThread(QStringLiteral("SELECT cancel_requested FROM job WHERE id = :id"));
+        q.bindValue(QStringLiteral(":id"), id);
+        *cancelRequested = (q.exec() && q.next() && q.value(0).toBool());
+    }
+
+    return true;
+}
+
+bool Job::finish(dbid_t id, Status status, const QJsonObject &result)
+{
+    const QDateTime currentTimeUtc = QDateTime::currentDateTimeUtc();
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE job SET status = :status, result = :result, finished_at = :finished_at, updated_at = :updated_at WHERE id = :id"));
+    q.bindValue(QStringLiteral(":status"), static_cast<quint8>(status));
+    q.bindValue(QStringLiteral(":result"), QString::fromUtf8(QJsonDocument(result).toJson(QJsonDocument::Compact)));
+    q.bindValue(QStringLiteral(":finished_at"), currentTimeUtc);
+    q.bindValue(QStringLiteral(":updated_at"), currentTimeUtc);
+    q.bindValue(QStringLiteral(":id"), id);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCCritical(SK_JOB, "Failed to set final status of job %u: %s", id, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Job::requeue(dbid_t id)
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE job SET status = :queued, started_at = NULL, updated_at = :updated_at WHERE id = :id AND status = :running"));
+    q.bindValue(QStringLiteral(":queued"), static_cast<quint8>(Queued));
+    q.bindValue(QStringLiteral(":updated_at"), QDateTime::currentDateTimeUtc());
+    q.bindValue(QStringLiteral(":id"), id);
+    q.bindValue(QStringLiteral(":running"), static_cast<quint8>(Running));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCCritical(SK_JOB, "Failed to put job %u back into the queue: %s", id, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
+
+void Job::failStale(quint32 timeout)
+{
+    const QDateTime currentTimeUtc = QDateTime::currentDateTimeUtc();
+    const QJsonObject result({
+                                 {QStringLiteral("error_msg"), QStringLiteral("The job has been interrupted.")}
+                             });
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE job SET status = :failed, result = :result, finished_at = :finished_at, updated_at = :finished_at WHERE status = :running AND updated_at < :limit"));
+    q.bindValue(QStringLiteral(":failed"), static_cast<quint8>(Failed));
+    q.bindValue(QStringLiteral(":result"), QString::fromUtf8(QJsonDocument(result).toJson(QJsonDocument::Compact)));
+    q.bindValue(QStringLiteral(":finished_at"), currentTimeUtc);
+    q.bindValue(QStringLiteral(":running"), static_cast<quint8>(Running));
+    q.bindValue(QStringLiteral(":limit"), currentTimeUtc.addSecs(-static_cast<qint64>(timeout)));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_JOB, "Failed to mark stale jobs as failed: %s", qUtf8Printable(q.lastError().text()));
+    } else if (q.numRowsAffected() > 0) {
+        qCWarning(SK_JOB, "Marked %i stale jobs as failed.", q.numRowsAffected());
+    }
+}
+
+void Job::toStash(Cutelyst::Context *c, const Job &job)
+{
+    Q_ASSERT_X(c, "job to stash", "invalid context object");
+    c->setStash(QStringLiteral(JOB_STASH_KEY), QVariant::fromValue<Job>(job));
+}
+
+Job Job::fromStash(Cutelyst::Context *c)
+{
+    Q_ASSERT_X(c, "job from stash", "invalid context object");
+    return c->stash(QStringLiteral(JOB_STASH_KEY)).value<Job>();
+}
+
+Job Job::fromQuery(const QSqlQuery &q)
+{
+    QDateTime createdTime = q.value(11).toDateTime();
+    createdTime.setTimeSpec(Qt::UTC);
+    QDateTime startedTime = q.value(12).toDateTime();
+    if (startedTime.isValid()) {
+        startedTime.setTimeSpec(Qt::UTC);
+    }
+    QDateTime finishedTime = q.value(13).toDateTime();
+    if (finishedTime.isValid()) {
+        finishedTime.setTimeSpec(Qt::UTC);
+    }
+
+    return Job(q.value(0).value<dbid_t>(),
+               static_cast<Type>(q.value(1).value<quint8>()),
+               static_cast<Status>(q.value(2).value<quint8>()),
+               q.value(3).value<dbid_t>(),
+               q.value(4).value<dbid_t>(),
+               q.value(5).toString(),
+               QJsonDocument::fromJson(q.value(6).toByteArray()).object().toVariantHash(),
+               QJsonDocument::fromJson(q.value(7).toByteArray()).object(),
+               q.value(8).value<quint32>(),
+               q.value(9).value<quint32>(),
+               q.value(10).toBool(),
+               createdTime,
+               startedTime,
+               finishedTime);
+}
+
+Job Job::fetch(dbid_t id, QSqlError *error)
+{
+    Job job;
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT " JOB_SELECT_COLUMNS " FROM job WHERE id = :id"));
+    q.bindValue(QStringLiteral(":id"), id);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        if (error) {
+            *error = q.lastError();
+        }
+        return job;
+    }
+
+    if (q.next()) {
+        job = Job::fromQuery(q);
+    }
+
+    return job;
+}
@@ -0,0 +1,291 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JOB_H
+#define JOB_H
+
+#include "../../common/global.h"
+#include <QObject>
+#include <QString>
+#include <QDateTime>
+#include <QVariantHash>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <vector>
+
+Q_DECLARE_LOGGING_CATEGORY(SK_JOB)
+
+namespace Cutelyst {
+class Context;
+}
+
+class SkaffariError;
+class QSqlError;
+class QSqlQuery;
+
+/*!
+ * \ingroup skaffariobjects
+ * \brief Contains information about a long running operation that is processed in the background.
+ *
+ * Jobs are stored in the \c job database table. They are created by the controllers with enqueue()
+ * and processed by the worker threads of the JobQueue. The current state of a job can be requested
+ * with get(), active jobs can be canceled with cancel().
+ */
+class Job
+{
+    Q_GADGET
+    Q_PROPERTY(dbid_t id READ id CONSTANT)
+    Q_PROPERTY(Job::Type type READ type CONSTANT)
+    Q_PROPERTY(Job::Status status READ status CONSTANT)
+    Q_PROPERTY(dbid_t objectId READ objectId CONSTANT)
+    Q_PROPERTY(quint32 progress READ progress CONSTANT)
+    Q_PROPERTY(quint32 total READ total CONSTANT)
+    Q_PROPERTY(bool active READ isActive CONSTANT)
+public:
+    /*!
+     * \brief Types of jobs.
+     */
+    enum Type : quint8 {
+        Invalid         = 0,    /**< invalid job */
+        RemoveDomain    = 1,    /**< removes a domain, parameters: newParentId, deleteChildren */
+        CheckDomain     = 2     /**< checks all accounts of a domain, parameters: checkChildAddresses */
+    };
+    Q_ENUM(Type)
+
+    /*!
+     * \brief Processing states of a job.
+     */
+    enum Status : quint8 {
+        Queued      = 0,    /**< waiting to be processed */
+        Running     = 1,    /**< currently processed by a worker */
+        Finished    = 2,    /**< successfully finished */
+        Failed      = 3,    /**< finished with an error */
+        Canceled    = 4     /**< canceled by an administrator */
+    };
+    Q_ENUM(Status)
+
+    /*!
+     * \brief Constructs an invalid, empty Job.
+     */
+    Job() = default;
+
+    /*!
+     * \brief Constructs a new Job with the given values.
+     */
+    Job(dbid_t id, Type type, Status status, dbid_t objectId, dbid_t adminId, const QString &lang, const QVariantHash &params, const QJsonObject &result, quint32 progress, quint32 total, bool cancelRequested, const QDateTime &created, const QDateTime &started, const QDateTime &finished);
+
+    /*!
+     * \brief Returns the database ID of the job.
+     */
+    dbid_t id() const;
+
+    /*!
+     * \brief Returns the type of the job.
+     */
+    Type type() const;
+
+    /*!
+     * \brief Returns the processing state of the job.
+     */
+    Status status() const;
+
+    /*!
+     * \brief Returns the database ID of the object the job operates on, like the domain ID.
+     */
+    dbid_t objectId() const;
+
+    /*!
+     * \brief Returns the database ID of the administrator that created the job.
+     */
+    dbid_t adminId() const;
+
+    /*!
+     * \brief Returns the name of the locale of the administrator that created the job.
+     */
+    QString lang() const;
+
+    /*!
+     * \brief Returns the type specific parameters of the job.
+     */
+    QVariantHash params() const;
+
+    /*!
+     * \brief Returns the result of the job.
+     *
+     * The result can contain the keys \a status_msg, \a error_msg and \a actions as well as type specific data.
+     */
+    QJsonObject result() const;
+
+    /*!
+     * \brief Returns the number of items that have already been processed.
+     */
+    quint32 progress() const;
+
+    /*!
+     * \brief Returns the total number of items to process.
+     *
+     * This is \c 0 as long as the total number is unknown.
+     */
+    quint32 total() const;
+
+    /*!
+     * \brief Returns \c true if the cancellation of a running job has been requested.
+     */
+    bool isCancelRequested() const;
+
+    /*!
+     * \brief Returns the date and time the job has been created in UTC.
+     */
+    QDateTime created() const;
+
+    /*!
+     * \brief Returns the date and time the processing of the job has been started in UTC.
+     */
+    QDateTime started() const;
+
+    /*!
+     * \brief Returns the date and time the processing of the job has been finished in UTC.
+     */
+    QDateTime finished() const;
+
+    /*!
+     * \brief Returns \c true if the job is valid.
+     */
+    bool isValid() const;
+
+    /*!
+     * \brief Returns \c true if the job is queued or running.
+     */
+    bool isActive() const;
+
+    /*!
+     * \brief Returns a JSON representation of the job.
+     */
+    QJsonObject toJson() const;
+
+    /*!
+     * \brief Adds a new job of \a type for the object identified by \a objectId to the queue.
+     *
+     * If there is already an active job of the same type for the same object, that job will
+     * be returned instead of creating a new one.
+     *
+     * \param c         Pointer to the current context, used for translations and to get the current admin.
+     * \param e         Object taking error information.
+     * \param type      The type of the new job.
+     * \param objectId  Database ID of the object the job operates on.
+     * \param params    Type specific parameters for the job.
+     * \return The queued job. Will be invalid on errors.
+     */
+    static Job enqueue(Cutelyst::Context *c, SkaffariError &e, Type type, dbid_t objectId, const QVariantHash &params = QVariantHash());
+
+    /*!
+     * \brief Returns the job identified by \a id from the database.
+     */
+    static Job get(Cutelyst::Context *c, SkaffariError &e, dbid_t id);
+
+    /*!
+     * \brief Returns the active job of \a type for the object identified by \a objectId.
+     *
+     * Returns an invalid job if there is no active job.
+     */
+    static Job getActive(Cutelyst::Context *c, SkaffariError &e, Type type, dbid_t objectId);
+
+    /*!
+     * \brief Returns all active jobs of \a type.
+     */
+    static std::vector<Job> listActive(Cutelyst::Context *c, SkaffariError &e, Type type);
+
+    /*!
+     * \brief Cancels this job.
+     *
+     * Queued jobs will be canceled immediately. For running jobs the cancellation is requested, the
+     * worker will stop processing the job at the next possible point.
+     *
+     * \return \c true on success.
+     */
+    bool cancel(Cutelyst::Context *c, SkaffariError &e);
+
+    /*!
+     * \brief Takes the oldest queued job and marks it as running.
+     *
+     * Returns an invalid job if there is no queued job or if another worker took it first.
+     * Used by the workers of the JobQueue.
+     */
+    static Job claim(QSqlError *error = nullptr);
+
+    /*!
+     * \brief Stores the \a progress and the \a total number of items for the job identified by \a id.
+     *
+     * \a cancelRequested will be set to \c true if the job should be canceled.
+     */
+    static bool setProgress(dbid_t id, quint32 progress, quint32 total, bool *cancelRequested = nullptr);
+
+    /*!
+     * \brief Sets the final \a status and the \a result for the job identified by \a id.
+     */
+    static bool finish(dbid_t id, Status status, const QJsonObject &result);
+
+    /*!
+     * \brief Puts the running job identified by \a id back into the queue.
+     *
+     * Used by workers that have been stopped while processing the job, so that it can be
+     * continued by another worker.
+     */
+    static bool requeue(dbid_t id);
+
+    /*!
+     * \brief Marks running jobs as failed that have not been updated for \a timeout seconds.
+     *
+     * Jobs can get stale if the process that worked on them has been stopped.
+     */
+    static void failStale(quint32 timeout);
+
+    /*!
+     * \brief Puts the \a job into the stash of context \a c.
+     */
+    static void toStash(Cutelyst::Context *c, const Job &job);
+
+    /*!
+     * \brief Returns the job from the stash of context \a c.
+     */
+    static Job fromStash(Cutelyst::Context *c);
+
+private:
+    static Job fromQuery(const QSqlQuery &q);
+    static Job fetch(dbid_t id, QSqlError *error);
+
+    QString m_lang;
+    QVariantHash m_params;
+    QJsonObject m_result;
+    QDateTime m_created;
+    QDateTime m_started;
+    QDateTime m_finished;
+    dbid_t m_id = 0;
+    dbid_t m_objectId = 0;
+    dbid_t m_adminId = 0;
+    quint32 m_progress = 0;
+    quint32 m_total = 0;
+    Type m_type = Invalid;
+    Status m_status = Queued;
+    bool m_cancelRequested = false;
+};
+
+Q_DECLARE_METATYPE(Job)
+Q_DECLARE_TYPEINFO(Job, Q_MOVABLE_TYPE);
+
+#endif // JOB_H
@@ -61,22 +61,18 @@ void Root::index(Context *c)
 
     QSqlQuery q;
 
+    // the statistics table is maintained by the data objects and recounted by skaffaricmd
     if (isAdmin) {
-        q = CPreparedSqlQueryThread(QStringLiteral("SELECT "
-                                                   "(SELECT COUNT(*) FROM accountuser) - 1 AS accounts, "
-                                                   "(SELECT COUNT(*) FROM adminuser) AS admins, "
-                                                   "(SELECT COUNT(*) FROM domain WHERE idn_id = 0) AS domains, "
-                                                   "(SELECT SUM(quota) FROM accountuser) AS accountquota, "
-                                                   "(SELECT SUM(domainquota) FROM domain) AS domainquota, "
-                                                   "(SELECT COUNT(*) FROM virtual WHERE alias LIKE '%@%' AND idn_id = 0) AS addresses"));
+        q = CPreparedSqlQueryThread(QStringLiteral("SELECT accounts, admins, domains, accountquota, domainquota, addresses FROM statistics WHERE domain_id = 0"));
     } else {
         q = CPreparedSqlQueryThread(QStringLiteral("SELECT "
-                                                   "(SELECT COUNT(*) FROM accountuser au JOIN domainadmin da ON au.domain_id = da.domain_id WHERE da.admin_id = :admin_id) AS accounts, "
-                                                   "(SELECT COUNT(*) FROM adminuser) AS admins, "
-                                                   "(SELECT COUNT(*) FROM domain dom JOIN domainadmin da ON dom.id = da.domain_id WHERE dom.idn_id = 0 AND da.admin_id = :admin_id) AS domains, "
-                                                   "(SELECT SUM(au.quota) FROM accountuser au JOIN domainadmin da ON au.domain_id = da.domain_id WHERE da.admin_id = :admin_id) AS accountquota, "
-                                                   "(SELECT SUM(dom.domainquota) FROM domain dom JOIN domainadmin da ON dom.id = da.domain_id WHERE da.admin_id = :admin_id) AS domainquota, "
-                                                   "(SELECT COUNT(*) FROM virtual vi JOIN accountuser au ON vi.username = au.username JOIN domainadmin da ON au.domain_id = da.domain_id WHERE da.admin_id = :admin_id AND vi.alias LIKE '%@%' AND vi.idn_id = 0) AS addresses"));
+                                                   "COALESCE(SUM(s.accounts), 0) AS accounts, "
+                                                   "(SELECT admins FROM statistics WHERE domain_id = 0) AS admins, "
+                                                   "COUNT(s.domain_id) AS domains, "
+                                                   "COALESCE(SUM(s.accountquota), 0) AS accountquota, "
+                                                   "COALESCE(SUM(s.domainquota), 0) AS domainquota, "
+                                                   "COALESCE(SUM(s.addresses), 0) AS addresses "
+                                                   "FROM statistics s JOIN domainadmin da ON s.domain_id = da.domain_id WHERE da.admin_id = :admin_id"));
         q.bindValue(QStringLiteral(":admin_id"), adminId);
     }
 
@@ -312,6 +308,8 @@ void Root::error(Context *c)
 
 bool Root::Auto(Context* c)
 {
+    SkaffariConfig::reloadIfRequested();
+
     if (c->controllerName() == QLatin1String("Login")) {
         return true;
     }
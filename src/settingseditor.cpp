@@ -354,4 +354,26 @@ void SettingsEditor::remove_autoconfig_server(Context *c, const QString &id)
     }
 }
 
+void SettingsEditor::reload_config(Context *c)
+{
+    if (AdminAccount::getUserType(c) < AdminAccount::SuperUser) {
+        c->res()->setStatus(403);
+        c->detach(c->getAction(QStringLiteral("error")));
+        return;
+    }
+
+    if (!c->req()->isPost()) {
+        c->res()->setStatus(Response::MethodNotAllowed);
+        c->res()->setHeader(QStringLiteral("Allow"), QStringLiteral("POST"));
+        c->detach(c->getAction(QStringLiteral("error")));
+        return;
+    }
+
+    if (SkaffariConfig::reloadAll()) {
+        c->res()->redirect(c->uriForAction(QStringLiteral("/settings/index"), QStringList(), QStringList(), StatusMessage::statusQuery(c, c->translate("SettingsEditor", "Successfully reloaded the configuration file."))));
+    } else {
+        c->res()->redirect(c->uriForAction(QStringLiteral("/settings/index"), QStringList(), QStringList(), StatusMessage::errorQuery(c, c->translate("SettingsEditor", "Failed to reload the configuration file. See the log for details."))));
+    }
+}
+
 #include "moc_settingseditor.cpp"
@@ -50,6 +50,9 @@ public:
     C_ATTR(remove_autoconfig_server, :Local :Args(1))
     void remove_autoconfig_server(Context *c, const QString &id);
 
+    C_ATTR(reload_config, :Local :Args(0))
+    void reload_config(Context *c);
+
 private:
     C_ATTR(Auto, :Private)
     bool Auto(Context *c);
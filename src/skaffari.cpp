@@ -46,6 +46,7 @@
 #include <QJsonObject>
 #include <QLoggingCategory>
 #include <QMutexLocker>
+#include <csignal>
 
 extern "C"
 {
@@ -63,6 +64,7 @@ extern "C"
 #include "objects/skaffarierror.h"
 
 #include "utils/skaffariconfig.h"
+#include "utils/jobqueue.h"
 #include "utils/qtimezonevariant_p.h"
 
 #include "../common/config.h"
@@ -78,6 +80,7 @@ extern "C"
 #include "settingseditor.h"
 #include "autoconfig.h"
 #include "autodiscover.h"
+#include "jobeditor.h"
 
 Q_LOGGING_CATEGORY(SK_CORE, "skaffari.core")
 
@@ -152,6 +155,12 @@ void syslogMessageOutput(QtMsgType type, const QMessageLogContext &context, cons
     }
 }
 
+void sigHupHandler(int signal)
+{
+    Q_UNUSED(signal);
+    SkaffariConfig::requestReload();
+}
+
 Skaffari::Skaffari(QObject *parent) : Application(parent)
 {
     QCoreApplication::setApplicationName(QStringLiteral("Skaffari"));
@@ -276,6 +285,7 @@ bool Skaffari::init()
     new SettingsEditor(this);
     new Autoconfig(this);
     new Autodiscover(this);
+    new JobEditor(this);
 
     qCDebug(SK_CORE) << "Registering plugins.";
 
@@ -326,13 +336,22 @@ bool Skaffari::init()
 
 bool Skaffari::postFork()
 {
-    QMutexLocker locker(&mutex);
+    if (Q_UNLIKELY(!initDb())) {
+        return false;
+    }
 
-    return initDb();
+    // the configuration is reloaded at the start of the next request
+    std::signal(SIGHUP, sigHupHandler);
+
+    JobQueue::start(this, SkaffariConfig::jobWorkers());
+
+    return true;
 }
 
 bool Skaffari::initDb() const
 {
+    QMutexLocker locker(&mutex);
+
     const QVariantMap dbconfig = engine()->config(QStringLiteral("Database"));
     const QString dbtype = dbconfig.value(QStringLiteral("type")).toString();
     const QString dbname = dbconfig.value(QStringLiteral("name")).toString();
@@ -76,12 +76,19 @@ public:
     /*!
      * \brief This will be called after the engine forked and will setup the database connection.
      *
-     * Returns always \c true.
+     * It also starts the background job workers of the process, see JobQueue. Returns \c false
+     * if the database connection could not be established.
      */
     bool postFork() override;
 
-private:
+    /*!
+     * \brief Establishes the database connection for the current thread.
+     *
+     * Returns \c false if the connection could not be established.
+     */
     bool initDb() const;
+
+private:
     static bool isInitialized;
     static bool messageHandlerInstalled;
 };
@@ -0,0 +1,173 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2019 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "autoconfigcache.h"
+#include "skaffariconfig.h"
+#include <Cutelyst/Plugins/Memcached/Memcached>
+#include <QXmlStreamWriter>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDataStream>
+
+#define MEMC_AUTOCONFIG_GEN_KEY QStringLiteral("sk_autoconfig_gen")
+#define MEMC_AUTOCONFIG_ADDRESS_KEY QLatin1String("sk_autoconfig_address_")
+#define MEMC_AUTOCONFIG_DOCUMENT_KEY QLatin1String("sk_autoconfig_document_")
+#define MEMC_AUTOCONFIG_ADDRESS_EXP 600
+#define MEMC_AUTOCONFIG_DOCUMENT_EXP 7200
+#define SK_AUTOCONFIG_USERNAME_ENTITY "sk_username"
+
+namespace {
+
+/*!
+ * \internal
+ * \brief Returns the hex encoded SHA1 hash of \a value.
+ *
+ * Email addresses and domain names are sent by the clients, so they are hashed to get valid keys.
+ */
+QString hashed(const QString &value)
+{
+    return QString::fromLatin1(QCryptographicHash::hash(value.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+}
+
+AutoconfigCache::AutoconfigCache()
+{
+    if (!SkaffariConfig::useMemcached()) {
+        return;
+    }
+
+    Cutelyst::Memcached::MemcachedReturnType memrt = Cutelyst::Memcached::NotFound;
+    QByteArray gen = Cutelyst::Memcached::get(MEMC_AUTOCONFIG_GEN_KEY, nullptr, &memrt);
+
+    if (memrt == Cutelyst::Memcached::NotFound) {
+        // a new generation, entries of an evicted generation must not be used again
+        gen = QByteArray::number(QDateTime::currentMSecsSinceEpoch());
+        if (!Cutelyst::Memcached::add(MEMC_AUTOCONFIG_GEN_KEY, gen, 0)) {
+            // another process was faster
+            gen = Cutelyst::Memcached::get(MEMC_AUTOCONFIG_GEN_KEY, nullptr, &memrt);
+        } else {
+            memrt = Cutelyst::Memcached::Success;
+        }
+    }
+
+    if (memrt == Cutelyst::Memcached::Success && !gen.isEmpty()) {
+        m_generation = QString::fromLatin1(gen);
+    }
+}
+
+bool AutoconfigCache::isEnabled() const
+{
+    return !m_generation.isEmpty();
+}
+
+QString AutoconfigCache::username(const QString &email) const
+{
+    QString username;
+
+    if (isEnabled()) {
+        const QByteArray cached = Cutelyst::Memcached::get(MEMC_AUTOCONFIG_ADDRESS_KEY + m_generation + QLatin1Char('_') + hashed(email));
+        if (!cached.isEmpty()) {
+            username = QString::fromUtf8(cached);
+        }
+    }
+
+    return username;
+}
+
+void AutoconfigCache::setUsername(const QString &email, const QString &username) const
+{
+    if (isEnabled() && !username.isEmpty()) {
+        Cutelyst::Memcached::set(MEMC_AUTOCONFIG_ADDRESS_KEY + m_generation + QLatin1Char('_') + hashed(email), username.toUtf8(), MEMC_AUTOCONFIG_ADDRESS_EXP);
+    }
+}
+
+QList<QByteArray> AutoconfigCache::document(Format format, const QString &mailDomain) const
+{
+    QList<QByteArray> segments;
+
+    if (isEnabled()) {
+        Cutelyst::Memcached::MemcachedReturnType memrt = Cutelyst::Memcached::NotFound;
+        const QList<QByteArray> cached = Cutelyst::Memcached::get<QList<QByteArray>>(MEMC_AUTOCONFIG_DOCUMENT_KEY + QString::number(format) + QLatin1Char('_') + m_generation + QLatin1Char('_') + hashed(mailDomain), nullptr, &memrt);
+        if (memrt == Cutelyst::Memcached::Success) {
+            segments = cached;
+        }
+    }
+
+    return segments;
+}
+
+void AutoconfigCache::setDocument(Format format, const QString &mailDomain, const QList<QByteArray> &segments) const
+{
+    if (isEnabled() && !segments.empty()) {
+        Cutelyst::Memcached::set<QList<QByteArray>>(MEMC_AUTOCONFIG_DOCUMENT_KEY + QString::number(format) + QLatin1Char('_') + m_generation + QLatin1Char('_') + hashed(mailDomain), segments, MEMC_AUTOCONFIG_DOCUMENT_EXP);
+    }
+}
+
+void AutoconfigCache::writeUsernamePlaceholder(QXmlStreamWriter *writer)
+{
+    Q_ASSERT_X(writer, "write username placeholder", "invalid writer object");
+    writer->writeEntityReference(QStringLiteral(SK_AUTOCONFIG_USERNAME_ENTITY));
+}
+
+QList<QByteArray> AutoconfigCache::split(const QByteArray &xml)
+{
+    static const QByteArray placeholder = QByteArrayLiteral("&" SK_AUTOCONFIG_USERNAME_ENTITY ";");
+
+    QList<QByteArray> segments;
+    int from = 0;
+    for (;;) {
+        const int pos = xml.indexOf(placeholder, from);
+        if (pos < 0) {
+            segments.push_back(xml.mid(from));
+            break;
+        }
+        segments.push_back(xml.mid(from, pos - from));
+        from = pos + placeholder.size();
+    }
+
+    return segments;
+}
+
+QByteArray AutoconfigCache::render(const QList<QByteArray> &segments, const QString &username)
+{
+    const QByteArray escaped = username.toHtmlEscaped().toUtf8();
+
+    int size = escaped.size() * (segments.size() - 1);
+    for (const QByteArray &segment : segments) {
+        size += segment.size();
+    }
+
+    QByteArray xml;
+    xml.reserve(size);
+    for (int i = 0; i < segments.size(); ++i) {
+        if (i > 0) {
+            xml.append(escaped);
+        }
+        xml.append(segments.at(i));
+    }
+
+    return xml;
+}
+
+void AutoconfigCache::clear()
+{
+    if (SkaffariConfig::useMemcached()) {
+        Cutelyst::Memcached::set(MEMC_AUTOCONFIG_GEN_KEY, QByteArray::number(QDateTime::currentMSecsSinceEpoch()), 0);
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2019 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUTOCONFIGCACHE_H
+#define AUTOCONFIGCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+
+class QXmlStreamWriter;
+
+/*!
+ * \ingroup skaffaricore
+ * \brief Caches the responses of the Autoconfig and Autodiscover controllers in memcached.
+ *
+ * Two kinds of entries are stored: the user name an email address belongs to and the rendered
+ * response document of a mail domain. The user name is the only part of the response that depends
+ * on the email address, so the domain documents contain a placeholder that is replaced by the
+ * escaped user name when the response is rendered. A request for a cached address and domain does
+ * not have to query the database.
+ *
+ * All keys contain a generation that is stored in memcached. clear() sets a new generation and by
+ * that invalidates all entries at once. It has to be called whenever autoconfig servers, domains or
+ * the autoconfig settings change. Address entries have a short expiration time instead, because
+ * email addresses are changed in too many places.
+ *
+ * If memcached is not used, the cache is disabled and every request queries the database.
+ */
+class AutoconfigCache
+{
+public:
+    /*!
+     * \brief Format of a cached domain document.
+     */
+    enum Format : quint8 {
+        Autoconfig      = 0,    /**< Thunderbird autoconfig client configuration */
+        Autodiscover    = 1     /**< Outlook autodiscover response */
+    };
+
+    /*!
+     * \brief Constructs a new AutoconfigCache object and reads the current generation from memcached.
+     */
+    AutoconfigCache();
+
+    /*!
+     * \brief Returns \c true if the cache can be used.
+     */
+    bool isEnabled() const;
+
+    /*!
+     * \brief Returns the cached user name of the account \a email belongs to.
+     *
+     * Returns a null string if there is no cache entry.
+     */
+    QString username(const QString &email) const;
+
+    /*!
+     * \brief Stores the \a username of the account \a email belongs to.
+     */
+    void setUsername(const QString &email, const QString &username) const;
+
+    /*!
+     * \brief Returns the cached document segments in \a format for \a mailDomain.
+     *
+     * Returns an empty list if there is no cache entry.
+     */
+    QList<QByteArray> document(Format format, const QString &mailDomain) const;
+
+    /*!
+     * \brief Stores the document \a segments in \a format for \a mailDomain.
+     */
+    void setDocument(Format format, const QString &mailDomain, const QList<QByteArray> &segments) const;
+
+    /*!
+     * \brief Writes the user name placeholder to \a writer.
+     *
+     * The placeholder is written as entity reference. Text written with QXmlStreamWriter::writeCharacters()
+     * has escaped ampersands, so it can never contain the placeholder.
+     */
+    static void writeUsernamePlaceholder(QXmlStreamWriter *writer);
+
+    /*!
+     * \brief Splits the \a xml document at the user name placeholders.
+     */
+    static QList<QByteArray> split(const QByteArray &xml);
+
+    /*!
+     * \brief Joins the document \a segments with the escaped \a username.
+     */
+    static QByteArray render(const QList<QByteArray> &segments, const QString &username);
+
+    /*!
+     * \brief Invalidates all cached entries.
+     */
+    static void clear();
+
+private:
+    QString m_generation;
+};
+
+#endif // AUTOCONFIGCACHE_H
@@ -0,0 +1,223 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2019 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "autoconfigguard.h"
+#include <QGlobalStatic>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QStringList>
+#include <atomic>
+
+#define SK_AUTOCONFIG_NEGATIVE_CACHE_SIZE 10000
+#define SK_AUTOCONFIG_NEGATIVE_CACHE_TTL 60000
+#define SK_AUTOCONFIG_LIMITER_SLOTS 4096
+#define SK_AUTOCONFIG_LIMITER_BURST 30
+#define SK_AUTOCONFIG_REPORT_INTERVAL 600000
+
+Q_LOGGING_CATEGORY(SK_AUTOCONFIGGUARD, "skaffari.autoconfig")
+
+namespace {
+
+/*
+ * A limiter slot contains the time of the last update in milliseconds in the upper 40 bits
+ * and the available tokens in thousandths in the lower 24 bits. An unused slot is 0.
+ */
+const quint64 slotTokenBits = 24;
+const quint64 slotTokenMask = (Q_UINT64_C(1) << slotTokenBits) - 1;
+const quint64 milliTokens = 1000;
+
+struct Guard {
+    Guard()
+    {
+        clock.start();
+        for (std::atomic<quint64> &slot : slots) {
+            slot.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    QMutex missingMutex;
+    QCache<QString,qint64> missing{SK_AUTOCONFIG_NEGATIVE_CACHE_SIZE};
+    QElapsedTimer clock;
+    std::atomic<quint64> slots[SK_AUTOCONFIG_LIMITER_SLOTS];
+    std::atomic<quint64> negativeHits{0};
+    std::atomic<quint64> lookups{0};
+    std::atomic<quint64> rejected{0};
+    std::atomic<qint64> lastReport{0};
+};
+Q_GLOBAL_STATIC(Guard, guard)
+
+/*!
+ * \internal
+ * \brief Returns \a address as IPv4 address if it is an IPv4 mapped IPv6 address.
+ */
+QHostAddress normalizedAddress(const QHostAddress &address)
+{
+    bool isV4 = false;
+    const quint32 v4 = address.toIPv4Address(&isV4);
+    return isV4 ? QHostAddress(v4) : address;
+}
+
+/*!
+ * \internal
+ * \brief Logs and resets the counters if the report interval has passed.
+ */
+void report()
+{
+    const qint64 now = guard->clock.elapsed();
+    qint64 last = guard->lastReport.load(std::memory_order_relaxed);
+    if ((now - last) < SK_AUTOCONFIG_REPORT_INTERVAL) {
+        return;
+    }
+    if (!guard->lastReport.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        // another thread reports
+        return;
+    }
+
+    const quint64 negativeHits = guard->negativeHits.exchange(0, std::memory_order_relaxed);
+    const quint64 lookups = guard->lookups.exchange(0, std::memory_order_relaxed);
+    const quint64 rejected = guard->rejected.exchange(0, std::memory_order_relaxed);
+    if (negativeHits || lookups || rejected) {
+        qCInfo(SK_AUTOCONFIGGUARD, "Address lookups in the last %lli seconds: %llu negative cache hits, %llu database lookups, %llu rejected by the rate limit.",
+               (now - last) / 1000, negativeHits, lookups, rejected);
+    }
+}
+
+}
+
+bool AutoconfigGuard::isKnownMissing(const QString &email)
+{
+    bool ret = false;
+
+    {
+        QMutexLocker locker(&guard->missingMutex);
+        const qint64 *expires = guard->missing.object(email);
+        if (expires) {
+            if (*expires > guard->clock.elapsed()) {
+                ret = true;
+            } else {
+                guard->missing.remove(email);
+            }
+        }
+    }
+
+    if (ret) {
+        guard->negativeHits.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    report();
+
+    return ret;
+}
+
+void AutoconfigGuard::addMissing(const QString &email)
+{
+    QMutexLocker locker(&guard->missingMutex);
+    guard->missing.insert(email, new qint64(guard->clock.elapsed() + SK_AUTOCONFIG_NEGATIVE_CACHE_TTL));
+}
+
+void AutoconfigGuard::removeMissing(const QString &email)
+{
+    QMutexLocker locker(&guard->missingMutex);
+    guard->missing.remove(email);
+}
+
+bool AutoconfigGuard::acquire(const QString &clientAddress, quint32 rate, int *retryAfter)
+{
+    Q_ASSERT_X(retryAfter, "acquire autoconfig token", "invalid retryAfter pointer");
+
+    if (rate == 0) {
+        guard->lookups.fetch_add(1, std::memory_order_relaxed);
+        *retryAfter = 0;
+        report();
+        return true;
+    }
+
+    std::atomic<quint64> &slot = guard->slots[qHash(clientAddress) % SK_AUTOCONFIG_LIMITER_SLOTS];
+    // 0 marks an unused slot
+    const quint64 now = static_cast<quint64>(guard->clock.elapsed()) + 1;
+
+    bool allowed = false;
+    quint64 tokens = 0;
+    quint64 current = slot.load(std::memory_order_relaxed);
+    for (;;) {
+        quint64 updated = now;
+        if (current == 0) {
+            tokens = SK_AUTOCONFIG_LIMITER_BURST * milliTokens;
+        } else {
+            const quint64 last = current >> slotTokenBits;
+            tokens = current & slotTokenMask;
+            if (now > last) {
+                // the rate is in tokens per second, so it is the same in thousandths per millisecond
+                tokens = qMin<quint64>(SK_AUTOCONFIG_LIMITER_BURST * milliTokens, tokens + (now - last) * rate);
+            } else {
+                // a thread that read the clock later has already updated the slot, moving the
+                // time back would credit the tokens of the same period twice
+                updated = last;
+            }
+        }
+
+        allowed = (tokens >= milliTokens);
+        if (allowed) {
+            tokens -= milliTokens;
+        }
+
+        if (slot.compare_exchange_weak(current, (updated << slotTokenBits) | tokens, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    if (allowed) {
+        guard->lookups.fetch_add(1, std::memory_order_relaxed);
+        *retryAfter = 0;
+    } else {
+        guard->rejected.fetch_add(1, std::memory_order_relaxed);
+        const quint64 wait = (milliTokens - tokens + rate - 1) / rate;
+        *retryAfter = static_cast<int>((wait + 999) / 1000);
+    }
+
+    report();
+
+    return allowed;
+}
+
+QString AutoconfigGuard::clientAddress(const QHostAddress &peer, const QString &forwardedFor, const QList<QHostAddress> &trustedProxies)
+{
+    QHostAddress client = normalizedAddress(peer);
+
+    if (forwardedFor.isEmpty() || !trustedProxies.contains(client)) {
+        return client.toString();
+    }
+
+    const QStringList hops = forwardedFor.split(QLatin1Char(','), QString::SkipEmptyParts);
+    for (int i = hops.size() - 1; i >= 0; --i) {
+        const QHostAddress hop(hops.at(i).trimmed());
+        if (hop.isNull()) {
+            // nothing left of an invalid entry can be trusted
+            break;
+        }
+        client = normalizedAddress(hop);
+        if (!trustedProxies.contains(client)) {
+            break;
+        }
+    }
+
+    return client.toString();
+}
@@ -0,0 +1,86 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2019 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUTOCONFIGGUARD_H
+#define AUTOCONFIGGUARD_H
+
+#include <QString>
+#include <QList>
+#include <QHostAddress>
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(SK_AUTOCONFIGGUARD)
+
+/*!
+ * \ingroup skaffaricore
+ * \brief Protects the database from the address lookups of the Autoconfig and Autodiscover controllers.
+ *
+ * Both endpoints are public and are also queried with random addresses. Unknown addresses are stored
+ * in a bounded negative cache for a minute, so repeated requests for them do not query the database.
+ * The lookups that still need the database have to pass a token bucket limiter per client address.
+ *
+ * Both structures live in the memory of the worker process. The negative cache is protected by a
+ * mutex, the limiter uses a fixed number of buckets that are updated with atomic compare and swap.
+ * Client addresses that share a bucket share their tokens. Behind a reverse proxy the address of the
+ * proxy has to be set in SkaffariConfig::trustedProxies(), otherwise all clients share the address of
+ * the proxy. The limiter can be disabled by setting SkaffariConfig::autoconfigRatelimit() to \c 0.
+ *
+ * The number of negative cache hits, database lookups and rejected lookups is logged every ten minutes.
+ */
+class AutoconfigGuard
+{
+public:
+    /*!
+     * \brief Returns \c true if \a email has recently been looked up without result.
+     */
+    static bool isKnownMissing(const QString &email);
+
+    /*!
+     * \brief Stores \a email as unknown address.
+     */
+    static void addMissing(const QString &email);
+
+    /*!
+     * \brief Removes \a email from the unknown addresses of this process.
+     *
+     * Has to be called when a new address is inserted into the database. Other worker
+     * processes will find the address after the negative cache entry expired.
+     */
+    static void removeMissing(const QString &email);
+
+    /*!
+     * \brief Takes a token from the bucket of the client with the \a clientAddress.
+     *
+     * Buckets are refilled with \a rate tokens per second, a \a rate of \c 0 disables the limiter.
+     * Returns \c false if the bucket is empty. In that case \a retryAfter will contain the number
+     * of seconds until the next token is available.
+     */
+    static bool acquire(const QString &clientAddress, quint32 rate, int *retryAfter);
+
+    /*!
+     * \brief Returns the address of the client used to select its limiter bucket.
+     *
+     * If the \a peer address belongs to one of the \a trustedProxies, the client address is taken
+     * from the \a forwardedFor header value. Proxies append the address they received the request
+     * from, so the rightmost address that is not a trusted proxy is used. Addresses left of it could
+     * have been set by the client itself.
+     */
+    static QString clientAddress(const QHostAddress &peer, const QString &forwardedFor, const QList<QHostAddress> &trustedProxies);
+};
+
+#endif // AUTOCONFIGGUARD_H
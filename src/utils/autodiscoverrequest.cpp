@@ -0,0 +1,106 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2019 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "autodiscoverrequest.h"
+#include <QIODevice>
+#include <QXmlStreamReader>
+
+#define SK_AUTODISCOVER_READ_CHUNK_SIZE 4096
+
+AutodiscoverRequest::AutodiscoverRequest(qint64 maxSize) :
+    m_maxSize(maxSize)
+{
+
+}
+
+AutodiscoverRequest::Result AutodiscoverRequest::parse(QIODevice *device)
+{
+    Q_ASSERT_X(device, "parse autodiscover request", "invalid device");
+
+    m_emailAddress.clear();
+    m_errorString.clear();
+
+    if (!device->isSequential() && (device->size() > m_maxSize)) {
+        return TooLarge;
+    }
+
+    QXmlStreamReader xml;
+    qint64 bytesRead = 0;
+    int depth = 0;
+    bool inRequest = false;
+    bool inAddress = false;
+    QString address;
+
+    for (;;) {
+        const QXmlStreamReader::TokenType token = xml.readNext();
+
+        if (token == QXmlStreamReader::Invalid) {
+            if (xml.error() != QXmlStreamReader::PrematureEndOfDocumentError) {
+                m_errorString = xml.errorString();
+                return InvalidXml;
+            }
+
+            const QByteArray chunk = device->read(SK_AUTODISCOVER_READ_CHUNK_SIZE);
+            if (chunk.isEmpty()) {
+                m_errorString = xml.errorString();
+                return InvalidXml;
+            }
+            bytesRead += chunk.size();
+            if (bytesRead > m_maxSize) {
+                return TooLarge;
+            }
+            xml.addData(chunk);
+            continue;
+        }
+
+        if (token == QXmlStreamReader::StartElement) {
+            ++depth;
+            if (!inRequest && (depth == 2) && (xml.name() == QLatin1String("Request"))) {
+                inRequest = true;
+            } else if (inRequest && (depth == 3) && (xml.name() == QLatin1String("EMailAddress"))) {
+                inAddress = true;
+            }
+        } else if (token == QXmlStreamReader::Characters) {
+            if (inAddress) {
+                address += xml.text();
+            }
+        } else if (token == QXmlStreamReader::EndElement) {
+            if (inAddress && (depth == 3)) {
+                m_emailAddress = address;
+                return Ok;
+            }
+            --depth;
+            // only the first Request element is evaluated
+            if ((depth == 1 && inRequest) || (depth == 0)) {
+                return Ok;
+            }
+        } else if (token == QXmlStreamReader::EndDocument) {
+            return Ok;
+        }
+    }
+}
+
+QString AutodiscoverRequest::emailAddress() const
+{
+    return m_emailAddress;
+}
+
+QString AutodiscoverRequest::errorString() const
+{
+    return m_errorString;
+}
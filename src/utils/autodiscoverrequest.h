@@ -0,0 +1,75 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2019 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUTODISCOVERREQUEST_H
+#define AUTODISCOVERREQUEST_H
+
+#include <QString>
+
+#define SK_AUTODISCOVER_MAX_REQUEST_SIZE 16384
+
+class QIODevice;
+
+/*!
+ * \ingroup skaffaricore
+ * \brief Extracts the requested email address from the body of an autodiscover request.
+ *
+ * The body is read in chunks into a QXmlStreamReader that stops as soon as the \c EMailAddress
+ * element below \c Request has been read, the rest of the body is neither read nor validated.
+ * Bodies that are larger than the maximum size are rejected before they are parsed, if their size
+ * is known, or as soon as more data than allowed has been read.
+ */
+class AutodiscoverRequest
+{
+public:
+    /*!
+     * \brief Result of parse().
+     */
+    enum Result : quint8 {
+        Ok          = 0,    /**< the request has been parsed, the address might be empty */
+        TooLarge    = 1,    /**< the request is larger than the maximum size */
+        InvalidXml  = 2     /**< the request could not be parsed */
+    };
+
+    /*!
+     * \brief Constructs a new AutodiscoverRequest that accepts bodies of up to \a maxSize bytes.
+     */
+    explicit AutodiscoverRequest(qint64 maxSize = SK_AUTODISCOVER_MAX_REQUEST_SIZE);
+
+    /*!
+     * \brief Reads the request from the opened \a device.
+     */
+    Result parse(QIODevice *device);
+
+    /*!
+     * \brief Returns the requested email address after parse() returned Ok.
+     */
+    QString emailAddress() const;
+
+    /*!
+     * \brief Returns the description of the parser error after parse() returned InvalidXml.
+     */
+    QString errorString() const;
+
+private:
+    QString m_emailAddress;
+    QString m_errorString;
+    qint64 m_maxSize;
+};
+
+#endif // AUTODISCOVERREQUEST_H
@@ -0,0 +1,344 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jobqueue.h"
+#include "../skaffari.h"
+#include "../objects/job.h"
+#include "../objects/domain.h"
+#include "../objects/account.h"
+#include "../objects/adminaccount.h"
+#include "../objects/skaffarierror.h"
+#include "../imap/skaffariimappool.h"
+#include <Cutelyst/Context>
+#include <Cutelyst/ParamsMultiMap>
+#include <Cutelyst/Plugins/Utils/Sql>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QJsonArray>
+#include <vector>
+
+#define SK_JOB_POLL_INTERVAL 2000
+#define SK_JOB_PROGRESS_INTERVAL 1000
+#define SK_JOB_STALE_CHECK_INTERVAL 60000
+#define SK_JOB_STALE_TIMEOUT 1800
+
+namespace {
+
+/*!
+ * \internal
+ * \brief Thread that polls the job table and processes the queued jobs one after another.
+ */
+class JobWorker : public QThread
+{
+public:
+    JobWorker(Skaffari *app, int number) :
+        QThread(),
+        m_app(app),
+        m_number(number)
+    {
+        setObjectName(QStringLiteral("SkaffariJobWorker%1").arg(number));
+    }
+
+protected:
+    void run() override
+    {
+        if (Q_UNLIKELY(!m_app->initDb())) {
+            qCCritical(SK_JOB, "Job worker %i failed to establish the database connection.", m_number);
+            return;
+        }
+
+        qCDebug(SK_JOB, "Job worker %i started.", m_number);
+
+        QElapsedTimer staleCheck;
+        bool dbErrorLogged = false;
+
+        while (!isInterruptionRequested()) {
+
+            if (!staleCheck.isValid() || staleCheck.hasExpired(SK_JOB_STALE_CHECK_INTERVAL)) {
+                Job::failStale(SK_JOB_STALE_TIMEOUT);
+                staleCheck.start();
+            }
+
+            QSqlError sqlError;
+            const Job job = Job::claim(&sqlError);
+
+            if (job.isValid()) {
+                dbErrorLogged = false;
+                execute(job);
+                continue;
+            }
+
+            if (sqlError.type() != QSqlError::NoError) {
+                if (!dbErrorLogged) {
+                    qCCritical(SK_JOB, "Job worker %i failed to query the job queue: %s", m_number, qUtf8Printable(sqlError.text()));
+                    dbErrorLogged = true;
+                }
+            } else {
+                dbErrorLogged = false;
+            }
+
+            // sleep in small steps to not delay the shutdown
+            for (int i = 0; (i < (SK_JOB_POLL_INTERVAL / 250)) && !isInterruptionRequested(); ++i) {
+                msleep(250);
+            }
+        }
+
+        SkaffariIMAPPool::clear();
+
+        qCDebug(SK_JOB, "Job worker %i stopped.", m_number);
+    }
+
+private:
+    void execute(const Job &job)
+    {
+        qCInfo(SK_JOB, "Job worker %i started to process job %u of type %u.", m_number, job.id(), static_cast<quint32>(job.type()));
+
+        // there is no request, so the context only provides translations, the stash and the
+        // current admin for the functions that are also used by the controllers
+        Cutelyst::Context c(m_app);
+        c.setLocale(QLocale(job.lang()));
+
+        SkaffariError e(&c);
+        QJsonObject result;
+        Job::Status status = Job::Failed;
+
+        const AdminAccount admin = AdminAccount::get(&c, e, job.adminId());
+        if (Q_LIKELY(admin.isValid())) {
+            c.setStash(QStringLiteral("user"), QVariant::fromValue<AdminAccount>(admin));
+
+            switch (job.type()) {
+            case Job::RemoveDomain:
+                status = removeDomain(&c, job, e, result);
+                break;
+            case Job::CheckDomain:
+                status = checkDomain(&c, job, e, result);
+                break;
+            default:
+                e.setErrorType(SkaffariError::ApplicationError);
+                e.setErrorText(c.translate("JobQueue", "Unknown job type."));
+                break;
+            }
+        }
+
+        if (status == Job::Queued) {
+            // the worker has been stopped, another worker will continue the job
+            Job::requeue(job.id());
+            qCInfo(SK_JOB, "Job worker %i put job %u back into the queue.", m_number, job.id());
+            return;
+        }
+
+        if ((status != Job::Finished) && (e.type() != SkaffariError::NoError)) {
+            result.insert(QStringLiteral("error_msg"), e.errorText());
+        }
+
+        Job::finish(job.id(), status, result);
+
+        qCInfo(SK_JOB, "Job worker %i finished job %u with status %u.", m_number, job.id(), static_cast<quint32>(status));
+    }
+
+    /*!
+     * \internal
+     * \brief Stores the progress and returns \c false if processing should be stopped.
+     *
+     * \a stopStatus will be set to the status the job should get if it has been stopped.
+     */
+    bool updateProgress(dbid_t jobId, quint32 progress, quint32 total, Job::Status *stopStatus)
+    {
+        if (isInterruptionRequested()) {
+            *stopStatus = Job::Queued;
+            return false;
+        }
+
+        bool cancelRequested = false;
+        Job::setProgress(jobId, progress, total, &cancelRequested);
+        if (cancelRequested) {
+            *stopStatus = Job::Canceled;
+            return false;
+        }
+
+        return true;
+    }
+
+    Job::Status removeDomain(Cutelyst::Context *c, const Job &job, SkaffariError &e, QJsonObject &result)
+    {
+        Domain dom = Domain::get(c, job.objectId(), e);
+        if (!dom.isValid()) {
+            return Job::Failed;
+        }
+
+        const QVariantHash params = job.params();
+        const dbid_t newParentId = params.value(QStringLiteral("newParentId")).value<dbid_t>();
+        const bool deleteChildren = params.value(QStringLiteral("deleteChildren")).toBool();
+
+        Job::Status stopStatus = Job::Failed;
+        const dbid_t jobId = job.id();
+        const bool removed = dom.remove(c, e, newParentId, deleteChildren, [this, jobId, &stopStatus](quint32 progress, quint32 total) -> bool {
+            return updateProgress(jobId, progress, total, &stopStatus);
+        });
+
+        if (!removed) {
+            return stopStatus;
+        }
+
+        result.insert(QStringLiteral("status_msg"), c->translate("JobQueue", "The domain %1 has been successfully deleted.").arg(dom.name()));
+        result.insert(QStringLiteral("deleted_id"), static_cast<qint64>(dom.id()));
+        result.insert(QStringLiteral("deleted_name"), dom.name());
+
+        return Job::Finished;
+    }
+
+    Job::Status checkDomain(Cutelyst::Context *c, const Job &job, SkaffariError &e, QJsonObject &result)
+    {
+        Domain dom = Domain::get(c, job.objectId(), e);
+        if (!dom.isValid()) {
+            return Job::Failed;
+        }
+
+        // checks all mailboxes at once, so the account checks do not have to
+        const QStringList mailboxActions = dom.checkMailboxes(c, e);
+        if (e.type() != SkaffariError::NoError) {
+            return Job::Failed;
+        }
+        if (!mailboxActions.empty()) {
+            result.insert(QStringLiteral("actions"), QJsonArray::fromStringList(mailboxActions));
+        }
+
+        QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT id FROM accountuser WHERE domain_id = :domain_id ORDER BY id ASC"));
+        q.bindValue(QStringLiteral(":domain_id"), dom.id());
+
+        if (Q_UNLIKELY(!q.exec())) {
+            e.setSqlError(q.lastError(), c->translate("JobQueue", "Failed to query all account IDs for domain %1 from database.").arg(dom.name()));
+            qCCritical(SK_JOB, "Failed to query all account IDs for domain %s from database: %s", qUtf8Printable(dom.name()), qUtf8Printable(q.lastError().text()));
+            return Job::Failed;
+        }
+
+        std::vector<dbid_t> accountIds;
+        if (q.size() > 0) {
+            accountIds.reserve(static_cast<std::size_t>(q.size()));
+        }
+        while (q.next()) {
+            accountIds.push_back(q.value(0).value<dbid_t>());
+        }
+
+        Cutelyst::ParamsMultiMap p;
+        p.insert(QStringLiteral("skipMailboxCheck"), QStringLiteral("1"));
+        if (job.params().value(QStringLiteral("checkChildAddresses")).toBool()) {
+            p.insert(QStringLiteral("checkChildAddresses"), QStringLiteral("1"));
+        }
+
+        const quint32 total = static_cast<quint32>(accountIds.size());
+        quint32 checked = 0;
+        Job::Status stopStatus = Job::Failed;
+        QJsonArray accounts;
+        QElapsedTimer progressTimer;
+        progressTimer.start();
+
+        if (!updateProgress(job.id(), checked, total, &stopStatus)) {
+            return stopStatus;
+        }
+
+        for (dbid_t accountId : accountIds) {
+            SkaffariError accountError(c);
+            Account a = Account::get(c, accountError, accountId);
+            if (a.isValid()) {
+                const QStringList actions = a.check(c, accountError, dom, p);
+                if (!actions.empty() || (accountError.type() != SkaffariError::NoError)) {
+                    QJsonObject account;
+                    account.insert(QStringLiteral("username"), a.username());
+                    if (!actions.empty()) {
+                        account.insert(QStringLiteral("actions"), QJsonArray::fromStringList(actions));
+                    }
+                    if (accountError.type() != SkaffariError::NoError) {
+                        account.insert(QStringLiteral("error_msg"), accountError.errorText());
+                    }
+                    accounts.append(account);
+                }
+            }
+
+            ++checked;
+
+            if (progressTimer.hasExpired(SK_JOB_PROGRESS_INTERVAL)) {
+                if (!updateProgress(job.id(), checked, total, &stopStatus)) {
+                    return stopStatus;
+                }
+                progressTimer.restart();
+            }
+        }
+
+        Job::setProgress(job.id(), checked, total);
+
+        result.insert(QStringLiteral("accounts"), accounts);
+
+        return Job::Finished;
+    }
+
+    Skaffari *m_app = nullptr;
+    int m_number = 0;
+};
+
+QMutex queueMutex;
+std::vector<JobWorker*> workerThreads;
+bool queueStarted = false;
+
+}
+
+void JobQueue::start(Skaffari *app, int workers)
+{
+    QMutexLocker locker(&queueMutex);
+
+    if (queueStarted) {
+        return;
+    }
+    queueStarted = true;
+
+    if (workers <= 0) {
+        qCInfo(SK_JOB, "Processing of background jobs is disabled for this process.");
+        return;
+    }
+
+    for (int i = 0; i < workers; ++i) {
+        auto worker = new JobWorker(app, i + 1);
+        workerThreads.push_back(worker);
+        worker->start(QThread::LowPriority);
+    }
+
+    QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, &JobQueue::stop);
+
+    qCInfo(SK_JOB, "Started %i background job workers.", workers);
+}
+
+void JobQueue::stop()
+{
+    QMutexLocker locker(&queueMutex);
+
+    for (JobWorker *worker : workerThreads) {
+        worker->requestInterruption();
+    }
+
+    for (JobWorker *worker : workerThreads) {
+        worker->wait();
+        delete worker;
+    }
+
+    workerThreads.clear();
+}
@@ -0,0 +1,63 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2018 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JOBQUEUE_H
+#define JOBQUEUE_H
+
+#include <QtGlobal>
+
+class Skaffari;
+
+/*!
+ * \ingroup skaffaricore
+ * \brief Processes the queued \link Job Jobs\endlink in background threads.
+ *
+ * Long running operations like the removal of a domain with thousands of accounts would block
+ * a worker thread of the web server until they are finished or the connection times out. Instead
+ * the controllers add a Job to the \c job database table and return immediately. Every Skaffari
+ * process starts SkaffariConfig::jobWorkers() threads that poll the table for queued jobs and
+ * process them. The worker threads have their own database and IMAP connections.
+ *
+ * While processing, the workers store the progress in the database. Controllers use that to
+ * report the current state and to request the cancellation of a job.
+ */
+class JobQueue
+{
+public:
+    /*!
+     * \brief Starts \a workers threads to process queued jobs for the \a app.
+     *
+     * The threads will only be started on the first call per process, subsequent calls will be ignored.
+     * The threads will be stopped when the application quits.
+     */
+    static void start(Skaffari *app, int workers);
+
+    /*!
+     * \brief Stops all worker threads of the current process.
+     *
+     * Blocks until the jobs that are currently processed reached a point where they can be interrupted.
+     */
+    static void stop();
+
+private:
+    // prevent construction
+    JobQueue();
+    ~JobQueue();
+};
+
+#endif // JOBQUEUE_H
@@ -0,0 +1,209 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2019 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "searchindex.h"
+#include <Cutelyst/Plugins/Utils/Sql>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QSqlDatabase>
+#include <QSet>
+#include <vector>
+
+Q_LOGGING_CATEGORY(SK_SEARCHINDEX, "skaffari.searchindex")
+
+QStringList SearchIndex::trigrams(const QString &str)
+{
+    QStringList ret;
+
+    // the trigram column uses an accent and case insensitive collation like the searched columns,
+    // stripping the diacritics here only prevents storing trigrams that compare equal anyway
+    const QString decomposed = str.normalized(QString::NormalizationForm_D);
+    QString lower;
+    lower.reserve(decomposed.size());
+    for (const QChar &ch : decomposed) {
+        if (ch.category() != QChar::Mark_NonSpacing) {
+            lower.append(ch.toLower());
+        }
+    }
+
+    const int count = lower.size() - 2;
+    if (count <= 0) {
+        return ret;
+    }
+
+    QSet<QString> seen;
+    seen.reserve(count);
+    ret.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const QString tg = lower.mid(i, 3);
+        if (!seen.contains(tg)) {
+            seen.insert(tg);
+            ret.push_back(tg);
+        }
+    }
+
+    return ret;
+}
+
+SearchIndex::Role SearchIndex::roleFromString(const QString &searchRole)
+{
+    if (searchRole == QLatin1String("email")) {
+        return Address;
+    } else if (searchRole == QLatin1String("forward")) {
+        return Forward;
+    } else {
+        return Username;
+    }
+}
+
+QString SearchIndex::condition(Role role, const QString &searchString, QVariantHash *binds)
+{
+    QString ret;
+
+    const QStringList tgs = SearchIndex::trigrams(searchString);
+    if (tgs.empty()) {
+        return ret;
+    }
+
+    QString placeholders;
+    for (int i = 0; i < tgs.size(); ++i) {
+        const QString ph = QLatin1String(":sk_tg") + QString::number(i);
+        if (i > 0) {
+            placeholders.append(QLatin1String(", "));
+        }
+        placeholders.append(ph);
+        binds->insert(ph, tgs.at(i));
+    }
+    binds->insert(QStringLiteral(":sk_tg_role"), static_cast<quint8>(role));
+    binds->insert(QStringLiteral(":sk_tg_count"), tgs.size());
+
+    // accounts that contain every trigram of the search string
+    ret = QStringLiteral(" AND au.id IN (SELECT ts.account_id FROM account_search ts WHERE ts.domain_id = :domain_id AND ts.role = :sk_tg_role AND ts.trigram IN (%1) GROUP BY ts.account_id HAVING COUNT(*) = :sk_tg_count)").arg(placeholders);
+
+    return ret;
+}
+
+QString SearchIndex::likePattern(const QString &searchString)
+{
+    QString escaped = searchString;
+    escaped.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+    escaped.replace(QLatin1Char('%'), QLatin1String("\\%"));
+    escaped.replace(QLatin1Char('_'), QLatin1String("\\_"));
+    return QLatin1Char('%') + escaped + QLatin1Char('%');
+}
+
+bool SearchIndex::update(dbid_t accountId, QSqlError *error)
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT domain_id, username FROM accountuser WHERE id = :id"));
+    q.bindValue(QStringLiteral(":id"), accountId);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        if (error) {
+            *error = q.lastError();
+        }
+        qCCritical(SK_SEARCHINDEX, "Failed to query account with ID %u to update the search index: %s", accountId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    if (!q.next()) {
+        // deleted accounts are removed from the index by the database
+        return true;
+    }
+
+    const dbid_t domainId = q.value(0).value<dbid_t>();
+    const QString username = q.value(1).toString();
+
+    std::vector<std::pair<Role,QStringList>> entries;
+    entries.emplace_back(Username, SearchIndex::trigrams(username));
+
+    q = CPreparedSqlQueryThread(QStringLiteral("SELECT alias FROM virtual WHERE dest = :username AND username = :username"));
+    q.bindValue(QStringLiteral(":username"), username);
+    if (Q_UNLIKELY(!q.exec())) {
+        if (error) {
+            *error = q.lastError();
+        }
+        qCCritical(SK_SEARCHINDEX, "Failed to query email addresses of account %s to update the search index: %s", qUtf8Printable(username), qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+    while (q.next()) {
+        entries.emplace_back(Address, SearchIndex::trigrams(q.value(0).toString()));
+    }
+
+    q = CPreparedSqlQueryThread(QStringLiteral("SELECT dest FROM virtual WHERE alias = :username AND username = ''"));
+    q.bindValue(QStringLiteral(":username"), username);
+    if (Q_UNLIKELY(!q.exec())) {
+        if (error) {
+            *error = q.lastError();
+        }
+        qCCritical(SK_SEARCHINDEX, "Failed to query forwards of account %s to update the search index: %s", qUtf8Printable(username), qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+    while (q.next()) {
+        entries.emplace_back(Forward, SearchIndex::trigrams(q.value(0).toString()));
+    }
+
+    q = CPreparedSqlQueryThread(QStringLiteral("DELETE FROM account_search WHERE account_id = :id"));
+    q.bindValue(QStringLiteral(":id"), accountId);
+    if (Q_UNLIKELY(!q.exec())) {
+        if (error) {
+            *error = q.lastError();
+        }
+        qCCritical(SK_SEARCHINDEX, "Failed to remove old search index entries of account %s: %s", qUtf8Printable(username), qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    // insert all trigrams with a single statement, duplicates of different addresses are ignored
+    QString values;
+    int rows = 0;
+    for (const std::pair<Role,QStringList> &entry : entries) {
+        rows += entry.second.size();
+    }
+
+    if (rows == 0) {
+        return true;
+    }
+
+    values.reserve(rows * 14);
+    for (int i = 0; i < rows; ++i) {
+        if (i > 0) {
+            values.append(QLatin1String(", "));
+        }
+        values.append(QLatin1String("(?, ?, ?, ?)"));
+    }
+
+    QSqlQuery iq(QSqlDatabase::database(Cutelyst::Sql::databaseNameThread()));
+    iq.prepare(QLatin1String("INSERT IGNORE INTO account_search (account_id, domain_id, role, trigram) VALUES ") + values);
+    for (const std::pair<Role,QStringList> &entry : entries) {
+        for (const QString &tg : entry.second) {
+            iq.addBindValue(accountId);
+            iq.addBindValue(domainId);
+            iq.addBindValue(static_cast<quint8>(entry.first));
+            iq.addBindValue(tg);
+        }
+    }
+
+    if (Q_UNLIKELY(!iq.exec())) {
+        if (error) {
+            *error = iq.lastError();
+        }
+        qCCritical(SK_SEARCHINDEX, "Failed to insert search index entries of account %s: %s", qUtf8Printable(username), qUtf8Printable(iq.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
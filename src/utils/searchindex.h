@@ -0,0 +1,99 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2019 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include "../../common/global.h"
+#include <QStringList>
+#include <QVariantHash>
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(SK_SEARCHINDEX)
+
+class QSqlError;
+
+/*!
+ * \ingroup skaffaricore
+ * \brief Trigram index for substring searches in the account list.
+ *
+ * Searching for a substring with <code>LIKE '%term%'</code> can not use any database index and
+ * has to scan the complete accountuser or virtual table. So the trigrams of the user names, email
+ * addresses and forwards of every account are stored in the account_search table. A search for a
+ * term with at least three characters first selects the accounts that contain all trigrams of the
+ * term through the primary key of that table. Only these candidates are then checked with the
+ * original LIKE condition to remove false positives.
+ *
+ * Like the LIKE condition on the utf8_unicode_ci columns, the search is case and accent insensitive.
+ * The trigrams use the same collation, so trigrams created by the database from the original values,
+ * like in Database::rebuildSearchIndex() of skaffaricmd, match the normalized trigrams().
+ *
+ * The index has to be updated with update() whenever the user name, the email addresses or the
+ * forwards of an account change. Rows of deleted accounts are removed by a foreign key constraint.
+ */
+class SearchIndex
+{
+public:
+    /*!
+     * \brief The account data a trigram has been created from.
+     */
+    enum Role : quint8 {
+        Username    = 0,    /**< the user name of the account */
+        Address     = 1,    /**< an email address of the account */
+        Forward     = 2     /**< a forward of the account */
+    };
+
+    /*!
+     * \brief Returns the unique lower case trigrams of \a str.
+     *
+     * Diacritics are removed, so \c "Jürgen" has the same trigrams as \c "jurgen". Strings with
+     * less than three characters do not have any trigram.
+     */
+    static QStringList trigrams(const QString &str);
+
+    /*!
+     * \brief Returns the search role for the \a searchRole name used in the account list filter.
+     *
+     * Valid names are \c username, \c email and \c forward. Unknown names return Username.
+     */
+    static Role roleFromString(const QString &searchRole);
+
+    /*!
+     * \brief Returns an SQL condition to restrict the account list to the accounts that might contain \a searchString.
+     *
+     * The returned condition starts with <code> AND</code> and refers to the accountuser table by the alias \c au
+     * and to the domain ID by the placeholder <code>:domain_id</code>.
+     * Values for the placeholders used in the condition will be added to \a binds. If \a searchString is too short
+     * to have trigrams, an empty string is returned and the caller has to fall back to a full scan.
+     */
+    static QString condition(Role role, const QString &searchString, QVariantHash *binds);
+
+    /*!
+     * \brief Escapes the wildcard characters of \a searchString and encloses it in wildcards for a LIKE substring match.
+     */
+    static QString likePattern(const QString &searchString);
+
+    /*!
+     * \brief Rebuilds all index entries of the account identified by \a accountId from the database.
+     *
+     * Returns \c false on database errors and sets \a error if it is not a \c nullptr.
+     */
+    static bool update(dbid_t accountId, QSqlError *error = nullptr);
+};
+
+#endif // SEARCHINDEX_H
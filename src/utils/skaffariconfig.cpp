@@ -17,28 +17,40 @@
  */
 
 #include "skaffariconfig.h"
+#include "autoconfigcache.h"
 #include "../common/config.h"
 #include <Cutelyst/Plugins/Utils/Sql>
-#include <Cutelyst/Plugins/Memcached/Memcached>
+#include <Cutelyst/Engine>
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QGlobalStatic>
-#include <QReadWriteLock>
-#include <QReadLocker>
-#include <QWriteLocker>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QFileInfo>
+#include <memory>
+#include <atomic>
+#include <csignal>
 #ifdef CUTELYST_VALIDATOR_WITH_PWQUALITY
 #include <pwquality.h>
 #endif
 
-#define MEMC_CONFIG_GROUP_KEY "options"
-#define MEMC_CONFIG_STORAGE_DURATION 7200
+#define SK_CONF_KEY_OPTIONS_VERSION "options_version"
+#define SK_CONF_KEY_CONFIG_VERSION "config_version"
+#define SK_CONF_OPTIONS_CHECK_INTERVAL 1000
 
 Q_LOGGING_CATEGORY(SK_CONFIG, "skaffari.config")
 
+/*!
+ * \internal
+ * \brief Immutable snapshot of the settings read from the configuration files.
+ *
+ * Snapshots are never changed after they have been published. Changes create a copy
+ * that replaces the current snapshot atomically, so readers do not need any lock.
+ */
 struct ConfigValues
 {
-    mutable QReadWriteLock lock{QReadWriteLock::Recursive};
-
     Password::Method accPwMethod = static_cast<Password::Method>(SK_DEF_ACC_PWMETHOD);
     Password::Algorithm accPwAlgorithm = static_cast<Password::Algorithm>(SK_DEF_ACC_PWALGORITHM);
     quint32 accPwRounds = SK_DEF_ACC_PWROUNDS;
@@ -46,7 +58,7 @@ struct ConfigValues
     QString accPwSettingsFile;
     int accPwThreshold = SK_DEF_ACC_PWTHRESHOLD;
 #else
-    quint8 SkaffariConfig::m_accPwMinlength = SK_DEF_ACC_PWMINLENGTH;
+    quint8 accPwMinlength = SK_DEF_ACC_PWMINLENGTH;
 #endif
 
     QCryptographicHash::Algorithm admPwAlgorithm = static_cast<QCryptographicHash::Algorithm>(SK_DEF_ADM_PWALGORITHM);
@@ -55,7 +67,7 @@ struct ConfigValues
     QString admPwSettingsFile;
     int admPwThreshold = SK_DEF_ADM_PWTHRESHOLD;
 #else
-    quint8 SkaffariConfig::m_admPwMinlength = SK_DEF_ADM_PWMINLENGTH;
+    quint8 admPwMinlength = SK_DEF_ADM_PWMINLENGTH;
 #endif
 
     QString imapHost;
@@ -70,6 +82,7 @@ struct ConfigValues
     bool imapUnixhierarchysep = SK_DEF_IMAP_UNIXHIERARCHYSEP;
     bool imapDomainasprefix = SK_DEF_IMAP_DOMAINASPREFIX;
     bool imapFqun = SK_DEF_IMAP_FQUN;
+    quint32 imapPoolmaxidle = SK_DEF_IMAP_POOLMAXIDLE;
 
     QString tmpl = QStringLiteral("default");
     QString tmplBasePath = QStringLiteral(SKAFFARI_TMPLDIR) + QLatin1String("/default");
@@ -77,56 +90,366 @@ struct ConfigValues
 
     bool useMemcached = false;
     bool useMemcachedSession = false;
+    quint8 jobWorkers = SK_DEF_JOBWORKERS;
+    quint32 autoconfigRatelimit = SK_DEF_AUTOCONFIG_RATELIMIT;
+    QList<QHostAddress> trustedProxies;
+
+    quint64 generation = 0;
 };
-Q_GLOBAL_STATIC(ConfigValues, cfg)
 
-void SkaffariConfig::load(const QVariantMap &general, const QVariantMap &accounts, const QVariantMap &admins, const QVariantMap &imap, const QVariantMap &tmpl)
+struct ConfigHolder
+{
+    std::shared_ptr<const ConfigValues> current{std::make_shared<const ConfigValues>()};
+};
+Q_GLOBAL_STATIC(ConfigHolder, cfgHolder)
+
+/*!
+ * \internal
+ * \brief Immutable snapshot of the database options table.
+ */
+struct DbOptionsValues
+{
+    QVariantHash options;
+    QHash<QString,SimpleAccount> accounts;
+    qlonglong version = -1;
+};
+
+/*!
+ * \internal
+ * \brief Holds the snapshot of the database options table shared by all threads of a process.
+ *
+ * Every change to the options table increments the value of the options_version row.
+ * The version is compared with the database at most once per SK_CONF_OPTIONS_CHECK_INTERVAL
+ * milliseconds by the thread that gets the refresh lock, other threads keep reading the
+ * current snapshot. If the version has changed, the complete table is loaded into a new
+ * snapshot that replaces the current one atomically.
+ */
+struct DbOptions
+{
+    DbOptions()
+    {
+        timer.start();
+    }
+
+    QMutex refreshMutex;
+    std::shared_ptr<const DbOptionsValues> current{std::make_shared<const DbOptionsValues>()};
+    QElapsedTimer timer;
+    std::atomic<qint64> nextCheck{0};
+    std::atomic<qlonglong> configVersion{-1};
+};
+Q_GLOBAL_STATIC(DbOptions, dbOpts)
+
+namespace {
+
+volatile std::sig_atomic_t reloadRequested = 0;
+
+std::atomic<quint64> lastGeneration{0};
+
+/*!
+ * \internal
+ * \brief Returns the current configuration snapshot.
+ */
+std::shared_ptr<const ConfigValues> cfg()
 {
-    QWriteLocker locker(&cfg->lock);
+    return std::atomic_load(&cfgHolder->current);
+}
 
-    cfg->tmpl = general.value(QStringLiteral("template"), QStringLiteral("default")).toString();
-    cfg->useMemcached = general.value(QStringLiteral("usememcached"), false).toBool();
-    cfg->useMemcachedSession = general.value(QStringLiteral("usememcachedsession"), false).toBool();
+/*!
+ * \internal
+ * \brief Returns the path of the configuration file used to reload the configuration.
+ *
+ * Can be set with the SKAFFARI_INI_FILE environment variable, defaults to the path set at build time.
+ */
+QString iniFile()
+{
+    const QString envFile = QString::fromLocal8Bit(qgetenv("SKAFFARI_INI_FILE"));
+    return envFile.isEmpty() ? QStringLiteral(SKAFFARI_INI_FILE) : envFile;
+}
 
-    cfg->accPwMethod = static_cast<Password::Method>(accounts.value(QStringLiteral("pwmethod"), SK_DEF_ACC_PWMETHOD).value<quint8>());
-    cfg->accPwAlgorithm = static_cast<Password::Algorithm>(accounts.value(QStringLiteral("pwalgorithm"), SK_DEF_ACC_PWALGORITHM).value<quint8>());
-    cfg->accPwRounds = accounts.value(QStringLiteral("pwrounds"), SK_DEF_ACC_PWROUNDS).value<quint32>();
+/*!
+ * \internal
+ * \brief Publishes \a values as the new configuration snapshot.
+ */
+void publish(const std::shared_ptr<const ConfigValues> &values)
+{
+    std::atomic_store(&cfgHolder->current, values);
+}
+
+/*!
+ * \internal
+ * \brief Sets the values from the \a Accounts, \a Admins and \a IMAP sections of the configuration file.
+ */
+void applyFileConfig(ConfigValues *v, const QVariantMap &accounts, const QVariantMap &admins, const QVariantMap &imap)
+{
+    v->accPwMethod = static_cast<Password::Method>(accounts.value(QStringLiteral("pwmethod"), SK_DEF_ACC_PWMETHOD).value<quint8>());
+    v->accPwAlgorithm = static_cast<Password::Algorithm>(accounts.value(QStringLiteral("pwalgorithm"), SK_DEF_ACC_PWALGORITHM).value<quint8>());
+    v->accPwRounds = accounts.value(QStringLiteral("pwrounds"), SK_DEF_ACC_PWROUNDS).value<quint32>();
 #ifdef CUTELYST_VALIDATOR_WITH_PWQUALITY
-    cfg->accPwSettingsFile = accounts.value(QStringLiteral("pwsettingsfile")).toString();
-    cfg->accPwThreshold = accounts.value(QStringLiteral("pwthreshold"), SK_DEF_ACC_PWTHRESHOLD).toInt();
+    v->accPwSettingsFile = accounts.value(QStringLiteral("pwsettingsfile")).toString();
+    v->accPwThreshold = accounts.value(QStringLiteral("pwthreshold"), SK_DEF_ACC_PWTHRESHOLD).toInt();
 #else
-    cfg->accPwMinlength = accounts.value(QStringLiteral("pwminlength"), SK_DEF_ACC_PWMINLENGTH).value<quint8>();
+    v->accPwMinlength = accounts.value(QStringLiteral("pwminlength"), SK_DEF_ACC_PWMINLENGTH).value<quint8>();
 #endif
 
-    cfg->admPwAlgorithm = static_cast<QCryptographicHash::Algorithm>(admins.value(QStringLiteral("pwalgorithm"), SK_DEF_ADM_PWALGORITHM).value<quint8>());
-    cfg->admPwRounds = admins.value(QStringLiteral("pwrounds"), SK_DEF_ADM_PWROUNDS).value<quint32>();
+    v->admPwAlgorithm = static_cast<QCryptographicHash::Algorithm>(admins.value(QStringLiteral("pwalgorithm"), SK_DEF_ADM_PWALGORITHM).value<quint8>());
+    v->admPwRounds = admins.value(QStringLiteral("pwrounds"), SK_DEF_ADM_PWROUNDS).value<quint32>();
 #ifdef CUTELYST_VALIDATOR_WITH_PWQUALITY
-    cfg->admPwSettingsFile = admins.value(QStringLiteral("pwsettingsfile")).toString();
-    cfg->admPwThreshold = admins.value(QStringLiteral("pwthreshold"), SK_DEF_ADM_PWTHRESHOLD).toInt();
+    v->admPwSettingsFile = admins.value(QStringLiteral("pwsettingsfile")).toString();
+    v->admPwThreshold = admins.value(QStringLiteral("pwthreshold"), SK_DEF_ADM_PWTHRESHOLD).toInt();
 #else
-    cfg->admPwMinlength = admins.value(QStringLiteral("pwminlength"), SK_DEF_ADM_PWMINLENGTH).value<quint8>();
+    v->admPwMinlength = admins.value(QStringLiteral("pwminlength"), SK_DEF_ADM_PWMINLENGTH).value<quint8>();
 #endif
 
-    cfg->imapHost = imap.value(QStringLiteral("host")).toString();
-    cfg->imapUser = imap.value(QStringLiteral("user")).toString();
-    cfg->imapPassword = imap.value(QStringLiteral("password")).toString();
-    cfg->imapPeername = imap.value(QStringLiteral("peername")).toString();
-    cfg->imapPort = imap.value(QStringLiteral("port"), 143).value<quint16>();
-    cfg->imapProtocol = static_cast<QAbstractSocket::NetworkLayerProtocol>(imap.value(QStringLiteral("protocol"), SK_DEF_IMAP_PROTOCOL).value<quint8>());
-    cfg->imapEncryption = static_cast<SkaffariIMAP::EncryptionType>(imap.value(QStringLiteral("encryption"), SK_DEF_IMAP_ENCRYPTION).value<quint8>());
-    cfg->imapCreatemailbox = static_cast<Account::CreateMailbox>(imap.value(QStringLiteral("createmailbox"), SK_DEF_IMAP_CREATEMAILBOX).value<quint8>());
-    cfg->imapUnixhierarchysep = imap.value(QStringLiteral("unixhierarchysep"), SK_DEF_IMAP_UNIXHIERARCHYSEP).toBool();
-    cfg->imapDomainasprefix = imap.value(QStringLiteral("domainasprefix"), SK_DEF_IMAP_DOMAINASPREFIX).toBool();
-    cfg->imapFqun = imap.value(QStringLiteral("fqun"), SK_DEF_IMAP_FQUN).toBool();
-    cfg->imapAuthMech = static_cast<SkaffariIMAP::AuthMech>(imap.value(QStringLiteral("authmech"), SK_DEF_IMAP_AUTHMECH).value<quint8>());
-
-    cfg->tmplAsyncAccountList = tmpl.value(QStringLiteral("asyncaccountlist"), SK_DEF_TMPL_ASYNCACCOUNTLIST).toBool();
+    v->imapHost = imap.value(QStringLiteral("host")).toString();
+    v->imapUser = imap.value(QStringLiteral("user")).toString();
+    v->imapPassword = imap.value(QStringLiteral("password")).toString();
+    v->imapPeername = imap.value(QStringLiteral("peername")).toString();
+    v->imapPort = imap.value(QStringLiteral("port"), 143).value<quint16>();
+    v->imapProtocol = static_cast<QAbstractSocket::NetworkLayerProtocol>(imap.value(QStringLiteral("protocol"), SK_DEF_IMAP_PROTOCOL).value<quint8>());
+    v->imapEncryption = static_cast<SkaffariIMAP::EncryptionType>(imap.value(QStringLiteral("encryption"), SK_DEF_IMAP_ENCRYPTION).value<quint8>());
+    v->imapCreatemailbox = static_cast<Account::CreateMailbox>(imap.value(QStringLiteral("createmailbox"), SK_DEF_IMAP_CREATEMAILBOX).value<quint8>());
+    v->imapUnixhierarchysep = imap.value(QStringLiteral("unixhierarchysep"), SK_DEF_IMAP_UNIXHIERARCHYSEP).toBool();
+    v->imapDomainasprefix = imap.value(QStringLiteral("domainasprefix"), SK_DEF_IMAP_DOMAINASPREFIX).toBool();
+    v->imapFqun = imap.value(QStringLiteral("fqun"), SK_DEF_IMAP_FQUN).toBool();
+    v->imapAuthMech = static_cast<SkaffariIMAP::AuthMech>(imap.value(QStringLiteral("authmech"), SK_DEF_IMAP_AUTHMECH).value<quint8>());
+    v->imapPoolmaxidle = imap.value(QStringLiteral("poolmaxidle"), SK_DEF_IMAP_POOLMAXIDLE).value<quint32>();
 }
 
-void SkaffariConfig::setDefaultsSettings(const QVariantHash &options)
+/*!
+ * \internal
+ * \brief Reloads the options snapshot if the version in the database has changed.
+ *
+ * Has to be called with locked dbOpts->refreshMutex.
+ */
+void refreshDbOptions()
 {
-    QWriteLocker locker(&cfg->lock);
+    // another thread might have refreshed the snapshot while this one was waiting for the lock
+    const qint64 now = dbOpts->timer.elapsed();
+    if (dbOpts->nextCheck.load() > now) {
+        return;
+    }
+
+    // do not query the database on every call if it is not available
+    dbOpts->nextCheck.store(now + SK_CONF_OPTIONS_CHECK_INTERVAL);
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT option_value FROM options WHERE option_name = :option_name"));
+    q.bindValue(QStringLiteral(":option_name"), QStringLiteral(SK_CONF_KEY_OPTIONS_VERSION));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCCritical(SK_CONFIG, "Failed to query version of the options from database: %s", qUtf8Printable(q.lastError().text()));
+        return;
+    }
 
+    const qlonglong version = q.next() ? q.value(0).toLongLong() : 0;
+    if (version == std::atomic_load(&dbOpts->current)->version) {
+        return;
+    }
+
+    // changes after the version query will be loaded on the next check
+    q = CPreparedSqlQueryThread(QStringLiteral("SELECT option_name, option_value FROM options"));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCCritical(SK_CONFIG, "Failed to query options from database: %s", qUtf8Printable(q.lastError().text()));
+        return;
+    }
+
+    QVariantHash options;
+    while (q.next()) {
+        options.insert(q.value(0).toString(), q.value(1));
+    }
+
+    q = CPreparedSqlQueryThread(QStringLiteral("SELECT op.option_name, a.id, a.username, d.domain_name FROM options op JOIN accountuser a ON a.id = op.option_value LEFT JOIN domain d ON a.domain_id = d.id WHERE op.option_name IN (:abuse, :noc, :security, :postmaster, :hostmaster, :webmaster)"));
+    q.bindValue(QStringLiteral(":abuse"), QStringLiteral(SK_CONF_KEY_DEF_ABUSE_ACC));
+    q.bindValue(QStringLiteral(":noc"), QStringLiteral(SK_CONF_KEY_DEF_NOC_ACC));
+    q.bindValue(QStringLiteral(":security"), QStringLiteral(SK_CONF_KEY_DEF_SECURITY_ACC));
+    q.bindValue(QStringLiteral(":postmaster"), QStringLiteral(SK_CONF_KEY_DEF_POSTMASTER_ACC));
+    q.bindValue(QStringLiteral(":hostmaster"), QStringLiteral(SK_CONF_KEY_DEF_HOSTMASTER_ACC));
+    q.bindValue(QStringLiteral(":webmaster"), QStringLiteral(SK_CONF_KEY_DEF_WEBMASTER_ACC));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCCritical(SK_CONFIG, "Failed to query default accounts from database: %s", qUtf8Printable(q.lastError().text()));
+        return;
+    }
+
+    QHash<QString,SimpleAccount> accounts;
+    while (q.next()) {
+        accounts.insert(q.value(0).toString(), SimpleAccount(q.value(1).value<dbid_t>(), q.value(2).toString(), q.value(3).toString()));
+    }
+
+    std::shared_ptr<DbOptionsValues> values = std::make_shared<DbOptionsValues>();
+    values->options = options;
+    values->accounts = accounts;
+    values->version = version;
+    std::atomic_store(&dbOpts->current, std::shared_ptr<const DbOptionsValues>(values));
+
+    qCDebug(SK_CONFIG, "Loaded version %lli of the options from database.", version);
+}
+
+/*!
+ * \internal
+ * \brief Returns the current snapshot of the database options.
+ *
+ * If the snapshot is due for a check, only the thread that gets the refresh lock queries the
+ * database, all other threads return the current snapshot without waiting. Only before the
+ * options have been loaded the first time, threads wait for the loading thread.
+ */
+std::shared_ptr<const DbOptionsValues> dbOptions()
+{
+    std::shared_ptr<const DbOptionsValues> values = std::atomic_load(&dbOpts->current);
+
+    if (dbOpts->nextCheck.load() <= dbOpts->timer.elapsed()) {
+        if (values->version < 0) {
+            QMutexLocker locker(&dbOpts->refreshMutex);
+            refreshDbOptions();
+            values = std::atomic_load(&dbOpts->current);
+        } else if (dbOpts->refreshMutex.tryLock()) {
+            refreshDbOptions();
+            dbOpts->refreshMutex.unlock();
+            values = std::atomic_load(&dbOpts->current);
+        }
+    }
+
+    return values;
+}
+
+/*!
+ * \internal
+ * \brief Increments the version of the options in the database and invalidates the local snapshot.
+ */
+void increaseDbOptionsVersion()
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("INSERT INTO options (option_name, option_value) "
+                                                         "VALUES (:option_name, '1') "
+                                                         "ON DUPLICATE KEY UPDATE "
+                                                         "option_value = CAST(option_value AS UNSIGNED) + 1"));
+    q.bindValue(QStringLiteral(":option_name"), QStringLiteral(SK_CONF_KEY_OPTIONS_VERSION));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCCritical(SK_CONFIG, "Failed to increase version of the options in database: %s", qUtf8Printable(q.lastError().text()));
+    }
+
+    // the next reader will compare the snapshot with the incremented version
+    dbOpts->nextCheck.store(0);
+}
+
+}
+
+void SkaffariConfig::load(const QVariantMap &general, const QVariantMap &accounts, const QVariantMap &admins, const QVariantMap &imap, const QVariantMap &tmpl)
+{
+    std::shared_ptr<ConfigValues> values = std::make_shared<ConfigValues>(*cfg());
+
+    values->tmpl = general.value(QStringLiteral("template"), QStringLiteral("default")).toString();
+    values->useMemcached = general.value(QStringLiteral("usememcached"), false).toBool();
+    values->useMemcachedSession = general.value(QStringLiteral("usememcachedsession"), false).toBool();
+    values->jobWorkers = general.value(QStringLiteral("jobworkers"), SK_DEF_JOBWORKERS).value<quint8>();
+    values->autoconfigRatelimit = general.value(QStringLiteral("autoconfigratelimit"), SK_DEF_AUTOCONFIG_RATELIMIT).value<quint32>();
+
+    // QSettings already splits comma separated values into a list
+    values->trustedProxies.clear();
+    const QStringList proxies = general.value(QStringLiteral("trustedproxies")).toStringList();
+    for (const QString &proxy : proxies) {
+        const QStringList parts = proxy.split(QLatin1Char(','), QString::SkipEmptyParts);
+        for (const QString &part : parts) {
+            const QHostAddress address(part.trimmed());
+            if (Q_LIKELY(!address.isNull())) {
+                values->trustedProxies.append(address);
+            } else {
+                qCWarning(SK_CONFIG, "Ignoring invalid trusted proxy address \"%s\".", qUtf8Printable(part.trimmed()));
+            }
+        }
+    }
+
+    applyFileConfig(values.get(), accounts, admins, imap);
+
+    values->tmplAsyncAccountList = tmpl.value(QStringLiteral("asyncaccountlist"), SK_DEF_TMPL_ASYNCACCOUNTLIST).toBool();
+
+    publish(values);
+}
+
+bool SkaffariConfig::reload()
+{
+    const QString file = iniFile();
+    if (!QFileInfo(file).isReadable()) {
+        qCCritical(SK_CONFIG, "Failed to reload configuration: can not read %s.", qUtf8Printable(file));
+        return false;
+    }
+
+    const QVariantMap ini = Cutelyst::Engine::loadIniConfig(file);
+
+    const QVariantMap imap = ini.value(QStringLiteral("IMAP")).toMap();
+    if (imap.value(QStringLiteral("user")).toString().isEmpty() || imap.value(QStringLiteral("password")).toString().isEmpty()) {
+        qCCritical(SK_CONFIG, "Failed to reload configuration: no valid IMAP user and password defined in %s.", qUtf8Printable(file));
+        return false;
+    }
+
+    // template, memcached and job worker settings are used to set up plugins at startup
+    std::shared_ptr<ConfigValues> values = std::make_shared<ConfigValues>(*cfg());
+    applyFileConfig(values.get(), ini.value(QStringLiteral("Accounts")).toMap(), ini.value(QStringLiteral("Admins")).toMap(), imap);
+    values->generation = ++lastGeneration;
+    publish(values);
+
+    qCInfo(SK_CONFIG, "Reloaded configuration from %s.", qUtf8Printable(file));
+
+    return true;
+}
+
+void SkaffariConfig::requestReload()
+{
+    reloadRequested = 1;
+}
+
+void SkaffariConfig::reloadIfRequested()
+{
+    bool doReload = false;
+
+    if (reloadRequested) {
+        reloadRequested = 0;
+        doReload = true;
+    }
+
+    const std::shared_ptr<const DbOptionsValues> opts = dbOptions();
+    if (opts->version > -1) {
+        const qlonglong version = opts->options.value(QStringLiteral(SK_CONF_KEY_CONFIG_VERSION), 0).toLongLong();
+        qlonglong known = dbOpts->configVersion.load();
+        // only the thread that records the changed version reloads the configuration
+        if ((version != known) && dbOpts->configVersion.compare_exchange_strong(known, version)) {
+            // the first recorded version is the one that was current at startup
+            if (known > -1) {
+                doReload = true;
+            }
+        }
+    }
+
+    if (doReload) {
+        SkaffariConfig::reload();
+    }
+}
+
+bool SkaffariConfig::reloadAll()
+{
+    if (!SkaffariConfig::reload()) {
+        return false;
+    }
+
+    // other processes reload on their next check of the options version
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("INSERT INTO options (option_name, option_value) "
+                                                         "VALUES (:option_name, '1') "
+                                                         "ON DUPLICATE KEY UPDATE "
+                                                         "option_value = CAST(option_value AS UNSIGNED) + 1"));
+    q.bindValue(QStringLiteral(":option_name"), QStringLiteral(SK_CONF_KEY_CONFIG_VERSION));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCCritical(SK_CONFIG, "Failed to increase version of the configuration in database: %s", qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    increaseDbOptionsVersion();
+
+    return true;
+}
+
+void SkaffariConfig::setDefaultsSettings(const QVariantHash &options)
+{
     setDbOption<quota_size_t>(QStringLiteral(SK_CONF_KEY_DEF_DOMAINQUOTA), options.value(QStringLiteral(SK_CONF_KEY_DEF_DOMAINQUOTA), static_cast<quota_size_t>(SK_DEF_DEF_DOMAINQUOTA)).value<quota_size_t>());
     setDbOption<quota_size_t>(QStringLiteral(SK_CONF_KEY_DEF_QUOTA), options.value(QStringLiteral(SK_CONF_KEY_DEF_QUOTA), static_cast<quota_size_t>(SK_DEF_DEF_QUOTA)).value<quota_size_t>());
     setDbOption<quint32>(QStringLiteral(SK_CONF_KEY_DEF_MAXACCOUNTS), options.value(QStringLiteral(SK_CONF_KEY_DEF_MAXACCOUNTS), static_cast<quota_size_t>(SK_DEF_DEF_MAXACCOUNTS)).value<quint32>());
@@ -152,7 +475,6 @@ void SkaffariConfig::setDefaultsSettings(const QVariantHash &options)
 
 QVariantHash SkaffariConfig::getDefaultsSettings()
 {
-    QReadLocker locker(&cfg->lock);
     QVariantHash s;
     s.reserve(19);
 
@@ -183,17 +505,15 @@ QVariantHash SkaffariConfig::getDefaultsSettings()
 
 void SkaffariConfig::setAutoconfigSettings(const QVariantHash &options)
 {
-    QWriteLocker locker(&cfg->lock);
-
     setDbOption<bool>(QStringLiteral(SK_CONF_KEY_AUTOCONF_ENABLED), options.value(QStringLiteral(SK_CONF_KEY_AUTOCONF_ENABLED)).toBool());
     setDbOption<QString>(QStringLiteral(SK_CONF_KEY_AUTOCONF_ID), options.value(QStringLiteral(SK_CONF_KEY_AUTOCONF_ID)).toString());
     setDbOption<QString>(QStringLiteral(SK_CONF_KEY_AUTOCONF_DISPLAY), options.value(QStringLiteral(SK_CONF_KEY_AUTOCONF_DISPLAY)).toString());
     setDbOption<QString>(QStringLiteral(SK_CONF_KEY_AUTOCONF_DISPLAY_SHORT), options.value(QStringLiteral(SK_CONF_KEY_AUTOCONF_DISPLAY_SHORT)).toString());
+    AutoconfigCache::clear();
 }
 
 QVariantHash SkaffariConfig::getAutoconfigSettings()
 {
-    QReadLocker locker(&cfg->lock);
     QVariantHash s;
     s.reserve(4);
 
@@ -205,33 +525,39 @@ QVariantHash SkaffariConfig::getAutoconfigSettings()
     return s;
 }
 
-QString SkaffariConfig::tmpl() { QReadLocker locker(&cfg->lock); return cfg->tmpl; }
-QString SkaffariConfig::tmplBasePath() { QReadLocker locker(&cfg->lock); return cfg->tmplBasePath; }
+QString SkaffariConfig::tmpl() { return cfg()->tmpl; }
+QString SkaffariConfig::tmplBasePath() { return cfg()->tmplBasePath; }
 QString SkaffariConfig::tmplPath(const QString &pathpart)
 {
-    QReadLocker locker(&cfg->lock);
     return tmplBasePath() + QLatin1Char('/') + pathpart;
 }
 QString SkaffariConfig::tmplPath(const QStringList &pathparts)
 {
-    QReadLocker locker(&cfg->lock);
     return tmplBasePath() + QLatin1Char('/') + pathparts.join(QLatin1Char('/'));
 }
-void SkaffariConfig::setTmplBasePath(const QString &path) { QWriteLocker locker(&cfg->lock); cfg->tmplBasePath = path; }
-bool SkaffariConfig::useMemcached() { QReadLocker locker(&cfg->lock); return cfg->useMemcached; }
-bool SkaffariConfig::useMemcachedSession() { QReadLocker locker(&cfg->lock); return cfg->useMemcachedSession; }
-
-Password::Method SkaffariConfig::accPwMethod() { QReadLocker locker(&cfg->lock); return cfg->accPwMethod; }
-Password::Algorithm SkaffariConfig::accPwAlgorithm() { QReadLocker locker(&cfg->lock); return cfg->accPwAlgorithm; }
-quint32 SkaffariConfig::accPwRounds() { QReadLocker locker(&cfg->lock); return cfg->accPwRounds; }
+void SkaffariConfig::setTmplBasePath(const QString &path)
+{
+    std::shared_ptr<ConfigValues> values = std::make_shared<ConfigValues>(*cfg());
+    values->tmplBasePath = path;
+    publish(values);
+}
+bool SkaffariConfig::useMemcached() { return cfg()->useMemcached; }
+bool SkaffariConfig::useMemcachedSession() { return cfg()->useMemcachedSession; }
+quint8 SkaffariConfig::jobWorkers() { return cfg()->jobWorkers; }
+quint32 SkaffariConfig::autoconfigRatelimit() { return cfg()->autoconfigRatelimit; }
+QList<QHostAddress> SkaffariConfig::trustedProxies() { return cfg()->trustedProxies; }
+
+Password::Method SkaffariConfig::accPwMethod() { return cfg()->accPwMethod; }
+Password::Algorithm SkaffariConfig::accPwAlgorithm() { return cfg()->accPwAlgorithm; }
+quint32 SkaffariConfig::accPwRounds() { return cfg()->accPwRounds; }
 quint8 SkaffariConfig::accPwMinlength()
 {
-    QReadLocker locker(&cfg->lock);
 #ifdef CUTELYST_VALIDATOR_WITH_PWQUALITY
+    const QString settingsFile = cfg()->accPwSettingsFile;
     pwquality_settings_t *pwq;
     pwq = pwquality_default_settings();
-    if (!cfg->accPwSettingsFile.isEmpty()) {
-        if (pwquality_read_config(pwq, cfg->accPwSettingsFile.toUtf8().constData(), nullptr) != 0) {
+    if (!settingsFile.isEmpty()) {
+        if (pwquality_read_config(pwq, settingsFile.toUtf8().constData(), nullptr) != 0) {
             pwquality_read_config(pwq, nullptr, nullptr);
         }
     } else {
@@ -244,24 +570,24 @@ quint8 SkaffariConfig::accPwMinlength()
     pwquality_free_settings(pwq);
     return static_cast<quint8>(minLen);
 #else
-    return cfg->accPwMinlength;
+    return cfg()->accPwMinlength;
 #endif
 }
 #ifdef CUTELYST_VALIDATOR_WITH_PWQUALITY
-QString SkaffariConfig::accPwSettingsFile() { QReadLocker locker(&cfg->lock); return cfg->accPwSettingsFile; }
-int SkaffariConfig::accPwThreshold() { QReadLocker locker(&cfg->lock); return cfg->accPwThreshold; }
+QString SkaffariConfig::accPwSettingsFile() { return cfg()->accPwSettingsFile; }
+int SkaffariConfig::accPwThreshold() { return cfg()->accPwThreshold; }
 #endif
 
-QCryptographicHash::Algorithm SkaffariConfig::admPwAlgorithm() { QReadLocker locker(&cfg->lock); return cfg->admPwAlgorithm; }
-quint32 SkaffariConfig::admPwRounds() { QReadLocker locker(&cfg->lock); return cfg->admPwRounds; }
+QCryptographicHash::Algorithm SkaffariConfig::admPwAlgorithm() { return cfg()->admPwAlgorithm; }
+quint32 SkaffariConfig::admPwRounds() { return cfg()->admPwRounds; }
 quint8 SkaffariConfig::admPwMinlength()
 {
-    QReadLocker locker(&cfg->lock);
 #ifdef CUTELYST_VALIDATOR_WITH_PWQUALITY
+    const QString settingsFile = cfg()->admPwSettingsFile;
     pwquality_settings_t *pwq;
     pwq = pwquality_default_settings();
-    if (!cfg->admPwSettingsFile.isEmpty()) {
-        if (pwquality_read_config(pwq, cfg->admPwSettingsFile.toUtf8().constData(), nullptr) != 0) {
+    if (!settingsFile.isEmpty()) {
+        if (pwquality_read_config(pwq, settingsFile.toUtf8().constData(), nullptr) != 0) {
             pwquality_read_config(pwq, nullptr, nullptr);
         }
     } else {
@@ -274,87 +600,73 @@ quint8 SkaffariConfig::admPwMinlength()
     pwquality_free_settings(pwq);
     return static_cast<quint8>(minLen);
 #else
-    return cfg->admPwMinlength;
+    return cfg()->admPwMinlength;
 #endif
 }
 #ifdef CUTELYST_VALIDATOR_WITH_PWQUALITY
-QString SkaffariConfig::admPwSettingsFile() { QReadLocker locker(&cfg->lock); return cfg->admPwSettingsFile; }
-int SkaffariConfig::admPwThreshold() { QReadLocker locker(&cfg->lock); return cfg->admPwThreshold; }
+QString SkaffariConfig::admPwSettingsFile() { return cfg()->admPwSettingsFile; }
+int SkaffariConfig::admPwThreshold() { return cfg()->admPwThreshold; }
 #endif
 
-quota_size_t SkaffariConfig::defDomainquota() { QReadLocker locker(&cfg->lock); return getDbOption<quota_size_t>(QStringLiteral(SK_CONF_KEY_DEF_DOMAINQUOTA), static_cast<quota_size_t>(SK_DEF_DEF_DOMAINQUOTA)); }
-quota_size_t SkaffariConfig::defQuota() { QReadLocker locker(&cfg->lock); return getDbOption<quota_size_t>(QStringLiteral(SK_CONF_KEY_DEF_QUOTA), static_cast<quota_size_t>(SK_DEF_DEF_QUOTA)); }
-quint32 SkaffariConfig::defMaxaccounts() { QReadLocker locker(&cfg->lock); return getDbOption<quint32>(QStringLiteral(SK_CONF_KEY_DEF_MAXACCOUNTS), static_cast<quint32>(SK_DEF_DEF_MAXACCOUNTS)); }
-QString SkaffariConfig::defLanguage() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_LANGUAGE), QStringLiteral(SK_DEF_DEF_LANGUAGE)); }
-QString SkaffariConfig::defTimezone() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_TIMEZONE), QStringLiteral(SK_DEF_DEF_TIMEZONE)); }
-quint8 SkaffariConfig::defMaxdisplay() { QReadLocker locker(&cfg->lock); return static_cast<quint8>(getDbOption<quint32>(QStringLiteral(SK_CONF_KEY_DEF_MAXDISPLAY), static_cast<quint32>(SK_DEF_DEF_MAXDISPLAY))); }
-quint8 SkaffariConfig::defWarnlevel() { QReadLocker locker(&cfg->lock); return static_cast<quint8>(getDbOption<quint32>(QStringLiteral(SK_CONF_KEY_DEF_WARNLEVEL), static_cast<quint32>(SK_DEF_DEF_WARNLEVEL))); }
-
-SimpleAccount SkaffariConfig::defAbuseAccount() { QReadLocker locker(&cfg->lock); return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_ABUSE_ACC)); }
-SimpleAccount SkaffariConfig::defNocAccount() { QReadLocker locker(&cfg->lock); return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_NOC_ACC)); }
-SimpleAccount SkaffariConfig::defSecurityAccount() { QReadLocker locker(&cfg->lock); return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_SECURITY_ACC)); }
-SimpleAccount SkaffariConfig::defPostmasterAccount() { QReadLocker locker(&cfg->lock); return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_POSTMASTER_ACC)); }
-SimpleAccount SkaffariConfig::defHostmasterAccount() { QReadLocker locker(&cfg->lock); return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_HOSTMASTER_ACC)); }
-SimpleAccount SkaffariConfig::defWebmasterAccount() { QReadLocker locker(&cfg->lock);  return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_WEBMASTER_ACC)); }
-
-QString SkaffariConfig::defFolderSent() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_SENT), QString()); }
-QString SkaffariConfig::defFolderDrafts() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_DRAFTS), QString()); }
-QString SkaffariConfig::defFolderTrash() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_TRASH), QString()); }
-QString SkaffariConfig::defFolderJunk() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_JUNK), QString()); }
-QString SkaffariConfig::defFolderArchive() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_ARCHIVE), QString()); }
-QString SkaffariConfig::defFolderOthers() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_OTHERS), QString()); }
-
-QString SkaffariConfig::imapHost() { QReadLocker locker(&cfg->lock); return cfg->imapHost; }
-quint16 SkaffariConfig::imapPort() { QReadLocker locker(&cfg->lock); return cfg->imapPort; }
-QString SkaffariConfig::imapUser() { QReadLocker locker(&cfg->lock); return cfg->imapUser; }
-QString SkaffariConfig::imapPassword() { QReadLocker locker(&cfg->lock);  return cfg->imapPassword; }
-QString SkaffariConfig::imapPeername() { QReadLocker locker(&cfg->lock); return cfg->imapPeername; }
-QAbstractSocket::NetworkLayerProtocol SkaffariConfig::imapProtocol() { QReadLocker locker(&cfg->lock); return cfg->imapProtocol; }
-SkaffariIMAP::EncryptionType SkaffariConfig::imapEncryption() { QReadLocker locker(&cfg->lock); return cfg->imapEncryption; }
-Account::CreateMailbox SkaffariConfig::imapCreatemailbox() { QReadLocker locker(&cfg->lock); return cfg->imapCreatemailbox; }
-bool SkaffariConfig::imapUnixhierarchysep() { QReadLocker locker(&cfg->lock); return cfg->imapUnixhierarchysep; }
-bool SkaffariConfig::imapDomainasprefix() { QReadLocker locker(&cfg->lock); return cfg->imapDomainasprefix;}
-bool SkaffariConfig::imapFqun() { QReadLocker locker(&cfg->lock); return cfg->imapUnixhierarchysep && cfg->imapDomainasprefix && cfg->imapFqun; }
-SkaffariIMAP::AuthMech SkaffariConfig::imapAuthmech() { QReadLocker locker(&cfg->lock); return cfg->imapAuthMech; }
-
-bool SkaffariConfig::autoconfigEnabled() { QReadLocker locker(&cfg->lock); return getDbOption<bool>(QStringLiteral(SK_CONF_KEY_AUTOCONF_ENABLED), false); }
-QString SkaffariConfig::autoconfigId() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_AUTOCONF_ID), QString()); }
-QString SkaffariConfig::autoconfigDisplayName() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_AUTOCONF_DISPLAY), QString()); }
-QString SkaffariConfig::autoconfigDisplayNameShort() { QReadLocker locker(&cfg->lock); return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_AUTOCONF_DISPLAY_SHORT), QString()); }
-
-bool SkaffariConfig::tmplAsyncAccountList() { QReadLocker locker(&cfg->lock); return cfg->tmplAsyncAccountList; }
-
-template< typename T >
-T SkaffariConfig::getDbOption(const QString &option, const T &defVal)
+quota_size_t SkaffariConfig::defDomainquota() { return getDbOption<quota_size_t>(QStringLiteral(SK_CONF_KEY_DEF_DOMAINQUOTA), static_cast<quota_size_t>(SK_DEF_DEF_DOMAINQUOTA)); }
+quota_size_t SkaffariConfig::defQuota() { return getDbOption<quota_size_t>(QStringLiteral(SK_CONF_KEY_DEF_QUOTA), static_cast<quota_size_t>(SK_DEF_DEF_QUOTA)); }
+quint32 SkaffariConfig::defMaxaccounts() { return getDbOption<quint32>(QStringLiteral(SK_CONF_KEY_DEF_MAXACCOUNTS), static_cast<quint32>(SK_DEF_DEF_MAXACCOUNTS)); }
+QString SkaffariConfig::defLanguage() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_LANGUAGE), QStringLiteral(SK_DEF_DEF_LANGUAGE)); }
+QString SkaffariConfig::defTimezone() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_TIMEZONE), QStringLiteral(SK_DEF_DEF_TIMEZONE)); }
+quint8 SkaffariConfig::defMaxdisplay() { return static_cast<quint8>(getDbOption<quint32>(QStringLiteral(SK_CONF_KEY_DEF_MAXDISPLAY), static_cast<quint32>(SK_DEF_DEF_MAXDISPLAY))); }
+quint8 SkaffariConfig::defWarnlevel() { return static_cast<quint8>(getDbOption<quint32>(QStringLiteral(SK_CONF_KEY_DEF_WARNLEVEL), static_cast<quint32>(SK_DEF_DEF_WARNLEVEL))); }
+
+SimpleAccount SkaffariConfig::defAbuseAccount() { return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_ABUSE_ACC)); }
+SimpleAccount SkaffariConfig::defNocAccount() { return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_NOC_ACC)); }
+SimpleAccount SkaffariConfig::defSecurityAccount() { return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_SECURITY_ACC)); }
+SimpleAccount SkaffariConfig::defPostmasterAccount() { return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_POSTMASTER_ACC)); }
+SimpleAccount SkaffariConfig::defHostmasterAccount() { return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_HOSTMASTER_ACC)); }
+SimpleAccount SkaffariConfig::defWebmasterAccount() { return getDefaultAccount(QStringLiteral(SK_CONF_KEY_DEF_WEBMASTER_ACC)); }
+
+QString SkaffariConfig::defFolderSent() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_SENT), QString()); }
+QString SkaffariConfig::defFolderDrafts() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_DRAFTS), QString()); }
+QString SkaffariConfig::defFolderTrash() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_TRASH), QString()); }
+QString SkaffariConfig::defFolderJunk() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_JUNK), QString()); }
+QString SkaffariConfig::defFolderArchive() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_ARCHIVE), QString()); }
+QString SkaffariConfig::defFolderOthers() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_DEF_FOLDER_OTHERS), QString()); }
+
+QString SkaffariConfig::imapHost() { return cfg()->imapHost; }
+quint16 SkaffariConfig::imapPort() { return cfg()->imapPort; }
+QString SkaffariConfig::imapUser() { return cfg()->imapUser; }
+QString SkaffariConfig::imapPassword() { return cfg()->imapPassword; }
+QString SkaffariConfig::imapPeername() { return cfg()->imapPeername; }
+QAbstractSocket::NetworkLayerProtocol SkaffariConfig::imapProtocol() { return cfg()->imapProtocol; }
+SkaffariIMAP::EncryptionType SkaffariConfig::imapEncryption() { return cfg()->imapEncryption; }
+Account::CreateMailbox SkaffariConfig::imapCreatemailbox() { return cfg()->imapCreatemailbox; }
+bool SkaffariConfig::imapUnixhierarchysep() { return cfg()->imapUnixhierarchysep; }
+bool SkaffariConfig::imapDomainasprefix() { return cfg()->imapDomainasprefix;}
+bool SkaffariConfig::imapFqun()
 {
-    T retVal = defVal;
+    const std::shared_ptr<const ConfigValues> values = cfg();
+    return values->imapUnixhierarchysep && values->imapDomainasprefix && values->imapFqun;
+}
+SkaffariIMAP::AuthMech SkaffariConfig::imapAuthmech() { return cfg()->imapAuthMech; }
+quint32 SkaffariConfig::imapPoolmaxidle() { return cfg()->imapPoolmaxidle; }
+quint64 SkaffariConfig::generation() { return cfg()->generation; }
 
-    if (cfg->useMemcached) {
-        Cutelyst::Memcached::MemcachedReturnType rt;
-        retVal = Cutelyst::Memcached::getByKey<T>(QStringLiteral(MEMC_CONFIG_GROUP_KEY), option, nullptr, &rt);
-        if (rt == Cutelyst::Memcached::Success) {
-            return retVal;
-        }
-    }
+bool SkaffariConfig::autoconfigEnabled() { return getDbOption<bool>(QStringLiteral(SK_CONF_KEY_AUTOCONF_ENABLED), false); }
+QString SkaffariConfig::autoconfigId() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_AUTOCONF_ID), QString()); }
+QString SkaffariConfig::autoconfigDisplayName() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_AUTOCONF_DISPLAY), QString()); }
+QString SkaffariConfig::autoconfigDisplayNameShort() { return getDbOption<QString>(QStringLiteral(SK_CONF_KEY_AUTOCONF_DISPLAY_SHORT), QString()); }
 
-    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT option_value FROM options WHERE option_name = :option_name"));
-    q.bindValue(QStringLiteral(":option_name"), option);
+bool SkaffariConfig::tmplAsyncAccountList() { return cfg()->tmplAsyncAccountList; }
 
-    if (Q_LIKELY(q.exec())) {
-        if (q.next()) {
-            retVal = q.value(0).value<T>();
-        } else {
-            return defVal;
-        }
-    } else {
-        qCCritical(SK_CONFIG, "Failed to query option %s from database, using default: %s", qUtf8Printable(option), qUtf8Printable(q.lastError().text()));
-    }
+template< typename T >
+T SkaffariConfig::getDbOption(const QString &option, const T &defVal)
+{
+    const std::shared_ptr<const DbOptionsValues> values = dbOptions();
 
-    if (cfg->useMemcached) {
-        Cutelyst::Memcached::setByKey<T>(QStringLiteral(MEMC_CONFIG_GROUP_KEY), option, retVal, MEMC_CONFIG_STORAGE_DURATION);
+    const QVariantHash::const_iterator it = values->options.constFind(option);
+    if (it == values->options.constEnd()) {
+        return defVal;
     }
 
-    return retVal;
+    return it.value().value<T>();
 }
 
 template< typename T >
@@ -376,43 +688,14 @@ bool SkaffariConfig::setDbOption(const QString &option, const T &value)
 
     rv = true;
 
-    if (cfg->useMemcached) {
-        Cutelyst::Memcached::setByKey<T>(QStringLiteral(MEMC_CONFIG_GROUP_KEY), option, value, MEMC_CONFIG_STORAGE_DURATION);
-    }
+    increaseDbOptionsVersion();
 
     return rv;
 }
 
 SimpleAccount SkaffariConfig::getDefaultAccount(const QString &optionName)
 {
-    SimpleAccount acc;
-
-    if (cfg->useMemcached) {
-        Cutelyst::Memcached::MemcachedReturnType rt;
-        acc = Cutelyst::Memcached::getByKey<SimpleAccount>(QStringLiteral(MEMC_CONFIG_GROUP_KEY), optionName, nullptr, &rt);
-        if (rt == Cutelyst::Memcached::Success) {
-            return acc;
-        }
-    }
-
-    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT a.id, a.username, d.domain_name FROM accountuser a LEFT JOIN options op ON op.option_value = a.id LEFT JOIN domain d ON a.domain_id = d.id WHERE op.option_name = :option_name"));
-    q.bindValue(QStringLiteral(":option_name"), optionName);
-
-    if (Q_LIKELY(q.exec())) {
-        if (q.next()) {
-            acc = SimpleAccount(q.value(0).value<dbid_t>(), q.value(1).toString(), q.value(2).toString());
-        } else {
-            return acc;
-        }
-    } else {
-        qCCritical(SK_CONFIG, "Failed to query database for %s: %s", qUtf8Printable(optionName), qUtf8Printable(q.lastError().text()));
-    }
-
-    if (cfg->useMemcached) {
-        Cutelyst::Memcached::setByKey<SimpleAccount>(QStringLiteral(MEMC_CONFIG_GROUP_KEY), optionName, acc, MEMC_CONFIG_STORAGE_DURATION);
-    }
-
-    return acc;
+    return dbOptions()->accounts.value(optionName);
 }
 
 bool SkaffariConfig::setDefaultAccount(const QString &option, dbid_t accountId)
@@ -439,27 +722,30 @@ bool SkaffariConfig::setDefaultAccount(const QString &option, dbid_t accountId)
         }
     }
 
-    if (cfg->useMemcached) {
-        if (accountId > 0) {
-            SimpleAccount a;
-            QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT a.id, a.username, d.domain_name FROM accountuser a LEFT JOIN domain d ON a.domain_id = d.id WHERE a.id = :id"));
-            q.bindValue(QStringLiteral(":id"), accountId);
+    rv = true;
 
-            if (Q_LIKELY(q.exec())) {
-                if (q.next()) {
-                    a = SimpleAccount(q.value(0).value<dbid_t>(), q.value(1).toString(), q.value(2).toString());
-                }
-            } else {
-                qCCritical(SK_SIMPLEACCOUNT, "Failed to query account with ID %u from database: %s", accountId, qUtf8Printable(q.lastError().text()));
-            }
+    increaseDbOptionsVersion();
 
-            if (a.isValid()) {
-                Cutelyst::Memcached::setByKey<SimpleAccount>(QStringLiteral(MEMC_CONFIG_GROUP_KEY), option, a, MEMC_CONFIG_STORAGE_DURATION);
-            }
-        } else {
-            Cutelyst::Memcached::removeByKey(QStringLiteral(MEMC_CONFIG_GROUP_KEY), option);
-        }
+    return rv;
+}
+
+void SkaffariConfig::removeOrphanedDefaultAccounts()
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("DELETE op FROM options op LEFT JOIN accountuser a ON a.id = op.option_value "
+                                                         "WHERE a.id IS NULL AND op.option_name IN (:abuse, :noc, :security, :postmaster, :hostmaster, :webmaster)"));
+    q.bindValue(QStringLiteral(":abuse"), QStringLiteral(SK_CONF_KEY_DEF_ABUSE_ACC));
+    q.bindValue(QStringLiteral(":noc"), QStringLiteral(SK_CONF_KEY_DEF_NOC_ACC));
+    q.bindValue(QStringLiteral(":security"), QStringLiteral(SK_CONF_KEY_DEF_SECURITY_ACC));
+    q.bindValue(QStringLiteral(":postmaster"), QStringLiteral(SK_CONF_KEY_DEF_POSTMASTER_ACC));
+    q.bindValue(QStringLiteral(":hostmaster"), QStringLiteral(SK_CONF_KEY_DEF_HOSTMASTER_ACC));
+    q.bindValue(QStringLiteral(":webmaster"), QStringLiteral(SK_CONF_KEY_DEF_WEBMASTER_ACC));
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCCritical(SK_CONFIG, "Failed to remove default accounts that do not exist anymore from database: %s", qUtf8Printable(q.lastError().text()));
+        return;
     }
 
-    return rv;
+    if (q.numRowsAffected() > 0) {
+        increaseDbOptionsVersion();
+    }
 }
@@ -26,6 +26,8 @@
 #include "../objects/simpleaccount.h"
 #include <QCryptographicHash>
 #include <QAbstractSocket>
+#include <QHostAddress>
+#include <QList>
 #include <QLoggingCategory>
 
 Q_DECLARE_LOGGING_CATEGORY(SK_CONFIG)
@@ -61,7 +63,9 @@ Q_DECLARE_LOGGING_CATEGORY(SK_CONFIG)
  * This class contains the settings from the Skaffari configuration file as well as the settings
  * from the current template and specific settings stored in the database.
  *
- * All configuration values are saved static to be accessible globally.
+ * All configuration values are saved static to be accessible globally. The values from the
+ * configuration file are held in an immutable snapshot that is replaced atomically when the
+ * configuration is reloaded, so reading them does not require a lock.
  */
 class SkaffariConfig
 {
@@ -77,6 +81,34 @@ public:
      */
     static void load(const QVariantMap &general, const QVariantMap &accounts, const QVariantMap &admins, const QVariantMap &imap, const QVariantMap &tmpl);
 
+    /*!
+     * \brief Reloads the \a Accounts, \a Admins and \a IMAP sections from the configuration file.
+     *
+     * The path of the configuration file can be set with the \c SKAFFARI_INI_FILE environment
+     * variable. Template, memcached and job worker settings require a restart. Returns \c false
+     * and keeps the current configuration if the file can not be read or is not valid.
+     */
+    static bool reload();
+
+    /*!
+     * \brief Reloads the configuration in this process and notifies all other processes via the database.
+     */
+    static bool reloadAll();
+
+    /*!
+     * \brief Requests a reload of the configuration on the next call of reloadIfRequested().
+     *
+     * This is async-signal-safe and used by the SIGHUP handler.
+     */
+    static void requestReload();
+
+    /*!
+     * \brief Reloads the configuration if it has been requested by requestReload() or by another process.
+     *
+     * Other processes are checked at most once per second.
+     */
+    static void reloadIfRequested();
+
     /*!
      * \brief Saves default value settings into the database options table.
      *
@@ -472,6 +504,26 @@ public:
      */
     static SkaffariIMAP::AuthMech imapAuthmech();
 
+    /*!
+     * \brief Maximum time in seconds an idle IMAP administrator connection is kept open for reuse.
+     *
+     * Idle connections are kept per worker thread by SkaffariIMAPPool, but never for longer than
+     * 60 seconds. Set it to \c 0 to disable the connection pool and to open a new connection for
+     * every request.
+     *
+     * \par Config file key
+     * IMAP/poolmaxidle
+     */
+    static quint32 imapPoolmaxidle();
+
+    /*!
+     * \brief Returns the generation of the configuration snapshot.
+     *
+     * The generation is increased every time the configuration file is reloaded. SkaffariIMAPPool
+     * uses it to discard connections that have been established with the previous IMAP settings.
+     */
+    static quint64 generation();
+
     /*!
      * \brief Returns the directory name of the template currently in use.
      */
@@ -519,6 +571,38 @@ public:
      */
     static bool useMemcachedSession();
 
+    /*!
+     * \brief Returns the number of threads per process that process background jobs.
+     *
+     * If this is \c 0, the process will not process any background jobs, see JobQueue.
+     *
+     * \par Config file key
+     * Skaffari/jobworkers
+     */
+    static quint8 jobWorkers();
+
+    /*!
+     * \brief Returns the number of address lookups per second a single client can do via autoconfig and autodiscover.
+     *
+     * Short bursts of up to 30 lookups are allowed. If this is \c 0, the rate limit is disabled,
+     * see AutoconfigGuard.
+     *
+     * \par Config file key
+     * Skaffari/autoconfigratelimit
+     */
+    static quint32 autoconfigRatelimit();
+
+    /*!
+     * \brief Returns the addresses of reverse proxies that are trusted to set the X-Forwarded-For header.
+     *
+     * For requests received from these addresses, the autoconfig and autodiscover rate limit uses the
+     * client address from the X-Forwarded-For header.
+     *
+     * \par Config file key
+     * Skaffari/trustedproxies
+     */
+    static QList<QHostAddress> trustedProxies();
+
     /*!
      * \brief Returns \c true if auto configuration support is enabled.
      *
@@ -551,6 +635,14 @@ public:
      */
     static QString autoconfigDisplayNameShort();
 
+    /*!
+     * \brief Removes default account options that point to accounts that do not exist anymore.
+     *
+     * Has to be called after accounts have been removed. The options read from the database are
+     * cached by every process until the options version in the database changes.
+     */
+    static void removeOrphanedDefaultAccounts();
+
 private:
     template< typename T >
     static T getDbOption(const QString &option, const T &defVal);
@@ -0,0 +1,222 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2019 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "statistics.h"
+#include "utils.h"
+#include <Cutelyst/Plugins/Utils/Sql>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDateTime>
+
+Q_LOGGING_CATEGORY(SK_STATISTICS, "skaffari.statistics")
+
+bool Statistics::addDomain(dbid_t domainId, quota_size_t domainQuota)
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("INSERT INTO statistics (domain_id, domains, domainquota, updated_at) VALUES (:domain_id, 1, :domainquota, :updated_at)"));
+    q.bindValue(QStringLiteral(":domain_id"), domainId);
+    q.bindValue(QStringLiteral(":domainquota"), domainQuota);
+    q.bindValue(QStringLiteral(":updated_at"), QDateTime::currentDateTimeUtc());
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to insert statistics of new domain with ID %u: %s", domainId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    q = CPreparedSqlQueryThread(QStringLiteral("UPDATE statistics SET domains = domains + 1, domainquota = domainquota + :domainquota, updated_at = :updated_at WHERE domain_id = 0"));
+    q.bindValue(QStringLiteral(":domainquota"), domainQuota);
+    q.bindValue(QStringLiteral(":updated_at"), QDateTime::currentDateTimeUtc());
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to add new domain with ID %u to the global statistics: %s", domainId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Statistics::removeDomain(dbid_t domainId)
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE statistics g JOIN statistics s ON s.domain_id = :domain_id "
+                                                         "SET g.domains = g.domains - s.domains, g.accounts = g.accounts - s.accounts, g.addresses = g.addresses - s.addresses, "
+                                                         "g.accountquota = g.accountquota - s.accountquota, g.domainquota = g.domainquota - s.domainquota, g.updated_at = :updated_at "
+                                                         "WHERE g.domain_id = 0"));
+    q.bindValue(QStringLiteral(":domain_id"), domainId);
+    q.bindValue(QStringLiteral(":updated_at"), QDateTime::currentDateTimeUtc());
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to subtract statistics of removed domain with ID %u: %s", domainId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    q = CPreparedSqlQueryThread(QStringLiteral("DELETE FROM statistics WHERE domain_id = :domain_id"));
+    q.bindValue(QStringLiteral(":domain_id"), domainId);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to delete statistics of removed domain with ID %u: %s", domainId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Statistics::changeDomainQuota(dbid_t domainId, qint64 delta)
+{
+    if (delta == 0) {
+        return true;
+    }
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE statistics SET domainquota = domainquota + :delta, updated_at = :updated_at WHERE domain_id IN (0, :domain_id)"));
+    q.bindValue(QStringLiteral(":delta"), delta);
+    q.bindValue(QStringLiteral(":updated_at"), QDateTime::currentDateTimeUtc());
+    q.bindValue(QStringLiteral(":domain_id"), domainId);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to update domain quota statistics of domain with ID %u: %s", domainId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Statistics::changeAccounts(dbid_t domainId, qint64 accounts, qint64 quota)
+{
+    if ((accounts == 0) && (quota == 0)) {
+        return true;
+    }
+
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE statistics SET accounts = accounts + :accounts, accountquota = accountquota + :quota, updated_at = :updated_at WHERE domain_id IN (0, :domain_id)"));
+    q.bindValue(QStringLiteral(":accounts"), accounts);
+    q.bindValue(QStringLiteral(":quota"), quota);
+    q.bindValue(QStringLiteral(":updated_at"), QDateTime::currentDateTimeUtc());
+    q.bindValue(QStringLiteral(":domain_id"), domainId);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to update account statistics of domain with ID %u: %s", domainId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Statistics::removeAccount(dbid_t accountId)
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE statistics s JOIN accountuser a ON a.id = :id AND s.domain_id IN (0, a.domain_id) "
+                                                         "SET s.accounts = s.accounts - 1, s.accountquota = s.accountquota - a.quota, s.addresses = s.addresses - a.addresscount, s.updated_at = :updated_at"));
+    q.bindValue(QStringLiteral(":id"), accountId);
+    q.bindValue(QStringLiteral(":updated_at"), QDateTime::currentDateTimeUtc());
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to subtract account with ID %u from the statistics: %s", accountId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Statistics::removeAccounts(QSqlDatabase &db, dbid_t domainId, const QStringList &usernames, QSqlError *error)
+{
+    if (usernames.empty()) {
+        return true;
+    }
+
+    // the number of placeholders depends on the list size, so this can not be a cached prepared query
+    QSqlQuery q(db);
+    if (Q_UNLIKELY(!q.prepare(QStringLiteral("UPDATE statistics s JOIN (SELECT COUNT(*) AS cnt, COALESCE(SUM(quota), 0) AS quota, COALESCE(SUM(addresscount), 0) AS addresses FROM accountuser WHERE username IN (%1)) r "
+                                             "SET s.accounts = s.accounts - r.cnt, s.accountquota = s.accountquota - r.quota, s.addresses = s.addresses - r.addresses, s.updated_at = ? "
+                                             "WHERE s.domain_id IN (0, ?)").arg(Utils::inPlaceholders(usernames.size()))))) {
+        if (error) {
+            *error = q.lastError();
+        }
+        qCWarning(SK_STATISTICS, "Failed to prepare query to subtract %i accounts of domain with ID %u from the statistics: %s", usernames.size(), domainId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    for (const QString &username : usernames) {
+        q.addBindValue(username);
+    }
+    q.addBindValue(QDateTime::currentDateTimeUtc());
+    q.addBindValue(domainId);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        if (error) {
+            *error = q.lastError();
+        }
+        qCWarning(SK_STATISTICS, "Failed to subtract %i accounts of domain with ID %u from the statistics: %s", usernames.size(), domainId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Statistics::updateAddresses(dbid_t accountId)
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("SELECT a.domain_id, a.addresscount, (SELECT COUNT(*) FROM virtual v WHERE v.username = a.username AND v.alias LIKE '%@%' AND v.idn_id = 0) FROM accountuser a WHERE a.id = :id"));
+    q.bindValue(QStringLiteral(":id"), accountId);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to count email addresses of account with ID %u: %s", accountId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    if (!q.next()) {
+        return true;
+    }
+
+    const dbid_t domainId = q.value(0).value<dbid_t>();
+    const qint64 oldCount = q.value(1).toLongLong();
+    const qint64 newCount = q.value(2).toLongLong();
+
+    if (oldCount == newCount) {
+        return true;
+    }
+
+    q = CPreparedSqlQueryThread(QStringLiteral("UPDATE accountuser SET addresscount = :addresscount WHERE id = :id"));
+    q.bindValue(QStringLiteral(":addresscount"), newCount);
+    q.bindValue(QStringLiteral(":id"), accountId);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to store number of email addresses of account with ID %u: %s", accountId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    q = CPreparedSqlQueryThread(QStringLiteral("UPDATE statistics SET addresses = addresses + :delta, updated_at = :updated_at WHERE domain_id IN (0, :domain_id)"));
+    q.bindValue(QStringLiteral(":delta"), newCount - oldCount);
+    q.bindValue(QStringLiteral(":updated_at"), QDateTime::currentDateTimeUtc());
+    q.bindValue(QStringLiteral(":domain_id"), domainId);
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to update address statistics of domain with ID %u: %s", domainId, qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Statistics::changeAdmins(qint64 delta)
+{
+    QSqlQuery q = CPreparedSqlQueryThread(QStringLiteral("UPDATE statistics SET admins = admins + :delta, updated_at = :updated_at WHERE domain_id = 0"));
+    q.bindValue(QStringLiteral(":delta"), delta);
+    q.bindValue(QStringLiteral(":updated_at"), QDateTime::currentDateTimeUtc());
+
+    if (Q_UNLIKELY(!q.exec())) {
+        qCWarning(SK_STATISTICS, "Failed to update administrator statistics: %s", qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    return true;
+}
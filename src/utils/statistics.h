@@ -0,0 +1,93 @@
+/*
+ * Skaffari - a mail account administration web interface based on Cutelyst
+ * Copyright (C) 2017-2019 Matthias Fehring <mf@huessenbergnetz.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include "../../common/global.h"
+#include <QStringList>
+#include <QSqlDatabase>
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(SK_STATISTICS)
+
+class QSqlError;
+
+/*!
+ * \ingroup skaffaricore
+ * \brief Maintains the counters shown on the dashboard.
+ *
+ * The statistics table contains one row per domain and a row with the domain ID \c 0 that
+ * contains the global counters. Instead of counting the accounts, addresses and assigned quotas
+ * on every dashboard request, the functions that change them adjust the domain row and the global
+ * row with a single statement. The number of email addresses of an account is stored in the
+ * \c addresscount column of the accountuser table to calculate the difference after changes.
+ *
+ * Failing updates are only logged and do not abort the operation that changed the data.
+ * <code>skaffaricmd --update-statistics</code> recounts all values to correct drift.
+ */
+class Statistics
+{
+public:
+    /*!
+     * \brief Adds the counters for the new domain with \a domainId and the assigned \a domainQuota.
+     */
+    static bool addDomain(dbid_t domainId, quota_size_t domainQuota);
+
+    /*!
+     * \brief Subtracts the remaining counters of the domain with \a domainId from the global counters and removes them.
+     */
+    static bool removeDomain(dbid_t domainId);
+
+    /*!
+     * \brief Changes the quota assigned to the domain with \a domainId by \a delta KiB.
+     */
+    static bool changeDomainQuota(dbid_t domainId, qint64 delta);
+
+    /*!
+     * \brief Changes the number of accounts in the domain with \a domainId by \a accounts and their assigned quota by \a quota KiB.
+     */
+    static bool changeAccounts(dbid_t domainId, qint64 accounts, qint64 quota);
+
+    /*!
+     * \brief Subtracts the account with \a accountId including its email addresses.
+     *
+     * Has to be called before the account is deleted from the database.
+     */
+    static bool removeAccount(dbid_t accountId);
+
+    /*!
+     * \brief Subtracts the accounts of domain \a domainId identified by \a usernames including their email addresses.
+     *
+     * Has to be called before the accounts are deleted. Uses the connection \a db to be part of the
+     * caller's transaction and sets \a error on failure.
+     */
+    static bool removeAccounts(QSqlDatabase &db, dbid_t domainId, const QStringList &usernames, QSqlError *error = nullptr);
+
+    /*!
+     * \brief Counts the email addresses of the account with \a accountId and applies the difference to the stored number.
+     */
+    static bool updateAddresses(dbid_t accountId);
+
+    /*!
+     * \brief Changes the number of administrators by \a delta.
+     */
+    static bool changeAdmins(qint64 delta);
+};
+
+#endif // STATISTICS_H
@@ -191,3 +191,16 @@ QDateTime Utils::dateTimeFromDateAndTime(Cutelyst::Context *c, const QVariantHas
 
     return dt;
 }
+
+QString Utils::inPlaceholders(int count)
+{
+    QString ret;
+    ret.reserve(count * 3);
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) {
+            ret.append(QLatin1String(", "));
+        }
+        ret.append(QLatin1Char('?'));
+    }
+    return ret;
+}
@@ -141,6 +141,13 @@ public:
      */
     static QDateTime dateTimeFromDateAndTime(Cutelyst::Context *c, const QVariantHash &params, const QString &dateTimeKey, const QString &dateKey, const QString &timeKey, const QDateTime &defaultDt);
 
+    /*!
+     * \brief Returns a comma separated list of \a count positional placeholders for an SQL IN clause.
+     *
+     * Queries using this can not be cached prepared queries, because the number of placeholders changes.
+     */
+    static QString inPlaceholders(int count);
+
 private:
     // prevent construction
     Utils();
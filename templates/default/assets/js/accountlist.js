@@ -240,6 +240,7 @@ Skaffari.DefaultTmpl.AccountList.load = function(loadMore) {
             aff.data('loading', '1');
             if (!loadMore) {
                 al.tbody.empty();
+                al.after.val('');
             } else {
                 al.currentPage.val(parseInt(al.currentPage.val()) + 1);
             }
@@ -282,7 +283,10 @@ Skaffari.DefaultTmpl.AccountList.load = function(loadMore) {
                     al.emptyListInfo.css('display', 'flex');
                 }
 
-                if (data.currentPage < data.lastPage) {
+                // continue after the last loaded account instead of skipping an offset
+                al.after.val(data.nextCursor);
+
+                if (data.nextCursor) {
                     if (loadMoreBtn.length > 0) {
                         loadMoreBtn.show();
                     } else {
@@ -346,6 +350,7 @@ Skaffari.DefaultTmpl.AccountList.init = function() {
         al.loadingActive = $('#loadingActive');
         al.currentPage = $('#currentPage');
         al.accountsPerPage = $('#accountsPerPage');
+        al.after = $('#after');
         al.checkAccountModal = $('#checkAccountModal');
         al.removeAccountModal = $('#removeAccountModal');
         al.accountRowTemplate = document.getElementById('account-template');
@@ -24,75 +24,157 @@ Skaffari.DefaultTmpl.checkDomain = Skaffari.DefaultTmpl.checkDomain || {};
 
 Skaffari.DefaultTmpl.checkDomain.button = $('#checkdomain');
 
+Skaffari.DefaultTmpl.checkDomain.cancelButton = $('#cancelcheck');
+
 Skaffari.DefaultTmpl.checkDomain.running = false;
 
+Skaffari.DefaultTmpl.checkDomain.jobId = 0;
+
+Skaffari.DefaultTmpl.checkDomain.pollInterval = 1000;
+
 Skaffari.DefaultTmpl.checkDomain.run = function() {
     var domainId = Skaffari.DefaultTmpl.checkDomain.button.data('domainid');
-    var accountIds = Skaffari.DefaultTmpl.checkDomain.button.data('accountids');
-    if (typeof accountIds === 'string') {
-        accountIds = Skaffari.DefaultTmpl.checkDomain.button.data('accountids').split(',');
+
+    if (!Skaffari.DefaultTmpl.checkDomain.running) {
+        Skaffari.DefaultTmpl.checkDomain.setRunning(true);
+        $('#checkdomaininfo').empty();
+
+        // the check is processed as background job on the server, we only poll its state
+        $.ajax({
+            method: 'post',
+            url: '/domain/' + domainId + '/check',
+            data: $('#checkDomainForm').serialize(),
+            dataType: 'json'
+        }).done(function(data) {
+            Skaffari.DefaultTmpl.checkDomain.watch(data.job);
+        }).fail(function(jqXHR) {
+            Skaffari.DefaultTmpl.checkDomain.showError(jqXHR);
+            Skaffari.DefaultTmpl.checkDomain.setRunning(false);
+        });
+    }
+}
+
+Skaffari.DefaultTmpl.checkDomain.setRunning = function(running) {
+    Skaffari.DefaultTmpl.checkDomain.running = running;
+    Skaffari.DefaultTmpl.checkDomain.button.prop('disabled', running);
+    $('input[name="checkChildAddresses"]').prop('disabled', running);
+    Skaffari.DefaultTmpl.checkDomain.cancelButton.prop('disabled', false);
+    Skaffari.DefaultTmpl.checkDomain.cancelButton.toggleClass('d-none', !running);
+}
+
+Skaffari.DefaultTmpl.checkDomain.showError = function(jqXHR) {
+    if (jqXHR.responseJSON && jqXHR.responseJSON.error_msg) {
+        $('#checkdomaininfo').append('<div class="alert alert-danger mt-3" role="alert">' + jqXHR.responseJSON.error_msg + '</div>');
+    }
+}
+
+Skaffari.DefaultTmpl.checkDomain.updateProgress = function(job) {
+    var cdp = $('#checkdomainprogress');
+    var total = job.total > 0 ? job.total : parseInt(cdp.attr('aria-valuemax'), 10);
+    var percentFinished = total > 0 ? (job.progress / total) * 100 : 0;
+    cdp.attr('aria-valuenow', job.progress);
+    cdp.attr('aria-valuemax', total);
+    cdp.css('width', percentFinished + '%');
+    cdp.text(job.progress + '/' + total);
+}
+
+Skaffari.DefaultTmpl.checkDomain.watch = function(job) {
+    Skaffari.DefaultTmpl.checkDomain.jobId = job.id;
+    Skaffari.DefaultTmpl.checkDomain.updateProgress(job);
+
+    if (job.active) {
+        window.setTimeout(function() {
+            $.ajax({
+                method: 'get',
+                url: '/job/' + job.id,
+                dataType: 'json'
+            }).done(function(data) {
+                Skaffari.DefaultTmpl.checkDomain.watch(data.job);
+            }).fail(function(jqXHR) {
+                Skaffari.DefaultTmpl.checkDomain.showError(jqXHR);
+                Skaffari.DefaultTmpl.checkDomain.setRunning(false);
+            });
+        }, Skaffari.DefaultTmpl.checkDomain.pollInterval);
     } else {
-        accountIds = [accountIds];
+        Skaffari.DefaultTmpl.checkDomain.showResult(job.result);
+        Skaffari.DefaultTmpl.checkDomain.jobId = 0;
+        Skaffari.DefaultTmpl.checkDomain.setRunning(false);
     }
-    var idCount = accountIds.length;
+}
+
+Skaffari.DefaultTmpl.checkDomain.showResult = function(result) {
     var infoBlock = $('#checkdomaininfo');
-    var checkChildAddressesSwitch = $('input[name="checkChildAddresses"]');
-    var cdp = $('#checkdomainprogress');
     var ntdStr = $.i18n('sk-def-tmpl-checkdomain-nothingtodo');
+    result = result || {};
 
-    if ((idCount > 0) && !Skaffari.DefaultTmpl.checkDomain.running) {
-        Skaffari.DefaultTmpl.checkDomain.running = true;
-        Skaffari.DefaultTmpl.checkDomain.button.prop('disabled', true);
-        checkChildAddressesSwitch.prop('disabled', true);
-        infoBlock.empty();
-
-        var _qjax = new $.qjax({
-            timeout: 10000,
-            ajaxSettings: {
-                dataType: "json",
-                data: $('#checkDomainForm').serialize()
-            },
-            onQueueChange: function(length) {
-                var finishedCount = idCount - length;
-                var percentFinished = (finishedCount / idCount) * 100;
-                cdp.attr('aria-valuenow', finishedCount);
-                cdp.css('width', percentFinished + '%');
-                cdp.text(finishedCount + '/' + idCount);
-                if (length === 0) {
-                    Skaffari.DefaultTmpl.checkDomain.button.prop('disabled', false);
-                    checkChildAddressesSwitch.prop('disabled', false);
-                    Skaffari.DefaultTmpl.checkDomain.running = false;
-                }
-            }
-        });
+    if (result.error_msg) {
+        infoBlock.append('<div class="alert alert-danger mt-3" role="alert">' + result.error_msg + '</div>');
+    }
 
-        for (i = 0; i < idCount; ++i) {
-            var ret = _qjax.Queue({
-                url: '/account/' + domainId +'/' + accountIds[i] + '/check',
-            });
-            ret.done(function(e) {
-                var info = '<div class="mt-3"><h3>' + e.username + '</h3>';
-                var actions = e.actions;
-                if (actions) {
-                    var al = actions.length;
-                    info += '<ul>';
-                    for (i = 0; i < al; ++i) {
-                        info += '<li>' + actions[i] + '</li>';
-                    }
-                    info += '</ul>';
-                } else {
-                    info += '<p>' + ntdStr + '</p>';
+    var actions = result.actions;
+    if (actions) {
+        var info = '<div class="mt-3"><ul>';
+        var al = actions.length;
+        for (var i = 0; i < al; ++i) {
+            info += '<li>' + actions[i] + '</li>';
+        }
+        info += '</ul></div>';
+        infoBlock.append(info);
+    }
+
+    // only accounts with actions or errors are part of the result
+    var accounts = result.accounts;
+    if (accounts) {
+        var accCount = accounts.length;
+        for (var j = 0; j < accCount; ++j) {
+            var acc = accounts[j];
+            var accInfo = '<div class="mt-3"><h3>' + acc.username + '</h3>';
+            if (acc.actions) {
+                var accActCount = acc.actions.length;
+                accInfo += '<ul>';
+                for (var k = 0; k < accActCount; ++k) {
+                    accInfo += '<li>' + acc.actions[k] + '</li>';
                 }
-                info += '</div>';
-                infoBlock.append(info);
-            });
+                accInfo += '</ul>';
+            }
+            if (acc.error_msg) {
+                accInfo += '<div class="alert alert-danger" role="alert">' + acc.error_msg + '</div>';
+            }
+            accInfo += '</div>';
+            infoBlock.append(accInfo);
         }
+        if (accCount === 0 && !actions && !result.error_msg) {
+            infoBlock.append('<div class="mt-3"><p>' + ntdStr + '</p></div>');
+        }
+    }
+}
+
+Skaffari.DefaultTmpl.checkDomain.cancel = function() {
+    var jobId = Skaffari.DefaultTmpl.checkDomain.jobId;
+    if (jobId > 0) {
+        Skaffari.DefaultTmpl.checkDomain.cancelButton.prop('disabled', true);
+        $.ajax({
+            method: 'post',
+            url: '/job/' + jobId + '/cancel',
+            dataType: 'json'
+        }).fail(function(jqXHR) {
+            Skaffari.DefaultTmpl.checkDomain.showError(jqXHR);
+            Skaffari.DefaultTmpl.checkDomain.cancelButton.prop('disabled', false);
+        });
     }
 }
 
 Skaffari.DefaultTmpl.checkDomain.init = function() {
     if (Skaffari.DefaultTmpl.checkDomain.button.length > 0) {
         Skaffari.DefaultTmpl.checkDomain.button.click(Skaffari.DefaultTmpl.checkDomain.run);
+        Skaffari.DefaultTmpl.checkDomain.cancelButton.click(Skaffari.DefaultTmpl.checkDomain.cancel);
+
+        // continue to watch a check that is still running
+        var jobId = Skaffari.DefaultTmpl.checkDomain.button.data('jobid');
+        if (jobId) {
+            Skaffari.DefaultTmpl.checkDomain.setRunning(true);
+            Skaffari.DefaultTmpl.checkDomain.watch({id: jobId, active: true, progress: 0, total: 0});
+        }
     }
 }
 
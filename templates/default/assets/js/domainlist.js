@@ -45,10 +45,7 @@ Skaffari.DefaultTmpl.DomainList.removeDomain = function() {
         removeDomainSubmit.prop('disabled', false);
     }).done(function(data) {
         Skaffari.DefaultTmpl.DomainList.removeDomainModal.modal('hide');
-        var row = $('#domain-' + data.deleted_id);
-        row.hide(300, function() {
-            row.remove();
-        })
+        Skaffari.DefaultTmpl.DomainList.watchRemoval(data.job);
     }).fail(function(jqXHR) {
         if (jqXHR.responseJSON.error_msg) {
             Skaffari.DefaultTmpl.createAlert('warning', jqXHR.responseJSON.error_msg, '#remove-domain-message-container', 'mt-1');
@@ -56,6 +53,57 @@ Skaffari.DefaultTmpl.DomainList.removeDomain = function() {
     });
 }
 
+Skaffari.DefaultTmpl.DomainList.pollInterval = 1000;
+
+Skaffari.DefaultTmpl.DomainList.setRemovalPending = function(row, pending) {
+    row.toggleClass('text-muted', pending);
+    row.find('.remove-domain-btn').toggleClass('d-none', pending);
+    row.find('.remove-domain-pending').remove();
+    if (pending) {
+        row.find('td').eq(1).append(' <span class="badge badge-warning remove-domain-pending"><i class="fas fa-circle-notch fa-spin"></i> ' + $.i18n('sk-def-tmpl-domainlist-removalpending') + '</span>');
+    }
+}
+
+Skaffari.DefaultTmpl.DomainList.showRemovalError = function(row, msg) {
+    Skaffari.DefaultTmpl.DomainList.setRemovalPending(row, false);
+    if (msg) {
+        row.find('td').eq(1).append(' <span class="badge badge-danger remove-domain-pending">' + msg + '</span>');
+    }
+}
+
+// the domain is removed by a background job on the server, the row stays until the job has been finished
+Skaffari.DefaultTmpl.DomainList.watchRemoval = function(job) {
+    var row = $('#domain-' + job.objectId);
+    if (row.length === 0) {
+        return;
+    }
+
+    if (job.active) {
+        Skaffari.DefaultTmpl.DomainList.setRemovalPending(row, true);
+        window.setTimeout(function() {
+            $.ajax({
+                method: 'get',
+                url: '/job/' + job.id,
+                dataType: 'json'
+            }).done(function(data) {
+                Skaffari.DefaultTmpl.DomainList.watchRemoval(data.job);
+            }).fail(function(jqXHR) {
+                Skaffari.DefaultTmpl.DomainList.showRemovalError(row, (jqXHR.responseJSON && jqXHR.responseJSON.error_msg) ? jqXHR.responseJSON.error_msg : '');
+            });
+        }, Skaffari.DefaultTmpl.DomainList.pollInterval);
+    } else if (job.status === 2) {
+        // finished
+        row.hide(300, function() {
+            row.remove();
+        });
+    } else if (job.status === 4) {
+        // canceled
+        Skaffari.DefaultTmpl.DomainList.showRemovalError(row, $.i18n('sk-def-tmpl-domainlist-removalcanceled'));
+    } else {
+        Skaffari.DefaultTmpl.DomainList.showRemovalError(row, (job.result && job.result.error_msg) ? job.result.error_msg : $.i18n('sk-def-tmpl-domainlist-removalfailed'));
+    }
+}
+
 Skaffari.DefaultTmpl.DomainList.init = function() {
     if (Skaffari.DefaultTmpl.DomainList.domainTable.length > 0) {
         var stupidDomainTable = Skaffari.DefaultTmpl.DomainList.domainTable.stupidtable();
@@ -102,6 +150,15 @@ Skaffari.DefaultTmpl.DomainList.init = function() {
             $('#domainTableFilter').val(window.atob(filterTerm)).keyup();
         }
 
+        // continue to watch domains that are still removed in the background
+        var removeJobs = Skaffari.DefaultTmpl.DomainList.domainTable.data('removejobs');
+        if (removeJobs) {
+            var rjl = removeJobs.length;
+            for (var i = 0; i < rjl; ++i) {
+                Skaffari.DefaultTmpl.DomainList.watchRemoval(removeJobs[i]);
+            }
+        }
+
         Skaffari.DefaultTmpl.DomainList.removeDomainModal = $('#removeDomainModal');
 
         if (Skaffari.DefaultTmpl.DomainList.removeDomainModal.length > 0) {
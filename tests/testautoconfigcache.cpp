@@ -0,0 +1,53 @@
+#include "../src/utils/autoconfigcache.h"
+
+#include <QTest>
+#include <QXmlStreamWriter>
+
+class AutoconfigCacheTest : public QObject
+{
+    Q_OBJECT
+public:
+    AutoconfigCacheTest(QObject *parent = nullptr) : QObject(parent) {}
+
+private Q_SLOTS:
+    void initTestCase() {}
+
+    void testSplit();
+    void testRender();
+    void testEscapedText();
+
+    void cleanupTestCase() {}
+};
+
+void AutoconfigCacheTest::testSplit()
+{
+    QCOMPARE(AutoconfigCache::split(QByteArrayLiteral("<a/>")), QList<QByteArray>({QByteArrayLiteral("<a/>")}));
+    QCOMPARE(AutoconfigCache::split(QByteArrayLiteral("<a>&sk_username;</a><b>&sk_username;</b>")),
+             QList<QByteArray>({QByteArrayLiteral("<a>"), QByteArrayLiteral("</a><b>"), QByteArrayLiteral("</b>")}));
+}
+
+void AutoconfigCacheTest::testRender()
+{
+    const QList<QByteArray> segments({QByteArrayLiteral("<a>"), QByteArrayLiteral("</a><b>"), QByteArrayLiteral("</b>")});
+    QCOMPARE(AutoconfigCache::render(segments, QStringLiteral("jdoe")), QByteArrayLiteral("<a>jdoe</a><b>jdoe</b>"));
+    QCOMPARE(AutoconfigCache::render(segments, QStringLiteral("j<d>&oe")), QByteArrayLiteral("<a>j&lt;d&gt;&amp;oe</a><b>j&lt;d&gt;&amp;oe</b>"));
+    QCOMPARE(AutoconfigCache::render(QList<QByteArray>({QByteArrayLiteral("<a/>")}), QStringLiteral("jdoe")), QByteArrayLiteral("<a/>"));
+}
+
+void AutoconfigCacheTest::testEscapedText()
+{
+    QByteArray out;
+    QXmlStreamWriter xml(&out);
+    xml.writeStartElement(QStringLiteral("a"));
+    xml.writeTextElement(QStringLiteral("b"), QStringLiteral("&sk_username;"));
+    xml.writeStartElement(QStringLiteral("c"));
+    AutoconfigCache::writeUsernamePlaceholder(&xml);
+    xml.writeEndElement();
+    xml.writeEndElement();
+
+    QCOMPARE(AutoconfigCache::render(AutoconfigCache::split(out), QStringLiteral("jdoe")), QByteArrayLiteral("<a><b>&amp;sk_username;</b><c>jdoe</c></a>"));
+}
+
+QTEST_MAIN(AutoconfigCacheTest)
+
+#include "testautoconfigcache.moc"
@@ -0,0 +1,93 @@
+#include "../src/utils/autoconfigguard.h"
+
+#include <QTest>
+
+class AutoconfigGuardTest : public QObject
+{
+    Q_OBJECT
+public:
+    AutoconfigGuardTest(QObject *parent = nullptr) : QObject(parent) {}
+
+private Q_SLOTS:
+    void initTestCase() {}
+
+    void testNegativeCache();
+    void testLimiter();
+    void testDisabledLimiter();
+    void testClientAddress_data();
+    void testClientAddress();
+
+    void cleanupTestCase() {}
+};
+
+void AutoconfigGuardTest::testNegativeCache()
+{
+    const QString email = QStringLiteral("unknown@example.com");
+    QVERIFY(!AutoconfigGuard::isKnownMissing(email));
+    AutoconfigGuard::addMissing(email);
+    QVERIFY(AutoconfigGuard::isKnownMissing(email));
+    QVERIFY(!AutoconfigGuard::isKnownMissing(QStringLiteral("other@example.com")));
+    AutoconfigGuard::removeMissing(email);
+    QVERIFY(!AutoconfigGuard::isKnownMissing(email));
+}
+
+void AutoconfigGuardTest::testLimiter()
+{
+    const QString client = QStringLiteral("192.0.2.1");
+    int retryAfter = -1;
+    int passed = 0;
+    while (AutoconfigGuard::acquire(client, 5, &retryAfter)) {
+        QCOMPARE(retryAfter, 0);
+        ++passed;
+        QVERIFY(passed < 1000);
+    }
+
+    QVERIFY(passed >= 30);
+    QCOMPARE(retryAfter, 1);
+    QVERIFY(!AutoconfigGuard::acquire(client, 5, &retryAfter));
+
+    QTest::qWait(1100);
+    QVERIFY(AutoconfigGuard::acquire(client, 5, &retryAfter));
+}
+
+void AutoconfigGuardTest::testDisabledLimiter()
+{
+    const QString client = QStringLiteral("192.0.2.2");
+    int retryAfter = -1;
+    for (int i = 0; i < 1000; ++i) {
+        QVERIFY(AutoconfigGuard::acquire(client, 0, &retryAfter));
+        QCOMPARE(retryAfter, 0);
+    }
+}
+
+void AutoconfigGuardTest::testClientAddress_data()
+{
+    QTest::addColumn<QString>("peer");
+    QTest::addColumn<QString>("forwardedFor");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("direct") << QStringLiteral("192.0.2.1") << QString() << QStringLiteral("192.0.2.1");
+    QTest::newRow("untrusted-peer") << QStringLiteral("192.0.2.1") << QStringLiteral("198.51.100.7") << QStringLiteral("192.0.2.1");
+    QTest::newRow("trusted-no-header") << QStringLiteral("127.0.0.1") << QString() << QStringLiteral("127.0.0.1");
+    QTest::newRow("trusted") << QStringLiteral("127.0.0.1") << QStringLiteral("198.51.100.7") << QStringLiteral("198.51.100.7");
+    QTest::newRow("trusted-mapped") << QStringLiteral("::ffff:127.0.0.1") << QStringLiteral("198.51.100.7") << QStringLiteral("198.51.100.7");
+    QTest::newRow("spoofed") << QStringLiteral("127.0.0.1") << QStringLiteral("203.0.113.9, 198.51.100.7") << QStringLiteral("198.51.100.7");
+    QTest::newRow("chain") << QStringLiteral("127.0.0.1") << QStringLiteral("198.51.100.7, 10.0.0.2") << QStringLiteral("198.51.100.7");
+    QTest::newRow("ipv6") << QStringLiteral("127.0.0.1") << QStringLiteral("2001:db8::1") << QStringLiteral("2001:db8::1");
+    QTest::newRow("invalid") << QStringLiteral("127.0.0.1") << QStringLiteral("198.51.100.7, unknown") << QStringLiteral("127.0.0.1");
+}
+
+void AutoconfigGuardTest::testClientAddress()
+{
+    QFETCH(QString, peer);
+    QFETCH(QString, forwardedFor);
+    QFETCH(QString, expected);
+
+    const QList<QHostAddress> trustedProxies({QHostAddress(QStringLiteral("127.0.0.1")), QHostAddress(QStringLiteral("10.0.0.2"))});
+
+    QCOMPARE(AutoconfigGuard::clientAddress(QHostAddress(peer), forwardedFor, trustedProxies), expected);
+}
+
+QTEST_MAIN(AutoconfigGuardTest)
+
+#include "testautoconfigguard.moc"
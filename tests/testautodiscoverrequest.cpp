@@ -0,0 +1,127 @@
+#include "../src/utils/autodiscoverrequest.h"
+
+#include <QTest>
+#include <QBuffer>
+#include <QDomDocument>
+
+class AutodiscoverRequestTest : public QObject
+{
+    Q_OBJECT
+public:
+    AutodiscoverRequestTest(QObject *parent = nullptr) : QObject(parent) {}
+
+private Q_SLOTS:
+    void initTestCase() {}
+
+    void testParse();
+    void testParse_data();
+    void testTooLarge();
+    void benchmarkDom();
+    void benchmarkStreamReader();
+
+    void cleanupTestCase() {}
+
+private:
+    QByteArray outlookRequest(int paddingElements = 0) const;
+};
+
+QByteArray AutodiscoverRequestTest::outlookRequest(int paddingElements) const
+{
+    QByteArray data = QByteArrayLiteral("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                                        "<Autodiscover xmlns=\"http://schemas.microsoft.com/exchange/autodiscover/outlook/requestschema/2006\">\n"
+                                        "  <Request>\n"
+                                        "    <EMailAddress>john.doe@example.com</EMailAddress>\n"
+                                        "    <AcceptableResponseSchema>http://schemas.microsoft.com/exchange/autodiscover/outlook/responseschema/2006a</AcceptableResponseSchema>\n");
+    for (int i = 0; i < paddingElements; ++i) {
+        data.append("    <Padding>" + QByteArray::number(i) + "</Padding>\n");
+    }
+    data.append("  </Request>\n"
+                "</Autodiscover>\n");
+    return data;
+}
+
+void AutodiscoverRequestTest::testParse()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, result);
+    QFETCH(QString, email);
+
+    QBuffer buffer(&data);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+
+    AutodiscoverRequest request;
+    QCOMPARE(static_cast<int>(request.parse(&buffer)), result);
+    QCOMPARE(request.emailAddress(), email);
+}
+
+void AutodiscoverRequestTest::testParse_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("result");
+    QTest::addColumn<QString>("email");
+
+    QTest::newRow("outlook") << outlookRequest() << static_cast<int>(AutodiscoverRequest::Ok) << QStringLiteral("john.doe@example.com");
+    QTest::newRow("prefixed") << QByteArrayLiteral("<a:Autodiscover xmlns:a=\"urn:test\"><a:Request><a:EMailAddress>jd@example.com</a:EMailAddress></a:Request></a:Autodiscover>")
+                              << static_cast<int>(AutodiscoverRequest::Ok) << QStringLiteral("jd@example.com");
+    QTest::newRow("stop-after-address") << QByteArrayLiteral("<Autodiscover><Request><EMailAddress>jd@example.com</EMailAddress><Broken></Request>")
+                                        << static_cast<int>(AutodiscoverRequest::Ok) << QStringLiteral("jd@example.com");
+    QTest::newRow("wrong-level") << QByteArrayLiteral("<Autodiscover><EMailAddress>jd@example.com</EMailAddress><Request/></Autodiscover>")
+                                 << static_cast<int>(AutodiscoverRequest::Ok) << QString();
+    QTest::newRow("first-request-only") << QByteArrayLiteral("<Autodiscover><Request/><Request><EMailAddress>jd@example.com</EMailAddress></Request></Autodiscover>")
+                                        << static_cast<int>(AutodiscoverRequest::Ok) << QString();
+    QTest::newRow("no-request") << QByteArrayLiteral("<Autodiscover/>") << static_cast<int>(AutodiscoverRequest::Ok) << QString();
+    QTest::newRow("empty") << QByteArray() << static_cast<int>(AutodiscoverRequest::InvalidXml) << QString();
+    QTest::newRow("truncated") << QByteArrayLiteral("<Autodiscover><Request><EMailAddress>jd@exa") << static_cast<int>(AutodiscoverRequest::InvalidXml) << QString();
+    QTest::newRow("malformed") << QByteArrayLiteral("<Autodiscover><Request></Autodiscover>") << static_cast<int>(AutodiscoverRequest::InvalidXml) << QString();
+}
+
+void AutodiscoverRequestTest::testTooLarge()
+{
+    QByteArray data = outlookRequest(1000);
+
+    QBuffer buffer(&data);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+
+    AutodiscoverRequest request(1024);
+    QCOMPARE(request.parse(&buffer), AutodiscoverRequest::TooLarge);
+    QCOMPARE(buffer.pos(), Q_INT64_C(0));
+}
+
+/*
+ * The former approach: parse the complete body into a DOM and search the address in it.
+ */
+void AutodiscoverRequestTest::benchmarkDom()
+{
+    QByteArray data = outlookRequest(100);
+    QString email;
+
+    QBENCHMARK {
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        QDomDocument xml;
+        xml.setContent(&buffer);
+        email = xml.documentElement().firstChildElement(QStringLiteral("Request")).firstChildElement(QStringLiteral("EMailAddress")).text();
+    }
+
+    QCOMPARE(email, QStringLiteral("john.doe@example.com"));
+}
+
+void AutodiscoverRequestTest::benchmarkStreamReader()
+{
+    QByteArray data = outlookRequest(100);
+    QString email;
+
+    QBENCHMARK {
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        AutodiscoverRequest request;
+        request.parse(&buffer);
+        email = request.emailAddress();
+    }
+
+    QCOMPARE(email, QStringLiteral("john.doe@example.com"));
+}
+
+QTEST_MAIN(AutodiscoverRequestTest)
+
+#include "testautodiscoverrequest.moc"
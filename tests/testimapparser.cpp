@@ -0,0 +1,315 @@
+#include "../src/imap/skaffariimapparser.h"
+
+#include <QTest>
+#include <QList>
+
+/*
+ * Responses written in the format of a Cyrus IMAP 2.5 server. They are not captured
+ * from a live server, but follow the server's output including the use of literals.
+ */
+static const QByteArray greeting = QByteArrayLiteral("* OK [CAPABILITY IMAP4rev1 LITERAL+ ID ENABLE STARTTLS AUTH=PLAIN AUTH=LOGIN SASL-IR] mail.example.net Cyrus IMAP 2.5.10 server ready\r\n");
+
+static const QByteArray loginResponse = QByteArrayLiteral("a000001 OK [CAPABILITY IMAP4rev1 LITERAL+ ID ENABLE ACL RIGHTS=kxten QUOTA MAILBOX-REFERRALS NAMESPACE UIDPLUS NO_ATOMIC_RENAME UNSELECT CHILDREN MULTIAPPEND BINARY CATENATE CONDSTORE ESEARCH SORT SORT=MODSEQ SORT=DISPLAY SORT=UID THREAD=ORDEREDSUBJECT THREAD=REFERENCES ANNOTATEMORE ANNOTATE-EXPERIMENT-1 METADATA LIST-EXTENDED LIST-STATUS LIST-MYRIGHTS WITHIN QRESYNC SCAN XLIST XMOVE MOVE SPECIAL-USE CREATE-SPECIAL-USE DIGEST=SHA1 X-REPLICATION URLAUTHFULL=INTERNAL IDLE] User logged in SESSIONID=<mail.example.net-1234-1517660000-1-123456789>\r\n");
+
+static const QByteArray listResponse = QByteArrayLiteral("* LIST (\\HasNoChildren) \"/\" user/jdoe/Drafts\r\n"
+                                                         "* LIST (\\HasNoChildren) \"/\" user/jdoe/Sent\r\n"
+                                                         "* LIST (\\HasNoChildren) \"/\" {23}\r\n"
+                                                         "user/jdoe/Trash\r\nA000\r\n"
+                                                         "\r\n"
+                                                         "* LIST (\\HasNoChildren) \"/\" \"user/jdoe/Old mails\"\r\n"
+                                                         "a000004 OK Completed (0.001 secs 5 calls)\r\n");
+
+static QByteArray quotaResponse(int accounts)
+{
+    QByteArray data;
+    for (int i = 0; i < accounts; ++i) {
+        const QByteArray user = QByteArrayLiteral("user/account") + QByteArray::number(i);
+        data.append(QByteArrayLiteral("* QUOTAROOT ") + user + QByteArrayLiteral(" ") + user + QByteArrayLiteral("\r\n"));
+        data.append(QByteArrayLiteral("* QUOTA ") + user + QByteArrayLiteral(" (STORAGE ") + QByteArray::number(i * 17) + QByteArrayLiteral(" 1048576)\r\n"));
+        data.append(QByteArrayLiteral("b") + QByteArray::number(i).rightJustified(6, '0') + QByteArrayLiteral(" OK Completed\r\n"));
+    }
+    return data;
+}
+
+/*
+ * A LIST transcript of a domain with the given number of accounts in the format Cyrus
+ * uses. Every fourth mailbox name contains a quote and is sent as literal, like Cyrus
+ * does for names it can not send as quoted string.
+ */
+static QByteArray listTranscript(int accounts)
+{
+    QByteArray data;
+    const QList<QByteArray> folders({QByteArrayLiteral("Drafts"), QByteArrayLiteral("Sent"), QByteArrayLiteral("Trash"), QByteArrayLiteral("Junk")});
+    for (int i = 0; i < accounts; ++i) {
+        const QByteArray user = QByteArrayLiteral("user/account") + QByteArray::number(i);
+        data.append(QByteArrayLiteral("* LIST (\\HasChildren) \"/\" ") + user + QByteArrayLiteral("\r\n"));
+        for (const QByteArray &folder : folders) {
+            data.append(QByteArrayLiteral("* LIST (\\HasNoChildren) \"/\" ") + user + '/' + folder + QByteArrayLiteral("\r\n"));
+        }
+        if ((i % 4) == 0) {
+            const QByteArray name = user + QByteArrayLiteral("/\"Old\" mails");
+            data.append(QByteArrayLiteral("* LIST (\\HasNoChildren) \"/\" {") + QByteArray::number(name.size()) + QByteArrayLiteral("}\r\n") + name + QByteArrayLiteral("\r\n"));
+        }
+    }
+    data.append(QByteArrayLiteral("a000005 OK Completed (0.120 secs 5251 calls)\r\n"));
+    return data;
+}
+
+class IMAPParserTest : public QObject
+{
+    Q_OBJECT
+public:
+    IMAPParserTest(QObject *parent = nullptr) : QObject(parent) {}
+
+private Q_SLOTS:
+    void initTestCase() {}
+
+    void greeting();
+    void taggedStatus();
+    void literal();
+    void literalPlus();
+    void splitSegments();
+    void continuation();
+    void noResponse();
+    void reset();
+    void next();
+
+    void benchmarkSplit();
+    void benchmarkParser();
+    void benchmarkPipelined();
+    void benchmarkListTranscript();
+
+    void cleanupTestCase() {}
+};
+
+void IMAPParserTest::greeting()
+{
+    SkaffariIMAPParser parser("*");
+    QCOMPARE(parser.feed(::greeting), SkaffariIMAPParser::Complete);
+    QCOMPARE(parser.count(), 0);
+    QVERIFY(parser.status().startsWith("OK [CAPABILITY IMAP4rev1"));
+    QVERIFY(!parser.hasTrailingData());
+}
+
+void IMAPParserTest::taggedStatus()
+{
+    SkaffariIMAPParser parser("a000001");
+    QCOMPARE(parser.feed(loginResponse), SkaffariIMAPParser::Complete);
+    QCOMPARE(parser.count(), 0);
+    QVERIFY(parser.statusLine().startsWith("a000001 OK [CAPABILITY"));
+    QVERIFY(parser.status().startsWith("OK [CAPABILITY"));
+    QVERIFY(parser.status().contains("QUOTA"));
+}
+
+void IMAPParserTest::literal()
+{
+    SkaffariIMAPParser parser("a000004");
+    QCOMPARE(parser.feed(listResponse), SkaffariIMAPParser::Complete);
+    QCOMPARE(parser.count(), 4);
+    for (int i = 0; i < parser.count(); ++i) {
+        QCOMPARE(parser.kind(i), SkaffariIMAPParser::Untagged);
+    }
+    QCOMPARE(parser.response(1), QByteArrayLiteral("* LIST (\\HasNoChildren) \"/\" user/jdoe/Sent"));
+    // the line breaks and the fake status line inside the literal are part of the response
+    QCOMPARE(parser.response(2), QByteArrayLiteral("* LIST (\\HasNoChildren) \"/\" {23}\r\nuser/jdoe/Trash\r\nA000\r\n"));
+    QCOMPARE(parser.response(3), QByteArrayLiteral("* LIST (\\HasNoChildren) \"/\" \"user/jdoe/Old mails\""));
+    QCOMPARE(parser.status(), QByteArrayLiteral("OK Completed (0.001 secs 5 calls)"));
+}
+
+void IMAPParserTest::literalPlus()
+{
+    SkaffariIMAPParser parser("a1");
+    const QByteArray data = QByteArrayLiteral("* METADATA user/jdoe (/private/comment {9+}\r\na1 OK xyz)\r\na1 OK Completed\r\n");
+    QCOMPARE(parser.feed(data), SkaffariIMAPParser::Complete);
+    QCOMPARE(parser.count(), 1);
+    QCOMPARE(parser.response(0), QByteArrayLiteral("* METADATA user/jdoe (/private/comment {9+}\r\na1 OK xyz)"));
+    QCOMPARE(parser.status(), QByteArrayLiteral("OK Completed"));
+}
+
+void IMAPParserTest::splitSegments()
+{
+    // feed the recorded response in every possible chunk size,
+    // including splits inside the CRLF and inside literals
+    for (int chunk = 1; chunk <= listResponse.size(); ++chunk) {
+        SkaffariIMAPParser parser("a000004");
+        int pos = 0;
+        while (pos < listResponse.size()) {
+            QCOMPARE(parser.state(), SkaffariIMAPParser::Incomplete);
+            parser.feed(listResponse.mid(pos, chunk));
+            pos += chunk;
+        }
+        QCOMPARE(parser.state(), SkaffariIMAPParser::Complete);
+        QCOMPARE(parser.count(), 4);
+        QCOMPARE(parser.response(2), QByteArrayLiteral("* LIST (\\HasNoChildren) \"/\" {23}\r\nuser/jdoe/Trash\r\nA000\r\n"));
+    }
+}
+
+void IMAPParserTest::continuation()
+{
+    SkaffariIMAPParser parser("a000001");
+    QCOMPARE(parser.feed(QByteArrayLiteral("+ PDE4OTYuNjk3MTcwOTUyQHBvc3RvZmZpY2UucmVzdG9uLm1jaS5uZXQ+\r\n")), SkaffariIMAPParser::Continuation);
+    QCOMPARE(parser.status(), QByteArrayLiteral("PDE4OTYuNjk3MTcwOTUyQHBvc3RvZmZpY2UucmVzdG9uLm1jaS5uZXQ+"));
+}
+
+void IMAPParserTest::noResponse()
+{
+    SkaffariIMAPParser parser("a000002");
+    QCOMPARE(parser.feed(QByteArrayLiteral("a000001 OK Completed\r\na000002 NO Mailbox does not exist\r\n")), SkaffariIMAPParser::Complete);
+    QCOMPARE(parser.count(), 1);
+    QCOMPARE(parser.kind(0), SkaffariIMAPParser::Tagged);
+    QCOMPARE(parser.status(), QByteArrayLiteral("NO Mailbox does not exist"));
+}
+
+void IMAPParserTest::reset()
+{
+    SkaffariIMAPParser parser("a000001");
+    QCOMPARE(parser.feed(QByteArrayLiteral("* CAPABILITY IMAP4rev1\r\na000001 OK done\r\n* BYE\r\n")), SkaffariIMAPParser::Complete);
+    QVERIFY(parser.hasTrailingData());
+    parser.reset("a000002");
+    QCOMPARE(parser.state(), SkaffariIMAPParser::Incomplete);
+    QCOMPARE(parser.count(), 0);
+    QCOMPARE(parser.tag(), QByteArrayLiteral("a000002"));
+    QVERIFY(parser.status().isEmpty());
+}
+
+void IMAPParserTest::next()
+{
+    SkaffariIMAPParser parser("a000001");
+    QCOMPARE(parser.feed(QByteArrayLiteral("* QUOTAROOT user.a user.a\r\na000001 OK done\r\n* QUOTAROOT user.b user.b\r\na000002 OK done\r\n* QUOTA")), SkaffariIMAPParser::Complete);
+    const SkaffariIMAPParser first = parser;
+
+    QCOMPARE(parser.next("a000002"), SkaffariIMAPParser::Complete);
+    QCOMPARE(parser.count(), 1);
+    QCOMPARE(parser.response(0), QByteArrayLiteral("* QUOTAROOT user.b user.b"));
+    QCOMPARE(parser.status(), QByteArrayLiteral("OK done"));
+
+    // the copy still refers to its own responses
+    QCOMPARE(first.count(), 1);
+    QCOMPARE(first.response(0), QByteArrayLiteral("* QUOTAROOT user.a user.a"));
+
+    QCOMPARE(parser.next("a000003"), SkaffariIMAPParser::Incomplete);
+    QCOMPARE(parser.feed(QByteArrayLiteral(" user.c (STORAGE 1 2)\r\na000003 NO failed\r\n")), SkaffariIMAPParser::Complete);
+    QCOMPARE(parser.count(), 1);
+    QCOMPARE(parser.response(0), QByteArrayLiteral("* QUOTA user.c (STORAGE 1 2)"));
+    QCOMPARE(parser.status(), QByteArrayLiteral("NO failed"));
+    QVERIFY(!parser.hasTrailingData());
+}
+
+/*
+ * The former approach: wait until the complete response is available,
+ * then split it into lines and search the status line.
+ */
+void IMAPParserTest::benchmarkSplit()
+{
+    const QByteArray data = quotaResponse(1000);
+    const QByteArray lastTag = QByteArrayLiteral("b000999");
+    const int chunkSize = 1448;
+    int found = 0;
+
+    QBENCHMARK {
+        QByteArray buffer;
+        QByteArray status;
+        int pos = 0;
+        while (status.isEmpty() && pos < data.size()) {
+            buffer.append(data.mid(pos, chunkSize));
+            pos += chunkSize;
+            const QList<QByteArray> lines = buffer.split('\n');
+            for (const QByteArray &line : lines) {
+                if (line.startsWith(lastTag)) {
+                    status = line;
+                }
+            }
+        }
+        found = 0;
+        const QList<QByteArray> lines = buffer.split('\n');
+        for (const QByteArray &line : lines) {
+            if (line.startsWith("* QUOTA ")) {
+                ++found;
+            }
+        }
+    }
+
+    QCOMPARE(found, 1000);
+}
+
+void IMAPParserTest::benchmarkParser()
+{
+    const QByteArray data = quotaResponse(1000);
+    const int chunkSize = 1448;
+    int found = 0;
+
+    QBENCHMARK {
+        SkaffariIMAPParser parser("b000999");
+        int pos = 0;
+        while (parser.state() == SkaffariIMAPParser::Incomplete && pos < data.size()) {
+            parser.feed(data.mid(pos, chunkSize));
+            pos += chunkSize;
+        }
+        found = 0;
+        for (int i = 0; i < parser.count(); ++i) {
+            if (parser.response(i).startsWith("* QUOTA ")) {
+                ++found;
+            }
+        }
+    }
+
+    QCOMPARE(found, 1000);
+}
+
+/*
+ * The responses of one GETQUOTAROOT command per account arriving in a single read,
+ * every response is parsed with its own tag from the same buffer.
+ */
+void IMAPParserTest::benchmarkPipelined()
+{
+    const QByteArray data = quotaResponse(1000);
+    int found = 0;
+
+    QBENCHMARK {
+        found = 0;
+        SkaffariIMAPParser parser("b000000");
+        parser.feed(data);
+        for (int i = 1; parser.state() == SkaffariIMAPParser::Complete; ++i) {
+            for (int j = 0; j < parser.count(); ++j) {
+                if (parser.response(j).startsWith("* QUOTA ")) {
+                    ++found;
+                }
+            }
+            parser.next(QByteArrayLiteral("b") + QByteArray::number(i).rightJustified(6, '0'));
+        }
+    }
+
+    QCOMPARE(found, 1000);
+}
+
+/*
+ * A large LIST transcript fed in TCP segment sized chunks,
+ * so that chunk borders also fall into literals.
+ */
+void IMAPParserTest::benchmarkListTranscript()
+{
+    const QByteArray data = listTranscript(1000);
+    const int chunkSize = 1448;
+    int literals = 0;
+
+    QBENCHMARK {
+        SkaffariIMAPParser parser("a000005");
+        int pos = 0;
+        while (parser.state() == SkaffariIMAPParser::Incomplete && pos < data.size()) {
+            parser.feed(data.mid(pos, chunkSize));
+            pos += chunkSize;
+        }
+        literals = 0;
+        for (int i = 0; i < parser.count(); ++i) {
+            if (parser.response(i).endsWith("mails")) {
+                ++literals;
+            }
+        }
+    }
+
+    QCOMPARE(literals, 250);
+}
+
+QTEST_MAIN(IMAPParserTest)
+
+#include "testimapparser.moc"
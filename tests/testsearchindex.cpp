@@ -0,0 +1,81 @@
+#include "../src/utils/searchindex.h"
+
+#include <QTest>
+
+class SearchIndexTest : public QObject
+{
+    Q_OBJECT
+public:
+    SearchIndexTest(QObject *parent = nullptr) : QObject(parent) {}
+
+private Q_SLOTS:
+    void initTestCase() {}
+
+    void testTrigrams();
+    void testTrigrams_data();
+    void testRoleFromString();
+    void testCondition();
+    void testLikePattern();
+
+    void cleanupTestCase() {}
+};
+
+void SearchIndexTest::testTrigrams()
+{
+    QFETCH(QString, input);
+    QFETCH(QStringList, result);
+
+    QCOMPARE(SearchIndex::trigrams(input), result);
+}
+
+void SearchIndexTest::testTrigrams_data()
+{
+    QTest::addColumn<QString>("input");
+    QTest::addColumn<QStringList>("result");
+
+    QTest::newRow("empty") << QString() << QStringList();
+    QTest::newRow("too-short") << QStringLiteral("ab") << QStringList();
+    QTest::newRow("exact") << QStringLiteral("abc") << QStringList({QStringLiteral("abc")});
+    QTest::newRow("lower-case") << QStringLiteral("JDoe") << QStringList({QStringLiteral("jdo"), QStringLiteral("doe")});
+    QTest::newRow("unique") << QStringLiteral("aaaa") << QStringList({QStringLiteral("aaa")});
+    QTest::newRow("address") << QStringLiteral("jd@ex.de") << QStringList({QStringLiteral("jd@"), QStringLiteral("d@e"), QStringLiteral("@ex"), QStringLiteral("ex."), QStringLiteral("x.d"), QStringLiteral(".de")});
+    QTest::newRow("diacritics") << QStringLiteral("Jürgen") << QStringList({QStringLiteral("jur"), QStringLiteral("urg"), QStringLiteral("rge"), QStringLiteral("gen")});
+    QTest::newRow("diacritics-decomposed") << QStringLiteral("Ju\u0308rgen") << QStringList({QStringLiteral("jur"), QStringLiteral("urg"), QStringLiteral("rge"), QStringLiteral("gen")});
+    QTest::newRow("diacritics-unique") << QStringLiteral("éèe") << QStringList({QStringLiteral("eee")});
+}
+
+void SearchIndexTest::testRoleFromString()
+{
+    QCOMPARE(SearchIndex::roleFromString(QStringLiteral("username")), SearchIndex::Username);
+    QCOMPARE(SearchIndex::roleFromString(QStringLiteral("email")), SearchIndex::Address);
+    QCOMPARE(SearchIndex::roleFromString(QStringLiteral("forward")), SearchIndex::Forward);
+    QCOMPARE(SearchIndex::roleFromString(QStringLiteral("unknown")), SearchIndex::Username);
+}
+
+void SearchIndexTest::testCondition()
+{
+    QVariantHash binds;
+    QVERIFY(SearchIndex::condition(SearchIndex::Address, QStringLiteral("ab"), &binds).isEmpty());
+    QVERIFY(binds.empty());
+
+    const QString cond = SearchIndex::condition(SearchIndex::Address, QStringLiteral("Doee"), &binds);
+    QVERIFY(cond.startsWith(QLatin1String(" AND au.id IN (SELECT ts.account_id FROM account_search ts")));
+    QVERIFY(cond.contains(QLatin1String(":sk_tg0, :sk_tg1")));
+    QVERIFY(!cond.contains(QLatin1String(":sk_tg2")));
+    QCOMPARE(binds.value(QStringLiteral(":sk_tg0")).toString(), QStringLiteral("doe"));
+    QCOMPARE(binds.value(QStringLiteral(":sk_tg1")).toString(), QStringLiteral("oee"));
+    QCOMPARE(binds.value(QStringLiteral(":sk_tg_count")).toInt(), 2);
+    QCOMPARE(binds.value(QStringLiteral(":sk_tg_role")).toInt(), static_cast<int>(SearchIndex::Address));
+}
+
+void SearchIndexTest::testLikePattern()
+{
+    QCOMPARE(SearchIndex::likePattern(QStringLiteral("doe")), QStringLiteral("%doe%"));
+    QCOMPARE(SearchIndex::likePattern(QStringLiteral("j_doe")), QStringLiteral("%j\\_doe%"));
+    QCOMPARE(SearchIndex::likePattern(QStringLiteral("100%")), QStringLiteral("%100\\%%"));
+    QCOMPARE(SearchIndex::likePattern(QStringLiteral("a\\b")), QStringLiteral("%a\\\\b%"));
+}
+
+QTEST_MAIN(SearchIndexTest)
+
+#include "testsearchindex.moc"